@@ -0,0 +1,34 @@
+/*****************************************************************************/
+/* PSG2TXT - Buffered text output                                            */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+#ifndef __textWriter_h
+#define __textWriter_h
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Constants
+#define TEXT_WRITER_BUFFER_SIZE (1024 * 1024)
+
+///////////////////////////////////////////////////////////////////////////////
+// Functions
+void textWriterOpen(FILE* in_file);
+void textWriterClose(void);
+
+void textWriterChar(char in_char);
+void textWriterString(const char* in_string);
+void textWriterHex(uint32_t in_value, int in_digits);
+void textWriterDecimal(int32_t in_value, int in_width, char in_padding);
+
+#endif
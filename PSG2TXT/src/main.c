@@ -8,8 +8,12 @@
 /* of the BSD license.  See the LICENSE file for details.                    */
 /*****************************************************************************/
 #include <stdio.h>
+#include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <fileMap.h>
+#include <filePSGDecoder.h>
+#include <textWriter.h>
 
 ///////////////////////////////////////////////////////////////////////////////
 // PSG File format description
@@ -28,6 +32,14 @@
 //% 0000 0001 - loop begin marker[value 0x01](optional, songs with no loop won't have this)
 //
 //	% 0000 0nnn - RESERVED for future expansions[values 0x02 - 0x07]
+//	* clock tag [value 0x06] (optional, only at the beginning of the file) - the following byte gives the clock
+//	frequency of the tone values (0 - 3.579545MHz, 1 - 3.125MHz TVC Game Card). Substring offsets include the tag.
+//	* macro [value 0x07] (optional, extended format) - at the beginning of the file (after the clock tag) it is the
+//	macro dictionary: followed by the number of macros and the macros (type/length byte %tlll llll: t=1 tone, t=0
+//	attenuation, l=1..127 frames, followed by l step bytes: attenuation values or signed tone offsets). In the music
+//	data it starts a macro: followed by %1cci iiii (channel c, macro index i), tone macros are followed by the base
+//	tone value (%0100 llll low bits, %01hh hhhh high bits). The macro writes one step into the register of the
+//	channel at the end of every frame (including the wait frames) from the frame of the command.
 //	* PLANNED: GameGear stereo - the following byte sets the stereo configuration
 //	* PLANNED : event callback - the following byte will be passed to the callback function
 //	* PLANNED : longer waits(8 - 255) - the following byte gives the additional frames
@@ -46,21 +58,6 @@
 
 ///////////////////////////////////////////////////////////////////////////////
 // Defines
-#define IS_LATCH_BYTE(x) (((x)&0x80)!= 0)
-#define IS_DATA_BYTE(x) (((x)&0xc0)==0x40)
-#define IS_ESCAPE_BYTE(x) (((x)&0xc0)==0x00)
-#define IS_END_OF_FRAME(x) (((x)&0xf8)==0x38)
-#define IS_END_OF_FILE(x) ((x)==0)
-#define IS_BEGIN_LOOP(x) ((x)==0x01)
-#define IS_COMPRESSION(x) ((x)>=8 && (x)<=8+MAX_COMPRESSION_LENGTH-MIN_COMPRESSON_LENGTH)
-
-#define MIN_COMPRESSON_LENGTH 4
-#define MAX_COMPRESSION_LENGTH 51 // 47+4
-#define GET_COMPRESSION_LENGTH(x) ((x)-8+MIN_COMPRESSON_LENGTH)
-#define GET_WAIT_FRAME_COUNT(x) (((x)&0x07)+1)
-#define GET_LATCH_REGISTER(x) (((x)&0x70)>>4)
-#define GET_LATCH_VALUE(x) ((x)&0x0f)
-
 #define SN76489REG_CH0_TONE		0
 #define SN76489REG_CH0_ATT		1
 #define SN76489REG_CH1_TONE		2
@@ -70,56 +67,233 @@
 #define SN76489REG_NOISE_CTRL	6
 #define SN76489REG_NOISE_ATT	7
 
-#define PSG_REGISTER_COUNT 8
-#define FILE_BUFFER_SIZE 64*1024
+#define PSG_FIELD_EMPTY -1
+
+///////////////////////////////////////////////////////////////////////////////
+// Types
 
-static uint8_t l_psg_buffer[FILE_BUFFER_SIZE];
-static int l_psg_length;
+// Output formats
+typedef enum
+{
+	Format_Text,		// human readable explanation of the commands
+	Format_CSV,			// one line per command
+	Format_JSON,		// array of command objects
+	Format_Frames		// one line per frame with the state of all registers
+} OutputFormat;
+
+// Event specific fields of the CSV and JSON formats (PSG_FIELD_EMPTY - the field is not used)
+typedef struct
+{
+	int32_t Register;
+	int32_t Value;
+	int32_t Extra;
+	const char* ValueName;		// name of the value and extra field in the JSON format
+	const char* ExtraName;
+} PSGEventFields;
+
+// Running macro of the frames format
+typedef struct
+{
+	const uint8_t* Step;
+	uint8_t RemainingSteps;
+	uint16_t Base;
+} PSGMacroState;
 
 ///////////////////////////////////////////////////////////////////////////////
 // Local functions
-static bool PSGProcessCommand(void);
-static uint8_t filePSGGetNextByte(void);
+static void PSGPrintText(PSGDecoderEvent* in_event);
+static void PSGPrintWrite(PSGDecoderEvent* in_event);
+static void PSGPrintMacroDictionary(PSGDecoderEvent* in_event);
+static void PSGPrintMacroStart(PSGDecoderEvent* in_event);
+static void PSGPrintTime(uint32_t in_frame);
+static void PSGPrintCSV(PSGDecoderEvent* in_event);
+static void PSGPrintJSON(PSGDecoderEvent* in_event);
+static void PSGGetEventFields(PSGDecoderEvent* in_event, PSGEventFields* out_fields);
+static void PSGPrintFrames(PSGDecoderEvent* in_event);
+static void PSGUpdateFrameRegisters(uint8_t in_command, uint8_t in_register);
 
-static uint16_t l_psg_registers[PSG_REGISTER_COUNT];
-static uint8_t l_psg_latch_register;
-
-// get next byte variables
-static uint32_t l_psg_resume_index;
-static uint32_t l_psg_resume_remaining_bytes;
-static uint32_t l_psg_current_index;
-static uint32_t l_psg_current_remaining_bytes;
+///////////////////////////////////////////////////////////////////////////////
+// Module variables
+static PSGDecoderType l_psg_decoder;
 static uint32_t l_psg_current_frame_count;
+static OutputFormat l_output_format = Format_Text;
+static bool l_first_json_object;
+
+// register state of the frames format
+static uint16_t l_frame_registers[PSG_DECODER_REGISTER_COUNT];
+static PSGMacroState l_frame_macros[PSG_DECODER_REGISTER_COUNT];
+
+// event names of the CSV and JSON formats
+static const char* l_event_names[] =
+{
+	"write",
+	"end_of_frame",
+	"loop",
+	"end",
+	"end_of_buffer",
+	"reference",
+	"reference_exit",
+	"clock_tag",
+	"macro_dictionary",
+	"macro",
+	"long_reference",
+	"stereo",
+	"reserved"
+};
 
 ///////////////////////////////////////////////////////////////////////////////
 // Main functions
 int main(int argc, char* argv[])
 {
+	FileMapType psg_file;
+	PSGDecoderEvent event;
+	char* filename = NULL;
 	int i;
-  FILE* psg_file;
 
-  if (argc != 2)
-  {
-    printf("Usage: psg2txt inputfile.PSG\n");
-    return (1);
-  }
+	// process command line
+	for (i = 1; i < argc; i++)
+	{
+		if (argv[i][0] == '-')
+		{
+			if (_strcmpi(argv[i], "-format") == 0 && i + 1 < argc)
+			{
+				i++;
+				if (_strcmpi(argv[i], "text") == 0)
+				{
+					l_output_format = Format_Text;
+				}
+				else
+				{
+					if (_strcmpi(argv[i], "csv") == 0)
+					{
+						l_output_format = Format_CSV;
+					}
+					else
+					{
+						if (_strcmpi(argv[i], "json") == 0)
+						{
+							l_output_format = Format_JSON;
+						}
+						else
+						{
+							if (_strcmpi(argv[i], "frames") == 0)
+							{
+								l_output_format = Format_Frames;
+							}
+							else
+							{
+								printf("Invalid format: %s\n", argv[i]);
+								return (1);
+							}
+						}
+					}
+				}
+			}
+			else
+			{
+				printf("Invalid command line parameter: %s\n", argv[i]);
+				return (1);
+			}
+		}
+		else
+		{
+			if (filename == NULL)
+			{
+				filename = argv[i];
+			}
+			else
+			{
+				printf("Invalid parameter: %s\n", argv[i]);
+				return (1);
+			}
+		}
+	}
+
+	if (filename == NULL)
+	{
+		printf("Usage: psg2txt inputfile.PSG [-format text|csv|json|frames]\n");
+		return (1);
+	}
 
-  psg_file = fopen(argv[1], "rb");
-  l_psg_length = (int)fread(&l_psg_buffer, 1, FILE_BUFFER_SIZE, psg_file);      // read input file
-  fclose(psg_file);
+	// map input file
+	if (!fileMapOpen(&psg_file, filename))
+	{
+		printf("Can't open file: %s\n", filename);
+		return (1);
+	}
 
 	// initialize
-	l_psg_latch_register = 0;
-	for (i = 0; i < PSG_REGISTER_COUNT; i++)
-		l_psg_registers[i] = 0;
-
-	l_psg_current_index = 0;
-	l_psg_current_remaining_bytes = l_psg_length;;
+	filePSGDecoderInit(&l_psg_decoder, psg_file.Data, psg_file.Length);
 	l_psg_current_frame_count = 0;
+	l_first_json_object = true;
 
-  printf("Info: input file size is %d bytes\n", l_psg_length);
+	for (i = 0; i < PSG_DECODER_REGISTER_COUNT; i++)
+	{
+		l_frame_registers[i] = ((i & 1) != 0) ? 0x0f : 0;
+		l_frame_macros[i].RemainingSteps = 0;
+	}
+
+	textWriterOpen(stdout);
+
+	// header
+	switch (l_output_format)
+	{
+		case Format_Text:
+			textWriterString("Info: input file size is ");
+			textWriterDecimal(psg_file.Length, 0, ' ');
+			textWriterString(" bytes\n");
+			break;
+
+		case Format_CSV:
+			textWriterString("offset,byte,frame,event,register,value,extra\n");
+			break;
+
+		case Format_JSON:
+			textWriterString("[\n");
+			break;
+
+		case Format_Frames:
+			textWriterString("frame   time      ch0    ch1    ch2    noise\n");
+			break;
+	}
+
+	// process commands
+	while (filePSGDecoderNext(&l_psg_decoder, &event) != PSGEvent_EndOfBuffer)
+	{
+		if (event.Type == PSGEvent_ReferenceExit)
+			continue;
+
+		switch (l_output_format)
+		{
+			case Format_Text:
+				PSGPrintText(&event);
+				break;
+
+			case Format_CSV:
+				PSGPrintCSV(&event);
+				break;
+
+			case Format_JSON:
+				PSGPrintJSON(&event);
+				break;
+
+			case Format_Frames:
+				PSGPrintFrames(&event);
+				break;
+		}
 
-	while (PSGProcessCommand());
+		if (event.Type == PSGEvent_EndOfFrame)
+			l_psg_current_frame_count += event.WaitFrames;
+
+		if (event.Type == PSGEvent_End)
+			break;
+	}
+
+	if (l_output_format == Format_JSON)
+		textWriterString("\n]\n");
+
+	textWriterClose();
+	fileMapClose(&psg_file);
 
 	return 0;
 }
@@ -129,151 +303,500 @@ int main(int argc, char* argv[])
 /*****************************************************************************/
 
 ///////////////////////////////////////////////////////////////////////////////
-// Processes one PSG command
-static bool PSGProcessCommand(void)
+// Prints one PSG command in text format
+static void PSGPrintText(PSGDecoderEvent* in_event)
 {
-	uint8_t command;
-	bool retval = true;
+	textWriterString("0x");
+	textWriterHex(in_event->Position, 4);
+	textWriterString(": 0x");
+	textWriterHex(in_event->Command, 2);
+	textWriterString("    ");
 
-	// gets next byte
-	printf("0x%04X: ", l_psg_current_index);
-	command = filePSGGetNextByte();
-	printf("0x%02X    ", command);
+	switch (in_event->Type)
+	{
+		// register write
+		case PSGEvent_Write:
+			PSGPrintWrite(in_event);
+			break;
+
+		// compressed substring
+		case PSGEvent_ReferenceEnter:
+			textWriterString("<< compression pos: 0x");
+			textWriterHex(in_event->ReferenceOffset, 4);
+			textWriterString(", length: ");
+			textWriterDecimal(in_event->ReferenceLength, 2, ' ');
+			textWriterString("       >>\n");
+			break;
+
+		// long substring (repeated frames)
+		case PSGEvent_LongReferenceEnter:
+			textWriterString("<< long compression pos: 0x");
+			textWriterHex(in_event->ReferenceOffset, 4);
+			textWriterString(", length: ");
+			textWriterDecimal(in_event->ReferenceLength, 5, ' ');
+			textWriterString("  >>\n");
+			break;
+
+		// end of frame
+		case PSGEvent_EndOfFrame:
+			textWriterString("---------- end of frame ------------ (");
+			PSGPrintTime(l_psg_current_frame_count);
+			textWriterString(")\n");
+			break;
+
+		case PSGEvent_Loop:
+			textWriterString("begin loop\n");
+			break;
+
+		// end of file
+		case PSGEvent_End:
+			textWriterString("\n");
+			break;
+
+		case PSGEvent_ClockTag:
+			textWriterString("clock tag: ");
+			textWriterString((in_event->Value == PSG_CLOCK_TAG_3125KHZ) ? "3.125MHz" : "3.579545MHz");
+			textWriterChar('\n');
+			break;
+
+		case PSGEvent_MacroDictionary:
+			PSGPrintMacroDictionary(in_event);
+			break;
+
+		case PSGEvent_Macro:
+			PSGPrintMacroStart(in_event);
+			break;
+
+		case PSGEvent_Stereo:
+			textWriterString("stereo: left 0x");
+			textWriterHex(in_event->Value >> 4, 1);
+			textWriterString(", right 0x");
+			textWriterHex(in_event->Value & 0x0f, 1);
+			textWriterChar('\n');
+			break;
+
+		default:
+			textWriterString("reserved\n");
+			break;
+	}
+}
 
-	// register latch command
-	if (IS_LATCH_BYTE(command))
+///////////////////////////////////////////////////////////////////////////////
+// Prints register write
+static void PSGPrintWrite(PSGDecoderEvent* in_event)
+{
+	// data byte
+	if ((in_event->Command & 0x80) == 0)
 	{
-		l_psg_latch_register = GET_LATCH_REGISTER(command);
-		switch (l_psg_latch_register)
+		switch (in_event->Register)
 		{
 			case SN76489REG_CH0_TONE:
 			case SN76489REG_CH1_TONE:
 			case SN76489REG_CH2_TONE:
-				l_psg_registers[l_psg_latch_register] = (l_psg_registers[l_psg_latch_register] & 0x3f0) | GET_LATCH_VALUE(command);
-				printf("Latch/Data: Tone Ch #%d -> 0x%03X\n", l_psg_latch_register / 2, l_psg_registers[l_psg_latch_register]);
+				textWriterString("      Data: Tone Ch #");
+				textWriterDecimal(in_event->Register / 2, 0, ' ');
+				textWriterString(" -> 0x");
+				textWriterHex(in_event->Value, 3);
+				textWriterChar('\n');
 				break;
 
-			case SN76489REG_CH0_ATT:
-			case  SN76489REG_CH1_ATT:
-			case  SN76489REG_CH2_ATT:
-			case SN76489REG_NOISE_ATT:
-				l_psg_registers[l_psg_latch_register] = GET_LATCH_VALUE(command);
-				printf("Latch/Data: Volume Ch #%d -> 0x%02X (%d%%)\n", l_psg_latch_register / 2, GET_LATCH_VALUE(command), (15 - GET_LATCH_VALUE(command)) * 100 / 15);
+			default:
+				textWriterString("      Data: Register #");
+				textWriterDecimal(in_event->Register, 0, ' ');
+				textWriterString(" -> 0x");
+				textWriterHex(in_event->Value, 2);
+				textWriterChar('\n');
 				break;
+		}
 
-			case SN76489REG_NOISE_CTRL:
-				printf("Noise Type: ");
-				if ((command & 0x04) != 0)
-					printf("white, ");
-				else
-					printf("periodic, ");
-				switch (command & 0x03)
-				{
-					case 0:
-						printf("low (N/512)\n");
-						break;
+		return;
+	}
 
-					case 1:
-						printf("medium (N/1024)\n");
-						break;
+	// register latch command
+	switch (in_event->Register)
+	{
+		case SN76489REG_CH0_TONE:
+		case SN76489REG_CH1_TONE:
+		case SN76489REG_CH2_TONE:
+			textWriterString("Latch/Data: Tone Ch #");
+			textWriterDecimal(in_event->Register / 2, 0, ' ');
+			textWriterString(" -> 0x");
+			textWriterHex(in_event->Value, 3);
+			textWriterChar('\n');
+			break;
+
+		case SN76489REG_CH0_ATT:
+		case  SN76489REG_CH1_ATT:
+		case  SN76489REG_CH2_ATT:
+		case SN76489REG_NOISE_ATT:
+			textWriterString("Latch/Data: Volume Ch #");
+			textWriterDecimal(in_event->Register / 2, 0, ' ');
+			textWriterString(" -> 0x");
+			textWriterHex(in_event->Value, 2);
+			textWriterString(" (");
+			textWriterDecimal((15 - in_event->Value) * 100 / 15, 0, ' ');
+			textWriterString("%)\n");
+			break;
+
+		case SN76489REG_NOISE_CTRL:
+			textWriterString("Noise Type: ");
+			if ((in_event->Command & 0x04) != 0)
+				textWriterString("white, ");
+			else
+				textWriterString("periodic, ");
+			switch (in_event->Command & 0x03)
+			{
+				case 0:
+					textWriterString("low (N/512)\n");
+					break;
 
-					case 2:
-						printf("high (N/2048)\n");
-						break;
+				case 1:
+					textWriterString("medium (N/1024)\n");
+					break;
 
-					case 3:
-						printf("tone #3\n");
-						break;
+				case 2:
+					textWriterString("high (N/2048)\n");
+					break;
 
-					default:
-						break;
-				}
-				break;
+				case 3:
+					textWriterString("tone #3\n");
+					break;
 
-			default:
-				break;
-		}
+				default:
+					break;
+			}
+			break;
+
+		default:
+			break;
 	}
-	else
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Prints the macro dictionary
+static void PSGPrintMacroDictionary(PSGDecoderEvent* in_event)
+{
+	const uint8_t* macro;
+	int length;
+	int i;
+	int step;
+
+	textWriterString("macro dictionary: ");
+	textWriterDecimal(in_event->Value, 0, ' ');
+	textWriterString(" macros\n");
+
+	for (i = 0; i < l_psg_decoder.MacroCount; i++)
 	{
-		// data byte
-		if (IS_DATA_BYTE(command))
+		macro = l_psg_decoder.Macros[i];
+		length = macro[0] & PSG_MACRO_LENGTH_MASK;
+
+		textWriterString("                  macro #");
+		textWriterDecimal(i, 2, ' ');
+		textWriterString(((macro[0] & PSG_MACRO_TONE) != 0) ? " tone, " : " attenuation, ");
+		textWriterDecimal(length, 3, ' ');
+		textWriterString(" steps:");
+
+		for (step = 1; step <= length; step++)
 		{
-			switch (l_psg_latch_register)
+			textWriterChar(' ');
+			if ((macro[0] & PSG_MACRO_TONE) != 0)
 			{
-				case SN76489REG_CH0_TONE:
-				case SN76489REG_CH1_TONE:
-				case SN76489REG_CH2_TONE:
-					l_psg_registers[l_psg_latch_register] = ((command & 0x3f) << 4) | (l_psg_registers[l_psg_latch_register] & 0xf);
-					printf("      Data: Tone Ch #%d -> 0x%03X\n", l_psg_latch_register / 2, l_psg_registers[l_psg_latch_register]);
-					break;
+				if ((int8_t)macro[step] >= 0)
+					textWriterChar('+');
+				textWriterDecimal((int8_t)macro[step], 0, ' ');
 			}
-		}
-		else
-		{
-			// must be escape
-			if (IS_COMPRESSION(command))
+			else
 			{
-				uint8_t posl = filePSGGetNextByte();
-				uint8_t posh = filePSGGetNextByte();
+				textWriterDecimal(macro[step], 0, ' ');
+			}
+		}
+
+		textWriterChar('\n');
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Prints the macro start command
+static void PSGPrintMacroStart(PSGDecoderEvent* in_event)
+{
+	if (in_event->Macro == NULL)
+	{
+		textWriterString("Macro: Ch #");
+		textWriterDecimal(in_event->Register / 2, 0, ' ');
+		textWriterString(", invalid macro #");
+		textWriterDecimal(in_event->MacroIndex, 0, ' ');
+		textWriterChar('\n');
+		return;
+	}
+
+	if ((in_event->Macro[0] & PSG_MACRO_TONE) != 0)
+	{
+		textWriterString("Macro: Tone Ch #");
+		textWriterDecimal(in_event->Register / 2, 0, ' ');
+		textWriterString(", macro #");
+		textWriterDecimal(in_event->MacroIndex, 0, ' ');
+		textWriterString(", base 0x");
+		textWriterHex(in_event->Value, 3);
+		textWriterChar('\n');
+	}
+	else
+	{
+		textWriterString("Macro: Volume Ch #");
+		textWriterDecimal(in_event->Register / 2, 0, ' ');
+		textWriterString(", macro #");
+		textWriterDecimal(in_event->MacroIndex, 0, ' ');
+		textWriterChar('\n');
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Prints the time of the frame (mm:ss.hh at 50Hz)
+static void PSGPrintTime(uint32_t in_frame)
+{
+	textWriterDecimal(in_frame / 50 / 60, 2, '0');
+	textWriterChar(':');
+	textWriterDecimal((in_frame / 50) % 60, 2, '0');
+	textWriterChar('.');
+	textWriterDecimal((in_frame * 2) % 100, 2, '0');
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Prints one PSG command as a CSV line
+static void PSGPrintCSV(PSGDecoderEvent* in_event)
+{
+	PSGEventFields fields;
+
+	PSGGetEventFields(in_event, &fields);
+
+	textWriterDecimal(in_event->Position, 0, ' ');
+	textWriterChar(',');
+	textWriterDecimal(in_event->Command, 0, ' ');
+	textWriterChar(',');
+	textWriterDecimal(l_psg_current_frame_count, 0, ' ');
+	textWriterChar(',');
+	textWriterString(l_event_names[in_event->Type]);
+	textWriterChar(',');
+	if (fields.Register != PSG_FIELD_EMPTY)
+		textWriterDecimal(fields.Register, 0, ' ');
+	textWriterChar(',');
+	if (fields.Value != PSG_FIELD_EMPTY)
+		textWriterDecimal(fields.Value, 0, ' ');
+	textWriterChar(',');
+	if (fields.Extra != PSG_FIELD_EMPTY)
+		textWriterDecimal(fields.Extra, 0, ' ');
+	textWriterChar('\n');
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Prints one PSG command as a JSON object
+static void PSGPrintJSON(PSGDecoderEvent* in_event)
+{
+	PSGEventFields fields;
+
+	PSGGetEventFields(in_event, &fields);
+
+	if (!l_first_json_object)
+		textWriterString(",\n");
+	l_first_json_object = false;
 
-				uint16_t compression_pos = (uint16_t)((posh << 8) + posl);
+	textWriterString("{\"offset\":");
+	textWriterDecimal(in_event->Position, 0, ' ');
+	textWriterString(",\"byte\":");
+	textWriterDecimal(in_event->Command, 0, ' ');
+	textWriterString(",\"frame\":");
+	textWriterDecimal(l_psg_current_frame_count, 0, ' ');
+	textWriterString(",\"event\":\"");
+	textWriterString(l_event_names[in_event->Type]);
+	textWriterChar('"');
 
-				printf("<< compression pos: 0x%04X, length: %2d       >>\n", compression_pos, GET_COMPRESSION_LENGTH(command));
+	if (fields.Register != PSG_FIELD_EMPTY)
+	{
+		textWriterString(",\"register\":");
+		textWriterDecimal(fields.Register, 0, ' ');
+	}
+
+	if (fields.Value != PSG_FIELD_EMPTY)
+	{
+		textWriterString(",\"");
+		textWriterString(fields.ValueName);
+		textWriterString("\":");
+		textWriterDecimal(fields.Value, 0, ' ');
+	}
+
+	if (fields.Extra != PSG_FIELD_EMPTY)
+	{
+		textWriterString(",\"");
+		textWriterString(fields.ExtraName);
+		textWriterString("\":");
+		textWriterDecimal(fields.Extra, 0, ' ');
+	}
+
+	textWriterChar('}');
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets the event specific fields of the CSV and JSON formats
+static void PSGGetEventFields(PSGDecoderEvent* in_event, PSGEventFields* out_fields)
+{
+	out_fields->Register = PSG_FIELD_EMPTY;
+	out_fields->Value = PSG_FIELD_EMPTY;
+	out_fields->Extra = PSG_FIELD_EMPTY;
+	out_fields->ValueName = "value";
+	out_fields->ExtraName = "extra";
+
+	switch (in_event->Type)
+	{
+		// register and its value after the write
+		case PSGEvent_Write:
+			out_fields->Register = in_event->Register;
+			out_fields->Value = in_event->Value;
+			break;
+
+		// number of frames to wait
+		case PSGEvent_EndOfFrame:
+			out_fields->Value = in_event->WaitFrames;
+			out_fields->ValueName = "wait";
+			break;
+
+		// substring offset and length
+		case PSGEvent_ReferenceEnter:
+		case PSGEvent_LongReferenceEnter:
+			out_fields->Value = in_event->ReferenceOffset;
+			out_fields->Extra = in_event->ReferenceLength;
+			out_fields->ValueName = "offset";
+			out_fields->ExtraName = "length";
+			break;
+
+		// clock id
+		case PSGEvent_ClockTag:
+			out_fields->Value = in_event->Value;
+			out_fields->ValueName = "clock";
+			break;
+
+		// number of macros and the length of the dictionary
+		case PSGEvent_MacroDictionary:
+			out_fields->Value = in_event->Value;
+			out_fields->Extra = in_event->Length;
+			out_fields->ValueName = "count";
+			out_fields->ExtraName = "length";
+			break;
+
+		// register, base tone value (tone macros only) and macro index
+		case PSGEvent_Macro:
+			out_fields->Register = in_event->Register;
+			if (in_event->Macro != NULL && (in_event->Macro[0] & PSG_MACRO_TONE) != 0)
+				out_fields->Value = in_event->Value;
+			out_fields->Extra = in_event->MacroIndex;
+			out_fields->ValueName = "base";
+			out_fields->ExtraName = "macro";
+			break;
+
+		// stereo register
+		case PSGEvent_Stereo:
+			out_fields->Value = in_event->Value;
+			out_fields->ValueName = "stereo";
+			break;
+
+		default:
+			break;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Frames format: updates the register state and prints one line for every played frame
+// (the running macros are applied, the loop is played once)
+static void PSGPrintFrames(PSGDecoderEvent* in_event)
+{
+	PSGMacroState* macro;
+	uint32_t frame;
+	int i;
 
-				l_psg_resume_index = l_psg_current_index;
-				l_psg_resume_remaining_bytes = l_psg_current_remaining_bytes;
+	switch (in_event->Type)
+	{
+		case PSGEvent_Write:
+			PSGUpdateFrameRegisters(in_event->Command, in_event->Register);
+			break;
 
-				l_psg_current_index = compression_pos;
-				l_psg_current_remaining_bytes = GET_COMPRESSION_LENGTH(command);
+		case PSGEvent_Macro:
+			if (in_event->Macro != NULL)
+			{
+				macro = &l_frame_macros[in_event->Register];
+				macro->Step = in_event->Macro + 1;
+				macro->RemainingSteps = in_event->Macro[0] & PSG_MACRO_LENGTH_MASK;
+				macro->Base = in_event->Value;
 			}
-			else
+			break;
+
+		case PSGEvent_Loop:
+			textWriterString("; loop\n");
+			break;
+
+		case PSGEvent_EndOfFrame:
+			for (frame = l_psg_current_frame_count; frame < l_psg_current_frame_count + in_event->WaitFrames; frame++)
 			{
-				// end of frame
-				if (IS_END_OF_FRAME(command))
+				// macro steps at the end of the frame
+				for (i = 0; i < PSG_DECODER_REGISTER_COUNT; i++)
 				{
-					printf("---------- end of frame ------------ (%02d:%02d.%02d)\n", l_psg_current_frame_count / 50 / 60, (l_psg_current_frame_count / 50) % 60, (l_psg_current_frame_count * 2) % 100);
-					l_psg_current_frame_count += GET_WAIT_FRAME_COUNT(command);
+					macro = &l_frame_macros[i];
+					if (macro->RemainingSteps == 0)
+						continue;
+
+					if ((i & 1) == 0)
+						l_frame_registers[i] = (uint16_t)((macro->Base + (int8_t)*macro->Step) & 0x3ff);
+					else
+						l_frame_registers[i] = *macro->Step & 0x0f;
+
+					macro->Step++;
+					macro->RemainingSteps--;
 				}
-				else
+
+				// frame number, time and register values
+				textWriterDecimal(frame, 7, '0');
+				textWriterChar(' ');
+				PSGPrintTime(frame);
+				for (i = SN76489REG_CH0_TONE; i < SN76489REG_NOISE_CTRL; i += 2)
 				{
-					if (IS_BEGIN_LOOP(command))
-					{
-						printf("begin loop\n");
-					}
-					else
-					{
-						// end of file
-						if (IS_END_OF_FILE(command))
-						{
-							retval = false;
-						}
-					}
+					textWriterString("  ");
+					textWriterHex(l_frame_registers[i], 3);
+					textWriterChar(' ');
+					textWriterHex(l_frame_registers[i + 1], 1);
 				}
+				textWriterString("  ");
+				textWriterHex(l_frame_registers[SN76489REG_NOISE_CTRL], 1);
+				textWriterChar(' ');
+				textWriterHex(l_frame_registers[SN76489REG_NOISE_ATT], 1);
+				textWriterChar('\n');
 			}
-		}
-	}
+			break;
 
-	return retval;
+		default:
+			break;
+	}
 }
 
-
 ///////////////////////////////////////////////////////////////////////////////
-// Gets next byte from the PSG data
-static uint8_t filePSGGetNextByte(void)
+// Updates the register state of the frames format by the written byte (as the sound chip does)
+static void PSGUpdateFrameRegisters(uint8_t in_command, uint8_t in_register)
 {
-	// if no more bytes -> resume position
-	if (l_psg_current_remaining_bytes == 0)
-	{
-		l_psg_current_index = l_psg_resume_index;
-		l_psg_current_remaining_bytes = l_psg_resume_remaining_bytes;
-	}
+	bool latch = (in_command & 0x80) != 0;
 
-	// get byte
-	uint8_t data = l_psg_buffer[l_psg_current_index];
+	switch (in_register)
+	{
+		case SN76489REG_CH0_TONE:
+		case SN76489REG_CH1_TONE:
+		case SN76489REG_CH2_TONE:
+			if (latch)
+				l_frame_registers[in_register] = (l_frame_registers[in_register] & 0x3f0) | (in_command & 0x0f);
+			else
+				l_frame_registers[in_register] = (l_frame_registers[in_register] & 0x00f) | ((in_command & 0x3f) << 4);
+			break;
 
-	l_psg_current_index++;
-	l_psg_current_remaining_bytes--;
+		case SN76489REG_NOISE_CTRL:
+			l_frame_registers[in_register] = in_command & 0x07;
+			break;
 
-	return data;
+		default:
+			l_frame_registers[in_register] = in_command & 0x0f;
+			break;
+	}
 }
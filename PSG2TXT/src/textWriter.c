@@ -0,0 +1,135 @@
+/*****************************************************************************/
+/* PSG2TXT - Buffered text output                                            */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#include <textWriter.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Local functions
+static void textWriterFlush(void);
+
+///////////////////////////////////////////////////////////////////////////////
+// Module variables
+static FILE* l_file = NULL;
+static char l_buffer[TEXT_WRITER_BUFFER_SIZE];
+static int l_buffer_pos = 0;
+static const char l_hex_digits[] = "0123456789ABCDEF";
+
+///////////////////////////////////////////////////////////////////////////////
+// Starts writing text into the file (the text is collected in a large buffer and written in blocks)
+void textWriterOpen(FILE* in_file)
+{
+	l_file = in_file;
+	l_buffer_pos = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes the buffered text into the file
+void textWriterClose(void)
+{
+	textWriterFlush();
+	fflush(l_file);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes one character
+void textWriterChar(char in_char)
+{
+	if (l_buffer_pos >= TEXT_WRITER_BUFFER_SIZE)
+		textWriterFlush();
+
+	l_buffer[l_buffer_pos++] = in_char;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes zero terminated string
+void textWriterString(const char* in_string)
+{
+	while (*in_string != '\0')
+	{
+		if (l_buffer_pos >= TEXT_WRITER_BUFFER_SIZE)
+			textWriterFlush();
+
+		l_buffer[l_buffer_pos++] = *in_string++;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes uppercase hexadecimal number with at least the given number of digits (like %0nX)
+void textWriterHex(uint32_t in_value, int in_digits)
+{
+	int i;
+
+	while (in_digits < 8 && (in_value >> (in_digits * 4)) != 0)
+		in_digits++;
+
+	if (l_buffer_pos + in_digits > TEXT_WRITER_BUFFER_SIZE)
+		textWriterFlush();
+
+	for (i = in_digits - 1; i >= 0; i--)
+	{
+		l_buffer[l_buffer_pos + i] = l_hex_digits[in_value & 0x0f];
+		in_value >>= 4;
+	}
+
+	l_buffer_pos += in_digits;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes decimal number padded to the given width (like %nd with ' ' padding, %0nd with '0' padding)
+void textWriterDecimal(int32_t in_value, int in_width, char in_padding)
+{
+	char digits[12];
+	int digit_count = 0;
+	uint32_t value;
+	bool negative = (in_value < 0);
+
+	value = negative ? (uint32_t)(-(int64_t)in_value) : (uint32_t)in_value;
+
+	do
+	{
+		digits[digit_count++] = (char)('0' + value % 10);
+		value /= 10;
+	} while (value > 0);
+
+	if (negative)
+		in_width--;
+
+	// the sign is written before the zero padding and after the space padding
+	if (negative && in_padding == '0')
+		textWriterChar('-');
+
+	while (in_width > digit_count)
+	{
+		textWriterChar(in_padding);
+		in_width--;
+	}
+
+	if (negative && in_padding != '0')
+		textWriterChar('-');
+
+	while (digit_count > 0)
+		textWriterChar(digits[--digit_count]);
+}
+
+/*****************************************************************************/
+/* Local functions                                                           */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes the content of the buffer into the file
+static void textWriterFlush(void)
+{
+	if (l_buffer_pos > 0)
+		fwrite(l_buffer, 1, l_buffer_pos, l_file);
+
+	l_buffer_pos = 0;
+}
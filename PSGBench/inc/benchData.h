@@ -0,0 +1,23 @@
+/*****************************************************************************/
+/* PSGBench - Benchmark input data generator                                 */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+#ifndef __benchData_h
+#define __benchData_h
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#include <Types.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Function prototypes
+int benchDataCreateVGM(uint32_t in_seed, int in_length, uint8_t* out_buffer, int in_buffer_length);
+int benchDataDeflate(uint8_t* in_buffer, int in_length, uint8_t* out_buffer, int in_buffer_length);
+
+#endif
@@ -0,0 +1,23 @@
+/*****************************************************************************/
+/* PSGBench - PSG rendering benchmark                                        */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+#ifndef __benchRender_h
+#define __benchRender_h
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#include <stdint.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Function prototypes
+void benchRenderInit(uint32_t in_clock_frequency, uint16_t in_sample_rate, int in_framerate);
+uint32_t benchRenderPSG(uint8_t* in_psg_buffer, int in_psg_length);
+
+#endif
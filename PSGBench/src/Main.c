@@ -0,0 +1,623 @@
+/*****************************************************************************/
+/* PSGBench - Microbenchmarks of the PSG tools                               */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#include <Windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define TINFL_HEADER_FILE_ONLY
+#include <tinfl.c>
+#include <Main.h>
+#include <fileVGM.h>
+#include <fileVGMDecompress.h>
+#include <filePSG.h>
+#include <filePSGCompress.h>
+#include <benchData.h>
+#include <benchRender.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+#define BENCH_MIN_SIZE 1024
+#define BENCH_DEFAULT_MAX_SIZE 1024				// in KB
+#define BENCH_SIZE_STEP 4
+#define BENCH_DEFAULT_MIN_TIME 500				// in ms
+#define BENCH_WARMUP_TIME_RATIO 10				// warm-up time is 1/10 of the measurement time
+#define BENCH_MIN_REPETITION 3
+#define BENCH_COMPRESS_VGM_RATIO 4				// synthetic VGM length / PSG length for the compressor input
+#define BENCH_SAMPLE_RATE 44100
+#define BENCH_SEED 2023
+
+#define BENCH_INFLATE		0x01
+#define BENCH_PARSE			0x02
+#define BENCH_ENCODE		0x04
+#define BENCH_COMPRESS	0x08
+#define BENCH_RENDER		0x10
+#define BENCH_ALL				0x1f
+
+///////////////////////////////////////////////////////////////////////////////
+// Types
+
+// Benchmark input data (all data is prepared before the measurement)
+typedef struct
+{
+	char Name[64];
+	uint32_t ClockFrequency;
+
+	uint8_t* VGM;								// uncompressed VGM file (parser input, inflate output)
+	int VGMLength;
+	uint8_t* Deflated;					// deflate stream of the VGM file (inflate input)
+	int DeflatedLength;
+	emuSN76489State* Frames;		// register state at the end of each frame (encoder input)
+	int FrameCount;
+	uint8_t* PSG;								// uncompressed PSG stream (compressor and renderer input)
+	int PSGLength;
+} BenchInput;
+
+// Benchmark function, returns the number of processed frames (or zero)
+typedef uint32_t (*BenchFunction)(BenchInput* in_input);
+
+///////////////////////////////////////////////////////////////////////////////
+// Local functions
+static bool benchPrepareInput(BenchInput* in_input, const char* in_name, uint8_t* in_vgm, int in_vgm_length);
+static void benchFreeInput(BenchInput* in_input);
+static void benchRunAll(BenchInput* in_input, int in_benchmarks);
+static void benchMeasure(const char* in_name, BenchInput* in_input, BenchFunction in_prepare, BenchFunction in_run, int in_byte_count);
+static double benchGetTime(void);
+
+static uint32_t benchInflate(BenchInput* in_input);
+static uint32_t benchParse(BenchInput* in_input);
+static uint32_t benchEncode(BenchInput* in_input);
+static uint32_t benchCompressPrepare(BenchInput* in_input);
+static uint32_t benchCompress(BenchInput* in_input);
+static uint32_t benchRender(BenchInput* in_input);
+
+static bool GetNumericParameter(int in_argc, char* in_argv[], int in_index, int in_min, int in_max, int* out_number);
+static void PrintUsage(void);
+
+///////////////////////////////////////////////////////////////////////////////
+// Global variables
+emuSN76489State g_SN76489_state;
+emuSN76489State g_SN76489_state_2nd;
+
+///////////////////////////////////////////////////////////////////////////////
+// Module global variables
+static int l_frame_step = 44100 / 50;
+static int l_framerate = 50;
+static double l_min_time = BENCH_DEFAULT_MIN_TIME / 1000.0;
+
+static uint8_t l_file_buffer[FILE_BUFFER_LENGTH];
+static uint8_t* l_work_buffer = NULL;
+static int l_work_buffer_length = 0;
+
+///////////////////////////////////////////////////////////////////////////////
+// Main function
+int main(int argc, char* argv[])
+{
+	BenchInput input;
+	int benchmarks = BENCH_ALL;
+	int max_size = BENCH_DEFAULT_MAX_SIZE * 1024;
+	int size;
+	int length;
+	int value;
+	int i;
+	bool synthetic = true;
+	uint8_t* vgm_buffer;
+	char name[64];
+
+	printf("PSG tools microbenchmarks (c) Laszlo Arvai 2023\n");
+
+	// process options
+	for (i = 1; i < argc; i++)
+	{
+		if (argv[i][0] != '-')
+			continue;
+
+		if (_strcmpi(argv[i], "-maxsize") == 0)
+		{
+			if (!GetNumericParameter(argc, argv, i, 1, 1024, &value))
+				return -1;
+
+			max_size = value * 1024;
+			i++;
+		}
+		else
+		{
+			if (_strcmpi(argv[i], "-mintime") == 0)
+			{
+				if (!GetNumericParameter(argc, argv, i, 1, 60000, &value))
+					return -1;
+
+				l_min_time = value / 1000.0;
+				i++;
+			}
+			else
+			{
+				if (_strcmpi(argv[i], "-framerate") == 0)
+				{
+					if (!GetNumericParameter(argc, argv, i, 20, 100, &value))
+						return -1;
+
+					l_framerate = value;
+					l_frame_step = 44100 / value;
+					i++;
+				}
+				else
+				{
+					if (_strcmpi(argv[i], "-bench") == 0 && i + 1 < argc)
+					{
+						i++;
+						if (_strcmpi(argv[i], "inflate") == 0)
+							benchmarks = BENCH_INFLATE;
+						else if (_strcmpi(argv[i], "parse") == 0)
+							benchmarks = BENCH_PARSE;
+						else if (_strcmpi(argv[i], "encode") == 0)
+							benchmarks = BENCH_ENCODE;
+						else if (_strcmpi(argv[i], "compress") == 0)
+							benchmarks = BENCH_COMPRESS;
+						else if (_strcmpi(argv[i], "render") == 0)
+							benchmarks = BENCH_RENDER;
+						else
+						{
+							printf("ERROR: Unknown benchmark: %s\n", argv[i]);
+							return -1;
+						}
+					}
+					else
+					{
+						if (_strcmpi(argv[i], "-level") == 0)
+						{
+							if (!GetNumericParameter(argc, argv, i, PSG_COMPRESSION_MIN_LEVEL, PSG_COMPRESSION_MAX_LEVEL, &value))
+								return -1;
+
+							filePSGCompressSetLevel(value);
+							i++;
+						}
+						else
+						{
+							if (_strcmpi(argv[i], "-nosynthetic") == 0)
+							{
+								synthetic = false;
+							}
+							else
+							{
+								if (_strcmpi(argv[i], "-?") == 0)
+								{
+									PrintUsage();
+									return 0;
+								}
+								else
+								{
+									printf("ERROR: Invalid command line parameter: %s\n", argv[i]);
+									return -1;
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	filePSGCompressShowProgress(false);
+
+	vgm_buffer = (uint8_t*)malloc(max_size * BENCH_COMPRESS_VGM_RATIO);
+	if (vgm_buffer == NULL)
+	{
+		printf("ERROR: Out of memory.\n");
+		return -1;
+	}
+
+	printf("\n%-9s %-20s %9s %5s %10s %10s %10s %12s\n", "Benchmark", "Input", "Bytes", "Reps", "Best[ms]", "Mean[ms]", "MB/s", "Frames/s");
+
+	// synthetic inputs with scaling size
+	if (synthetic)
+	{
+		for (size = BENCH_MIN_SIZE; size <= max_size; size *= BENCH_SIZE_STEP)
+		{
+			// parser, encoder, renderer and inflate input
+			if ((benchmarks & ~BENCH_COMPRESS) != 0)
+			{
+				length = benchDataCreateVGM(BENCH_SEED, size, vgm_buffer, size);
+				sprintf(name, "synthetic-%dK", size / 1024);
+
+				if (benchPrepareInput(&input, name, vgm_buffer, length))
+					benchRunAll(&input, benchmarks & ~BENCH_COMPRESS);
+
+				benchFreeInput(&input);
+			}
+
+			// compressor input is a PSG stream with the given length
+			if ((benchmarks & BENCH_COMPRESS) != 0)
+			{
+				length = benchDataCreateVGM(BENCH_SEED, size * BENCH_COMPRESS_VGM_RATIO, vgm_buffer, max_size * BENCH_COMPRESS_VGM_RATIO);
+				sprintf(name, "synthetic-%dK", size / 1024);
+
+				if (benchPrepareInput(&input, name, vgm_buffer, length))
+				{
+					// truncate PSG stream
+					if (input.PSGLength > size)
+					{
+						input.PSGLength = size;
+						input.PSG[size - 1] = 0;
+					}
+
+					benchRunAll(&input, BENCH_COMPRESS);
+				}
+
+				benchFreeInput(&input);
+			}
+		}
+	}
+
+	// corpus files
+	for (i = 1; i < argc; i++)
+	{
+		if (argv[i][0] == '-')
+		{
+			if (_strcmpi(argv[i], "-maxsize") == 0 || _strcmpi(argv[i], "-mintime") == 0 || _strcmpi(argv[i], "-framerate") == 0 || _strcmpi(argv[i], "-bench") == 0 || _strcmpi(argv[i], "-level") == 0)
+				i++;
+
+			continue;
+		}
+
+		length = fileVGMLoad(argv[i], l_file_buffer, FILE_BUFFER_LENGTH);
+		if (length == 0)
+		{
+			printf("ERROR: Can't load file: %s\n", argv[i]);
+			continue;
+		}
+
+		if (benchPrepareInput(&input, argv[i], l_file_buffer, length))
+			benchRunAll(&input, benchmarks);
+
+		benchFreeInput(&input);
+	}
+
+	free(vgm_buffer);
+	free(l_work_buffer);
+
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Prepares all input data of the benchmarks from a VGM file
+static bool benchPrepareInput(BenchInput* in_input, const char* in_name, uint8_t* in_vgm, int in_vgm_length)
+{
+	const char* name;
+	int frame_index;
+	int work_buffer_length;
+
+	memset(in_input, 0, sizeof(BenchInput));
+
+	// use file name only
+	name = strrchr(in_name, '\\');
+	if (name == NULL)
+		name = strrchr(in_name, '/');
+	name = (name == NULL) ? in_name : name + 1;
+
+	strncpy(in_input->Name, name, sizeof(in_input->Name) - 1);
+
+	in_input->VGM = in_vgm;
+	in_input->VGMLength = in_vgm_length;
+
+	if (!fileVGMOpen(in_vgm, in_vgm_length) || g_vgm_file_header.SN76489Clock == 0)
+	{
+		printf("ERROR: Invalid VGM file: %s\n", in_name);
+		return false;
+	}
+	in_input->ClockFrequency = g_vgm_file_header.SN76489Clock & VGM_CLOCK_MASK;
+
+	// deflate stream
+	in_input->Deflated = (uint8_t*)malloc(in_vgm_length + in_vgm_length / 4 + 64);
+	if (in_input->Deflated == NULL)
+		return false;
+
+	in_input->DeflatedLength = benchDataDeflate(in_vgm, in_vgm_length, in_input->Deflated, in_vgm_length + in_vgm_length / 4 + 64);
+
+	// count frames
+	in_input->FrameCount = benchParse(in_input);
+
+	// store register state of all frames
+	in_input->Frames = (emuSN76489State*)malloc((in_input->FrameCount + 1) * sizeof(emuSN76489State));
+	if (in_input->Frames == NULL)
+		return false;
+
+	fileVGMOpen(in_input->VGM, in_input->VGMLength);
+	g_SN76489_state.ClockFrequency = in_input->ClockFrequency;
+	g_SN76489_state_2nd.ClockFrequency = in_input->ClockFrequency;
+	emuSN76489Reset(&g_SN76489_state);
+	fileVGMPlayerStart();
+	frame_index = 0;
+	while (fileVGMPlayerIsBusy() && frame_index < in_input->FrameCount)
+	{
+		fileVGMPlayerProcess(l_frame_step);
+
+		in_input->Frames[frame_index++] = g_SN76489_state;
+		emuSN76489ClearRegisterChanged(&g_SN76489_state);
+	}
+	fileVGMClose();
+
+	// encode PSG stream (one frame is max. 12 bytes: 8 latch, 3 data and end of frame)
+	in_input->PSG = (uint8_t*)malloc(in_input->FrameCount * 12 + 16);
+	if (in_input->PSG == NULL)
+		return false;
+
+	filePSGStart(in_input->PSG, in_input->FrameCount * 12 + 16);
+	benchEncode(in_input);
+	in_input->PSGLength = filePSGGetLength();
+
+	// compressor works in place, so it needs a working copy of the PSG stream
+	work_buffer_length = (in_input->PSGLength > in_vgm_length) ? in_input->PSGLength : in_vgm_length;
+	if (work_buffer_length > l_work_buffer_length)
+	{
+		free(l_work_buffer);
+		l_work_buffer = (uint8_t*)malloc(work_buffer_length);
+		l_work_buffer_length = (l_work_buffer != NULL) ? work_buffer_length : 0;
+		if (l_work_buffer == NULL)
+			return false;
+	}
+
+	// check deflate stream
+	if (in_input->DeflatedLength > 0 && (tinfl_decompress_mem_to_mem(l_work_buffer, l_work_buffer_length, in_input->Deflated, in_input->DeflatedLength, 0) != (size_t)in_vgm_length ||
+		memcmp(l_work_buffer, in_vgm, in_vgm_length) != 0))
+	{
+		printf("ERROR: Deflate stream check failed: %s\n", in_input->Name);
+		in_input->DeflatedLength = 0;
+	}
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Frees input data
+static void benchFreeInput(BenchInput* in_input)
+{
+	free(in_input->Deflated);
+	free(in_input->Frames);
+	free(in_input->PSG);
+
+	memset(in_input, 0, sizeof(BenchInput));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Runs the selected benchmarks on the input
+static void benchRunAll(BenchInput* in_input, int in_benchmarks)
+{
+	if ((in_benchmarks & BENCH_INFLATE) != 0 && in_input->DeflatedLength > 0)
+		benchMeasure("inflate", in_input, NULL, benchInflate, in_input->VGMLength);
+
+	if ((in_benchmarks & BENCH_PARSE) != 0)
+		benchMeasure("parse", in_input, NULL, benchParse, in_input->VGMLength);
+
+	if ((in_benchmarks & BENCH_ENCODE) != 0)
+		benchMeasure("encode", in_input, NULL, benchEncode, in_input->PSGLength);
+
+	if ((in_benchmarks & BENCH_COMPRESS) != 0)
+		benchMeasure("compress", in_input, benchCompressPrepare, benchCompress, in_input->PSGLength);
+
+	if ((in_benchmarks & BENCH_RENDER) != 0)
+		benchMeasure("render", in_input, NULL, benchRender, in_input->PSGLength);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Measures the run time of a benchmark function. The function is warmed up then repeated
+// until the minimum measurement time elapsed (but at least BENCH_MIN_REPETITION times).
+// Very slow functions (longer than the measurement time) are run only once after the first run.
+static void benchMeasure(const char* in_name, BenchInput* in_input, BenchFunction in_prepare, BenchFunction in_run, int in_byte_count)
+{
+	double start_time;
+	double run_time;
+	double first_run_time;
+	double total_time;
+	double best_time;
+	uint32_t frame_count;
+	int repetition;
+	int min_repetition;
+	char frame_rate[32];
+
+	// warm-up
+	if (in_prepare != NULL)
+		in_prepare(in_input);
+
+	start_time = benchGetTime();
+	in_run(in_input);
+	first_run_time = benchGetTime() - start_time;
+
+	total_time = first_run_time;
+	while (total_time < l_min_time / BENCH_WARMUP_TIME_RATIO)
+	{
+		if (in_prepare != NULL)
+			in_prepare(in_input);
+
+		start_time = benchGetTime();
+		in_run(in_input);
+		total_time += benchGetTime() - start_time;
+	}
+
+	// measurement
+	min_repetition = (first_run_time > l_min_time) ? 1 : BENCH_MIN_REPETITION;
+	repetition = 0;
+	total_time = 0;
+	best_time = 0;
+	frame_count = 0;
+	while (repetition < min_repetition || total_time < l_min_time)
+	{
+		if (in_prepare != NULL)
+			in_prepare(in_input);
+
+		start_time = benchGetTime();
+		frame_count = in_run(in_input);
+		run_time = benchGetTime() - start_time;
+
+		if (repetition == 0 || run_time < best_time)
+			best_time = run_time;
+
+		total_time += run_time;
+		repetition++;
+	}
+
+	// report
+	if (best_time <= 0)
+		best_time = 1e-9;
+
+	if (frame_count > 0)
+		sprintf(frame_rate, "%12.0f", frame_count / best_time);
+	else
+		sprintf(frame_rate, "%12s", "-");
+
+	printf("%-9s %-20s %9d %5d %10.3f %10.3f %10.2f %s\n", in_name, in_input->Name, in_byte_count, repetition,
+		best_time * 1000, total_time * 1000 / repetition, in_byte_count / best_time / 1000000.0, frame_rate);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets high resolution time in seconds
+static double benchGetTime(void)
+{
+	LARGE_INTEGER counter;
+	LARGE_INTEGER frequency;
+
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+
+	return (double)counter.QuadPart / frequency.QuadPart;
+}
+
+/*****************************************************************************/
+/* Benchmark functions                                                       */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Inflates the deflate stream of the VGM file
+static uint32_t benchInflate(BenchInput* in_input)
+{
+	tinfl_decompress_mem_to_mem(l_work_buffer, l_work_buffer_length, in_input->Deflated, in_input->DeflatedLength, 0);
+
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Parses the VGM file and logs register writes, returns the number of frames
+static uint32_t benchParse(BenchInput* in_input)
+{
+	uint32_t frame_count = 0;
+
+	fileVGMOpen(in_input->VGM, in_input->VGMLength);
+	g_SN76489_state.ClockFrequency = in_input->ClockFrequency;
+	g_SN76489_state_2nd.ClockFrequency = in_input->ClockFrequency;
+	emuSN76489Reset(&g_SN76489_state);
+	fileVGMPlayerStart();
+	while (fileVGMPlayerIsBusy())
+	{
+		fileVGMPlayerProcess(l_frame_step);
+		emuSN76489ClearRegisterChanged(&g_SN76489_state);
+		frame_count++;
+	}
+	fileVGMClose();
+
+	return frame_count;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Encodes the stored register states into PSG stream, returns the number of frames
+static uint32_t benchEncode(BenchInput* in_input)
+{
+	emuSN76489State state;
+	int frame_index;
+
+	filePSGStart(in_input->PSG, in_input->FrameCount * 12 + 16);
+
+	for (frame_index = 0; frame_index < in_input->FrameCount; frame_index++)
+	{
+		state = in_input->Frames[frame_index];
+		filePSGUpdate(&state, false);
+	}
+
+	filePSGFinish(&state);
+
+	return in_input->FrameCount;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Restores uncompressed PSG stream before compression
+static uint32_t benchCompressPrepare(BenchInput* in_input)
+{
+	memcpy(l_work_buffer, in_input->PSG, in_input->PSGLength);
+
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Compresses the PSG stream
+static uint32_t benchCompress(BenchInput* in_input)
+{
+	filePSGCompress(l_work_buffer, in_input->PSGLength);
+
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Renders the PSG stream into audio samples, returns the number of frames
+static uint32_t benchRender(BenchInput* in_input)
+{
+	benchRenderInit(in_input->ClockFrequency, BENCH_SAMPLE_RATE, l_framerate);
+
+	return benchRenderPSG(in_input->PSG, in_input->PSGLength);
+}
+
+/*****************************************************************************/
+/* Local functions                                                           */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets numeric parameter from the command line
+static bool GetNumericParameter(int in_argc, char* in_argv[], int in_index, int in_min, int in_max, int* out_number)
+{
+	int number;
+
+	if (in_index + 1 < in_argc)
+	{
+		number = atoi(in_argv[in_index + 1]);
+
+		if (number < in_min || number>in_max)
+		{
+			printf("Invalid value: %d\n", number);
+			return false;
+		}
+		else
+		{
+			*out_number = number;
+
+			return true;
+		}
+	}
+	else
+	{
+		printf("Invalid parameter: %s\n", in_argv[in_index]);
+		return false;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Prints help text
+static void PrintUsage(void)
+{
+	printf("Usage:\n");
+	printf("PSGBench [options] [musicfile.vgm ...]\n");
+	printf("Options:\n");
+	printf("  -bench name    - runs only the given benchmark (inflate, parse, encode, compress, render)\n");
+	printf("  -framerate n   - sets the PSG framerate to n Hz. The default is 50Hz\n");
+	printf("  -level n       - sets the compression level of the compress benchmark (1..9). The default is 6\n");
+	printf("  -maxsize n     - sets the largest synthetic input size to n KB (1..1024). The default is 1024\n");
+	printf("  -mintime n     - sets the minimum measurement time of one benchmark to n ms. The default is 500ms\n");
+	printf("  -nosynthetic   - benchmarks only the given VGM files\n");
+	printf("  -?             - prints this help text\n");
+}
@@ -0,0 +1,349 @@
+/*****************************************************************************/
+/* PSGBench - Benchmark input data generator                                 */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#include <string.h>
+#include <benchData.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Constants
+
+// synthetic song parameters
+#define SONG_HEADER_LENGTH 0x40
+#define SONG_CLOCK 3579545
+#define SONG_NOTE_COUNT 16
+#define SONG_PATTERN_COUNT 4
+#define SONG_PATTERN_LENGTH 16
+#define SONG_FRAMES_PER_STEP 6
+#define SONG_MAX_FRAME_LENGTH 32
+#define SONG_SAMPLES_PER_FRAME 882
+
+// VGM commands
+#define VGM_CMD_PSG 0x50
+#define VGM_CMD_WAIT_882 0x63
+#define VGM_CMD_EOF 0x66
+
+// deflate encoder parameters
+#define DEFLATE_HASH_BITS 15
+#define DEFLATE_HASH_SIZE (1 << DEFLATE_HASH_BITS)
+#define DEFLATE_WINDOW_SIZE 32768
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+#define DEFLATE_END_OF_BLOCK 256
+
+///////////////////////////////////////////////////////////////////////////////
+// Types
+
+// Bit stream writer of the deflate encoder
+typedef struct
+{
+	uint8_t* Buffer;
+	int BufferLength;
+	int Pos;
+	uint32_t BitBuffer;
+	int BitCount;
+	bool Overflow;
+} DeflateBitStream;
+
+///////////////////////////////////////////////////////////////////////////////
+// Local functions
+static uint32_t benchDataRandom(uint32_t* inout_seed);
+static void benchDataWritePSG(uint8_t* in_buffer, int* inout_pos, uint8_t in_data);
+static void benchDataWriteBits(DeflateBitStream* in_stream, uint32_t in_bits, int in_bit_count);
+static void benchDataWriteCode(DeflateBitStream* in_stream, uint32_t in_code, int in_code_length);
+static void benchDataWriteLiteral(DeflateBitStream* in_stream, int in_symbol);
+static void benchDataWriteMatch(DeflateBitStream* in_stream, int in_length, int in_distance);
+
+///////////////////////////////////////////////////////////////////////////////
+// Module global variables
+
+// deflate length and distance code tables (RFC 1951 3.2.5)
+static const uint16_t l_length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t l_length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t l_distance_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t l_distance_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static int l_hash_head[DEFLATE_HASH_SIZE];
+
+///////////////////////////////////////////////////////////////////////////////
+// Creates a synthetic, chiptune like VGM file (repeated patterns, volume envelopes, vibrato,
+// noise drums) with approximately the given length. Returns the length of the created file.
+int benchDataCreateVGM(uint32_t in_seed, int in_length, uint8_t* out_buffer, int in_buffer_length)
+{
+	static const uint8_t envelope[] = { 0, 1, 2, 3, 4, 6, 8, 10, 12, 15 };
+	uint16_t notes[SONG_NOTE_COUNT];
+	uint16_t patterns[SONG_PATTERN_COUNT][SONG_PATTERN_LENGTH];
+	uint32_t seed = in_seed;
+	uint32_t total_samples = 0;
+	uint16_t note;
+	int pattern;
+	int step;
+	int frame;
+	int pos;
+	int i;
+
+	if (in_length > in_buffer_length)
+		in_length = in_buffer_length;
+
+	if (in_length < SONG_HEADER_LENGTH + SONG_MAX_FRAME_LENGTH + 1)
+		return 0;
+
+	// create note pool and patterns
+	for (i = 0; i < SONG_NOTE_COUNT; i++)
+		notes[i] = (uint16_t)(100 + benchDataRandom(&seed) % 800);
+
+	for (pattern = 0; pattern < SONG_PATTERN_COUNT; pattern++)
+	{
+		for (step = 0; step < SONG_PATTERN_LENGTH; step++)
+		{
+			if (benchDataRandom(&seed) % 10 < 6)
+				patterns[pattern][step] = notes[benchDataRandom(&seed) % SONG_NOTE_COUNT];
+			else
+				patterns[pattern][step] = 0;
+		}
+	}
+
+	// create song data frame by frame
+	pos = SONG_HEADER_LENGTH;
+	pattern = 0;
+	step = SONG_PATTERN_LENGTH - 1;
+	frame = SONG_FRAMES_PER_STEP;
+	while (pos + SONG_MAX_FRAME_LENGTH + 1 <= in_length)
+	{
+		// next step, next pattern
+		if (frame == SONG_FRAMES_PER_STEP)
+		{
+			frame = 0;
+			step++;
+
+			if (step == SONG_PATTERN_LENGTH)
+			{
+				step = 0;
+				pattern = benchDataRandom(&seed) % SONG_PATTERN_COUNT;
+			}
+		}
+
+		note = patterns[pattern][step];
+
+		// lead and bass with volume envelopes, vibrato on the third channel
+		if (note != 0)
+		{
+			if (frame == 0)
+			{
+				benchDataWritePSG(out_buffer, &pos, 0x80 | (note & 0x0f));
+				benchDataWritePSG(out_buffer, &pos, (note >> 4) & 0x3f);
+				benchDataWritePSG(out_buffer, &pos, 0xa0 | ((note * 2) & 0x0f));
+				benchDataWritePSG(out_buffer, &pos, ((note * 2) >> 4) & 0x3f);
+			}
+
+			benchDataWritePSG(out_buffer, &pos, 0x90 | envelope[(frame < 9) ? frame : 9]);
+			benchDataWritePSG(out_buffer, &pos, 0xb0 | envelope[(frame + 2 < 9) ? frame + 2 : 9]);
+
+			if (frame >= 2)
+			{
+				benchDataWritePSG(out_buffer, &pos, 0xc0 | ((note + (frame & 1) * 3) & 0x0f));
+				benchDataWritePSG(out_buffer, &pos, ((note + (frame & 1) * 3) >> 4) & 0x3f);
+			}
+
+			benchDataWritePSG(out_buffer, &pos, 0xd4);
+		}
+
+		// noise drum on every fourth step
+		if ((step & 3) == 0)
+		{
+			if (frame == 0)
+			{
+				benchDataWritePSG(out_buffer, &pos, 0xe0 | ((benchDataRandom(&seed) & 1) ? 4 : 5));
+				benchDataWritePSG(out_buffer, &pos, 0xf2);
+			}
+			else
+			{
+				benchDataWritePSG(out_buffer, &pos, 0xf0 | ((2 + frame * 3 < 15) ? 2 + frame * 3 : 15));
+			}
+		}
+
+		out_buffer[pos++] = VGM_CMD_WAIT_882;
+		total_samples += SONG_SAMPLES_PER_FRAME;
+		frame++;
+	}
+
+	out_buffer[pos++] = VGM_CMD_EOF;
+
+	// create header
+	memset(out_buffer, 0, SONG_HEADER_LENGTH);
+	*(uint32_t*)&out_buffer[0x00] = 0x206d6756ul;									// ident
+	*(uint32_t*)&out_buffer[0x04] = pos - 4;												// EOF offset
+	*(uint32_t*)&out_buffer[0x08] = 0x150;													// version
+	*(uint32_t*)&out_buffer[0x0c] = SONG_CLOCK;											// SN76489 clock
+	*(uint32_t*)&out_buffer[0x18] = total_samples;									// total number of samples
+	*(uint32_t*)&out_buffer[0x34] = SONG_HEADER_LENGTH - 0x34;			// data offset
+
+	return pos;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Compresses the buffer into a raw deflate stream using fixed Huffman codes and
+// a greedy hash matcher. Returns the length of the compressed data or 0 on overflow.
+int benchDataDeflate(uint8_t* in_buffer, int in_length, uint8_t* out_buffer, int in_buffer_length)
+{
+	DeflateBitStream stream;
+	uint32_t hash;
+	int candidate;
+	int match_length;
+	int max_length;
+	int pos;
+	int i;
+
+	memset(&stream, 0, sizeof(stream));
+	stream.Buffer = out_buffer;
+	stream.BufferLength = in_buffer_length;
+
+	for (i = 0; i < DEFLATE_HASH_SIZE; i++)
+		l_hash_head[i] = -1;
+
+	// final block with fixed Huffman codes
+	benchDataWriteBits(&stream, 1, 1);
+	benchDataWriteBits(&stream, 1, 2);
+
+	pos = 0;
+	while (pos < in_length)
+	{
+		match_length = 0;
+
+		if (pos + DEFLATE_MIN_MATCH <= in_length)
+		{
+			hash = ((in_buffer[pos] << 16) | (in_buffer[pos + 1] << 8) | in_buffer[pos + 2]) * 2654435761u >> (32 - DEFLATE_HASH_BITS);
+			candidate = l_hash_head[hash];
+			l_hash_head[hash] = pos;
+
+			if (candidate >= 0 && pos - candidate <= DEFLATE_WINDOW_SIZE)
+			{
+				max_length = in_length - pos;
+				if (max_length > DEFLATE_MAX_MATCH)
+					max_length = DEFLATE_MAX_MATCH;
+
+				while (match_length < max_length && in_buffer[candidate + match_length] == in_buffer[pos + match_length])
+					match_length++;
+			}
+		}
+
+		if (match_length >= DEFLATE_MIN_MATCH)
+		{
+			benchDataWriteMatch(&stream, match_length, pos - candidate);
+			pos += match_length;
+		}
+		else
+		{
+			benchDataWriteLiteral(&stream, in_buffer[pos]);
+			pos++;
+		}
+	}
+
+	benchDataWriteLiteral(&stream, DEFLATE_END_OF_BLOCK);
+
+	// flush remaining bits
+	benchDataWriteBits(&stream, 0, 7);
+
+	if (stream.Overflow)
+		return 0;
+
+	return stream.Pos;
+}
+
+/*****************************************************************************/
+/* Local functions                                                           */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Generates pseudo random number (15 bits)
+static uint32_t benchDataRandom(uint32_t* inout_seed)
+{
+	*inout_seed = *inout_seed * 1103515245u + 12345u;
+
+	return (*inout_seed >> 16) & 0x7fff;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes SN76489 register write command
+static void benchDataWritePSG(uint8_t* in_buffer, int* inout_pos, uint8_t in_data)
+{
+	in_buffer[(*inout_pos)++] = VGM_CMD_PSG;
+	in_buffer[(*inout_pos)++] = in_data;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes bits into the deflate stream (LSB first)
+static void benchDataWriteBits(DeflateBitStream* in_stream, uint32_t in_bits, int in_bit_count)
+{
+	in_stream->BitBuffer |= in_bits << in_stream->BitCount;
+	in_stream->BitCount += in_bit_count;
+
+	while (in_stream->BitCount >= 8)
+	{
+		if (in_stream->Pos < in_stream->BufferLength)
+			in_stream->Buffer[in_stream->Pos++] = (uint8_t)in_stream->BitBuffer;
+		else
+			in_stream->Overflow = true;
+
+		in_stream->BitBuffer >>= 8;
+		in_stream->BitCount -= 8;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes Huffman code into the deflate stream (MSB first)
+static void benchDataWriteCode(DeflateBitStream* in_stream, uint32_t in_code, int in_code_length)
+{
+	uint32_t reversed_code = 0;
+	int i;
+
+	for (i = 0; i < in_code_length; i++)
+		reversed_code |= ((in_code >> i) & 1) << (in_code_length - 1 - i);
+
+	benchDataWriteBits(in_stream, reversed_code, in_code_length);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes literal/length symbol using the fixed Huffman code
+static void benchDataWriteLiteral(DeflateBitStream* in_stream, int in_symbol)
+{
+	if (in_symbol < 144)
+		benchDataWriteCode(in_stream, 0x30 + in_symbol, 8);
+	else
+		if (in_symbol < 256)
+			benchDataWriteCode(in_stream, 0x190 + in_symbol - 144, 9);
+		else
+			if (in_symbol < 280)
+				benchDataWriteCode(in_stream, in_symbol - 256, 7);
+			else
+				benchDataWriteCode(in_stream, 0xc0 + in_symbol - 280, 8);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes length/distance pair using the fixed Huffman code
+static void benchDataWriteMatch(DeflateBitStream* in_stream, int in_length, int in_distance)
+{
+	int code;
+
+	code = 28;
+	while (l_length_base[code] > in_length)
+		code--;
+
+	benchDataWriteLiteral(in_stream, 257 + code);
+	benchDataWriteBits(in_stream, in_length - l_length_base[code], l_length_extra[code]);
+
+	code = 29;
+	while (l_distance_base[code] > in_distance)
+		code--;
+
+	benchDataWriteCode(in_stream, code, 5);
+	benchDataWriteBits(in_stream, in_distance - l_distance_base[code], l_distance_extra[code]);
+}
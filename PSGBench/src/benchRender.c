@@ -0,0 +1,103 @@
+/*****************************************************************************/
+/* PSGBench - PSG rendering benchmark                                        */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+
+// The PSGPlayer sound chip emulator uses the same function and type names as the
+// VGM2PSG register logger, so it is compiled into this module under private names.
+// The shared PSG decoder of the PSGPlayer is compiled into this module as well.
+// (this file must be compiled with the PSGPlayer include folder)
+#define emuSN76489State emuRenderSN76489State
+#define emuSN76489Reset emuRenderSN76489Reset
+#define emuSN76496WriteRegister emuRenderSN76496WriteRegister
+#define emuSN76489RenderAudioStream emuRenderSN76489RenderAudioStream
+#define emuSN76489SetPanning emuRenderSN76489SetPanning
+#define emuSN76489SetStereo emuRenderSN76489SetStereo
+
+#include <string.h>
+#include "../../PSGPlayer/src/emuSN76489.c"
+#include "../../PSGPlayer/src/filePSGDecoder.c"
+#include <benchRender.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Constants
+#define RENDER_MAX_FRAME_SAMPLE_COUNT 4096
+
+///////////////////////////////////////////////////////////////////////////////
+// Global variables (used by the emulator)
+uint16_t g_sample_rate = 44100;
+
+///////////////////////////////////////////////////////////////////////////////
+// Module global variables
+static emuSN76489State l_render_state;
+static uint32_t l_clock_frequency;
+static uint16_t l_frame_sample_count;
+static int16_t l_frame_buffer[RENDER_MAX_FRAME_SAMPLE_COUNT];
+
+///////////////////////////////////////////////////////////////////////////////
+// Sets rendering parameters
+void benchRenderInit(uint32_t in_clock_frequency, uint16_t in_sample_rate, int in_framerate)
+{
+	g_sample_rate = in_sample_rate;
+
+	l_clock_frequency = in_clock_frequency;
+	l_frame_sample_count = (uint16_t)(in_sample_rate / in_framerate);
+	if (l_frame_sample_count > RENDER_MAX_FRAME_SAMPLE_COUNT)
+		l_frame_sample_count = RENDER_MAX_FRAME_SAMPLE_COUNT;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Renders the whole PSG stream frame by frame (loop is not repeated).
+// Returns the number of rendered frames.
+uint32_t benchRenderPSG(uint8_t* in_psg_buffer, int in_psg_length)
+{
+	PSGDecoderType decoder;
+	PSGDecoderEvent event;
+	uint32_t frame_count = 0;
+	int wait_count;
+
+	emuSN76489Reset(&l_render_state);
+	l_render_state.ClockFrequency = l_clock_frequency;
+	l_render_state.ChannelCount = 1;
+
+	filePSGDecoderInit(&decoder, in_psg_buffer, in_psg_length);
+
+	while (true)
+	{
+		switch (filePSGDecoderNext(&decoder, &event))
+		{
+			// register write
+			case PSGEvent_Write:
+				emuSN76496WriteRegister(&l_render_state, event.Command);
+				break;
+
+			// end of frame, render frame and wait frames
+			case PSGEvent_EndOfFrame:
+				wait_count = event.WaitFrames;
+				while (wait_count > 0)
+				{
+					memset(l_frame_buffer, 0, l_frame_sample_count * sizeof(int16_t));
+					emuSN76489RenderAudioStream(&l_render_state, l_frame_buffer, l_frame_sample_count, 1);
+					frame_count++;
+					wait_count--;
+				}
+				break;
+
+			case PSGEvent_End:
+			case PSGEvent_EndOfBuffer:
+				return frame_count;
+
+			// loop start, substring references and reserved codes are ignored
+			default:
+				break;
+		}
+	}
+}
@@ -1,63 +1,255 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fileMap.h>
+#include <filePSGDecoder.h>
 
-FILE* fIN;
-FILE* fOUT;
-
-#define BUF_SIZE        65536
-#define MIN_LEN         4
-#define MAX_LEN         51        // 47+4
+#define OUTPUT_BUFFER_SIZE (1024 * 1024)
 
-#define PSG_SUBSTRING   0x08
+// register state of one decoded frame (used by the verification)
+typedef struct
+{
+  PSGDecoderEventType EndType;    // end of frame, end of data or end of buffer
+  uint16_t Registers[PSG_DECODER_REGISTER_COUNT];
+  uint8_t WaitFrames;
+  int LoopCount;                  // number of loop markers in the frame
+  uint32_t MacroHash;             // hash of the macro starts of the frame
+  uint8_t Stereo;                 // stereo register at the end of the frame
+} FrameState;
+
+void WriteOutput(const unsigned char* data, int length);
+void FlushOutput(void);
+int VerifyOutput(const char* output_file_name);
+void DecodeFrame(PSGDecoderType* frame_decoder, FrameState* frame);
+
+FileMapType fIN;
+FILE* fOUT;
 
-unsigned char buf[BUF_SIZE];
+PSGDecoderType decoder;
 
 int size;
 
+unsigned char output_buffer[OUTPUT_BUFFER_SIZE];
+int output_buffer_pos = 0;
+int output_size = 0;
+
 
 int main(int argc, char* argv[])
 {
 
-  int i, offset;
-  int output_size = 0;
-  int length;
+  PSGDecoderEvent event;
+  unsigned char command[4];
+  int command_length;
+  int error = 0;
+  int verify = 0;
+
+  if (argc == 4 && _strcmpi(argv[3], "-verify") == 0)
+    verify = 1;
 
-  if (argc != 3)
+  if (argc != 3 && !verify)
   {
-    printf("Usage: psgdecomp inputfile.PSG outputfile.PSG\n");
+    printf("Usage: psgdecomp inputfile.PSG outputfile.PSG [-verify]\n");
     return (1);
   }
 
-  fIN = fopen(argv[1], "rb");
-  size = (int)fread(&buf, 1, BUF_SIZE, fIN);      // read input file
-  fclose(fIN);
+  if (!fileMapOpen(&fIN, argv[1]))      // map input file
+  {
+    printf("Error: can't open %s\n", argv[1]);
+    return (1);
+  }
+
+  size = fIN.Length;
 
   printf("Info: input file size is %d bytes\n", size);
   fOUT = fopen(argv[2], "wb");
+  if (fOUT == NULL)
+  {
+    printf("Error: can't create %s\n", argv[2]);
+    fileMapClose(&fIN);
+    return (1);
+  }
 
-  for (i = 0; i < size; i++)
+  // every command is written as it was decoded, the substring references are replaced by their content
+  filePSGDecoderInit(&decoder, fIN.Data, size);
+
+  while (!error && filePSGDecoderNext(&decoder, &event) != PSGEvent_EndOfBuffer)
   {
-    if ((buf[i] >= PSG_SUBSTRING) && (buf[i] <= PSG_SUBSTRING + MAX_LEN - MIN_LEN))
-    {
+    command[0] = event.Command;
+    command_length = 1;
 
-      offset = buf[i + 1] + (buf[i + 2] * 256);
-      length = buf[i] - PSG_SUBSTRING + MIN_LEN;
-      output_size += length;
-      fwrite(&buf[offset], 1, length, fOUT);
-      i += 2;  // skip two additional bytes
-    }
-    else
+    switch (event.Type)
     {
-      fwrite(&buf[i], 1, 1, fOUT);
-      output_size++;
+      case PSGEvent_ReferenceEnter:
+      case PSGEvent_LongReferenceEnter:
+        if (event.ReferenceOffset + event.ReferenceLength > size)
+        {
+          printf("Error: invalid substring at 0x%04X\n", event.Position);
+          error = 1;
+        }
+        command_length = 0;
+        break;
+
+      case PSGEvent_ReferenceExit:
+        command_length = 0;
+        break;
+
+      case PSGEvent_ClockTag:
+        command[1] = (unsigned char)event.Value;
+        command_length = 2;
+        break;
+
+      case PSGEvent_MacroDictionary:
+        // the dictionary is copied without change
+        WriteOutput(&fIN.Data[event.Position], event.Length);
+        command_length = 0;
+        break;
+
+      case PSGEvent_Macro:
+        command[1] = (unsigned char)(0x80 | ((event.Register / 2) << 5) | event.MacroIndex);
+        command_length = 2;
+        if (event.Macro != NULL && (event.Register & 1) == 0)
+        {
+          // base tone value of the tone macros
+          command[2] = (unsigned char)(0x40 | (event.Value & 0x0f));
+          command[3] = (unsigned char)(0x40 | (event.Value >> 4));
+          command_length = 4;
+        }
+        break;
+
+      case PSGEvent_Stereo:
+        command[1] = (unsigned char)(0x40 | (event.Value & 0x0f));
+        command[2] = (unsigned char)(0x40 | (event.Value >> 4));
+        command_length = 3;
+        break;
+
+      default:
+        break;
     }
 
+    WriteOutput(command, command_length);
   }
 
+  FlushOutput();
   fclose(fOUT);
 
   printf("%d bytes written\n", output_size);
+
+  // compare the register state of every frame of the written file with the original
+  if (!error && verify)
+    error = VerifyOutput(argv[2]);
+
+  fileMapClose(&fIN);
+
   printf("Info: done!\n");
-  return(0);
-}
\ No newline at end of file
+  return(error);
+}
+
+// copies the data into the output buffer, the buffer is written into the file when it is full
+void WriteOutput(const unsigned char* data, int length)
+{
+  int block_length;
+
+  output_size += length;
+
+  while (length > 0)
+  {
+    if (output_buffer_pos == OUTPUT_BUFFER_SIZE)
+      FlushOutput();
+
+    block_length = OUTPUT_BUFFER_SIZE - output_buffer_pos;
+    if (block_length > length)
+      block_length = length;
+
+    memcpy(&output_buffer[output_buffer_pos], data, block_length);
+    output_buffer_pos += block_length;
+    data += block_length;
+    length -= block_length;
+  }
+}
+
+// writes the content of the output buffer into the file
+void FlushOutput(void)
+{
+  if (output_buffer_pos > 0)
+    fwrite(output_buffer, 1, output_buffer_pos, fOUT);
+
+  output_buffer_pos = 0;
+}
+
+// decodes the original and the written file frame by frame and compares the register states
+// returns 0 when they are the same
+int VerifyOutput(const char* output_file_name)
+{
+  FileMapType output_file;
+  PSGDecoderType original_decoder;
+  PSGDecoderType output_decoder;
+  FrameState original_frame;
+  FrameState output_frame;
+  uint32_t frame_count = 0;
+
+  if (!fileMapOpen(&output_file, output_file_name))
+  {
+    printf("Error: can't open %s for verification\n", output_file_name);
+    return (1);
+  }
+
+  filePSGDecoderInit(&original_decoder, fIN.Data, fIN.Length);
+  filePSGDecoderInit(&output_decoder, output_file.Data, output_file.Length);
+
+  do
+  {
+    DecodeFrame(&original_decoder, &original_frame);
+    DecodeFrame(&output_decoder, &output_frame);
+
+    if (memcmp(&original_frame, &output_frame, sizeof(FrameState)) != 0)
+    {
+      printf("Error: verification failed at frame %u\n", frame_count);
+      fileMapClose(&output_file);
+      return (1);
+    }
+
+    frame_count += original_frame.WaitFrames;
+  } while (original_frame.EndType == PSGEvent_EndOfFrame);
+
+  fileMapClose(&output_file);
+
+  printf("Info: verified %u frames\n", frame_count);
+  return (0);
+}
+
+// decodes the commands until the end of the next frame
+void DecodeFrame(PSGDecoderType* frame_decoder, FrameState* frame)
+{
+  PSGDecoderEvent event;
+
+  memset(frame, 0, sizeof(FrameState));
+
+  while (1)
+  {
+    switch (filePSGDecoderNext(frame_decoder, &event))
+    {
+      case PSGEvent_EndOfFrame:
+        frame->WaitFrames = event.WaitFrames;
+        // fall through
+
+      case PSGEvent_End:
+      case PSGEvent_EndOfBuffer:
+        frame->EndType = event.Type;
+        memcpy(frame->Registers, frame_decoder->Registers, sizeof(frame->Registers));
+        frame->Stereo = frame_decoder->Stereo;
+        return;
+
+      case PSGEvent_Loop:
+        frame->LoopCount++;
+        break;
+
+      case PSGEvent_Macro:
+        frame->MacroHash = (frame->MacroHash * 31 + event.Register) * 31 + event.MacroIndex;
+        frame->MacroHash = frame->MacroHash * 31 + event.Value;
+        break;
+
+      default:
+        break;
+    }
+  }
+}
@@ -28,6 +28,8 @@ typedef struct
 	uint16_t Registers[8];
 
 	int8_t Paning[4]; // -127 ... 0 ... 127 (Left-Center-Right)
+	uint8_t Stereo;		// Game Gear stereo register (bit 0..3 - channel on the right, bit 4..7 - channel on the left)
+	uint8_t ChannelCount;	// rendered channels (1 - mono, 2 - interleaved left and right samples)
 
 	uint16_t Frequency[3];
 	uint16_t Counter[3];
@@ -47,5 +49,6 @@ void emuSN76489Reset(emuSN76489State* in_state);
 void emuSN76496WriteRegister(emuSN76489State* in_state, uint8_t in_data);
 void emuSN76489RenderAudioStream(emuSN76489State* in_state, int16_t* out_stream, uint16_t in_sample_count, uint8_t in_attenuation);
 void emuSN76489SetPanning(emuSN76489State* in_state, uint8_t in_channel, uint8_t in_panning);
+void emuSN76489SetStereo(emuSN76489State* in_state, uint8_t in_stereo);
 
 #endif
\ No newline at end of file
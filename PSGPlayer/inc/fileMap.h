@@ -0,0 +1,37 @@
+/*****************************************************************************/
+/* Memory mapped file loader                                                 */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+#ifndef __fileMap_h
+#define __fileMap_h
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#include <stdint.h>
+#include <stdbool.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Types
+
+// Read only view of a whole file
+typedef struct
+{
+	const uint8_t* Data;		// content of the file
+	int Length;							// length of the file in bytes
+
+	void* FileHandle;				// system handles of the mapping
+	void* MappingHandle;
+} FileMapType;
+
+///////////////////////////////////////////////////////////////////////////////
+// Function prototypes
+bool fileMapOpen(FileMapType* out_file_map, const char* in_file_name);
+void fileMapClose(FileMapType* inout_file_map);
+
+#endif
\ No newline at end of file
@@ -16,16 +16,105 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <emuSN76489.h>
+#include <filePSGDecoder.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Constants
+
+// Clock frequencies of the clock tag values (clock frequency of the tone register values)
+#define PSG_CLOCK_3579KHZ 3579545
+#define PSG_CLOCK_3125KHZ 3125000
+
+// Macros (extended format)
+#define PSG_MACRO_REGISTER_COUNT 8
+
+// Frame table
+#define PSG_FRAME_TABLE_NO_LOOP 0xffffffff
+#define PSG_FRAME_TABLE_MAX_MACRO_WRITES (PSG_MACRO_REGISTER_COUNT / 2 * 3)	// tone (two bytes) and attenuation writes of every channel
+#define PSG_FRAME_TABLE_STEREO 0x02			// stereo change in the writes of the frame table (followed by the stereo register value)
+
+///////////////////////////////////////////////////////////////////////////////
+// Types
+
+// Running macro of a sound chip register
+typedef struct
+{
+	const uint8_t* Step;			// next step of the macro
+	uint8_t RemainingSteps;
+	uint16_t Base;						// base value of the tone macros
+} PSGMacroSlot;
+
+// Pre-decoded PSG file: register writes of the frames in flat arrays (structure of arrays)
+// Every frame record is a run of register writes followed by waiting, the last record (wait count 0) is the end of the song.
+typedef struct
+{
+	uint32_t FrameCount;				// number of frame records (including the end of the song record)
+	uint32_t WriteCount;				// number of written bytes
+	uint32_t* FrameWriteIndex;	// index of the first write of the frame records (FrameCount + 1 entries)
+	uint8_t* FrameWaitCount;		// number of frames to wait after the writes of the record (0 - end of the song)
+	uint8_t* Writes;						// written bytes of all frames (and the stereo changes)
+	uint32_t LoopFrame;					// record of the loop marker (PSG_FRAME_TABLE_NO_LOOP - the song doesn't loop)
+	uint32_t LoopWriteIndex;		// first write after the loop marker
+	uint32_t MemorySize;				// allocated memory in bytes
+} PSGFrameTableType;
+
+// PSG player instance state (all state of one playing song, the functions using it are reentrant)
+typedef struct
+{
+	// PSG data decoder
+	PSGDecoderType Decoder;
+	uint32_t PSGClockFrequency;		// clock frequency of the tone values given by the clock tag (0 - no clock tag)
+
+	// loop handling
+	int PlayCount;
+	int MaxPlayCount;		// number of times the end of the song is reached before stopping (0 - loop forever)
+
+	// macros
+	PSGMacroSlot MacroSlots[PSG_MACRO_REGISTER_COUNT];
+	uint8_t PendingWaitFrames;	// wait frames are processed one by one when the file has macros
+
+	// pre-decoded playback (NULL - the commands are decoded from the PSG data while playing)
+	PSGFrameTableType* FrameTable;
+	uint32_t FrameTableRecord;
+	uint32_t FrameTableWriteIndex;
+
+	// frame and wait variables
+	uint32_t CurrentFrameCount;
+	uint16_t FrameSampleCount;
+	uint16_t WaitSampleCount;
+	uint16_t WaitSamplePos;
+	bool Finished;
+
+	// sound chip emulation
+	emuSN76489State SN76489;
+	uint8_t OutputAttenuation;	// divisor of the rendered samples (the instances of the dual-chip songs are mixed)
+} PSGPlayerType;
 
 ///////////////////////////////////////////////////////////////////////////////
 // Functions
 void filePSGPlayerInit(void);
-void filePSGPlayerStart(uint8_t* in_psg_buffer, int in_psg_file_length);
+void filePSGPlayerStart(const uint8_t* in_psg_buffer, int in_psg_file_length);
+void filePSGPlayerStartSong(const uint8_t* in_psg_buffer, int in_psg_file_length, uint32_t in_song_start);
+void filePSGPlayerStartDualChipSong(const uint8_t* in_psg_buffer, int in_psg_file_length, uint32_t in_first_song_start, uint32_t in_second_song_start);
 void filePSGPlayerProcess(void);
 bool filePSGPlayerIsBusy(void);
 uint32_t filePSGGetCurrentSamplePos(void);
 
 void filePSGSetFramerate(int in_framerate);
 void filePSGSetClockFrequency(int in_clock_frequency);
+void filePSGSetFrameTable(PSGFrameTableType* in_frame_table);
+void filePSGPlayerSeek(uint32_t in_frame);
+
+void filePSGInstanceInit(PSGPlayerType* in_player, int in_clock_frequency, int in_framerate, int in_channel_count);
+void filePSGInstanceStart(PSGPlayerType* in_player, const uint8_t* in_psg_buffer, int in_psg_file_length, int in_max_play_count);
+void filePSGInstanceStartSong(PSGPlayerType* in_player, const uint8_t* in_psg_buffer, int in_psg_file_length, uint32_t in_song_start, int in_max_play_count);
+int filePSGInstanceRender(PSGPlayerType* in_player, int16_t* out_buffer, int in_sample_count);
+bool filePSGInstanceIsBusy(PSGPlayerType* in_player);
+uint32_t filePSGInstanceGetCurrentSamplePos(PSGPlayerType* in_player);
+void filePSGInstanceSetFrameTable(PSGPlayerType* in_player, PSGFrameTableType* in_frame_table);
+void filePSGInstanceSeek(PSGPlayerType* in_player, uint32_t in_frame);
+
+bool filePSGFrameTableCreate(PSGFrameTableType* out_frame_table, const uint8_t* in_psg_buffer, int in_psg_file_length, uint32_t in_song_start, uint32_t in_memory_limit);
+void filePSGFrameTableFree(PSGFrameTableType* inout_frame_table);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,123 @@
+/*****************************************************************************/
+/* PSG file decoder (shared by PSGPlayer, PSG2TXT and PSGDecompress)         */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+#ifndef __filePSGDecoder_h
+#define __filePSGDecoder_h
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#include <stdint.h>
+#include <stdbool.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Constants
+
+// Clock tag values (clock frequency of the tone register values)
+#define PSG_CLOCK_TAG_3579KHZ 0
+#define PSG_CLOCK_TAG_3125KHZ 1
+
+// Macros (extended format)
+#define PSG_MACRO_MAX_COUNT 32
+#define PSG_MACRO_TONE 0x80
+#define PSG_MACRO_LENGTH_MASK 0x7f
+
+// Game Gear stereo register (bit 0..3 - channel on the right, bit 4..7 - channel on the left)
+#define PSG_STEREO_DEFAULT 0xff
+
+// Number of the sound chip registers
+#define PSG_DECODER_REGISTER_COUNT 8
+
+// Song bank (song count byte followed by the little-endian offsets of the songs, the substring offsets are relative to the beginning of the bank)
+#define PSG_BANK_MAX_SONG_COUNT 255
+#define PSG_BANK_TABLE_LENGTH(count) (1 + (count) * 2)
+
+///////////////////////////////////////////////////////////////////////////////
+// Types
+
+// Decoded PSG file events
+typedef enum
+{
+	PSGEvent_Write,							// register write (latch or data byte)
+	PSGEvent_EndOfFrame,				// end of frame with the number of frames to wait
+	PSGEvent_Loop,							// loop begin marker
+	PSGEvent_End,								// end of data marker
+	PSGEvent_EndOfBuffer,				// end of the buffer without end of data marker
+	PSGEvent_ReferenceEnter,		// substring reference, the following events are decoded from the substring
+	PSGEvent_ReferenceExit,			// end of the substring, the decoding continues after the reference
+	PSGEvent_ClockTag,					// clock tag at the beginning of the file
+	PSGEvent_MacroDictionary,		// macro dictionary at the beginning of the file
+	PSGEvent_Macro,							// macro start
+	PSGEvent_LongReferenceEnter,	// long substring (extended format), the end of the block is a reference exit
+	PSGEvent_Stereo,						// Game Gear stereo (extended format)
+	PSGEvent_Reserved						// reserved escape byte
+} PSGDecoderEventType;
+
+// Decoded event
+typedef struct
+{
+	PSGDecoderEventType Type;
+	uint32_t Position;					// file offset of the command byte
+	uint8_t Command;						// command byte (the written byte of register writes)
+	uint8_t Register;						// register index of register writes and macros (channel * 2 + 0 tone, 1 attenuation)
+	uint16_t Value;							// register value after the write, clock id of the clock tag, number of macros of the dictionary, base tone value of the tone macros, stereo register
+	uint8_t WaitFrames;					// number of frames of end of frame (1..8)
+	uint16_t ReferenceOffset;		// substring offset of the reference
+	uint16_t ReferenceLength;		// substring length of the reference
+	uint32_t Length;						// length of the macro dictionary in bytes
+	uint8_t MacroIndex;					// macro index of the macro start
+	const uint8_t* Macro;				// macro definition (type/length byte) of the macro start (NULL - invalid index)
+} PSGDecoderEvent;
+
+// Decoder state (all state of one decoded file, the functions using it are reentrant)
+typedef struct
+{
+	// PSG buffer
+	const uint8_t* Buffer;
+	uint32_t BufferLength;
+	uint32_t SongStart;					// offset of the song in the buffer (non zero only for the songs of a bank)
+
+	// current position
+	const uint8_t* CurrentPointer;
+	uint32_t CurrentRemainingBytes;
+	const uint8_t* ResumePointer;
+	uint32_t ResumeRemainingBytes;
+	bool InSubstring;
+	const uint8_t* LongResumePointer;
+	uint32_t LongResumeRemainingBytes;
+	bool InLongSubstring;				// the long substring block can contain substrings
+
+	// loop position (NULL - no loop marker found yet)
+	const uint8_t* LoopStart;
+	uint32_t LoopStartRemainingBytes;
+
+	// register state
+	uint8_t LatchRegister;
+	uint16_t Registers[PSG_DECODER_REGISTER_COUNT];
+	uint8_t Stereo;
+
+	// file header
+	bool MusicDataStarted;			// the clock tag and the macro dictionary are accepted only before the music data
+	int ClockTag;								// clock id of the clock tag (-1 - no clock tag)
+	const uint8_t* Macros[PSG_MACRO_MAX_COUNT];		// macro definitions of the dictionary (type/length byte)
+	int MacroCount;
+} PSGDecoderType;
+
+///////////////////////////////////////////////////////////////////////////////
+// Functions
+void filePSGDecoderInit(PSGDecoderType* out_decoder, const uint8_t* in_buffer, uint32_t in_buffer_length);
+void filePSGDecoderInitSong(PSGDecoderType* out_decoder, const uint8_t* in_buffer, uint32_t in_buffer_length, uint32_t in_song_start);
+PSGDecoderEventType filePSGDecoderNext(PSGDecoderType* inout_decoder, PSGDecoderEvent* out_event);
+void filePSGDecoderReadHeader(PSGDecoderType* inout_decoder);
+bool filePSGDecoderRestartLoop(PSGDecoderType* inout_decoder);
+
+int filePSGDecoderGetBankSongCount(const uint8_t* in_bank, uint32_t in_bank_length);
+bool filePSGDecoderGetBankSong(const uint8_t* in_bank, uint32_t in_bank_length, int in_song_index, uint32_t* out_song_start);
+
+#endif
\ No newline at end of file
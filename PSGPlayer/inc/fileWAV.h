@@ -0,0 +1,38 @@
+/*****************************************************************************/
+/* PSGPlayer - WAV file writer                                               */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+#ifndef __fileWAV_h
+#define __fileWAV_h
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Types
+
+// WAV file writer state
+typedef struct
+{
+	FILE* File;
+	uint32_t DataLength;
+	uint16_t ChannelCount;
+	uint32_t SampleRate;
+} WAVFileType;
+
+///////////////////////////////////////////////////////////////////////////////
+// Function prototypes
+bool fileWAVCreate(WAVFileType* in_wav_file, char* in_filename, uint32_t in_sample_rate, uint16_t in_channel_count);
+bool fileWAVWriteSamples(WAVFileType* in_wav_file, int16_t* in_samples, int in_sample_count);
+bool fileWAVClose(WAVFileType* in_wav_file);
+
+#endif
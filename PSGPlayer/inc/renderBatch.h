@@ -0,0 +1,40 @@
+/*****************************************************************************/
+/* PSGPlayer - Parallel batch renderer                                       */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+#ifndef __renderBatch_h
+#define __renderBatch_h
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#include <stdint.h>
+#include <stdbool.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Types
+
+// Batch rendering settings
+typedef struct
+{
+	char* Directory;				// directory of the PSG files
+	char* WAVDirectory;			// output directory of the WAV files (NULL - hash only)
+	int ThreadCount;				// number of worker threads (0 - number of processors)
+	int ClockFrequency;
+	int Framerate;
+	int MaxPlayCount;				// number of times the song is played (loop repeat count + 1)
+	int ChannelCount;				// 1 - mono, 2 - stereo
+	int SongIndex;					// rendered song of the bank files (-1 - the files are not banks)
+	int FrameTableLimit;		// memory limit of the pre-decoded frame tables in kbytes (-1 - no pre-decoding, 0 - no limit)
+} RenderBatchSettings;
+
+///////////////////////////////////////////////////////////////////////////////
+// Function prototypes
+bool renderBatchRun(RenderBatchSettings* in_settings);
+
+#endif
@@ -14,12 +14,13 @@
 #include <stdio.h>
 #include <conio.h>
 #include <filePSG.h>
+#include <fileMap.h>
 #include <drvWaveOut.h>
+#include <renderBatch.h>
 
 ///////////////////////////////////////////////////////////////////////////////
 // Defines
 #define STOP_KEY VK_ESCAPE
-#define BUFFER_SIZE 1024*1024
 
 ///////////////////////////////////////////////////////////////////////////////
 // Local functions
@@ -29,8 +30,8 @@ static void PrintUsage(void);
 
 ///////////////////////////////////////////////////////////////////////////////
 // Global variables
-uint8_t g_psg_buffer[BUFFER_SIZE];
-uint32_t g_psg_length;
+FileMapType g_psg_file;
+PSGFrameTableType g_frame_table;
 
 ///////////////////////////////////////////////////////////////////////////////
 // Main function
@@ -40,6 +41,21 @@ int main(int argc, char* argv[])
 	DWORD sample_count;
 	int i;
 	int value;
+	int clock_frequency = 3579545;
+	int framerate = 50;
+	int start_time = 0;
+	int song_index = -1;
+	uint32_t song_start = 0;
+	uint32_t second_song_start = 0;
+	bool dual_chip = false;
+	bool frame_table_created = false;
+	RenderBatchSettings batch_settings;
+
+	batch_settings.Directory = NULL;
+	batch_settings.WAVDirectory = NULL;
+	batch_settings.ThreadCount = 0;
+	batch_settings.MaxPlayCount = 1;
+	batch_settings.FrameTableLimit = -1;
 
 	// title
 	printf("PSG Music file player (c) Laszlo Arvai 2023\n");
@@ -64,6 +80,7 @@ int main(int argc, char* argv[])
 					return -1;
 
 				filePSGSetFramerate(value);
+				framerate = value;
 				i++;
 			}
 			else
@@ -75,18 +92,102 @@ int main(int argc, char* argv[])
 						return -1;
 
 					filePSGSetClockFrequency(value);
+					clock_frequency = value;
 					i++;
 				}
 				else
 				{
-					if (_strcmpi(argv[i], "-?") == 0)
+					if (_strcmpi(argv[i], "-render-dir") == 0 && i + 1 < argc)
 					{
-						PrintUsage();
+						batch_settings.Directory = argv[++i];
 					}
 					else
 					{
-						printf("Invalid command line parameter: %s\n", argv[i]);
-						return -1;
+						if (_strcmpi(argv[i], "-wav") == 0 && i + 1 < argc)
+						{
+							batch_settings.WAVDirectory = argv[++i];
+						}
+						else
+						{
+							if (_strcmpi(argv[i], "-threads") == 0)
+							{
+								if (!GetNumericParameter(argc, argv, i, 1, 64, &value))
+									return -1;
+
+								batch_settings.ThreadCount = value;
+								i++;
+							}
+							else
+							{
+								if (_strcmpi(argv[i], "-loops") == 0)
+								{
+									if (!GetNumericParameter(argc, argv, i, 0, 100, &value))
+										return -1;
+
+									batch_settings.MaxPlayCount = value + 1;
+									i++;
+								}
+								else
+								{
+									if (_strcmpi(argv[i], "-predecode") == 0)
+									{
+										if (!GetNumericParameter(argc, argv, i, 0, 4000000, &value))
+											return -1;
+
+										batch_settings.FrameTableLimit = value;
+										i++;
+									}
+									else
+									{
+										if (_strcmpi(argv[i], "-start") == 0)
+										{
+											if (!GetNumericParameter(argc, argv, i, 0, 36000, &value))
+												return -1;
+
+											start_time = value;
+											i++;
+										}
+										else
+										{
+											if (_strcmpi(argv[i], "-song") == 0)
+											{
+												if (!GetNumericParameter(argc, argv, i, 0, PSG_BANK_MAX_SONG_COUNT - 1, &value))
+													return -1;
+
+												song_index = value;
+												i++;
+											}
+											else
+											{
+												if (_strcmpi(argv[i], "-stereo") == 0)
+												{
+													g_stereo_mode = true;
+												}
+												else
+												{
+													if (_strcmpi(argv[i], "-dual") == 0)
+													{
+														dual_chip = true;
+													}
+													else
+													{
+														if (_strcmpi(argv[i], "-?") == 0)
+														{
+															PrintUsage();
+														}
+														else
+														{
+															printf("Invalid command line parameter: %s\n", argv[i]);
+															return -1;
+														}
+													}
+												}
+											}
+										}
+									}
+								}
+							}
+						}
 					}
 				}
 			}
@@ -105,19 +206,86 @@ int main(int argc, char* argv[])
 		}
 	}
 
+	// render all files of a directory
+	if (batch_settings.Directory != NULL)
+	{
+		batch_settings.ClockFrequency = clock_frequency;
+		batch_settings.Framerate = framerate;
+		batch_settings.ChannelCount = g_stereo_mode ? 2 : 1;
+		batch_settings.SongIndex = song_index;
+
+		return renderBatchRun(&batch_settings) ? 0 : -1;
+	}
+
+	if (filename == NULL)
+	{
+		PrintUsage();
+		return -1;
+	}
+
 	// load PSG file
 	if (!LoadPSG(filename))
 	{
 		return -1;
 	}
 
+	// the dual-chip songs are two songs of the bank (first and second chip)
+	if (dual_chip && song_index < 0)
+		song_index = 0;
+
+	// song of a bank file
+	if (song_index >= 0)
+	{
+		if (!filePSGDecoderGetBankSong(g_psg_file.Data, g_psg_file.Length, song_index, &song_start))
+		{
+			printf("Invalid song index or bank file (the bank has %d songs)\n", filePSGDecoderGetBankSongCount(g_psg_file.Data, g_psg_file.Length));
+			fileMapClose(&g_psg_file);
+			return -1;
+		}
+
+		printf("Playing song %d of %d\n", song_index, filePSGDecoderGetBankSongCount(g_psg_file.Data, g_psg_file.Length));
+	}
+
+	// the second chip of the dual-chip song is the next song of the bank
+	if (dual_chip)
+	{
+		if (!filePSGDecoderGetBankSong(g_psg_file.Data, g_psg_file.Length, song_index + 1, &second_song_start))
+		{
+			printf("The second chip of the dual-chip song (song %d) is not in the bank\n", song_index + 1);
+			fileMapClose(&g_psg_file);
+			return -1;
+		}
+
+		printf("Playing song %d on the second chip\n", song_index + 1);
+	}
+
+	// pre-decode the song (falls back to decoding while playing when it doesn't fit into the memory limit)
+	if (batch_settings.FrameTableLimit >= 0)
+	{
+		if (filePSGFrameTableCreate(&g_frame_table, g_psg_file.Data, g_psg_file.Length, song_start, (uint32_t)batch_settings.FrameTableLimit * 1024))
+		{
+			printf("Pre-decoded: %u frames, %u bytes\n", g_frame_table.FrameCount, g_frame_table.MemorySize);
+			filePSGSetFrameTable(&g_frame_table);
+			frame_table_created = true;
+		}
+		else
+		{
+			printf("The song can't be pre-decoded within the memory limit, it is decoded while playing\n");
+		}
+	}
+
 	// open default wave out device
 	waveOpen();
 
 	printf("Press ESC to stop playback\n");
 
 	// starts PSG player
-	filePSGPlayerStart(g_psg_buffer, g_psg_length);
+	if (dual_chip)
+		filePSGPlayerStartDualChipSong(g_psg_file.Data, g_psg_file.Length, song_start, second_song_start);
+	else
+		filePSGPlayerStartSong(g_psg_file.Data, g_psg_file.Length, song_start);
+	if (start_time > 0)
+		filePSGPlayerSeek(start_time * framerate);
 	while(filePSGPlayerIsBusy())
 	{
 		filePSGPlayerProcess();
@@ -139,6 +307,9 @@ int main(int argc, char* argv[])
 	}
 
 	waveClose(false);
+	if (frame_table_created)
+		filePSGFrameTableFree(&g_frame_table);
+	fileMapClose(&g_psg_file);
 
 	printf("\r                 \n");
 
@@ -149,28 +320,13 @@ int main(int argc, char* argv[])
 // Loads PSG file
 static bool LoadPSG(char* in_file_name)
 {
-	FILE* psg_file;
-
-	// open PSG file
+	// open PSG file (the file is mapped into the memory, the player reads it directly)
 	printf("Opening: %s\n", in_file_name);
-	psg_file = fopen(in_file_name, "rb");
-	if (psg_file == NULL)
+	if (!fileMapOpen(&g_psg_file, in_file_name))
 	{
 		printf("Can't open file\n");
 		return false;
 	}
-	
-	// load file
-	g_psg_length = fread(g_psg_buffer, 1, BUFFER_SIZE, psg_file);
-
-	fclose(psg_file);
-
-	// check load result
-	if (g_psg_length == 0)
-	{
-		printf("Can't read file\n");
-		return false;
-	}
 
 	return true;
 }
@@ -210,8 +366,20 @@ static void PrintUsage(void)
 {
 	printf("Usage:\n");
 	printf("PSGPlay musicfile.psg [options]\n");
+	printf("PSGPlay bankfile.psg -song n [options]\n");
+	printf("PSGPlay bankfile.psg -dual [-song n] [options]\n");
+	printf("PSGPlay -render-dir directory [options]\n");
 	printf("Options:\n");
-	printf("  -clock n      - sets SN76489 clock frequency to n Hz. The default is 3579545Hz\n");
-	printf("  -framerate n  - sets the playback framerate to n Hz. The default is 50Hz\n");
-	printf("  -?            - prints this help text\n");
+	printf("  -clock n           - sets SN76489 clock frequency to n Hz. The default is 3579545Hz\n");
+	printf("  -framerate n       - sets the playback framerate to n Hz. The default is 50Hz\n");
+	printf("  -render-dir folder - renders all PSG files of the folder in parallel and prints PCM hashes and throughput\n");
+	printf("  -wav folder        - writes the rendered audio of '-render-dir' into WAV files of the folder\n");
+	printf("  -threads n         - number of rendering threads. The default is the number of processors\n");
+	printf("  -loops n           - number of loop repetitions when rendering. The default is 0\n");
+	printf("  -predecode n       - decodes the songs into a frame table before playing, n is the memory limit in kbytes (0 - no limit)\n");
+	printf("  -start n           - starts the playback at n seconds\n");
+	printf("  -song n            - plays the song n (0..) of a song bank created by 'VGM2PSG -bank' (renders the song n of every file with '-render-dir')\n");
+	printf("  -dual              - plays the song n and n + 1 of the bank on two sound chips (created by 'VGM2PSG -bank -dual split')\n");
+	printf("  -stereo            - stereo output, the Game Gear stereo commands pan the channels\n");
+	printf("  -?                 - prints this help text\n");
 }
\ No newline at end of file
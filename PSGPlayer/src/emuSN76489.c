@@ -19,6 +19,9 @@
 #define NOISE_INITIAL_STATE 0x8000
 #define NOISE_DEFAULT_TAP 0x0009
 #define NOISE_CONTROL_REGISTER 6
+#define STEREO_DEFAULT 0xff
+#define PANNING_LEFT -127
+#define PANNING_RIGHT 127
 
 ///////////////////////////////////////////////////////////////////////////////
 // Local functions
@@ -60,6 +63,7 @@ void emuSN76489Reset(emuSN76489State* in_state)
 		in_state->Amplitude[i] = 0;
 		in_state->Paning[i] = 0;
 	}
+	in_state->Stereo = STEREO_DEFAULT;
 
 	in_state->NoiseShiftRegister	= NOISE_INITIAL_STATE;
 	in_state->NoiseOutput					= in_state->NoiseShiftRegister & 1;
@@ -146,6 +150,31 @@ void emuSN76489SetPanning(emuSN76489State* in_state, uint8_t in_channel, uint8_t
 	in_state->Paning[in_channel] = in_panning;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Sets the Game Gear stereo register: the channels enabled on one side only are panned to that side,
+// the channels disabled on both sides are muted (stereo output only)
+void emuSN76489SetStereo(emuSN76489State* in_state, uint8_t in_stereo)
+{
+	uint8_t i;
+	bool right;
+	bool left;
+
+	for (i = 0; i < 4; i++)
+	{
+		right = (in_stereo & (0x01 << i)) != 0;
+		left = (in_stereo & (0x10 << i)) != 0;
+
+		if (left && !right)
+			emuSN76489SetPanning(in_state, i, (uint8_t)PANNING_LEFT);
+		else if (right && !left)
+			emuSN76489SetPanning(in_state, i, PANNING_RIGHT);
+		else
+			emuSN76489SetPanning(in_state, i, 0);
+	}
+
+	in_state->Stereo = in_stereo;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Renders audio stream
 void emuSN76489RenderAudioStream(emuSN76489State* in_state, int16_t* out_stream, uint16_t in_sample_count, uint8_t in_attenuation)
@@ -252,10 +281,17 @@ void emuSN76489RenderAudioStream(emuSN76489State* in_state, int16_t* out_stream,
 		sample[3] = in_state->NoiseOutput * in_state->Amplitude[3];
 
 		// generate sample output
-		if (g_stereo_mode)
+		if (in_state->ChannelCount == 2)
 		{
 			// stereo output
 
+			// channels disabled by the stereo register
+			for (i = 0; i < 4; i++)
+			{
+				if ((in_state->Stereo & (0x11 << i)) == 0)
+					sample[i] = 0;
+			}
+
 			// left channel
 			sample_sum = 0;
 			for (i = 0; i < 4; i++)
@@ -0,0 +1,131 @@
+/*****************************************************************************/
+/* Memory mapped file loader                                                 */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include <stddef.h>
+#include <fileMap.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+#define FILE_MAP_MAX_LENGTH 0x7fffffff
+
+/*****************************************************************************/
+/* Public functions                                                          */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Maps the whole file into the memory (read only). Returns false if the file can't be opened or it is empty.
+bool fileMapOpen(FileMapType* out_file_map, const char* in_file_name)
+{
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+	LARGE_INTEGER length;
+	void* data;
+
+	out_file_map->Data = NULL;
+	out_file_map->Length = 0;
+	out_file_map->FileHandle = NULL;
+	out_file_map->MappingHandle = NULL;
+
+	file = CreateFileA(in_file_name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	// empty files can't be mapped
+	if (!GetFileSizeEx(file, &length) || length.QuadPart == 0 || length.QuadPart > FILE_MAP_MAX_LENGTH)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data == NULL)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	out_file_map->Data = (const uint8_t*)data;
+	out_file_map->Length = (int)length.QuadPart;
+	out_file_map->FileHandle = file;
+	out_file_map->MappingHandle = mapping;
+
+	return true;
+#else
+	int file;
+	struct stat file_status;
+	void* data;
+
+	out_file_map->Data = NULL;
+	out_file_map->Length = 0;
+	out_file_map->FileHandle = NULL;
+	out_file_map->MappingHandle = NULL;
+
+	file = open(in_file_name, O_RDONLY);
+	if (file < 0)
+		return false;
+
+	// empty files can't be mapped
+	if (fstat(file, &file_status) != 0 || file_status.st_size == 0 || file_status.st_size > FILE_MAP_MAX_LENGTH)
+	{
+		close(file);
+		return false;
+	}
+
+	data = mmap(NULL, (size_t)file_status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+	if (data == MAP_FAILED)
+		return false;
+
+	out_file_map->Data = (const uint8_t*)data;
+	out_file_map->Length = (int)file_status.st_size;
+
+	return true;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Releases the mapped file
+void fileMapClose(FileMapType* inout_file_map)
+{
+	if (inout_file_map->Data == NULL)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile((void*)inout_file_map->Data);
+	CloseHandle(inout_file_map->MappingHandle);
+	CloseHandle(inout_file_map->FileHandle);
+#else
+	munmap((void*)inout_file_map->Data, (size_t)inout_file_map->Length);
+#endif
+
+	inout_file_map->Data = NULL;
+	inout_file_map->Length = 0;
+	inout_file_map->FileHandle = NULL;
+	inout_file_map->MappingHandle = NULL;
+}
\ No newline at end of file
@@ -11,172 +11,133 @@
 
 ///////////////////////////////////////////////////////////////////////////////
 // Includes
+#include <stdlib.h>
 #include <filePSG.h>
 #include <drvWaveOut.h>
 #include <emuSN76489.h>
 
 
-///////////////////////////////////////////////////////////////////////////////
-// PSG File format description
-///////////////////////////////////////////////////////////////////////////////
-//PSG simplistic approach(log of writes to SN76489 port)
-//
-//- No header
-//- % 1cct xxxx = Latch / Data byte for SN76489 channel c, type t, data xxxx(4 bits)
-//- % 01xx xxxx = Data byte for SN76489 latched channel and type, data xxxxxx(6 bits)
-//- % 00xx xxxx = escape / control byte(values 0x00 - 0x3f), see following table #1
-//
-//Table #1
-//
-//% 0000 0000 - end of data[value 0x00](compulsory, at the end of file)
-//
-//% 0000 0001 - loop begin marker[value 0x01](optional, songs with no loop won't have this)
-//
-//	% 0000 0nnn - RESERVED for future expansions[values 0x02 - 0x07]
-//	* PLANNED: GameGear stereo - the following byte sets the stereo configuration
-//	* PLANNED : event callback - the following byte will be passed to the callback function
-//	* PLANNED : longer waits(8 - 255) - the following byte gives the additional frames
-//	* PLANNED : compression for longer substrings(52 - 255) - followed by a byte that gives the length
-//	and a word that gives the offset
-// 
-//	%0000 1xxx - COMPRESSION: repeat block of len 4 - 11 bytes
-//	%0001 xxxx - COMPRESSION: repeat block of len 12 - 27 bytes
-//	%0010 xxxx - COMPRESSION: repeat block of len 28 - 43
-//	%0011 0xxx - COMPRESSION: repeat block of len 44 - 51 [values 0x08 - 0x37]
-//	This is followed by a little - endian word which is the offset(from begin of data) of the repeating block
-//
-//	% 0011 1nnn - end of frame, wait nnn additional frames(0 - 7)[values 0x38 - 0x3f]
-///////////////////////////////////////////////////////////////////////////////
-
-
-///////////////////////////////////////////////////////////////////////////////
-// Defines
-#define IS_LATCH_BYTE(x) (((x)&0x80)!= 0)
-#define IS_DATA_BYTE(x) (((x)&0xc0)==0x40)
-#define IS_ESCAPE_BYTE(x) (((x)&0xc0)==0x00)
-#define IS_END_OF_FRAME(x) (((x)&0xf8)==0x38)
-#define IS_END_OF_FILE(x) ((x)==0)
-#define IS_BEGIN_LOOP(x) ((x)==0x01)
-#define IS_COMPRESSION(x) ((x)>=8 && (x)<=8+MAX_COMPRESSION_LENGTH-MIN_COMPRESSON_LENGTH)
-
-#define MIN_COMPRESSON_LENGTH 4
-#define MAX_COMPRESSION_LENGTH 51 // 47+4
-#define GET_COMPRESSION_LENGTH(x) ((x)-8+MIN_COMPRESSON_LENGTH)
-#define GET_WAIT_FRAME_COUNT(x) (((x)&0x07)+1)
-
 ///////////////////////////////////////////////////////////////////////////////
 // Types
 
-// VGM player state
+// Interactive (wave out) player state
 typedef enum
 {
 	PSG_Idle,
-	PSG_CommandProcessing,
-	PSG_Waiting,
-	PSG_RenderingBufferWaiting,
+	PSG_Playing,
 	PSG_Ending
 } PSGPlayerState;
 
 
 ///////////////////////////////////////////////////////////////////////////////
 // Local functions
-static uint8_t filePSGGetNextByte(void);
-static void filePSGWaitingAndRendering(void);
-static void	filePSGRenderingBufferWaiting(void);
-static void filePSGProcessCommand(void);
-static void filePSGWaitingAndRendering(void);
-static void	filePSGRenderingBufferWaiting(void);
+static bool filePSGProcessCommand(PSGPlayerType* in_player);
+static bool filePSGProcessFrameTable(PSGPlayerType* in_player);
+static void filePSGStartMacro(PSGMacroSlot* inout_macro_slots, PSGDecoderEvent* in_event);
+static bool filePSGIsMacroRunning(PSGMacroSlot* in_macro_slots);
+static int filePSGGetMacroWrites(PSGMacroSlot* inout_macro_slots, uint8_t* out_writes);
+static void filePSGProcessMacros(PSGPlayerType* in_player);
+static bool filePSGFrameTableDecode(PSGFrameTableType* inout_frame_table, const uint8_t* in_psg_buffer, int in_psg_file_length, uint32_t in_song_start);
 
 ///////////////////////////////////////////////////////////////////////////////
 // Module variables
 
-// PSG buffer
-static uint8_t* l_psg_buffer;
-static int l_psg_buffer_max_length;
-static int l_psg_buffer_pos = 0;
-static int l_frame_count = 0;
-
+// interactive player
 static PSGPlayerState l_player_state = PSG_Idle;
-
-static uint8_t* l_psg_loop_start;
-static uint32_t l_loop_start_remaining_bytes;
-
-// get next byte variables
-static uint8_t* l_psg_resume_pointer;
-static uint32_t l_psg_resume_remaining_bytes;
-static uint8_t* l_psg_current_pointer;
-static uint32_t l_psg_current_remaining_bytes;
-static uint32_t l_psg_current_frame_count;
-
-// wait variables
-static uint16_t l_wait_sample_count;
-static uint16_t l_wait_sample_pos;
-
-// rendering buffer
-static int16_t* l_rendering_buffer;
-static uint16_t l_rendering_buffer_length;
-static uint16_t l_rendering_buffer_pos;
-
-// positon variables
-static uint32_t l_current_sample_pos = 0;
-
-// PSG chip state
-static emuSN76489State l_SN76489;
-
-uint16_t g_frame_sample_count = 44100 / 50;
+static PSGPlayerType l_player;
+static PSGPlayerType l_second_player;		// second chip of the dual-chip songs
+static bool l_dual_chip = false;
+static int l_clock_frequency = 3579545;
+static int l_framerate = 50;
+static PSGFrameTableType* l_frame_table = NULL;
 
 
 ///////////////////////////////////////////////////////////////////////////////
 // Initialize PSG player
 void filePSGPlayerInit(void)
 {
-	l_SN76489.ClockFrequency = 3579545;
+	filePSGInstanceInit(&l_player, l_clock_frequency, l_framerate, g_stereo_mode ? 2 : 1);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 // Pepares PSG file for playback
-void filePSGPlayerStart(uint8_t* in_psg_buffer, int in_psg_file_length)
+void filePSGPlayerStart(const uint8_t* in_psg_buffer, int in_psg_file_length)
 {
-	l_psg_current_frame_count = 0;
+	filePSGPlayerStartSong(in_psg_buffer, in_psg_file_length, 0);
+}
 
-	l_psg_buffer = in_psg_buffer;
-	l_psg_buffer_max_length = in_psg_file_length;
+///////////////////////////////////////////////////////////////////////////////
+// Pepares a song of a PSG bank for playback
+void filePSGPlayerStartSong(const uint8_t* in_psg_buffer, int in_psg_file_length, uint32_t in_song_start)
+{
+	filePSGInstanceInit(&l_player, l_clock_frequency, l_framerate, g_stereo_mode ? 2 : 1);
+	filePSGInstanceStartSong(&l_player, in_psg_buffer, in_psg_file_length, in_song_start, 0);
+	filePSGInstanceSetFrameTable(&l_player, l_frame_table);
 
-	l_psg_current_pointer = in_psg_buffer;
-	l_psg_current_remaining_bytes = in_psg_file_length;
+	l_dual_chip = false;
+	l_player_state = PSG_Playing;
+}
 
-	l_loop_start_remaining_bytes = 0;
-	l_psg_loop_start = NULL;
+///////////////////////////////////////////////////////////////////////////////
+// Pepares the two songs of a dual-chip song (created by 'VGM2PSG -dual split') for playback on two sound chips
+// (the frame table is used by the first song only)
+void filePSGPlayerStartDualChipSong(const uint8_t* in_psg_buffer, int in_psg_file_length, uint32_t in_first_song_start, uint32_t in_second_song_start)
+{
+	filePSGPlayerStartSong(in_psg_buffer, in_psg_file_length, in_first_song_start);
 
-	l_player_state = PSG_CommandProcessing;
+	filePSGInstanceInit(&l_second_player, l_clock_frequency, l_framerate, g_stereo_mode ? 2 : 1);
+	filePSGInstanceStartSong(&l_second_player, in_psg_buffer, in_psg_file_length, in_second_song_start, 0);
 
-	emuSN76489Reset(&l_SN76489);
+	l_player.OutputAttenuation = 2;
+	l_second_player.OutputAttenuation = 2;
+	l_dual_chip = true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 // Player periodic callback
 void filePSGPlayerProcess(void)
 {
-	// process VHM commands
+	int16_t* buffer;
+	int sample_count;
+	int rendered_sample_count;
+	int second_sample_count;
+	int i;
+
 	switch (l_player_state)
 	{
 		// player isidle -> do nothing
 		case PSG_Idle:
 			break;
 
-		// process VGM command
-		case PSG_CommandProcessing:
-			filePSGProcessCommand();
-			break;
+		// render the next wave out buffer (waits for a free buffer)
+		case PSG_Playing:
+			buffer = waveGetBuffer();
+			if (buffer == NULL)
+				break;
 
-		// waiting for the next command and redering audio data
-		case PSG_Waiting:
-			filePSGWaitingAndRendering();
-			break;
+			// clear buffer
+			for (i = 0; i < WAVE_BUFFER_LENGTH; i++)
+				buffer[i] = 0;
+
+			// buffer size in samples
+			sample_count = WAVE_BUFFER_LENGTH / l_player.SN76489.ChannelCount;
 
-		// waiting for rendering buffer to available
-		case PSG_RenderingBufferWaiting:
-			filePSGRenderingBufferWaiting();
+			rendered_sample_count = filePSGInstanceRender(&l_player, buffer, sample_count);
+
+			// the second chip is mixed into the same buffer
+			if (l_dual_chip)
+			{
+				second_sample_count = filePSGInstanceRender(&l_second_player, buffer, sample_count);
+				if (second_sample_count > rendered_sample_count)
+					rendered_sample_count = second_sample_count;
+			}
+
+			// end of song -> send the last buffer to the wave out
+			if (rendered_sample_count < sample_count)
+			{
+				waveGetBuffer();
+				l_player_state = PSG_Ending;
+			}
 			break;
 
 		// PSG end
@@ -198,206 +159,595 @@ bool filePSGPlayerIsBusy(void)
 // Returns current sample pos
 uint32_t filePSGGetCurrentSamplePos(void)
 {
-	return l_psg_current_frame_count * g_frame_sample_count;
+	return filePSGInstanceGetCurrentSamplePos(&l_player);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 // Sets playback framerate
 void filePSGSetFramerate(int in_framerate)
 {
-	g_frame_sample_count = 44100 / in_framerate;
+	l_framerate = in_framerate;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 // Set SN76489 clock frequency
 void filePSGSetClockFrequency(int in_clock_frequency)
 {
-	l_SN76489.ClockFrequency = in_clock_frequency;
+	l_clock_frequency = in_clock_frequency;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sets the pre-decoded frame table of the next started song (NULL - the song is decoded while playing)
+void filePSGSetFrameTable(PSGFrameTableType* in_frame_table)
+{
+	l_frame_table = in_frame_table;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Moves the playback position of the started song to the given frame
+void filePSGPlayerSeek(uint32_t in_frame)
+{
+	filePSGInstanceSeek(&l_player, in_frame);
+
+	if (l_dual_chip)
+		filePSGInstanceSeek(&l_second_player, in_frame);
 }
 
 /*****************************************************************************/
-/* Local functions                                                           */
+/* Reentrant player functions                                                */
 /*****************************************************************************/
 
 ///////////////////////////////////////////////////////////////////////////////
-// Processes one VGM command
-static void filePSGProcessCommand(void)
+// Initializes player instance (the rendered samples are mono or interleaved stereo by the channel count)
+void filePSGInstanceInit(PSGPlayerType* in_player, int in_clock_frequency, int in_framerate, int in_channel_count)
 {
-	uint8_t command;
+	filePSGDecoderInit(&in_player->Decoder, NULL, 0);
+	in_player->PSGClockFrequency = 0;
+	in_player->FrameTable = NULL;
+	in_player->FrameSampleCount = (uint16_t)(g_sample_rate / in_framerate);
+	in_player->Finished = true;
+	in_player->OutputAttenuation = 1;
+
+	emuSN76489Reset(&in_player->SN76489);
+	in_player->SN76489.ClockFrequency = in_clock_frequency;
+	in_player->SN76489.ChannelCount = (uint8_t)in_channel_count;
+}
 
-	while (l_player_state == PSG_CommandProcessing)
+///////////////////////////////////////////////////////////////////////////////
+// Pepares PSG file for playback on the given player instance
+void filePSGInstanceStart(PSGPlayerType* in_player, const uint8_t* in_psg_buffer, int in_psg_file_length, int in_max_play_count)
+{
+	filePSGInstanceStartSong(in_player, in_psg_buffer, in_psg_file_length, 0, in_max_play_count);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Pepares a song of a PSG bank for playback on the given player instance (the song starts at the given offset of the bank)
+void filePSGInstanceStartSong(PSGPlayerType* in_player, const uint8_t* in_psg_buffer, int in_psg_file_length, uint32_t in_song_start, int in_max_play_count)
+{
+	uint32_t clock_frequency;
+	int i;
+
+	filePSGDecoderInitSong(&in_player->Decoder, in_psg_buffer, in_psg_file_length, in_song_start);
+
+	in_player->PlayCount = 0;
+	in_player->MaxPlayCount = in_max_play_count;
+
+	in_player->CurrentFrameCount = 0;
+	in_player->WaitSampleCount = 0;
+	in_player->WaitSamplePos = 0;
+	in_player->Finished = false;
+
+	in_player->FrameTable = NULL;
+
+	in_player->PendingWaitFrames = 0;
+	for (i = 0; i < PSG_MACRO_REGISTER_COUNT; i++)
+		in_player->MacroSlots[i].RemainingSteps = 0;
+
+	// clock tag and macro dictionary
+	filePSGDecoderReadHeader(&in_player->Decoder);
+
+	// clock tag at the beginning of the file: the tone values are played with the tagged clock
+	clock_frequency = in_player->SN76489.ClockFrequency;
+	in_player->PSGClockFrequency = 0;
+	if (in_player->Decoder.ClockTag >= 0)
 	{
+		in_player->PSGClockFrequency = (in_player->Decoder.ClockTag == PSG_CLOCK_TAG_3125KHZ) ? PSG_CLOCK_3125KHZ : PSG_CLOCK_3579KHZ;
+		clock_frequency = in_player->PSGClockFrequency;
+	}
 
-		// gets next byte
-		command = filePSGGetNextByte();
+	emuSN76489Reset(&in_player->SN76489);
+	in_player->SN76489.ClockFrequency = clock_frequency;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Renders audio samples into the buffer (the buffer content is mixed, it must be cleared by the caller)
+// Returns the number of rendered samples, it is less than requested when the song is finished
+int filePSGInstanceRender(PSGPlayerType* in_player, int16_t* out_buffer, int in_sample_count)
+{
+	int rendered_sample_count = 0;
+	int sample_count;
 
-		// register latch command
-		if (IS_LATCH_BYTE(command))
+	while (rendered_sample_count < in_sample_count)
+	{
+		// process commands of the next frame when waiting is finished
+		if (in_player->WaitSamplePos >= in_player->WaitSampleCount)
 		{
-			emuSN76496WriteRegister(&l_SN76489, command);
+			if (in_player->Finished || !filePSGProcessCommand(in_player))
+				break;
 		}
-		else
-		{
-			// data byte
-			if (IS_DATA_BYTE(command))
-			{
-				emuSN76496WriteRegister(&l_SN76489, command);
-			}
-			else
-			{
-				// must be escape
-				if (IS_COMPRESSION(command))
-				{
-					uint8_t posl = filePSGGetNextByte();
-					uint8_t posh = filePSGGetNextByte();
 
-					uint16_t compression_pos = (uint16_t)((posh << 8) + posl);
+		// min(wait_sample_count, available_sample_count)
+		sample_count = in_player->WaitSampleCount - in_player->WaitSamplePos;
+		if (sample_count > in_sample_count - rendered_sample_count)
+			sample_count = in_sample_count - rendered_sample_count;
 
-					l_psg_resume_pointer = l_psg_current_pointer;
-					l_psg_resume_remaining_bytes = l_psg_current_remaining_bytes;
+		// render audio
+		emuSN76489RenderAudioStream(&in_player->SN76489, out_buffer, (uint16_t)sample_count, in_player->OutputAttenuation);
 
-					l_psg_current_pointer = l_psg_buffer + compression_pos;
-					l_psg_current_remaining_bytes = GET_COMPRESSION_LENGTH(command);
-				}
-				else
-				{
-					// end of frame
-					if (IS_END_OF_FRAME(command))
-					{
-						// start waiting
-						l_wait_sample_count = GET_WAIT_FRAME_COUNT(command) * g_frame_sample_count;
-						l_wait_sample_pos = 0;
+		// update buffer position
+		out_buffer += sample_count * in_player->SN76489.ChannelCount;
 
-						l_psg_current_frame_count += GET_WAIT_FRAME_COUNT(command);
+		in_player->WaitSamplePos += sample_count;
+		rendered_sample_count += sample_count;
+	}
 
-						l_player_state = PSG_Waiting;
-					}
-					else
-					{
-						if (IS_BEGIN_LOOP(command))
-						{
-							l_psg_loop_start = l_psg_current_pointer;
-							l_loop_start_remaining_bytes = l_psg_current_remaining_bytes;
-						}
-						else
-						{
-							// end of file
-							if (IS_END_OF_FILE(command))
-							{
-								if (l_loop_start_remaining_bytes > 0)
-								{
-									l_psg_current_pointer = l_psg_loop_start;
-									l_psg_current_remaining_bytes = l_loop_start_remaining_bytes;
-								}
-								else
-								{
-									waveGetBuffer(); // send current buffer to the wave out
-									l_player_state = PSG_Ending;
-								}
-							}
-						}
-					}
-				}
-			}
+	return rendered_sample_count;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns true while the player instance has samples to render
+bool filePSGInstanceIsBusy(PSGPlayerType* in_player)
+{
+	return !in_player->Finished || in_player->WaitSamplePos < in_player->WaitSampleCount;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns current sample pos of the player instance
+uint32_t filePSGInstanceGetCurrentSamplePos(PSGPlayerType* in_player)
+{
+	return in_player->CurrentFrameCount * in_player->FrameSampleCount;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Plays the started song from the pre-decoded frame table (it must be created from the same PSG data)
+void filePSGInstanceSetFrameTable(PSGPlayerType* in_player, PSGFrameTableType* in_frame_table)
+{
+	in_player->FrameTable = in_frame_table;
+	in_player->FrameTableRecord = 0;
+	in_player->FrameTableWriteIndex = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Moves the playback position to the given frame
+// The song is restarted and the register writes of the skipped frames are processed without rendering
+void filePSGInstanceSeek(PSGPlayerType* in_player, uint32_t in_frame)
+{
+	PSGFrameTableType* frame_table = in_player->FrameTable;
+
+	filePSGInstanceStartSong(in_player, in_player->Decoder.Buffer, in_player->Decoder.BufferLength, in_player->Decoder.SongStart, in_player->MaxPlayCount);
+	filePSGInstanceSetFrameTable(in_player, frame_table);
+
+	while (in_player->CurrentFrameCount < in_frame)
+	{
+		// the song ends before the requested frame
+		if (!filePSGProcessCommand(in_player))
+		{
+			in_player->WaitSamplePos = in_player->WaitSampleCount;
+			return;
 		}
 	}
+
+	// the requested frame is inside the last wait
+	in_player->WaitSamplePos = (uint16_t)(in_player->WaitSampleCount - (in_player->CurrentFrameCount - in_frame) * in_player->FrameSampleCount);
 }
 
+/*****************************************************************************/
+/* Frame table functions                                                     */
+/*****************************************************************************/
+
 ///////////////////////////////////////////////////////////////////////////////
-// Gets next byte from the PSG data
-static uint8_t filePSGGetNextByte(void)
+// Decodes the whole PSG file into the frame table (loops, seeking and repeated rendering don't decode the file again)
+// Returns false when the file can't be pre-decoded or the table is larger than the memory limit (0 - no limit)
+bool filePSGFrameTableCreate(PSGFrameTableType* out_frame_table, const uint8_t* in_psg_buffer, int in_psg_file_length, uint32_t in_song_start, uint32_t in_memory_limit)
 {
-	// if no more bytes -> resume position
-	if (l_psg_current_remaining_bytes == 0)
+	uint64_t memory_size;
+
+	out_frame_table->FrameWriteIndex = NULL;
+	out_frame_table->FrameWaitCount = NULL;
+	out_frame_table->Writes = NULL;
+	out_frame_table->MemorySize = 0;
+
+	// first pass: counts the records and the writes
+	if (!filePSGFrameTableDecode(out_frame_table, in_psg_buffer, in_psg_file_length, in_song_start))
+		return false;
+
+	memory_size = (uint64_t)(out_frame_table->FrameCount + 1) * sizeof(uint32_t) + out_frame_table->FrameCount + out_frame_table->WriteCount;
+	if (memory_size > UINT32_MAX || (in_memory_limit > 0 && memory_size > in_memory_limit))
+		return false;
+
+	// allocate arrays (at least one byte of writes, the table has to be distinguishable from the counting pass)
+	out_frame_table->FrameWriteIndex = (uint32_t*)malloc((out_frame_table->FrameCount + 1) * sizeof(uint32_t));
+	out_frame_table->FrameWaitCount = (uint8_t*)malloc(out_frame_table->FrameCount);
+	out_frame_table->Writes = (uint8_t*)malloc(out_frame_table->WriteCount + 1);
+
+	if (out_frame_table->FrameWriteIndex == NULL || out_frame_table->FrameWaitCount == NULL || out_frame_table->Writes == NULL)
 	{
-		l_psg_current_pointer = l_psg_resume_pointer;
-		l_psg_current_remaining_bytes = l_psg_resume_remaining_bytes;
+		filePSGFrameTableFree(out_frame_table);
+		return false;
 	}
 
-	// get byte
-	uint8_t data = *l_psg_current_pointer;
+	out_frame_table->MemorySize = (uint32_t)memory_size;
 
-	l_psg_current_pointer++;
-	l_psg_current_remaining_bytes--;
+	// second pass: stores the records
+	filePSGFrameTableDecode(out_frame_table, in_psg_buffer, in_psg_file_length, in_song_start);
 
-	return data;
+	return true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// Renders audio stream
-static void filePSGWaitingAndRendering(void)
+// Releases the memory of the frame table
+void filePSGFrameTableFree(PSGFrameTableType* inout_frame_table)
 {
-	uint16_t sample_count;
-	uint16_t wait_sample_count;
+	free(inout_frame_table->FrameWriteIndex);
+	free(inout_frame_table->FrameWaitCount);
+	free(inout_frame_table->Writes);
+
+	inout_frame_table->FrameWriteIndex = NULL;
+	inout_frame_table->FrameWaitCount = NULL;
+	inout_frame_table->Writes = NULL;
+	inout_frame_table->MemorySize = 0;
+}
+
+/*****************************************************************************/
+/* Local functions                                                           */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Processes PSG commands until the end of the frame
+// Returns false when the end of the song is reached
+static bool filePSGProcessCommand(PSGPlayerType* in_player)
+{
+	PSGDecoderEvent event;
+
+	// pre-decoded song
+	if (in_player->FrameTable != NULL)
+		return filePSGProcessFrameTable(in_player);
 
-	// check rendering buffer
-	if (l_rendering_buffer == NULL || l_rendering_buffer_length == 0 || l_rendering_buffer_pos >= l_rendering_buffer_length)
+	// wait frames of the files with macros
+	if (in_player->PendingWaitFrames > 0)
 	{
-		// get new rendering buffer
-		l_player_state = PSG_RenderingBufferWaiting;
+		in_player->PendingWaitFrames--;
+		filePSGProcessMacros(in_player);
+
+		in_player->WaitSampleCount = in_player->FrameSampleCount;
+		in_player->WaitSamplePos = 0;
+		in_player->CurrentFrameCount++;
+
+		return true;
 	}
-	else
+
+	while (true)
 	{
-		if (l_wait_sample_pos >= l_wait_sample_count)
+		switch (filePSGDecoderNext(&in_player->Decoder, &event))
 		{
-			l_player_state = PSG_CommandProcessing;
-		}
-		else
-		{
-			// number of free sample places in to buffer
-			sample_count = l_rendering_buffer_length - l_rendering_buffer_pos;
-			if (g_stereo_mode)
-				sample_count /= 2;
+			// register write
+			case PSGEvent_Write:
+				emuSN76496WriteRegister(&in_player->SN76489, event.Command);
+				break;
+
+			// end of frame
+			case PSGEvent_EndOfFrame:
+				// the macros are updated in every frame, the wait frames are processed one by one
+				if (in_player->Decoder.MacroCount > 0)
+				{
+					filePSGProcessMacros(in_player);
+
+					in_player->PendingWaitFrames = event.WaitFrames - 1;
+					in_player->WaitSampleCount = in_player->FrameSampleCount;
+					in_player->WaitSamplePos = 0;
+					in_player->CurrentFrameCount++;
+
+					return true;
+				}
+
+				// start waiting
+				in_player->WaitSampleCount = event.WaitFrames * in_player->FrameSampleCount;
+				in_player->WaitSamplePos = 0;
+
+				in_player->CurrentFrameCount += event.WaitFrames;
+
+				return true;
 
-			// number of remaining wait samples
-			wait_sample_count = l_wait_sample_count - l_wait_sample_pos;
+			// end of data -> restart from the loop
+			case PSGEvent_End:
+				in_player->PlayCount++;
 
-			// min(wait_sample_count, available_sample_count)
-			if (wait_sample_count < sample_count)
-				sample_count = wait_sample_count;
+				if ((in_player->MaxPlayCount == 0 || in_player->PlayCount < in_player->MaxPlayCount) && filePSGDecoderRestartLoop(&in_player->Decoder))
+					break;
 
-			// render audio
-			emuSN76489RenderAudioStream(&l_SN76489, &l_rendering_buffer[l_rendering_buffer_pos], sample_count, 1);
+				in_player->Finished = true;
+				return false;
 
-			// update buffer position
-			if (g_stereo_mode)
-				l_rendering_buffer_pos += sample_count * 2;
+			// end of the buffer without end of data marker
+			case PSGEvent_EndOfBuffer:
+				in_player->Finished = true;
+				return false;
+
+			// macro start
+			case PSGEvent_Macro:
+				filePSGStartMacro(in_player->MacroSlots, &event);
+				break;
+
+			// stereo change
+			case PSGEvent_Stereo:
+				emuSN76489SetStereo(&in_player->SN76489, (uint8_t)event.Value);
+				break;
+
+			default:
+				break;
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Processes the register writes of the next frame record of the frame table
+// Returns false when the end of the song is reached
+static bool filePSGProcessFrameTable(PSGPlayerType* in_player)
+{
+	PSGFrameTableType* frame_table = in_player->FrameTable;
+	uint32_t record;
+	uint32_t write_index;
+	uint32_t write_end;
+	uint8_t wait_frames;
+
+	while (true)
+	{
+		record = in_player->FrameTableRecord;
+		write_end = frame_table->FrameWriteIndex[record + 1];
+
+		for (write_index = in_player->FrameTableWriteIndex; write_index < write_end; write_index++)
+		{
+			if (frame_table->Writes[write_index] == PSG_FRAME_TABLE_STEREO)
+				emuSN76489SetStereo(&in_player->SN76489, frame_table->Writes[++write_index]);
 			else
-				l_rendering_buffer_pos += sample_count;
+				emuSN76496WriteRegister(&in_player->SN76489, frame_table->Writes[write_index]);
+		}
+
+		// start waiting
+		wait_frames = frame_table->FrameWaitCount[record];
+		if (wait_frames > 0)
+		{
+			in_player->FrameTableRecord = record + 1;
+			in_player->FrameTableWriteIndex = write_end;
 
-			l_wait_sample_pos += sample_count;
+			in_player->WaitSampleCount = wait_frames * in_player->FrameSampleCount;
+			in_player->WaitSamplePos = 0;
+
+			in_player->CurrentFrameCount += wait_frames;
+
+			return true;
+		}
 
-			if (l_rendering_buffer_pos >= l_rendering_buffer_length)
-				l_player_state = PSG_RenderingBufferWaiting;
+		// end of the song -> restart from the loop
+		in_player->PlayCount++;
 
-			l_current_sample_pos += sample_count;
+		if ((in_player->MaxPlayCount == 0 || in_player->PlayCount < in_player->MaxPlayCount) && frame_table->LoopFrame != PSG_FRAME_TABLE_NO_LOOP)
+		{
+			in_player->FrameTableRecord = frame_table->LoopFrame;
+			in_player->FrameTableWriteIndex = frame_table->LoopWriteIndex;
+			continue;
 		}
+
+		in_player->Finished = true;
+		return false;
 	}
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// Waiting for rendering buffer to be available
-static void	filePSGRenderingBufferWaiting(void)
+// Starts the macro of the macro command on its register
+static void filePSGStartMacro(PSGMacroSlot* inout_macro_slots, PSGDecoderEvent* in_event)
+{
+	PSGMacroSlot* slot;
+
+	// invalid macro index
+	if (in_event->Macro == NULL)
+		return;
+
+	slot = &inout_macro_slots[in_event->Register];
+
+	slot->Step = in_event->Macro + 1;
+	slot->RemainingSteps = in_event->Macro[0] & PSG_MACRO_LENGTH_MASK;
+	slot->Base = in_event->Value;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns true when any of the macros is running
+static bool filePSGIsMacroRunning(PSGMacroSlot* in_macro_slots)
 {
-	int16_t* buffer = waveGetBuffer();
-	uint16_t i;
+	int register_index;
 
-	if (buffer != NULL)
+	for (register_index = 0; register_index < PSG_MACRO_REGISTER_COUNT; register_index++)
 	{
-		l_rendering_buffer = buffer;
+		if (in_macro_slots[register_index].RemainingSteps > 0)
+			return true;
+	}
 
-		// clear buffer
-		for (i = 0; i < WAVE_BUFFER_LENGTH; i++)
-			*buffer++ = 0;
+	return false;
+}
 
-		// buffer size in samples
-		l_rendering_buffer_length = WAVE_BUFFER_LENGTH;
+///////////////////////////////////////////////////////////////////////////////
+// Gets the register writes of the next step of the running macros (at the end of every frame)
+// Returns the number of bytes to write (max. PSG_FRAME_TABLE_MAX_MACRO_WRITES)
+static int filePSGGetMacroWrites(PSGMacroSlot* inout_macro_slots, uint8_t* out_writes)
+{
+	PSGMacroSlot* slot;
+	int register_index;
+	int write_count = 0;
+	uint16_t value;
 
-		// init
-		l_rendering_buffer_pos = 0;
+	for (register_index = 0; register_index < PSG_MACRO_REGISTER_COUNT; register_index++)
+	{
+		slot = &inout_macro_slots[register_index];
+		if (slot->RemainingSteps == 0)
+			continue;
+
+		if ((register_index & 1) == 0)
+		{
+			// tone: offset from the base value
+			value = (uint16_t)((slot->Base + (int8_t)*slot->Step) & 0x3ff);
+			out_writes[write_count++] = (uint8_t)(0x80 | (register_index << 4) | (value & 0x0f));
+			out_writes[write_count++] = (uint8_t)(0x40 | (value >> 4));
+		}
+		else
+		{
+			// attenuation
+			out_writes[write_count++] = (uint8_t)(0x80 | (register_index << 4) | (*slot->Step & 0x0f));
+		}
 
-		// change state
-		l_player_state = PSG_Waiting;
+		slot->Step++;
+		slot->RemainingSteps--;
 	}
+
+	return write_count;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Writes the next step of the running macros into the sound chip (at the end of every frame)
+static void filePSGProcessMacros(PSGPlayerType* in_player)
+{
+	uint8_t writes[PSG_FRAME_TABLE_MAX_MACRO_WRITES];
+	int write_count;
+	int i;
+
+	write_count = filePSGGetMacroWrites(in_player->MacroSlots, writes);
+
+	for (i = 0; i < write_count; i++)
+		emuSN76496WriteRegister(&in_player->SN76489, writes[i]);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Decodes the PSG file into the frame table, only counts the records and writes when the arrays are not allocated
+// Returns false when the file can't be played from a frame table (macro running at the loop or at the end, loop inside a substring)
+static bool filePSGFrameTableDecode(PSGFrameTableType* inout_frame_table, const uint8_t* in_psg_buffer, int in_psg_file_length, uint32_t in_song_start)
+{
+	PSGDecoderType decoder;
+	PSGDecoderEvent event;
+	PSGMacroSlot macro_slots[PSG_MACRO_REGISTER_COUNT];
+	uint8_t macro_writes[PSG_FRAME_TABLE_MAX_MACRO_WRITES];
+	int macro_write_count;
+	bool store = (inout_frame_table->Writes != NULL);
+	uint32_t record = 0;
+	uint32_t write_index = 0;
+	uint32_t loop_frame_count = 0;
+	uint8_t remaining_frames;
+	uint8_t wait_frames;
+	int i;
+
+	filePSGDecoderInitSong(&decoder, in_psg_buffer, in_psg_file_length, in_song_start);
+	filePSGDecoderReadHeader(&decoder);
+
+	for (i = 0; i < PSG_MACRO_REGISTER_COUNT; i++)
+		macro_slots[i].RemainingSteps = 0;
+
+	inout_frame_table->LoopFrame = PSG_FRAME_TABLE_NO_LOOP;
+	inout_frame_table->LoopWriteIndex = 0;
+
+	if (store)
+		inout_frame_table->FrameWriteIndex[0] = 0;
+
+	while (true)
+	{
+		switch (filePSGDecoderNext(&decoder, &event))
+		{
+			// register write
+			case PSGEvent_Write:
+				if (store)
+					inout_frame_table->Writes[write_index] = event.Command;
+				write_index++;
+				break;
+
+			// end of frame: closes the record, every wait frame is a separate record while a macro is running
+			case PSGEvent_EndOfFrame:
+				remaining_frames = event.WaitFrames;
+				while (remaining_frames > 0)
+				{
+					if (filePSGIsMacroRunning(macro_slots))
+					{
+						macro_write_count = filePSGGetMacroWrites(macro_slots, macro_writes);
+						for (i = 0; i < macro_write_count; i++)
+						{
+							if (store)
+								inout_frame_table->Writes[write_index] = macro_writes[i];
+							write_index++;
+						}
+						wait_frames = 1;
+					}
+					else
+					{
+						wait_frames = remaining_frames;
+					}
+
+					if (store)
+					{
+						inout_frame_table->FrameWaitCount[record] = wait_frames;
+						inout_frame_table->FrameWriteIndex[record + 1] = write_index;
+					}
+					record++;
+
+					loop_frame_count += wait_frames;
+					remaining_frames -= wait_frames;
+				}
+				break;
+
+			// loop marker: the playback restarts with the next write of the current record
+			case PSGEvent_Loop:
+				if (decoder.InSubstring || decoder.InLongSubstring || filePSGIsMacroRunning(macro_slots))
+					return false;
+
+				inout_frame_table->LoopFrame = record;
+				inout_frame_table->LoopWriteIndex = write_index;
+				loop_frame_count = 0;
+				break;
+
+			// macro start
+			case PSGEvent_Macro:
+				filePSGStartMacro(macro_slots, &event);
+				break;
+
+			// stereo change: stored as a write with the stereo register value
+			case PSGEvent_Stereo:
+				if (store)
+				{
+					inout_frame_table->Writes[write_index] = PSG_FRAME_TABLE_STEREO;
+					inout_frame_table->Writes[write_index + 1] = (uint8_t)event.Value;
+				}
+				write_index += 2;
+				break;
+
+			// end of the song: closes the table with the end record
+			case PSGEvent_End:
+			case PSGEvent_EndOfBuffer:
+				if (filePSGIsMacroRunning(macro_slots))
+					return false;
+
+				// the song without end of data marker is not looped, and the loop without frames would never end
+				if (event.Type == PSGEvent_EndOfBuffer || loop_frame_count == 0)
+					inout_frame_table->LoopFrame = PSG_FRAME_TABLE_NO_LOOP;
+
+				if (store)
+				{
+					inout_frame_table->FrameWaitCount[record] = 0;
+					inout_frame_table->FrameWriteIndex[record + 1] = write_index;
+				}
+				record++;
+
+				inout_frame_table->FrameCount = record;
+				inout_frame_table->WriteCount = write_index;
+
+				return true;
+
+			default:
+				break;
+		}
+	}
+}
@@ -0,0 +1,548 @@
+/*****************************************************************************/
+/* PSG file decoder (shared by PSGPlayer, PSG2TXT and PSGDecompress)         */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#include <stddef.h>
+#include <filePSGDecoder.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// PSG File format description
+///////////////////////////////////////////////////////////////////////////////
+//PSG simplistic approach(log of writes to SN76489 port)
+//
+//- No header
+//- % 1cct xxxx = Latch / Data byte for SN76489 channel c, type t, data xxxx(4 bits)
+//- % 01xx xxxx = Data byte for SN76489 latched channel and type, data xxxxxx(6 bits)
+//- % 00xx xxxx = escape / control byte(values 0x00 - 0x3f), see following table #1
+//
+//Table #1
+//
+//% 0000 0000 - end of data[value 0x00](compulsory, at the end of file)
+//
+//% 0000 0001 - loop begin marker[value 0x01](optional, songs with no loop won't have this)
+//
+//	% 0000 0nnn - RESERVED for future expansions[values 0x02 - 0x07]
+//	* clock tag [value 0x06] (optional, only at the beginning of the file) - the following byte gives the clock
+//	frequency of the tone values (0 - 3.579545MHz, 1 - 3.125MHz TVC Game Card). Substring offsets include the tag.
+//	* macro [value 0x07] (optional, extended format) - at the beginning of the file (after the clock tag) it is the
+//	macro dictionary: followed by the number of macros and the macros (type/length byte %tlll llll: t=1 tone, t=0
+//	attenuation, l=1..127 frames, followed by l step bytes: attenuation values or signed tone offsets). In the music
+//	data it starts a macro: followed by %1cci iiii (channel c, macro index i), tone macros are followed by the base
+//	tone value (%0100 llll low bits, %01hh hhhh high bits). The macro writes one step into the register of the
+//	channel at the end of every frame (including the wait frames) from the frame of the command.
+//	* GameGear stereo [value 0x02] (optional, extended format) - followed by %0100 rrrr and %0100 llll, the channels
+//	(bit 0..3 - channel 0..3) which are enabled on the right and on the left side. It is at the beginning of the frame.
+//	* PLANNED : event callback - the following byte will be passed to the callback function
+//	* PLANNED : longer waits(8 - 255) - the following byte gives the additional frames
+//	* long substring [value 0x05] (optional, extended format) - followed by a little-endian word of the length and
+//	a little-endian word of the offset of a block of the compressed data (repeated frames). The block can contain
+//	substring references but no long substrings.
+// 
+//	%0000 1xxx - COMPRESSION: repeat block of len 4 - 11 bytes
+//	%0001 xxxx - COMPRESSION: repeat block of len 12 - 27 bytes
+//	%0010 xxxx - COMPRESSION: repeat block of len 28 - 43
+//	%0011 0xxx - COMPRESSION: repeat block of len 44 - 51 [values 0x08 - 0x37]
+//	This is followed by a little - endian word which is the offset(from begin of data) of the repeating block
+//
+//	% 0011 1nnn - end of frame, wait nnn additional frames(0 - 7)[values 0x38 - 0x3f]
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+#define IS_LATCH_BYTE(x) (((x)&0x80)!= 0)
+#define IS_DATA_BYTE(x) (((x)&0xc0)==0x40)
+#define IS_END_OF_FRAME(x) (((x)&0xf8)==0x38)
+#define IS_COMPRESSION(x) ((x)>=8 && (x)<=8+MAX_COMPRESSION_LENGTH-MIN_COMPRESSON_LENGTH)
+#define IS_CLOCK_TAG(x) ((x)==PSG_CLOCK_TAG)
+#define IS_MACRO(x) ((x)==PSG_MACRO)
+#define IS_TONE_REGISTER(x) (((x)&0x01)==0)
+#define IS_TONE_MACRO(x) (((x)&PSG_MACRO_TONE)!=0)
+#define GET_MACRO_LENGTH(x) ((x)&PSG_MACRO_LENGTH_MASK)
+#define GET_MACRO_CHANNEL(x) (((x)>>5)&0x03)
+#define GET_MACRO_INDEX(x) ((x)&0x1f)
+#define GET_LATCH_REGISTER(x) (((x)&0x70)>>4)
+
+#define PSG_END_OF_DATA 0x00
+#define PSG_BEGIN_LOOP 0x01
+#define PSG_STEREO 0x02
+#define PSG_LONG_SUBSTRING 0x05
+#define PSG_CLOCK_TAG 0x06
+#define PSG_MACRO 0x07
+#define PSG_NOISE_CONTROL_REGISTER 6
+
+#define MIN_COMPRESSON_LENGTH 4
+#define MAX_COMPRESSION_LENGTH 51 // 47+4
+#define GET_COMPRESSION_LENGTH(x) ((x)-8+MIN_COMPRESSON_LENGTH)
+#define GET_WAIT_FRAME_COUNT(x) (((x)&0x07)+1)
+
+///////////////////////////////////////////////////////////////////////////////
+// Local functions
+static uint8_t filePSGDecoderGetNextByte(PSGDecoderType* inout_decoder);
+static uint8_t filePSGDecoderGetNextParameterByte(PSGDecoderType* inout_decoder);
+static void filePSGDecoderStartSubstring(PSGDecoderType* inout_decoder, uint8_t in_command, PSGDecoderEvent* out_event);
+static void filePSGDecoderStartLongSubstring(PSGDecoderType* inout_decoder, PSGDecoderEvent* out_event);
+static bool filePSGDecoderResume(PSGDecoderType* inout_decoder);
+static void filePSGDecoderReadMacroDictionary(PSGDecoderType* inout_decoder, PSGDecoderEvent* out_event);
+static void filePSGDecoderReadMacro(PSGDecoderType* inout_decoder, PSGDecoderEvent* out_event);
+static void filePSGDecoderReadStereo(PSGDecoderType* inout_decoder, PSGDecoderEvent* out_event);
+
+/*****************************************************************************/
+/* Public functions                                                          */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Initializes the decoder for the PSG data
+void filePSGDecoderInit(PSGDecoderType* out_decoder, const uint8_t* in_buffer, uint32_t in_buffer_length)
+{
+	filePSGDecoderInitSong(out_decoder, in_buffer, in_buffer_length, 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Initializes the decoder for a song of a bank, the decoding starts at the song start
+// but the substring offsets are relative to the beginning of the buffer
+void filePSGDecoderInitSong(PSGDecoderType* out_decoder, const uint8_t* in_buffer, uint32_t in_buffer_length, uint32_t in_song_start)
+{
+	int i;
+
+	if (in_song_start > in_buffer_length)
+		in_song_start = in_buffer_length;
+
+	out_decoder->Buffer = in_buffer;
+	out_decoder->BufferLength = in_buffer_length;
+	out_decoder->SongStart = in_song_start;
+
+	out_decoder->CurrentPointer = in_buffer + in_song_start;
+	out_decoder->CurrentRemainingBytes = in_buffer_length - in_song_start;
+	out_decoder->ResumePointer = NULL;
+	out_decoder->ResumeRemainingBytes = 0;
+	out_decoder->InSubstring = false;
+	out_decoder->LongResumePointer = NULL;
+	out_decoder->LongResumeRemainingBytes = 0;
+	out_decoder->InLongSubstring = false;
+
+	out_decoder->LoopStart = NULL;
+	out_decoder->LoopStartRemainingBytes = 0;
+
+	out_decoder->LatchRegister = 0;
+	for (i = 0; i < PSG_DECODER_REGISTER_COUNT; i++)
+		out_decoder->Registers[i] = 0;
+	out_decoder->Stereo = PSG_STEREO_DEFAULT;
+
+	out_decoder->MusicDataStarted = false;
+	out_decoder->ClockTag = -1;
+	out_decoder->MacroCount = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Decodes the next command of the PSG data
+// Returns the type of the decoded event (the event is stored in out_event)
+PSGDecoderEventType filePSGDecoderNext(PSGDecoderType* inout_decoder, PSGDecoderEvent* out_event)
+{
+	uint8_t command;
+	uint8_t register_index;
+	uint16_t value;
+
+	// end of the substring or the buffer
+	if (inout_decoder->CurrentRemainingBytes == 0)
+	{
+		if (filePSGDecoderResume(inout_decoder))
+		{
+			out_event->Type = PSGEvent_ReferenceExit;
+		}
+		else
+		{
+			out_event->Type = PSGEvent_EndOfBuffer;
+		}
+
+		out_event->Position = (uint32_t)(inout_decoder->CurrentPointer - inout_decoder->Buffer);
+		out_event->Command = 0;
+
+		return out_event->Type;
+	}
+
+	// get command byte
+	out_event->Position = (uint32_t)(inout_decoder->CurrentPointer - inout_decoder->Buffer);
+	command = *inout_decoder->CurrentPointer++;
+	inout_decoder->CurrentRemainingBytes--;
+	out_event->Command = command;
+
+	if (IS_LATCH_BYTE(command))
+	{
+		// register latch command
+		register_index = GET_LATCH_REGISTER(command);
+		value = inout_decoder->Registers[register_index];
+
+		if (IS_TONE_REGISTER(register_index) && register_index != PSG_NOISE_CONTROL_REGISTER)
+			value = (value & 0x3f0) | (command & 0x0f);
+		else
+			value = command & 0x0f;
+
+		inout_decoder->LatchRegister = register_index;
+		inout_decoder->Registers[register_index] = value;
+
+		out_event->Type = PSGEvent_Write;
+		out_event->Register = register_index;
+		out_event->Value = value;
+	}
+	else if (IS_DATA_BYTE(command))
+	{
+		// data byte of the latched register
+		register_index = inout_decoder->LatchRegister;
+		value = inout_decoder->Registers[register_index];
+
+		if (IS_TONE_REGISTER(register_index) && register_index != PSG_NOISE_CONTROL_REGISTER)
+			value = ((command & 0x3f) << 4) | (value & 0x0f);
+		else
+			value = command & 0x0f;
+
+		inout_decoder->Registers[register_index] = value;
+
+		out_event->Type = PSGEvent_Write;
+		out_event->Register = register_index;
+		out_event->Value = value;
+	}
+	else if (IS_END_OF_FRAME(command))
+	{
+		out_event->Type = PSGEvent_EndOfFrame;
+		out_event->WaitFrames = GET_WAIT_FRAME_COUNT(command);
+	}
+	else if (IS_COMPRESSION(command))
+	{
+		filePSGDecoderStartSubstring(inout_decoder, command, out_event);
+		out_event->Type = PSGEvent_ReferenceEnter;
+	}
+	else
+	{
+		switch (command)
+		{
+			case PSG_END_OF_DATA:
+				out_event->Type = PSGEvent_End;
+				break;
+
+			case PSG_BEGIN_LOOP:
+				inout_decoder->LoopStart = inout_decoder->CurrentPointer;
+				inout_decoder->LoopStartRemainingBytes = inout_decoder->CurrentRemainingBytes;
+				out_event->Type = PSGEvent_Loop;
+				break;
+
+			case PSG_STEREO:
+				filePSGDecoderReadStereo(inout_decoder, out_event);
+				out_event->Type = PSGEvent_Stereo;
+				break;
+
+			case PSG_CLOCK_TAG:
+				// the clock tag is valid only at the beginning of the song
+				if (out_event->Position == inout_decoder->SongStart)
+				{
+					inout_decoder->ClockTag = filePSGDecoderGetNextByte(inout_decoder);
+					out_event->Type = PSGEvent_ClockTag;
+					out_event->Value = (uint16_t)inout_decoder->ClockTag;
+				}
+				else
+				{
+					out_event->Type = PSGEvent_Reserved;
+				}
+				break;
+
+			case PSG_LONG_SUBSTRING:
+				// long substrings can't be nested
+				if (inout_decoder->InSubstring || inout_decoder->InLongSubstring)
+				{
+					out_event->Type = PSGEvent_Reserved;
+				}
+				else
+				{
+					filePSGDecoderStartLongSubstring(inout_decoder, out_event);
+					out_event->Type = PSGEvent_LongReferenceEnter;
+				}
+				break;
+
+			case PSG_MACRO:
+				// the macro dictionary is before the music data, later the command starts a macro
+				if (inout_decoder->MusicDataStarted)
+				{
+					filePSGDecoderReadMacro(inout_decoder, out_event);
+					out_event->Type = PSGEvent_Macro;
+				}
+				else
+				{
+					filePSGDecoderReadMacroDictionary(inout_decoder, out_event);
+					out_event->Type = PSGEvent_MacroDictionary;
+				}
+				break;
+
+			default:
+				out_event->Type = PSGEvent_Reserved;
+				break;
+		}
+	}
+
+	// only the clock tag can be before the macro dictionary
+	if (out_event->Type != PSGEvent_ClockTag)
+		inout_decoder->MusicDataStarted = true;
+
+	return out_event->Type;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Processes the file header (clock tag and macro dictionary), the next event will be the first music data event
+void filePSGDecoderReadHeader(PSGDecoderType* inout_decoder)
+{
+	PSGDecoderEvent event;
+	uint8_t command;
+
+	while (!inout_decoder->MusicDataStarted && inout_decoder->CurrentRemainingBytes > 0)
+	{
+		command = *inout_decoder->CurrentPointer;
+		if (!IS_CLOCK_TAG(command) && !IS_MACRO(command))
+			break;
+
+		filePSGDecoderNext(inout_decoder, &event);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Continues the decoding from the loop begin marker
+// Returns false if there is no loop in the file
+bool filePSGDecoderRestartLoop(PSGDecoderType* inout_decoder)
+{
+	if (inout_decoder->LoopStart == NULL || inout_decoder->LoopStartRemainingBytes == 0)
+		return false;
+
+	inout_decoder->CurrentPointer = inout_decoder->LoopStart;
+	inout_decoder->CurrentRemainingBytes = inout_decoder->LoopStartRemainingBytes;
+	inout_decoder->InSubstring = false;
+	inout_decoder->InLongSubstring = false;
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets the number of songs of a bank (0 - invalid song table)
+int filePSGDecoderGetBankSongCount(const uint8_t* in_bank, uint32_t in_bank_length)
+{
+	if (in_bank_length < 1 || in_bank_length < (uint32_t)PSG_BANK_TABLE_LENGTH(in_bank[0]))
+		return 0;
+
+	return in_bank[0];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets the start offset of a song of the bank
+// Returns false if the song index or the song table entry is invalid
+bool filePSGDecoderGetBankSong(const uint8_t* in_bank, uint32_t in_bank_length, int in_song_index, uint32_t* out_song_start)
+{
+	int song_count = filePSGDecoderGetBankSongCount(in_bank, in_bank_length);
+	const uint8_t* entry;
+	uint32_t song_start;
+
+	if (in_song_index < 0 || in_song_index >= song_count)
+		return false;
+
+	entry = in_bank + PSG_BANK_TABLE_LENGTH(in_song_index);
+	song_start = entry[0] | (entry[1] << 8);
+
+	// the song can't overlap the song table
+	if (song_start < (uint32_t)PSG_BANK_TABLE_LENGTH(song_count) || song_start >= in_bank_length)
+		return false;
+
+	*out_song_start = song_start;
+
+	return true;
+}
+
+/*****************************************************************************/
+/* Local functions                                                           */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets the next parameter byte of a command
+static uint8_t filePSGDecoderGetNextByte(PSGDecoderType* inout_decoder)
+{
+	uint8_t data;
+
+	// if no more bytes -> resume position
+	if (inout_decoder->CurrentRemainingBytes == 0)
+		filePSGDecoderResume(inout_decoder);
+
+	// read after the end of the buffer -> end of data
+	if (inout_decoder->CurrentRemainingBytes == 0)
+		return 0;
+
+	data = *inout_decoder->CurrentPointer++;
+	inout_decoder->CurrentRemainingBytes--;
+
+	return data;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets the next parameter byte of a command which can be replaced by a substring (macro parameters)
+static uint8_t filePSGDecoderGetNextParameterByte(PSGDecoderType* inout_decoder)
+{
+	PSGDecoderEvent event;
+	uint8_t data = filePSGDecoderGetNextByte(inout_decoder);
+
+	while (IS_COMPRESSION(data))
+	{
+		filePSGDecoderStartSubstring(inout_decoder, data, &event);
+		data = filePSGDecoderGetNextByte(inout_decoder);
+	}
+
+	return data;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Continues the decoding from the substring of the compression command
+static void filePSGDecoderStartSubstring(PSGDecoderType* inout_decoder, uint8_t in_command, PSGDecoderEvent* out_event)
+{
+	uint8_t posl = filePSGDecoderGetNextByte(inout_decoder);
+	uint8_t posh = filePSGDecoderGetNextByte(inout_decoder);
+	uint16_t offset = (uint16_t)((posh << 8) + posl);
+	uint32_t length = GET_COMPRESSION_LENGTH(in_command);
+
+	out_event->ReferenceOffset = offset;
+	out_event->ReferenceLength = (uint8_t)length;
+
+	// the substring can't be outside of the buffer
+	if (offset >= inout_decoder->BufferLength)
+		length = 0;
+	else if (length > inout_decoder->BufferLength - offset)
+		length = inout_decoder->BufferLength - offset;
+
+	inout_decoder->ResumePointer = inout_decoder->CurrentPointer;
+	inout_decoder->ResumeRemainingBytes = inout_decoder->CurrentRemainingBytes;
+
+	inout_decoder->CurrentPointer = inout_decoder->Buffer + offset;
+	inout_decoder->CurrentRemainingBytes = length;
+	inout_decoder->InSubstring = true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Continues the decoding from the block of the long substring command
+static void filePSGDecoderStartLongSubstring(PSGDecoderType* inout_decoder, PSGDecoderEvent* out_event)
+{
+	uint8_t lengthl = filePSGDecoderGetNextByte(inout_decoder);
+	uint8_t lengthh = filePSGDecoderGetNextByte(inout_decoder);
+	uint8_t posl = filePSGDecoderGetNextByte(inout_decoder);
+	uint8_t posh = filePSGDecoderGetNextByte(inout_decoder);
+	uint16_t offset = (uint16_t)((posh << 8) + posl);
+	uint32_t length = (uint32_t)((lengthh << 8) + lengthl);
+
+	out_event->ReferenceOffset = offset;
+	out_event->ReferenceLength = (uint16_t)length;
+
+	// the block can't be outside of the buffer
+	if (offset >= inout_decoder->BufferLength)
+		length = 0;
+	else if (length > inout_decoder->BufferLength - offset)
+		length = inout_decoder->BufferLength - offset;
+
+	inout_decoder->LongResumePointer = inout_decoder->CurrentPointer;
+	inout_decoder->LongResumeRemainingBytes = inout_decoder->CurrentRemainingBytes;
+
+	inout_decoder->CurrentPointer = inout_decoder->Buffer + offset;
+	inout_decoder->CurrentRemainingBytes = length;
+	inout_decoder->InLongSubstring = true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Continues the decoding after the ended substring (or the long substring when it is not in a substring)
+// Returns false if the decoding is not in a substring
+static bool filePSGDecoderResume(PSGDecoderType* inout_decoder)
+{
+	if (inout_decoder->InSubstring)
+	{
+		inout_decoder->CurrentPointer = inout_decoder->ResumePointer;
+		inout_decoder->CurrentRemainingBytes = inout_decoder->ResumeRemainingBytes;
+		inout_decoder->InSubstring = false;
+	}
+	else if (inout_decoder->InLongSubstring)
+	{
+		inout_decoder->CurrentPointer = inout_decoder->LongResumePointer;
+		inout_decoder->CurrentRemainingBytes = inout_decoder->LongResumeRemainingBytes;
+		inout_decoder->InLongSubstring = false;
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Reads the macro dictionary
+static void filePSGDecoderReadMacroDictionary(PSGDecoderType* inout_decoder, PSGDecoderEvent* out_event)
+{
+	int macro_count;
+	uint32_t length;
+	int i;
+
+	macro_count = filePSGDecoderGetNextByte(inout_decoder);
+
+	for (i = 0; i < macro_count && inout_decoder->CurrentRemainingBytes > 0; i++)
+	{
+		length = 1 + GET_MACRO_LENGTH(inout_decoder->CurrentPointer[0]);
+		if (length > inout_decoder->CurrentRemainingBytes)
+			break;
+
+		if (inout_decoder->MacroCount < PSG_MACRO_MAX_COUNT)
+			inout_decoder->Macros[inout_decoder->MacroCount++] = inout_decoder->CurrentPointer;
+
+		inout_decoder->CurrentPointer += length;
+		inout_decoder->CurrentRemainingBytes -= length;
+	}
+
+	out_event->Value = (uint16_t)macro_count;
+	out_event->Length = (uint32_t)(inout_decoder->CurrentPointer - inout_decoder->Buffer) - out_event->Position;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Reads the parameters of the macro start command
+static void filePSGDecoderReadMacro(PSGDecoderType* inout_decoder, PSGDecoderEvent* out_event)
+{
+	uint8_t parameter = filePSGDecoderGetNextParameterByte(inout_decoder);
+	const uint8_t* macro = NULL;
+	uint8_t low;
+	uint8_t high;
+
+	out_event->MacroIndex = GET_MACRO_INDEX(parameter);
+	out_event->Register = (uint8_t)(GET_MACRO_CHANNEL(parameter) * 2 + 1);
+	out_event->Value = 0;
+
+	if (out_event->MacroIndex < inout_decoder->MacroCount)
+	{
+		macro = inout_decoder->Macros[out_event->MacroIndex];
+
+		// tone macros: register and base tone value
+		if (IS_TONE_MACRO(macro[0]))
+		{
+			low = filePSGDecoderGetNextParameterByte(inout_decoder);
+			high = filePSGDecoderGetNextParameterByte(inout_decoder);
+
+			out_event->Register--;
+			out_event->Value = (uint16_t)((low & 0x0f) | ((high & 0x3f) << 4));
+		}
+	}
+
+	out_event->Macro = macro;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Reads the parameters of the stereo command (right and left channel bits)
+static void filePSGDecoderReadStereo(PSGDecoderType* inout_decoder, PSGDecoderEvent* out_event)
+{
+	uint8_t right = filePSGDecoderGetNextParameterByte(inout_decoder);
+	uint8_t left = filePSGDecoderGetNextParameterByte(inout_decoder);
+
+	inout_decoder->Stereo = (uint8_t)((right & 0x0f) | ((left & 0x0f) << 4));
+	out_event->Value = inout_decoder->Stereo;
+}
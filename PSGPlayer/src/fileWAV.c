@@ -0,0 +1,138 @@
+/*****************************************************************************/
+/* PSGPlayer - WAV file writer                                               */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#include <fileWAV.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+#define WAV_HEADER_LENGTH 44
+#define WAV_BITS_PER_SAMPLE 16
+
+///////////////////////////////////////////////////////////////////////////////
+// Local functions
+static void fileWAVStoreWord(uint8_t* out_buffer, uint16_t in_value);
+static void fileWAVStoreDWord(uint8_t* out_buffer, uint32_t in_value);
+static bool fileWAVWriteHeader(WAVFileType* in_wav_file);
+
+///////////////////////////////////////////////////////////////////////////////
+// Creates WAV file. The header is finalized when the file is closed.
+bool fileWAVCreate(WAVFileType* in_wav_file, char* in_filename, uint32_t in_sample_rate, uint16_t in_channel_count)
+{
+	in_wav_file->DataLength = 0;
+	in_wav_file->ChannelCount = in_channel_count;
+	in_wav_file->SampleRate = in_sample_rate;
+
+	in_wav_file->File = fopen(in_filename, "wb");
+	if (in_wav_file->File == NULL)
+		return false;
+
+	// write placeholder header
+	return fileWAVWriteHeader(in_wav_file);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes samples (interleaved in the case of stereo files)
+bool fileWAVWriteSamples(WAVFileType* in_wav_file, int16_t* in_samples, int in_sample_count)
+{
+	uint8_t buffer[1024];
+	int buffer_pos = 0;
+	int sample_index;
+	int value_count = in_sample_count * in_wav_file->ChannelCount;
+
+	// convert samples to little-endian byte order
+	for (sample_index = 0; sample_index < value_count; sample_index++)
+	{
+		fileWAVStoreWord(&buffer[buffer_pos], (uint16_t)in_samples[sample_index]);
+		buffer_pos += 2;
+
+		if (buffer_pos == sizeof(buffer))
+		{
+			if (fwrite(buffer, 1, buffer_pos, in_wav_file->File) != (size_t)buffer_pos)
+				return false;
+
+			buffer_pos = 0;
+		}
+	}
+
+	if (buffer_pos > 0 && fwrite(buffer, 1, buffer_pos, in_wav_file->File) != (size_t)buffer_pos)
+		return false;
+
+	in_wav_file->DataLength += value_count * 2;
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Updates header and closes WAV file
+bool fileWAVClose(WAVFileType* in_wav_file)
+{
+	bool success;
+
+	if (in_wav_file->File == NULL)
+		return false;
+
+	// rewrite header with the final length
+	success = (fseek(in_wav_file->File, 0, SEEK_SET) == 0) && fileWAVWriteHeader(in_wav_file);
+
+	fclose(in_wav_file->File);
+	in_wav_file->File = NULL;
+
+	return success;
+}
+
+/*****************************************************************************/
+/* Local functions                                                           */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes RIFF/WAVE header
+static bool fileWAVWriteHeader(WAVFileType* in_wav_file)
+{
+	uint8_t header[WAV_HEADER_LENGTH];
+	uint16_t block_align = in_wav_file->ChannelCount * WAV_BITS_PER_SAMPLE / 8;
+
+	header[0] = 'R'; header[1] = 'I'; header[2] = 'F'; header[3] = 'F';
+	fileWAVStoreDWord(&header[4], WAV_HEADER_LENGTH - 8 + in_wav_file->DataLength);
+	header[8] = 'W'; header[9] = 'A'; header[10] = 'V'; header[11] = 'E';
+
+	// format chunk
+	header[12] = 'f'; header[13] = 'm'; header[14] = 't'; header[15] = ' ';
+	fileWAVStoreDWord(&header[16], 16);
+	fileWAVStoreWord(&header[20], 1); // PCM
+	fileWAVStoreWord(&header[22], in_wav_file->ChannelCount);
+	fileWAVStoreDWord(&header[24], in_wav_file->SampleRate);
+	fileWAVStoreDWord(&header[28], in_wav_file->SampleRate * block_align);
+	fileWAVStoreWord(&header[32], block_align);
+	fileWAVStoreWord(&header[34], WAV_BITS_PER_SAMPLE);
+
+	// data chunk
+	header[36] = 'd'; header[37] = 'a'; header[38] = 't'; header[39] = 'a';
+	fileWAVStoreDWord(&header[40], in_wav_file->DataLength);
+
+	return fwrite(header, 1, WAV_HEADER_LENGTH, in_wav_file->File) == WAV_HEADER_LENGTH;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Stores little-endian word
+static void fileWAVStoreWord(uint8_t* out_buffer, uint16_t in_value)
+{
+	out_buffer[0] = (uint8_t)(in_value & 0xff);
+	out_buffer[1] = (uint8_t)(in_value >> 8);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Stores little-endian double word
+static void fileWAVStoreDWord(uint8_t* out_buffer, uint32_t in_value)
+{
+	fileWAVStoreWord(out_buffer, (uint16_t)(in_value & 0xffff));
+	fileWAVStoreWord(out_buffer + 2, (uint16_t)(in_value >> 16));
+}
@@ -0,0 +1,365 @@
+/*****************************************************************************/
+/* PSGPlayer - Parallel batch renderer                                       */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#include <Windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <renderBatch.h>
+#include <filePSG.h>
+#include <fileMap.h>
+#include <fileWAV.h>
+#include <drvWaveOut.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+#define RENDER_BUFFER_LENGTH 16384  // in samples
+#define MAX_THREAD_COUNT 64
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+///////////////////////////////////////////////////////////////////////////////
+// Types
+
+// Result of one rendered file
+typedef struct
+{
+	char FileName[MAX_PATH];
+	bool Success;
+	uint32_t SampleCount;
+	uint64_t Hash;
+	double RenderTime;
+	bool Predecoded;
+	uint32_t FrameTableSize;
+} RenderBatchResult;
+
+///////////////////////////////////////////////////////////////////////////////
+// Local functions
+static bool renderBatchCollectFiles(char* in_directory);
+static DWORD WINAPI renderBatchWorker(LPVOID in_param);
+static void renderBatchRenderFile(RenderBatchResult* in_result, PSGPlayerType* in_player, int16_t* in_buffer);
+static uint64_t renderBatchHash(uint64_t in_hash, int16_t* in_samples, int in_value_count);
+static double renderBatchGetTime(void);
+
+///////////////////////////////////////////////////////////////////////////////
+// Module variables
+static RenderBatchSettings* l_settings;
+static RenderBatchResult* l_results = NULL;
+static int l_file_count = 0;
+static volatile LONG l_next_file_index;
+
+///////////////////////////////////////////////////////////////////////////////
+// Renders all PSG files of the directory using multiple threads
+bool renderBatchRun(RenderBatchSettings* in_settings)
+{
+	HANDLE threads[MAX_THREAD_COUNT];
+	SYSTEM_INFO system_info;
+	int thread_count;
+	int thread_index;
+	int file_index;
+	int failed_count;
+	int predecoded_count;
+	uint32_t max_frame_table_size;
+	double start_time;
+	double wall_time;
+	double render_time;
+	uint64_t total_sample_count;
+	double audio_length;
+
+	l_settings = in_settings;
+
+	// collect PSG files
+	if (!renderBatchCollectFiles(in_settings->Directory))
+	{
+		printf("ERROR: Can't read directory: %s\n", in_settings->Directory);
+		return false;
+	}
+
+	if (l_file_count == 0)
+	{
+		printf("No PSG file found in: %s\n", in_settings->Directory);
+		return true;
+	}
+
+	// determine number of threads
+	thread_count = in_settings->ThreadCount;
+	if (thread_count <= 0)
+	{
+		GetSystemInfo(&system_info);
+		thread_count = system_info.dwNumberOfProcessors;
+	}
+	if (thread_count > MAX_THREAD_COUNT)
+		thread_count = MAX_THREAD_COUNT;
+	if (thread_count > l_file_count)
+		thread_count = l_file_count;
+
+	printf("Rendering %d files using %d threads\n", l_file_count, thread_count);
+
+	// start worker threads
+	l_next_file_index = 0;
+	start_time = renderBatchGetTime();
+
+	for (thread_index = 0; thread_index < thread_count; thread_index++)
+	{
+		threads[thread_index] = CreateThread(NULL, 0, renderBatchWorker, NULL, 0, NULL);
+		if (threads[thread_index] == NULL)
+		{
+			printf("ERROR: Can't create worker thread\n");
+			thread_count = thread_index;
+			break;
+		}
+	}
+
+	// wait for all workers
+	if (thread_count > 0)
+		WaitForMultipleObjects(thread_count, threads, TRUE, INFINITE);
+
+	wall_time = renderBatchGetTime() - start_time;
+
+	for (thread_index = 0; thread_index < thread_count; thread_index++)
+		CloseHandle(threads[thread_index]);
+
+	// print results
+	failed_count = 0;
+	predecoded_count = 0;
+	max_frame_table_size = 0;
+	total_sample_count = 0;
+	render_time = 0;
+	for (file_index = 0; file_index < l_file_count; file_index++)
+	{
+		if (l_results[file_index].Predecoded)
+		{
+			predecoded_count++;
+			if (l_results[file_index].FrameTableSize > max_frame_table_size)
+				max_frame_table_size = l_results[file_index].FrameTableSize;
+		}
+
+		if (l_results[file_index].Success)
+		{
+			printf("%016llx %10u %8.3fs %s\n", (unsigned long long)l_results[file_index].Hash, l_results[file_index].SampleCount, l_results[file_index].RenderTime, l_results[file_index].FileName);
+			total_sample_count += l_results[file_index].SampleCount;
+			render_time += l_results[file_index].RenderTime;
+		}
+		else
+		{
+			printf("FAILED                                     %s\n", l_results[file_index].FileName);
+			failed_count++;
+		}
+	}
+
+	// print aggregated throughput
+	audio_length = (double)total_sample_count / g_sample_rate;
+	printf("Files:       %d rendered, %d failed\n", l_file_count - failed_count, failed_count);
+	if (in_settings->FrameTableLimit >= 0)
+		printf("Pre-decoded: %d files (largest frame table: %u bytes), %d files decoded while rendering\n", predecoded_count, max_frame_table_size, l_file_count - predecoded_count);
+	printf("Audio:       %.1fs (%llu samples)\n", audio_length, (unsigned long long)total_sample_count);
+	printf("Wall time:   %.3fs (sum of per-file render times: %.3fs)\n", wall_time, render_time);
+	if (wall_time > 0)
+	{
+		printf("Throughput:  %.2f Msamples/s, %.1fx realtime, %.1f files/s\n", total_sample_count / wall_time / 1000000.0, audio_length / wall_time, l_file_count / wall_time);
+	}
+
+	free(l_results);
+	l_results = NULL;
+
+	return failed_count == 0;
+}
+
+/*****************************************************************************/
+/* Local functions                                                           */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Collects PSG file names from the directory
+static bool renderBatchCollectFiles(char* in_directory)
+{
+	char search_path[MAX_PATH];
+	WIN32_FIND_DATAA find_data;
+	HANDLE find_handle;
+	int capacity = 0;
+	RenderBatchResult* results;
+
+	l_file_count = 0;
+	l_results = NULL;
+
+	snprintf(search_path, MAX_PATH, "%s\\*.psg", in_directory);
+	find_handle = FindFirstFileA(search_path, &find_data);
+	if (find_handle == INVALID_HANDLE_VALUE)
+		return true;
+
+	do
+	{
+		if ((find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+			continue;
+
+		// grow result array
+		if (l_file_count == capacity)
+		{
+			capacity = (capacity == 0) ? 64 : capacity * 2;
+			results = (RenderBatchResult*)realloc(l_results, capacity * sizeof(RenderBatchResult));
+			if (results == NULL)
+			{
+				FindClose(find_handle);
+				return false;
+			}
+			l_results = results;
+		}
+
+		memset(&l_results[l_file_count], 0, sizeof(RenderBatchResult));
+		snprintf(l_results[l_file_count].FileName, MAX_PATH, "%s", find_data.cFileName);
+		l_file_count++;
+	} while (FindNextFileA(find_handle, &find_data));
+
+	FindClose(find_handle);
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Worker thread, renders files until all of them are processed
+static DWORD WINAPI renderBatchWorker(LPVOID in_param)
+{
+	PSGPlayerType* player;
+	int16_t* buffer;
+	int file_index;
+
+	(void)in_param;
+
+	player = (PSGPlayerType*)malloc(sizeof(PSGPlayerType));
+	buffer = (int16_t*)malloc(RENDER_BUFFER_LENGTH * 2 * sizeof(int16_t));
+
+	if (player != NULL && buffer != NULL)
+	{
+		// get next file from the shared index
+		while ((file_index = InterlockedIncrement(&l_next_file_index) - 1) < l_file_count)
+		{
+			renderBatchRenderFile(&l_results[file_index], player, buffer);
+		}
+	}
+
+	free(buffer);
+	free(player);
+
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Renders one file to hash and optionally to WAV file
+static void renderBatchRenderFile(RenderBatchResult* in_result, PSGPlayerType* in_player, int16_t* in_buffer)
+{
+	char path[MAX_PATH];
+	FileMapType psg_file;
+	int sample_count;
+	int channel_count = l_settings->ChannelCount;
+	uint32_t song_start = 0;
+	WAVFileType wav_file;
+	PSGFrameTableType frame_table;
+	bool wav_output = (l_settings->WAVDirectory != NULL);
+	double start_time;
+
+	start_time = renderBatchGetTime();
+
+	// map the file into the memory
+	snprintf(path, MAX_PATH, "%s\\%s", l_settings->Directory, in_result->FileName);
+	if (!fileMapOpen(&psg_file, path))
+		return;
+
+	// song of the bank file
+	if (l_settings->SongIndex >= 0 && !filePSGDecoderGetBankSong(psg_file.Data, psg_file.Length, l_settings->SongIndex, &song_start))
+	{
+		fileMapClose(&psg_file);
+		return;
+	}
+
+	// create WAV file
+	if (wav_output)
+	{
+		snprintf(path, MAX_PATH, "%s\\%s.wav", l_settings->WAVDirectory, in_result->FileName);
+		if (!fileWAVCreate(&wav_file, path, g_sample_rate, (uint16_t)channel_count))
+		{
+			fileMapClose(&psg_file);
+			return;
+		}
+	}
+
+	// render
+	in_result->Success = true;
+	in_result->Hash = FNV_OFFSET_BASIS;
+	in_result->SampleCount = 0;
+
+	filePSGInstanceInit(in_player, l_settings->ClockFrequency, l_settings->Framerate, channel_count);
+	filePSGInstanceStartSong(in_player, psg_file.Data, psg_file.Length, song_start, l_settings->MaxPlayCount);
+
+	// pre-decode the song when it fits into the memory limit
+	if (l_settings->FrameTableLimit >= 0 && filePSGFrameTableCreate(&frame_table, psg_file.Data, psg_file.Length, song_start, (uint32_t)l_settings->FrameTableLimit * 1024))
+	{
+		filePSGInstanceSetFrameTable(in_player, &frame_table);
+		in_result->Predecoded = true;
+		in_result->FrameTableSize = frame_table.MemorySize;
+	}
+
+	while (filePSGInstanceIsBusy(in_player))
+	{
+		memset(in_buffer, 0, RENDER_BUFFER_LENGTH * channel_count * sizeof(int16_t));
+
+		sample_count = filePSGInstanceRender(in_player, in_buffer, RENDER_BUFFER_LENGTH);
+		if (sample_count == 0)
+			break;
+
+		in_result->Hash = renderBatchHash(in_result->Hash, in_buffer, sample_count * channel_count);
+		in_result->SampleCount += sample_count;
+
+		if (wav_output && !fileWAVWriteSamples(&wav_file, in_buffer, sample_count))
+			in_result->Success = false;
+	}
+
+	if (wav_output && !fileWAVClose(&wav_file))
+		in_result->Success = false;
+
+	if (in_result->Predecoded)
+		filePSGFrameTableFree(&frame_table);
+
+	fileMapClose(&psg_file);
+
+	in_result->RenderTime = renderBatchGetTime() - start_time;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Updates FNV-1a hash with the samples (little-endian byte order)
+static uint64_t renderBatchHash(uint64_t in_hash, int16_t* in_samples, int in_value_count)
+{
+	int i;
+	uint16_t sample;
+
+	for (i = 0; i < in_value_count; i++)
+	{
+		sample = (uint16_t)in_samples[i];
+
+		in_hash = (in_hash ^ (sample & 0xff)) * FNV_PRIME;
+		in_hash = (in_hash ^ (sample >> 8)) * FNV_PRIME;
+	}
+
+	return in_hash;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets high resolution time in seconds
+static double renderBatchGetTime(void)
+{
+	LARGE_INTEGER counter;
+	LARGE_INTEGER frequency;
+
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+
+	return (double)counter.QuadPart / frequency.QuadPart;
+}
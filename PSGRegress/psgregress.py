@@ -0,0 +1,310 @@
+#!/usr/bin/env python3
+###############################################################################
+# PSGRegress - Golden-hash regression harness for VGM2PSG and PSGPlayer
+#
+# Copyright (C) 2023 Laszlo Arvai
+# All rights reserved.
+#
+# This software may be modified and distributed under the terms
+# of the BSD license.  See the LICENSE file for details.
+###############################################################################
+#
+# Converts every VGM/VGZ file of a corpus folder with VGM2PSG (compressed and
+# non compressed, and with the '-macros' option toggled), renders the PSG files
+# with 'PSGPlayer -render-dir' and
+# records output sizes, compression ratios, PCM hashes and the wall time of
+# every stage. The corpus is converted into song banks as well, every song of
+# the banks is rendered looped once. The results are compared against a
+# baseline file.
+#
+# The check fails when:
+#  - the compressed and the non compressed PSG files render to different PCM
+#  - the PSG files with and without macros render to different PCM
+#  - a looped song of a bank renders to different PCM than the looped song
+#  - the PCM hash differs from the baseline
+#  - the compressed size grows more than the size threshold
+#  - the time of a stage grows more than the time threshold
+###############################################################################
+
+import argparse
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+BASELINE_VERSION = 1
+
+# stages measured for every file
+STAGES = ('convert', 'encode', 'compress', 'render')
+
+# time regressions below this limit (in seconds) are treated as noise
+MIN_TIME_DELTA = 0.05
+
+# number of songs of the banks of the bank check
+DEFAULT_BANK_SIZE = 3
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+DEFAULT_VGM2PSG = os.path.join(SCRIPT_DIR, '..', 'VGM2PSG', 'Release', 'Win32', 'VGM2PSG.exe')
+DEFAULT_PLAYER = os.path.join(SCRIPT_DIR, '..', 'PSGPlayer', 'Win32', 'Release', 'PSGPlayer.exe')
+
+RENDER_LINE = re.compile(r'^([0-9a-f]{16})\s+(\d+)\s+([0-9.]+)s\s+(.+)$')
+
+
+###############################################################################
+# Runs a command and returns the elapsed wall time
+def run_timed(command):
+    start = time.perf_counter()
+    result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+    elapsed = time.perf_counter() - start
+
+    if result.returncode != 0:
+        raise RuntimeError('command failed ({}): {}\n{}'.format(result.returncode, ' '.join(command), result.stdout))
+
+    return elapsed, result.stdout
+
+
+###############################################################################
+# Renders all PSG files of a folder, returns {file name: (hash, samples, time)}
+def render_folder(player, folder, options=()):
+    _, output = run_timed([player, '-render-dir', folder, '-threads', '1'] + list(options))
+
+    renders = {}
+    for line in output.splitlines():
+        match = RENDER_LINE.match(line.strip())
+        if match:
+            renders[match.group(4)] = (match.group(1), int(match.group(2)), float(match.group(3)))
+
+    return renders
+
+
+###############################################################################
+# Measures all files of the corpus
+def measure_corpus(args):
+    corpus_files = sorted(f for f in os.listdir(args.corpus) if f.lower().endswith(('.vgm', '.vgz')))
+    if not corpus_files:
+        raise RuntimeError('no VGM file found in: ' + args.corpus)
+
+    results = {}
+
+    with tempfile.TemporaryDirectory() as work_dir:
+        compressed_dir = os.path.join(work_dir, 'compressed')
+        uncompressed_dir = os.path.join(work_dir, 'uncompressed')
+        macro_dir = os.path.join(work_dir, 'macro')
+        os.mkdir(compressed_dir)
+        os.mkdir(uncompressed_dir)
+        os.mkdir(macro_dir)
+
+        # the macro check converts the corpus with the '-macros' option toggled
+        if '-macros' in args.options:
+            macro_options = [option for option in args.options if option != '-macros']
+        else:
+            macro_options = args.options + ['-macros']
+
+        # conversion stages
+        for vgm_file in corpus_files:
+            vgm_path = os.path.join(args.corpus, vgm_file)
+            psg_name = os.path.splitext(vgm_file)[0] + '.psg'
+            compressed_path = os.path.join(compressed_dir, psg_name)
+            uncompressed_path = os.path.join(uncompressed_dir, psg_name)
+
+            encode_time = min(run_timed([args.vgm2psg, vgm_path, uncompressed_path, '-noncompressed'] + args.options)[0] for _ in range(args.repeat))
+            convert_time = min(run_timed([args.vgm2psg, vgm_path, compressed_path] + args.options)[0] for _ in range(args.repeat))
+            run_timed([args.vgm2psg, vgm_path, os.path.join(macro_dir, psg_name)] + macro_options)
+
+            uncompressed_size = os.path.getsize(uncompressed_path)
+            compressed_size = os.path.getsize(compressed_path)
+
+            results[vgm_file] = {
+                'psg': psg_name,
+                'uncompressed_size': uncompressed_size,
+                'compressed_size': compressed_size,
+                'ratio': round(compressed_size / uncompressed_size, 4) if uncompressed_size else 0,
+                'time': {
+                    'convert': round(convert_time, 4),
+                    'encode': round(encode_time, 4),
+                    'compress': round(max(convert_time - encode_time, 0), 4),
+                },
+            }
+
+        # rendering stage
+        compressed_renders = render_folder(args.player, compressed_dir)
+        uncompressed_renders = render_folder(args.player, uncompressed_dir)
+        macro_renders = render_folder(args.player, macro_dir)
+
+        if args.bank_size > 0:
+            bank_matches = check_banks(args, corpus_files, compressed_dir, work_dir)
+
+    for vgm_file, result in results.items():
+        psg_name = result.pop('psg')
+        if psg_name not in compressed_renders or psg_name not in uncompressed_renders or psg_name not in macro_renders:
+            raise RuntimeError('rendering failed: ' + psg_name)
+
+        pcm_hash, samples, render_time = compressed_renders[psg_name]
+        result['pcm_hash'] = pcm_hash
+        result['samples'] = samples
+        result['time']['render'] = round(render_time, 4)
+        result['pcm_match'] = (uncompressed_renders[psg_name][0] == pcm_hash)
+        result['macro_match'] = (macro_renders[psg_name][0] == pcm_hash)
+        if args.bank_size > 0:
+            result['bank_match'] = bank_matches[vgm_file]
+
+    return results
+
+
+###############################################################################
+# Converts the corpus into banks of 'bank_size' songs. Every song of the banks is rendered looped once and compared
+# with the looped song converted alone. Returns {VGM file: match (None - the songs don't fit into a bank)}
+def check_banks(args, corpus_files, compressed_dir, work_dir):
+    bank_dir = os.path.join(work_dir, 'bank')
+    os.mkdir(bank_dir)
+
+    groups = [corpus_files[i:i + args.bank_size] for i in range(0, len(corpus_files), args.bank_size)]
+    bank_names = ['bank{}.psg'.format(i) for i in range(len(groups))]
+    matches = {}
+
+    for group, bank_name in zip(groups, bank_names):
+        try:
+            run_timed([args.vgm2psg, '-bank'] + [os.path.join(args.corpus, f) for f in group] + [os.path.join(bank_dir, bank_name)] + args.options)
+        except RuntimeError as error:
+            print('SKIP  bank of {}: {}'.format(', '.join(group), str(error).strip().splitlines()[-1]))
+            matches.update((vgm_file, None) for vgm_file in group)
+            if os.path.exists(os.path.join(bank_dir, bank_name)):
+                os.remove(os.path.join(bank_dir, bank_name))
+
+    standalone_renders = render_folder(args.player, compressed_dir, ['-loops', '1'])
+
+    for song_index in range(args.bank_size):
+        # the banks having the song are rendered from a separate folder
+        song_dir = os.path.join(work_dir, 'song{}'.format(song_index))
+        os.mkdir(song_dir)
+        song_banks = [(group, bank_name) for group, bank_name in zip(groups, bank_names) if song_index < len(group) and group[song_index] not in matches]
+        if not song_banks:
+            continue
+
+        for _, bank_name in song_banks:
+            shutil.copy(os.path.join(bank_dir, bank_name), song_dir)
+
+        bank_renders = render_folder(args.player, song_dir, ['-song', str(song_index), '-loops', '1'])
+
+        for group, bank_name in song_banks:
+            standalone = standalone_renders.get(os.path.splitext(group[song_index])[0] + '.psg')
+            song = bank_renders.get(bank_name)
+            matches[group[song_index]] = (standalone is not None and song is not None and standalone[:2] == song[:2])
+
+    return matches
+
+
+###############################################################################
+# Compares results against the baseline, returns list of failures
+def compare(results, baseline, args):
+    failures = []
+    baseline_files = baseline.get('files', {})
+
+    for vgm_file, result in sorted(results.items()):
+        if not result['pcm_match']:
+            failures.append('{}: compressed and non compressed PSG render differently'.format(vgm_file))
+
+        if result.get('macro_match') is False:
+            failures.append('{}: the PSG files with and without macros render differently'.format(vgm_file))
+
+        if result.get('bank_match') is False:
+            failures.append('{}: the looped song renders differently in a bank'.format(vgm_file))
+
+        reference = baseline_files.get(vgm_file)
+        if reference is None:
+            print('NEW   {}'.format(vgm_file))
+            continue
+
+        if result['pcm_hash'] != reference['pcm_hash']:
+            failures.append('{}: PCM hash changed {} -> {}'.format(vgm_file, reference['pcm_hash'], result['pcm_hash']))
+
+        size_limit = reference['compressed_size'] * (1 + args.size_threshold / 100.0)
+        if result['compressed_size'] > size_limit:
+            failures.append('{}: compressed size grew {} -> {} bytes'.format(vgm_file, reference['compressed_size'], result['compressed_size']))
+
+        for stage in STAGES:
+            old_time = reference['time'].get(stage, 0)
+            new_time = result['time'][stage]
+            if new_time > old_time * (1 + args.time_threshold / 100.0) and new_time - old_time > MIN_TIME_DELTA:
+                failures.append('{}: {} time regressed {:.3f}s -> {:.3f}s'.format(vgm_file, stage, old_time, new_time))
+
+    for vgm_file in sorted(set(baseline_files) - set(results)):
+        print('GONE  {}'.format(vgm_file))
+
+    return failures
+
+
+###############################################################################
+# Prints result table
+def print_results(results, baseline):
+    baseline_files = baseline.get('files', {}) if baseline else {}
+
+    print('{:<32} {:>9} {:>9} {:>7} {:>8} {:>8} {:>8} {:>8}  {}'.format('file', 'raw', 'packed', 'ratio', 'convert', 'encode', 'compress', 'render', 'size delta'))
+    for vgm_file, result in sorted(results.items()):
+        reference = baseline_files.get(vgm_file)
+        delta = '' if reference is None else '{:+d}'.format(result['compressed_size'] - reference['compressed_size'])
+        print('{:<32} {:>9} {:>9} {:>7.3f} {:>8.3f} {:>8.3f} {:>8.3f} {:>8.3f}  {}'.format(
+            vgm_file[:32], result['uncompressed_size'], result['compressed_size'], result['ratio'],
+            result['time']['convert'], result['time']['encode'], result['time']['compress'], result['time']['render'], delta))
+
+    total_raw = sum(r['uncompressed_size'] for r in results.values())
+    total_packed = sum(r['compressed_size'] for r in results.values())
+    print('Total: {} files, {} -> {} bytes ({:.3f})'.format(len(results), total_raw, total_packed, total_packed / total_raw if total_raw else 0))
+
+
+###############################################################################
+# Main function
+def main():
+    parser = argparse.ArgumentParser(description='Golden-hash regression harness for VGM2PSG and PSGPlayer')
+    parser.add_argument('corpus', help='folder of the VGM/VGZ files')
+    parser.add_argument('--baseline', default=os.path.join(SCRIPT_DIR, 'baseline.json'), help='baseline file (default: %(default)s)')
+    parser.add_argument('--update', action='store_true', help='store the results as the new baseline')
+    parser.add_argument('--vgm2psg', default=DEFAULT_VGM2PSG, help='VGM2PSG executable')
+    parser.add_argument('--player', default=DEFAULT_PLAYER, help='PSGPlayer executable')
+    parser.add_argument('--size-threshold', type=float, default=0.0, help='allowed compressed size growth in percent (default: %(default)s)')
+    parser.add_argument('--time-threshold', type=float, default=25.0, help='allowed stage time growth in percent (default: %(default)s)')
+    parser.add_argument('--repeat', type=int, default=1, help='number of conversion runs, the fastest one is used (default: %(default)s)')
+    parser.add_argument('--bank-size', type=int, default=DEFAULT_BANK_SIZE, help='songs per bank of the bank check, 0 - no bank check (default: %(default)s)')
+    parser.add_argument('--options', nargs=argparse.REMAINDER, default=[], help='additional VGM2PSG options (must be the last argument)')
+    args = parser.parse_args()
+
+    try:
+        results = measure_corpus(args)
+    except (RuntimeError, OSError) as error:
+        print('ERROR: {}'.format(error))
+        return 2
+
+    baseline = None
+    if os.path.exists(args.baseline):
+        with open(args.baseline, 'r') as baseline_file:
+            baseline = json.load(baseline_file)
+        if baseline.get('version') != BASELINE_VERSION or baseline.get('options', []) != args.options:
+            print('WARNING: baseline was recorded with a different version or options')
+
+    print_results(results, baseline)
+
+    if args.update:
+        with open(args.baseline, 'w') as baseline_file:
+            json.dump({'version': BASELINE_VERSION, 'options': args.options, 'files': results}, baseline_file, indent=2, sort_keys=True)
+        print('Baseline updated: {}'.format(args.baseline))
+        return 0
+
+    if baseline is None:
+        print('No baseline found, run with --update to create one: {}'.format(args.baseline))
+        return 1
+
+    failures = compare(results, baseline, args)
+    for failure in failures:
+        print('FAIL  ' + failure)
+
+    print('PASSED' if not failures else '{} check(s) FAILED'.format(len(failures)))
+
+    return 0 if not failures else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
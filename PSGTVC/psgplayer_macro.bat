@@ -0,0 +1,5 @@
+@sjasmplus.exe -Wno-rdlow --raw=psgplayer.bin --sym=psgplayer.sym --syntax=abf -DPSGMacroPlayer main.a80
+@copy /b psgplayer.bin + %1.psg psgplayer.bin
+@tvctape psgplayer.bin %1.cas -a 1 -o
+
+
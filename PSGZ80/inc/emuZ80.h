@@ -0,0 +1,72 @@
+/*****************************************************************************/
+/* PSGZ80 - Minimal Z80 CPU emulation                                        */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+#ifndef __emuZ80_h
+#define __emuZ80_h
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#include <stdint.h>
+#include <stdbool.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Constants
+#define emuZ80_MEMORY_SIZE 0x10000
+
+// Flags
+#define emuZ80_FLAG_C 0x01
+#define emuZ80_FLAG_N 0x02
+#define emuZ80_FLAG_PV 0x04
+#define emuZ80_FLAG_X 0x08
+#define emuZ80_FLAG_H 0x10
+#define emuZ80_FLAG_Y 0x20
+#define emuZ80_FLAG_Z 0x40
+#define emuZ80_FLAG_S 0x80
+
+///////////////////////////////////////////////////////////////////////////////
+// Types
+
+// I/O port callbacks
+typedef void (*emuZ80PortWrite)(void* in_context, uint16_t in_port, uint8_t in_data);
+typedef uint8_t (*emuZ80PortRead)(void* in_context, uint16_t in_port);
+
+// CPU state (no interrupt handling, the emulated code is called directly)
+typedef struct
+{
+	// registers
+	uint8_t A, F, B, C, D, E, H, L;
+	uint8_t AltA, AltF, AltB, AltC, AltD, AltE, AltH, AltL;
+	uint16_t IX;
+	uint16_t IY;
+	uint16_t SP;
+	uint16_t PC;
+	uint8_t I;
+	uint8_t R;
+	bool IFF1;
+	bool IFF2;
+	uint8_t InterruptMode;
+	bool Halted;
+
+	// executed T-states
+	uint64_t Cycles;
+
+	// memory and I/O
+	uint8_t Memory[emuZ80_MEMORY_SIZE];
+	emuZ80PortWrite PortWrite;
+	emuZ80PortRead PortRead;
+	void* PortContext;
+} emuZ80State;
+
+///////////////////////////////////////////////////////////////////////////////
+// Function prototypes
+void emuZ80Reset(emuZ80State* in_state);
+int emuZ80Step(emuZ80State* in_state);
+
+#endif
@@ -0,0 +1,61 @@
+/*****************************************************************************/
+/* PSGZ80 - TVC PSG player binary execution                                  */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+#ifndef __tvcPlayer_h
+#define __tvcPlayer_h
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#include <stdint.h>
+#include <stdbool.h>
+#include <emuSN76489.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Constants
+#define TVC_PLAYER_DEFAULT_ORG 6639				// PROGRAM_START_ADDRESS of PSGTVC/main.a80
+#define TVC_PLAYER_SOUND_PORT 0x10				// emulated sound card base address (slot 1)
+
+///////////////////////////////////////////////////////////////////////////////
+// Types
+
+// Sound card types (same values as the 'SndCardType' variable of the player)
+typedef enum
+{
+	TVC_CARD_GAME = 1,			// Game Card (frequency recalculation for the 3.125MHz chip clock)
+	TVC_CARD_SOUNDMAGIC = 2	// Sound Magic card (direct chip writes)
+} tvcPlayerCardType;
+
+// Addresses of the player routines and variables
+typedef struct
+{
+	uint16_t MusicPlayerIT;
+	uint16_t StartMusic;
+	uint16_t StartBankMusic;	// song start of the banks (zero if not found, only read from the symbol file)
+	uint16_t PSGFile;
+	uint16_t SndCardType;
+	uint16_t SndCardBaseAddr;
+	uint16_t PSGFileData;			// PSG data appended to the player binary (zero if not found)
+} tvcPlayerSymbols;
+
+///////////////////////////////////////////////////////////////////////////////
+// Function prototypes
+bool tvcPlayerLoad(uint8_t* in_binary, int in_binary_length, uint16_t in_org);
+bool tvcPlayerLoadSymbols(char* in_file_name);
+bool tvcPlayerFindSymbols(void);
+tvcPlayerSymbols* tvcPlayerGetSymbols(void);
+bool tvcPlayerIsFastFrequencyCalculation(void);
+int tvcPlayerGetBinaryEnd(void);
+uint8_t* tvcPlayerGetMemory(void);
+
+bool tvcPlayerStart(tvcPlayerCardType in_card, uint16_t in_psg_address, int in_song_index);
+bool tvcPlayerInterrupt(uint32_t* out_cycles, uint32_t* out_write_count);
+emuSN76489State* tvcPlayerGetChip(void);
+
+#endif
@@ -0,0 +1,511 @@
+/*****************************************************************************/
+/* PSGZ80 - TVC PSG player cycle measurement on an emulated Z80              */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <filePSG.h>
+#include <drvWaveOut.h>
+#include <tvcPlayer.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+#define BUFFER_SIZE (128*1024)
+#define Z80_CLOCK 3125000							// TVC CPU clock frequency in Hz
+#define PSG_CLOCK 3579545							// clock frequency of the PSG file
+#define CAS_HEADER_LENGTH 0x90				// file and program header of the TVC .cas file
+#define CAS_PROGRAM_LENGTH_POS 0x82
+#define MAX_REPORTED_MISMATCH 10
+
+///////////////////////////////////////////////////////////////////////////////
+// Local functions
+static int LoadFile(char* in_file_name, uint8_t* out_buffer, int in_buffer_size);
+static bool IsCASFile(char* in_file_name);
+static uint16_t ConvertGameCardTone(uint16_t in_tone, bool in_fast);
+static bool CompareRegisters(uint32_t in_interrupt, bool in_recalculate, bool in_fast);
+static bool GetNumericParameter(int in_argc, char* in_argv[], int in_index, int in_min, int in_max, int* out_number);
+static void PrintUsage(void);
+
+///////////////////////////////////////////////////////////////////////////////
+// Module global variables
+static uint8_t l_file_buffer[BUFFER_SIZE];
+static uint8_t l_psg_buffer[BUFFER_SIZE];
+static int16_t l_render_buffer[WAVE_BUFFER_LENGTH];
+static PSGPlayerType l_reference;
+static uint16_t l_reference_registers[8];
+static uint8_t l_written_registers = 0;
+static uint32_t l_mismatch_count = 0;
+
+// frequency table of 'RecalculateAndUpdateFrequency' (PSGFastFreqCalculation=0)
+static const uint16_t l_freq_multiplier_table[32] =
+{
+	  0,  28,  56,  84, 112, 140, 168, 196,
+	224, 251, 279, 307, 335, 363, 391, 419,
+	447, 475, 503, 531, 559, 587, 615, 643,
+	671, 699, 726, 754, 782, 810, 838, 866
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Main function
+int main(int argc, char* argv[])
+{
+	char* player_file_name = NULL;
+	char* psg_file_name = NULL;
+	char* symbol_file_name = NULL;
+	char* csv_file_name = NULL;
+	FILE* csv_file = NULL;
+	tvcPlayerCardType card = TVC_CARD_GAME;
+	tvcPlayerSymbols* symbols;
+	int org = TVC_PLAYER_DEFAULT_ORG;
+	int framerate = 50;
+	int max_interrupts = 0;
+	int song_index = -1;
+	uint32_t song_start = 0;
+	int length;
+	int psg_address;
+	int psg_length;
+	int value;
+	int i;
+	uint8_t* binary;
+	uint32_t cycles;
+	uint32_t write_count;
+	uint32_t frame_count;
+	uint32_t interrupt_count = 0;
+	uint32_t data_frame_count = 0;
+	uint32_t worst_cycles = 0;
+	uint32_t worst_interrupt = 0;
+	uint32_t compared_count = 0;
+	uint64_t total_cycles = 0;
+	uint32_t frame_cycles;
+	bool data_frame;
+	bool fast;
+	bool recalculate;
+
+	printf("TVC PSG player Z80 cycle measurement (c) Laszlo Arvai 2023\n");
+
+	if (argc < 2)
+	{
+		PrintUsage();
+		return -1;
+	}
+
+	// process command line parameters
+	for (i = 1; i < argc; i++)
+	{
+		if (argv[i][0] == '-')
+		{
+			if (_strcmpi(argv[i], "-card") == 0 && i + 1 < argc)
+			{
+				i++;
+				if (_strcmpi(argv[i], "game") == 0)
+					card = TVC_CARD_GAME;
+				else if (_strcmpi(argv[i], "soundmagic") == 0)
+					card = TVC_CARD_SOUNDMAGIC;
+				else
+				{
+					printf("ERROR: Unknown sound card: %s\n", argv[i]);
+					return -1;
+				}
+			}
+			else
+			{
+				if (_strcmpi(argv[i], "-sym") == 0 && i + 1 < argc)
+				{
+					i++;
+					symbol_file_name = argv[i];
+				}
+				else
+				{
+					if (_strcmpi(argv[i], "-org") == 0)
+					{
+						if (!GetNumericParameter(argc, argv, i, 256, 65535, &value))
+							return -1;
+
+						org = value;
+						i++;
+					}
+					else
+					{
+						if (_strcmpi(argv[i], "-interrupts") == 0)
+						{
+							if (!GetNumericParameter(argc, argv, i, 1, 100000000, &value))
+								return -1;
+
+							max_interrupts = value;
+							i++;
+						}
+						else
+						{
+							if (_strcmpi(argv[i], "-framerate") == 0)
+							{
+								if (!GetNumericParameter(argc, argv, i, 20, 100, &value))
+									return -1;
+
+								framerate = value;
+								i++;
+							}
+							else
+							{
+								if (_strcmpi(argv[i], "-csv") == 0 && i + 1 < argc)
+								{
+									i++;
+									csv_file_name = argv[i];
+								}
+								else
+								{
+									if (_strcmpi(argv[i], "-song") == 0)
+									{
+										if (!GetNumericParameter(argc, argv, i, 0, PSG_BANK_MAX_SONG_COUNT - 1, &value))
+											return -1;
+
+										song_index = value;
+										i++;
+									}
+									else
+									{
+										if (_strcmpi(argv[i], "-?") == 0)
+										{
+											PrintUsage();
+											return 0;
+										}
+										else
+										{
+											printf("ERROR: Invalid command line parameter: %s\n", argv[i]);
+											return -1;
+										}
+									}
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+		else
+		{
+			if (player_file_name == NULL)
+				player_file_name = argv[i];
+			else
+				psg_file_name = argv[i];
+		}
+	}
+
+	if (player_file_name == NULL)
+	{
+		printf("ERROR: No player binary was specified.\n");
+		return -1;
+	}
+
+	// load player binary
+	length = LoadFile(player_file_name, l_file_buffer, BUFFER_SIZE);
+	if (length <= 0)
+		return -1;
+
+	binary = l_file_buffer;
+	if (IsCASFile(player_file_name))
+	{
+		// skip the headers of the tape file
+		value = (length > CAS_HEADER_LENGTH) ? l_file_buffer[CAS_PROGRAM_LENGTH_POS] + (l_file_buffer[CAS_PROGRAM_LENGTH_POS + 1] << 8) : 0;
+		if (value == 0 || CAS_HEADER_LENGTH + value > length)
+		{
+			printf("ERROR: Invalid CAS file: %s\n", player_file_name);
+			return -1;
+		}
+
+		binary += CAS_HEADER_LENGTH;
+		length = value;
+	}
+
+	if (!tvcPlayerLoad(binary, length, (uint16_t)org))
+		return -1;
+
+	// resolve player addresses
+	if (symbol_file_name != NULL && !tvcPlayerLoadSymbols(symbol_file_name))
+		return -1;
+
+	if (!tvcPlayerFindSymbols())
+		return -1;
+
+	symbols = tvcPlayerGetSymbols();
+	fast = tvcPlayerIsFastFrequencyCalculation();
+
+	// place PSG data
+	if (psg_file_name != NULL)
+	{
+		// after the player binary
+		psg_address = tvcPlayerGetBinaryEnd();
+		psg_length = LoadFile(psg_file_name, l_psg_buffer, BUFFER_SIZE);
+		if (psg_length <= 0)
+			return -1;
+
+		if (psg_address + psg_length > 0x10000)
+		{
+			printf("ERROR: PSG file does not fit into the memory after the player.\n");
+			return -1;
+		}
+
+		memcpy(tvcPlayerGetMemory() + psg_address, l_psg_buffer, psg_length);
+	}
+	else
+	{
+		// appended to the binary by psgplayer.bat
+		psg_address = symbols->PSGFileData;
+		psg_length = tvcPlayerGetBinaryEnd() - psg_address;
+		if (psg_address == 0 || psg_length <= 0)
+		{
+			printf("ERROR: No PSG data in the player binary, specify a PSG file.\n");
+			return -1;
+		}
+
+		memcpy(l_psg_buffer, tvcPlayerGetMemory() + psg_address, psg_length);
+	}
+
+	printf("Player: $%04X-$%04X, MusicPlayer_IT=$%04X, StartMusic=$%04X, PSG data=$%04X (%d bytes)\n", org, tvcPlayerGetBinaryEnd() - 1,
+		symbols->MusicPlayerIT, symbols->StartMusic, psg_address, psg_length);
+
+	// song of a bank
+	if (song_index >= 0)
+	{
+		if (!filePSGDecoderGetBankSong(l_psg_buffer, psg_length, song_index, &song_start))
+		{
+			printf("ERROR: Invalid song index or bank file (the bank has %d songs).\n", filePSGDecoderGetBankSongCount(l_psg_buffer, psg_length));
+			return -1;
+		}
+
+		printf("Song %d of the bank: offset $%04X\n", song_index, song_start);
+	}
+
+	// open CSV file
+	if (csv_file_name != NULL)
+	{
+		csv_file = fopen(csv_file_name, "wt");
+		if (csv_file == NULL)
+		{
+			printf("ERROR: Can't create CSV file: %s\n", csv_file_name);
+			return -1;
+		}
+
+		fprintf(csv_file, "Interrupt,Cycles,ChipWrites,Frame\n");
+	}
+
+	// start the Z80 player and the C player
+	if (!tvcPlayerStart(card, (uint16_t)psg_address, song_index))
+		return -1;
+
+	filePSGInstanceInit(&l_reference, PSG_CLOCK, framerate, 1);
+	filePSGInstanceStartSong(&l_reference, l_psg_buffer, psg_length, song_start, 0);
+	memset(l_reference_registers, 0, sizeof(l_reference_registers));
+
+	// the Game Card player recalculates the tone values unless the clock tag gives the Game Card clock
+	recalculate = (card == TVC_CARD_GAME && l_reference.PSGClockFrequency != PSG_CLOCK_3125KHZ);
+
+	// one call of the Z80 player and one frame of the C player per interrupt
+	while (max_interrupts == 0 || interrupt_count < (uint32_t)max_interrupts)
+	{
+		if (!tvcPlayerInterrupt(&cycles, &write_count))
+			return -1;
+
+		frame_count = l_reference.CurrentFrameCount;
+		filePSGInstanceRender(&l_reference, l_render_buffer, l_reference.FrameSampleCount);
+		data_frame = (l_reference.CurrentFrameCount != frame_count);
+
+		// the C player stops at the end of the song when there is no loop point
+		if (!l_reference.Finished)
+		{
+			CompareRegisters(interrupt_count, recalculate, fast);
+			compared_count++;
+		}
+
+		if (data_frame)
+			data_frame_count++;
+
+		if (cycles > worst_cycles)
+		{
+			worst_cycles = cycles;
+			worst_interrupt = interrupt_count;
+		}
+
+		total_cycles += cycles;
+
+		if (csv_file != NULL)
+			fprintf(csv_file, "%u,%u,%u,%d\n", interrupt_count, cycles, write_count, data_frame ? 1 : 0);
+
+		interrupt_count++;
+
+		// one playthrough (until the end of data mark)
+		if (max_interrupts == 0 && (l_reference.PlayCount > 0 || l_reference.Finished))
+			break;
+	}
+
+	if (csv_file != NULL)
+		fclose(csv_file);
+
+	// print results
+	frame_cycles = Z80_CLOCK / framerate;
+
+	if (recalculate)
+	{
+		printf("Z80 player cycles (Game Card, %s frequency recalculation):\n", fast ? "fast" : "table based");
+	}
+	else
+	{
+		if (card == TVC_CARD_GAME)
+			printf("Z80 player cycles (Game Card, clock tagged PSG, no frequency recalculation):\n");
+		else
+			printf("Z80 player cycles (Sound Magic, no frequency recalculation):\n");
+	}
+
+	printf("  Interrupts:         %u (%u with PSG data)\n", interrupt_count, data_frame_count);
+	printf("  Worst case:         %u T-states (%.2f%% of frame) at interrupt %u (%.2fs)\n", worst_cycles, worst_cycles * 100.0 / frame_cycles,
+		worst_interrupt, (double)worst_interrupt / framerate);
+	printf("  Average:            %.1f T-states (%.2f%% of frame)\n", (double)total_cycles / interrupt_count,
+		(double)total_cycles * 100.0 / interrupt_count / frame_cycles);
+
+	if (data_frame_count > 0)
+		printf("  Average with data:  %.1f T-states\n", (double)total_cycles / data_frame_count);
+
+	printf("  Register check:     %u interrupts compared with the C player, %u mismatches\n", compared_count, l_mismatch_count);
+
+	return (l_mismatch_count > 0) ? 1 : 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Loads file into the buffer, returns the length (or -1 on error)
+static int LoadFile(char* in_file_name, uint8_t* out_buffer, int in_buffer_size)
+{
+	FILE* file;
+	int length;
+
+	file = fopen(in_file_name, "rb");
+	if (file == NULL)
+	{
+		printf("ERROR: Can't open file: %s\n", in_file_name);
+		return -1;
+	}
+
+	length = (int)fread(out_buffer, 1, in_buffer_size, file);
+
+	fclose(file);
+
+	if (length <= 0)
+	{
+		printf("ERROR: Can't read file: %s\n", in_file_name);
+		return -1;
+	}
+
+	return length;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns true if the file has .cas extension
+static bool IsCASFile(char* in_file_name)
+{
+	char* extension = strrchr(in_file_name, '.');
+
+	return extension != NULL && _strcmpi(extension, ".cas") == 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Converts tone register value of the PSG file to the 3.125MHz Game Card chip clock
+// the same way as the 'RecalculateAndUpdateFrequency' routine
+static uint16_t ConvertGameCardTone(uint16_t in_tone, bool in_fast)
+{
+	if (in_fast)
+		return (uint16_t)(((in_tone * 7) >> 3) & 0x3ff);
+
+	return (uint16_t)((l_freq_multiplier_table[(in_tone >> 5) & 0x1f] + (l_freq_multiplier_table[in_tone & 0x1f] >> 5)) & 0x3ff);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Compares the chip registers written by the Z80 player with the C player registers
+static bool CompareRegisters(uint32_t in_interrupt, bool in_recalculate, bool in_fast)
+{
+	emuSN76489State* chip = tvcPlayerGetChip();
+	uint16_t expected;
+	bool match = true;
+	int i;
+
+	for (i = 0; i < 8; i++)
+	{
+		// only the registers written by the song are compared
+		if (l_reference.SN76489.Registers[i] != l_reference_registers[i])
+			l_written_registers |= (1 << i);
+
+		l_reference_registers[i] = l_reference.SN76489.Registers[i];
+
+		if ((l_written_registers & (1 << i)) == 0)
+			continue;
+
+		expected = l_reference_registers[i];
+
+		// tone registers are recalculated on the Game Card
+		if (in_recalculate && i < 6 && (i & 1) == 0)
+			expected = ConvertGameCardTone(expected, in_fast);
+
+		if (chip->Registers[i] != expected)
+		{
+			if (l_mismatch_count < MAX_REPORTED_MISMATCH)
+				printf("Register %d mismatch at interrupt %u: Z80 player $%03X, C player $%03X\n", i, in_interrupt, chip->Registers[i], expected);
+
+			l_mismatch_count++;
+			match = false;
+		}
+	}
+
+	return match;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets numeric parameter from the command line
+static bool GetNumericParameter(int in_argc, char* in_argv[], int in_index, int in_min, int in_max, int* out_number)
+{
+	int number;
+
+	if (in_index + 1 < in_argc)
+	{
+		number = atoi(in_argv[in_index + 1]);
+
+		if (number < in_min || number>in_max)
+		{
+			printf("Invalid value: %d\n", number);
+			return false;
+		}
+		else
+		{
+			*out_number = number;
+
+			return true;
+		}
+	}
+	else
+	{
+		printf("Invalid parameter: %s\n", in_argv[in_index]);
+		return false;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Prints help text
+static void PrintUsage(void)
+{
+	printf("Usage:\n");
+	printf("PSGZ80 [options] player.bin|player.cas [musicfile.psg]\n");
+	printf("Options:\n");
+	printf("  -card type     - sets the emulated sound card (game, soundmagic). The default is game\n");
+	printf("  -csv file      - writes the cycles and chip writes of every interrupt into the CSV file\n");
+	printf("  -framerate n   - sets the interrupt rate to n Hz (used for the frame percentage). The default is 50Hz\n");
+	printf("  -interrupts n  - runs n interrupts (the song is looped). The default is one playthrough\n");
+	printf("  -org n         - sets the load address of the binary. The default is 6639\n");
+	printf("  -song n        - starts the song n (0..) of a song bank by 'StartBankMusic' (needs the symbol file)\n");
+	printf("  -sym file      - reads the player addresses from the sjasmplus symbol file\n");
+	printf("  -?             - prints this help text\n");
+}
@@ -0,0 +1,55 @@
+/*****************************************************************************/
+/* PSGZ80 - Wave out device replacement (no audio output)                    */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#include <drvWaveOut.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// The PSGPlayer C player and sound chip emulation are used without audio output,
+// this module provides the wave out globals and functions they refer to.
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+// Global variables
+uint16_t g_sample_rate = 44100;
+bool g_stereo_mode = false;
+
+///////////////////////////////////////////////////////////////////////////////
+// Module global variables
+static int16_t l_buffer[WAVE_BUFFER_LENGTH];
+
+///////////////////////////////////////////////////////////////////////////////
+// Opens wave out device (always success)
+bool waveOpen(void)
+{
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets the next wave out buffer (the content is discarded)
+int16_t* waveGetBuffer(void)
+{
+	return l_buffer;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Closes wave out device
+void waveClose(bool in_force_close)
+{
+	(void)in_force_close;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns true while buffers are played (never)
+bool waveIsBusy(void)
+{
+	return false;
+}
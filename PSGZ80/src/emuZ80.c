@@ -0,0 +1,1205 @@
+/*****************************************************************************/
+/* PSGZ80 - Minimal Z80 CPU emulation                                        */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#include <string.h>
+#include <emuZ80.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Instruction decoding
+///////////////////////////////////////////////////////////////////////////////
+// The opcodes are decoded by their bit fields: xx yyy zzz (y = pp q).
+// The DD and FD prefixes replace HL by IX or IY, and (HL) by (IX+d) or (IY+d).
+// The returned T-states are the documented instruction timings, the interrupt
+// handling and the wait states of the hardware are not emulated.
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+#define INDEX_HL 0
+#define INDEX_IX 1
+#define INDEX_IY 2
+
+#define REG_HL_INDIRECT 6
+
+#define FLAG_C emuZ80_FLAG_C
+#define FLAG_N emuZ80_FLAG_N
+#define FLAG_PV emuZ80_FLAG_PV
+#define FLAG_X emuZ80_FLAG_X
+#define FLAG_H emuZ80_FLAG_H
+#define FLAG_Y emuZ80_FLAG_Y
+#define FLAG_Z emuZ80_FLAG_Z
+#define FLAG_S emuZ80_FLAG_S
+#define FLAG_XY (FLAG_X | FLAG_Y)
+
+///////////////////////////////////////////////////////////////////////////////
+// Local functions
+static int emuZ80ExecuteMain(emuZ80State* in_state, uint8_t in_opcode, int in_index);
+static int emuZ80ExecuteCB(emuZ80State* in_state, int in_index);
+static int emuZ80ExecuteED(emuZ80State* in_state);
+
+static uint8_t emuZ80FetchByte(emuZ80State* in_state);
+static uint16_t emuZ80FetchWord(emuZ80State* in_state);
+static uint16_t emuZ80ReadWord(emuZ80State* in_state, uint16_t in_address);
+static void emuZ80WriteWord(emuZ80State* in_state, uint16_t in_address, uint16_t in_data);
+static void emuZ80Push(emuZ80State* in_state, uint16_t in_data);
+static uint16_t emuZ80Pop(emuZ80State* in_state);
+static void emuZ80PortOut(emuZ80State* in_state, uint16_t in_port, uint8_t in_data);
+static uint8_t emuZ80PortIn(emuZ80State* in_state, uint16_t in_port);
+
+static uint16_t emuZ80GetPair(emuZ80State* in_state, int in_pair, int in_index);
+static void emuZ80SetPair(emuZ80State* in_state, int in_pair, int in_index, uint16_t in_value);
+static uint16_t emuZ80GetPair2(emuZ80State* in_state, int in_pair, int in_index);
+static void emuZ80SetPair2(emuZ80State* in_state, int in_pair, int in_index, uint16_t in_value);
+static uint16_t emuZ80GetIndexAddress(emuZ80State* in_state, int in_index);
+static uint8_t emuZ80GetRegister(emuZ80State* in_state, int in_register, int in_index, uint16_t in_address);
+static void emuZ80SetRegister(emuZ80State* in_state, int in_register, int in_index, uint16_t in_address, uint8_t in_value);
+static bool emuZ80TestCondition(emuZ80State* in_state, int in_condition);
+
+static void emuZ80ALU(emuZ80State* in_state, int in_operation, uint8_t in_value);
+static uint8_t emuZ80Increment(emuZ80State* in_state, uint8_t in_value);
+static uint8_t emuZ80Decrement(emuZ80State* in_state, uint8_t in_value);
+static uint16_t emuZ80Add16(emuZ80State* in_state, uint16_t in_value1, uint16_t in_value2);
+static uint16_t emuZ80AddCarry16(emuZ80State* in_state, uint16_t in_value1, uint16_t in_value2);
+static uint16_t emuZ80SubtractCarry16(emuZ80State* in_state, uint16_t in_value1, uint16_t in_value2);
+static uint8_t emuZ80Rotate(emuZ80State* in_state, int in_operation, uint8_t in_value);
+static void emuZ80DecimalAdjust(emuZ80State* in_state);
+static uint8_t emuZ80SZP(uint8_t in_value);
+
+///////////////////////////////////////////////////////////////////////////////
+// Resets the CPU (the memory content is not changed)
+void emuZ80Reset(emuZ80State* in_state)
+{
+	in_state->A = in_state->F = in_state->B = in_state->C = 0xff;
+	in_state->D = in_state->E = in_state->H = in_state->L = 0xff;
+	in_state->AltA = in_state->AltF = in_state->AltB = in_state->AltC = 0xff;
+	in_state->AltD = in_state->AltE = in_state->AltH = in_state->AltL = 0xff;
+	in_state->IX = in_state->IY = 0xffff;
+	in_state->SP = 0xffff;
+	in_state->PC = 0;
+	in_state->I = 0;
+	in_state->R = 0;
+	in_state->IFF1 = in_state->IFF2 = false;
+	in_state->InterruptMode = 0;
+	in_state->Halted = false;
+	in_state->Cycles = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Executes one instruction, returns its T-states
+int emuZ80Step(emuZ80State* in_state)
+{
+	uint8_t opcode;
+	int cycles;
+
+	if (in_state->Halted)
+	{
+		in_state->Cycles += 4;
+		return 4;
+	}
+
+	in_state->R = (in_state->R & 0x80) | ((in_state->R + 1) & 0x7f);
+	opcode = emuZ80FetchByte(in_state);
+
+	switch (opcode)
+	{
+		case 0xcb:
+			cycles = emuZ80ExecuteCB(in_state, INDEX_HL);
+			break;
+
+		case 0xed:
+			cycles = emuZ80ExecuteED(in_state);
+			break;
+
+		case 0xdd:
+		case 0xfd:
+			cycles = 4;
+			// the last one of the repeated prefixes is used
+			while (in_state->Memory[in_state->PC] == 0xdd || in_state->Memory[in_state->PC] == 0xfd)
+			{
+				opcode = emuZ80FetchByte(in_state);
+				cycles += 4;
+			}
+
+			if (in_state->Memory[in_state->PC] == 0xcb)
+			{
+				in_state->PC++;
+				cycles += emuZ80ExecuteCB(in_state, (opcode == 0xdd) ? INDEX_IX : INDEX_IY);
+			}
+			else
+			{
+				if (in_state->Memory[in_state->PC] == 0xed)
+				{
+					// the prefix has no effect
+					in_state->PC++;
+					cycles += emuZ80ExecuteED(in_state);
+				}
+				else
+				{
+					cycles += emuZ80ExecuteMain(in_state, emuZ80FetchByte(in_state), (opcode == 0xdd) ? INDEX_IX : INDEX_IY);
+				}
+			}
+			break;
+
+		default:
+			cycles = emuZ80ExecuteMain(in_state, opcode, INDEX_HL);
+			break;
+	}
+
+	in_state->Cycles += cycles;
+
+	return cycles;
+}
+
+/*****************************************************************************/
+/* Local functions                                                           */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Executes a non prefixed instruction (or a DD/FD prefixed one), returns T-states (without the prefix)
+static int emuZ80ExecuteMain(emuZ80State* in_state, uint8_t in_opcode, int in_index)
+{
+	int x = in_opcode >> 6;
+	int y = (in_opcode >> 3) & 7;
+	int z = in_opcode & 7;
+	int p = y >> 1;
+	int q = y & 1;
+	uint16_t address = 0;
+	uint16_t word;
+	uint8_t value;
+	int8_t displacement;
+	int cycles;
+
+	switch (x)
+	{
+		case 0:
+			switch (z)
+			{
+				case 0:
+					switch (y)
+					{
+						case 0:	// NOP
+							return 4;
+
+						case 1:	// EX AF,AF'
+							value = in_state->A; in_state->A = in_state->AltA; in_state->AltA = value;
+							value = in_state->F; in_state->F = in_state->AltF; in_state->AltF = value;
+							return 4;
+
+						case 2:	// DJNZ d
+							displacement = (int8_t)emuZ80FetchByte(in_state);
+							in_state->B--;
+							if (in_state->B != 0)
+							{
+								in_state->PC += displacement;
+								return 13;
+							}
+							return 8;
+
+						case 3:	// JR d
+							displacement = (int8_t)emuZ80FetchByte(in_state);
+							in_state->PC += displacement;
+							return 12;
+
+						default: // JR cc,d
+							displacement = (int8_t)emuZ80FetchByte(in_state);
+							if (emuZ80TestCondition(in_state, y - 4))
+							{
+								in_state->PC += displacement;
+								return 12;
+							}
+							return 7;
+					}
+
+				case 1:
+					if (q == 0)
+					{
+						// LD rp,nn
+						emuZ80SetPair(in_state, p, in_index, emuZ80FetchWord(in_state));
+						return 10;
+					}
+					else
+					{
+						// ADD HL,rp
+						emuZ80SetPair(in_state, 2, in_index, emuZ80Add16(in_state, emuZ80GetPair(in_state, 2, in_index), emuZ80GetPair(in_state, p, in_index)));
+						return 11;
+					}
+
+				case 2:
+					switch (y)
+					{
+						case 0:	// LD (BC),A
+							in_state->Memory[(in_state->B << 8) | in_state->C] = in_state->A;
+							return 7;
+
+						case 1:	// LD A,(BC)
+							in_state->A = in_state->Memory[(in_state->B << 8) | in_state->C];
+							return 7;
+
+						case 2:	// LD (DE),A
+							in_state->Memory[(in_state->D << 8) | in_state->E] = in_state->A;
+							return 7;
+
+						case 3:	// LD A,(DE)
+							in_state->A = in_state->Memory[(in_state->D << 8) | in_state->E];
+							return 7;
+
+						case 4:	// LD (nn),HL
+							emuZ80WriteWord(in_state, emuZ80FetchWord(in_state), emuZ80GetPair(in_state, 2, in_index));
+							return 16;
+
+						case 5:	// LD HL,(nn)
+							emuZ80SetPair(in_state, 2, in_index, emuZ80ReadWord(in_state, emuZ80FetchWord(in_state)));
+							return 16;
+
+						case 6:	// LD (nn),A
+							in_state->Memory[emuZ80FetchWord(in_state)] = in_state->A;
+							return 13;
+
+						default: // LD A,(nn)
+							in_state->A = in_state->Memory[emuZ80FetchWord(in_state)];
+							return 13;
+					}
+
+				case 3:
+					// INC rp / DEC rp
+					emuZ80SetPair(in_state, p, in_index, emuZ80GetPair(in_state, p, in_index) + ((q == 0) ? 1 : -1));
+					return 6;
+
+				case 4:
+				case 5:
+					// INC r / DEC r
+					cycles = 4;
+					if (y == REG_HL_INDIRECT)
+					{
+						address = emuZ80GetIndexAddress(in_state, in_index);
+						cycles = (in_index == INDEX_HL) ? 11 : 19;
+					}
+					value = emuZ80GetRegister(in_state, y, in_index, address);
+					value = (z == 4) ? emuZ80Increment(in_state, value) : emuZ80Decrement(in_state, value);
+					emuZ80SetRegister(in_state, y, in_index, address, value);
+					return cycles;
+
+				case 6:
+					// LD r,n
+					cycles = 7;
+					if (y == REG_HL_INDIRECT)
+					{
+						address = emuZ80GetIndexAddress(in_state, in_index);
+						cycles = (in_index == INDEX_HL) ? 10 : 15;
+					}
+					emuZ80SetRegister(in_state, y, in_index, address, emuZ80FetchByte(in_state));
+					return cycles;
+
+				default:
+					switch (y)
+					{
+						case 0: // RLCA
+							in_state->A = (uint8_t)((in_state->A << 1) | (in_state->A >> 7));
+							in_state->F = (in_state->F & (FLAG_S | FLAG_Z | FLAG_PV)) | (in_state->A & (FLAG_XY | FLAG_C));
+							break;
+
+						case 1: // RRCA
+							in_state->F = (in_state->F & (FLAG_S | FLAG_Z | FLAG_PV)) | (in_state->A & FLAG_C);
+							in_state->A = (uint8_t)((in_state->A >> 1) | (in_state->A << 7));
+							in_state->F |= in_state->A & FLAG_XY;
+							break;
+
+						case 2: // RLA
+							value = in_state->A >> 7;
+							in_state->A = (uint8_t)((in_state->A << 1) | (in_state->F & FLAG_C));
+							in_state->F = (in_state->F & (FLAG_S | FLAG_Z | FLAG_PV)) | (in_state->A & FLAG_XY) | value;
+							break;
+
+						case 3: // RRA
+							value = in_state->A & FLAG_C;
+							in_state->A = (uint8_t)((in_state->A >> 1) | ((in_state->F & FLAG_C) << 7));
+							in_state->F = (in_state->F & (FLAG_S | FLAG_Z | FLAG_PV)) | (in_state->A & FLAG_XY) | value;
+							break;
+
+						case 4: // DAA
+							emuZ80DecimalAdjust(in_state);
+							break;
+
+						case 5: // CPL
+							in_state->A = ~in_state->A;
+							in_state->F = (in_state->F & (FLAG_S | FLAG_Z | FLAG_PV | FLAG_C)) | FLAG_H | FLAG_N | (in_state->A & FLAG_XY);
+							break;
+
+						case 6: // SCF
+							in_state->F = (in_state->F & (FLAG_S | FLAG_Z | FLAG_PV)) | FLAG_C | (in_state->A & FLAG_XY);
+							break;
+
+						default: // CCF
+							in_state->F = ((in_state->F & (FLAG_S | FLAG_Z | FLAG_PV | FLAG_C)) | ((in_state->F & FLAG_C) << 4) | (in_state->A & FLAG_XY)) ^ FLAG_C;
+							break;
+					}
+					return 4;
+			}
+
+		case 1:
+			// HALT
+			if (y == REG_HL_INDIRECT && z == REG_HL_INDIRECT)
+			{
+				in_state->Halted = true;
+				return 4;
+			}
+
+			// LD r,r' (H and L are not replaced when the other operand is (IX+d))
+			if (y == REG_HL_INDIRECT || z == REG_HL_INDIRECT)
+			{
+				address = emuZ80GetIndexAddress(in_state, in_index);
+				if (y == REG_HL_INDIRECT)
+					emuZ80SetRegister(in_state, y, in_index, address, emuZ80GetRegister(in_state, z, INDEX_HL, address));
+				else
+					emuZ80SetRegister(in_state, y, INDEX_HL, address, emuZ80GetRegister(in_state, z, in_index, address));
+
+				return (in_index == INDEX_HL) ? 7 : 15;
+			}
+
+			emuZ80SetRegister(in_state, y, in_index, 0, emuZ80GetRegister(in_state, z, in_index, 0));
+			return 4;
+
+		case 2:
+			// ALU r
+			cycles = 4;
+			if (z == REG_HL_INDIRECT)
+			{
+				address = emuZ80GetIndexAddress(in_state, in_index);
+				cycles = (in_index == INDEX_HL) ? 7 : 15;
+			}
+			emuZ80ALU(in_state, y, emuZ80GetRegister(in_state, z, in_index, address));
+			return cycles;
+
+		default:
+			switch (z)
+			{
+				case 0:
+					// RET cc
+					if (emuZ80TestCondition(in_state, y))
+					{
+						in_state->PC = emuZ80Pop(in_state);
+						return 11;
+					}
+					return 5;
+
+				case 1:
+					if (q == 0)
+					{
+						// POP rp2
+						emuZ80SetPair2(in_state, p, in_index, emuZ80Pop(in_state));
+						return 10;
+					}
+
+					switch (p)
+					{
+						case 0: // RET
+							in_state->PC = emuZ80Pop(in_state);
+							return 10;
+
+						case 1: // EXX
+							value = in_state->B; in_state->B = in_state->AltB; in_state->AltB = value;
+							value = in_state->C; in_state->C = in_state->AltC; in_state->AltC = value;
+							value = in_state->D; in_state->D = in_state->AltD; in_state->AltD = value;
+							value = in_state->E; in_state->E = in_state->AltE; in_state->AltE = value;
+							value = in_state->H; in_state->H = in_state->AltH; in_state->AltH = value;
+							value = in_state->L; in_state->L = in_state->AltL; in_state->AltL = value;
+							return 4;
+
+						case 2: // JP (HL)
+							in_state->PC = emuZ80GetPair(in_state, 2, in_index);
+							return 4;
+
+						default: // LD SP,HL
+							in_state->SP = emuZ80GetPair(in_state, 2, in_index);
+							return 6;
+					}
+
+				case 2:
+					// JP cc,nn
+					word = emuZ80FetchWord(in_state);
+					if (emuZ80TestCondition(in_state, y))
+						in_state->PC = word;
+					return 10;
+
+				case 3:
+					switch (y)
+					{
+						case 0: // JP nn
+							in_state->PC = emuZ80FetchWord(in_state);
+							return 10;
+
+						case 2: // OUT (n),A
+							emuZ80PortOut(in_state, (uint16_t)((in_state->A << 8) | emuZ80FetchByte(in_state)), in_state->A);
+							return 11;
+
+						case 3: // IN A,(n)
+							in_state->A = emuZ80PortIn(in_state, (uint16_t)((in_state->A << 8) | emuZ80FetchByte(in_state)));
+							return 11;
+
+						case 4: // EX (SP),HL
+							word = emuZ80ReadWord(in_state, in_state->SP);
+							emuZ80WriteWord(in_state, in_state->SP, emuZ80GetPair(in_state, 2, in_index));
+							emuZ80SetPair(in_state, 2, in_index, word);
+							return 19;
+
+						case 5: // EX DE,HL (not affected by the prefix)
+							value = in_state->D; in_state->D = in_state->H; in_state->H = value;
+							value = in_state->E; in_state->E = in_state->L; in_state->L = value;
+							return 4;
+
+						case 6: // DI
+							in_state->IFF1 = in_state->IFF2 = false;
+							return 4;
+
+						default: // EI
+							in_state->IFF1 = in_state->IFF2 = true;
+							return 4;
+					}
+
+				case 4:
+					// CALL cc,nn
+					word = emuZ80FetchWord(in_state);
+					if (emuZ80TestCondition(in_state, y))
+					{
+						emuZ80Push(in_state, in_state->PC);
+						in_state->PC = word;
+						return 17;
+					}
+					return 10;
+
+				case 5:
+					if (q == 0)
+					{
+						// PUSH rp2
+						emuZ80Push(in_state, emuZ80GetPair2(in_state, p, in_index));
+						return 11;
+					}
+
+					// CALL nn (the other opcodes are prefixes, handled by the caller)
+					word = emuZ80FetchWord(in_state);
+					emuZ80Push(in_state, in_state->PC);
+					in_state->PC = word;
+					return 17;
+
+				case 6:
+					// ALU n
+					emuZ80ALU(in_state, y, emuZ80FetchByte(in_state));
+					return 7;
+
+				default:
+					// RST
+					emuZ80Push(in_state, in_state->PC);
+					in_state->PC = (uint16_t)(y * 8);
+					return 11;
+			}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Executes a CB prefixed instruction (the prefix is already fetched), returns T-states (without the DD/FD prefix)
+static int emuZ80ExecuteCB(emuZ80State* in_state, int in_index)
+{
+	uint8_t opcode;
+	uint16_t address = 0;
+	uint8_t value;
+	int x, y, z;
+	bool indirect;
+
+	// DD CB d op: the displacement precedes the opcode
+	if (in_index != INDEX_HL)
+		address = emuZ80GetIndexAddress(in_state, in_index);
+
+	opcode = emuZ80FetchByte(in_state);
+	x = opcode >> 6;
+	y = (opcode >> 3) & 7;
+	z = opcode & 7;
+
+	indirect = (in_index != INDEX_HL || z == REG_HL_INDIRECT);
+	if (in_index == INDEX_HL && z == REG_HL_INDIRECT)
+		address = (uint16_t)((in_state->H << 8) | in_state->L);
+
+	if (in_index == INDEX_HL)
+		in_state->R = (in_state->R & 0x80) | ((in_state->R + 1) & 0x7f);
+
+	value = (indirect) ? in_state->Memory[address] : emuZ80GetRegister(in_state, z, INDEX_HL, 0);
+
+	switch (x)
+	{
+		case 0:
+			// rotate and shift
+			value = emuZ80Rotate(in_state, y, value);
+			break;
+
+		case 1:
+			// BIT y,r
+			in_state->F = (in_state->F & FLAG_C) | FLAG_H | (value & FLAG_XY);
+			if ((value & (1 << y)) == 0)
+				in_state->F |= FLAG_Z | FLAG_PV;
+			if (y == 7 && (value & 0x80) != 0)
+				in_state->F |= FLAG_S;
+			if (in_index == INDEX_HL)
+				return (z == REG_HL_INDIRECT) ? 12 : 8;
+			return 16;
+
+		case 2:
+			// RES y,r
+			value &= ~(1 << y);
+			break;
+
+		default:
+			// SET y,r
+			value |= (1 << y);
+			break;
+	}
+
+	// store result (the indexed instructions also copy it into the register)
+	if (indirect)
+		in_state->Memory[address] = value;
+	if (z != REG_HL_INDIRECT)
+		emuZ80SetRegister(in_state, z, INDEX_HL, 0, value);
+
+	if (in_index == INDEX_HL)
+		return (z == REG_HL_INDIRECT) ? 15 : 8;
+
+	return 19;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Executes an ED prefixed instruction (the prefix is already fetched), returns T-states
+static int emuZ80ExecuteED(emuZ80State* in_state)
+{
+	uint8_t opcode = emuZ80FetchByte(in_state);
+	int x = opcode >> 6;
+	int y = (opcode >> 3) & 7;
+	int z = opcode & 7;
+	int p = y >> 1;
+	int q = y & 1;
+	uint16_t hl;
+	uint16_t bc;
+	uint16_t de;
+	uint8_t value;
+	uint8_t result;
+
+	in_state->R = (in_state->R & 0x80) | ((in_state->R + 1) & 0x7f);
+
+	if (x == 1)
+	{
+		switch (z)
+		{
+			case 0:
+				// IN r,(C)
+				value = emuZ80PortIn(in_state, (uint16_t)((in_state->B << 8) | in_state->C));
+				in_state->F = (in_state->F & FLAG_C) | emuZ80SZP(value);
+				if (y != REG_HL_INDIRECT)
+					emuZ80SetRegister(in_state, y, INDEX_HL, 0, value);
+				return 12;
+
+			case 1:
+				// OUT (C),r
+				emuZ80PortOut(in_state, (uint16_t)((in_state->B << 8) | in_state->C), (y == REG_HL_INDIRECT) ? 0 : emuZ80GetRegister(in_state, y, INDEX_HL, 0));
+				return 12;
+
+			case 2:
+				// SBC HL,rp / ADC HL,rp
+				if (q == 0)
+					emuZ80SetPair(in_state, 2, INDEX_HL, emuZ80SubtractCarry16(in_state, emuZ80GetPair(in_state, 2, INDEX_HL), emuZ80GetPair(in_state, p, INDEX_HL)));
+				else
+					emuZ80SetPair(in_state, 2, INDEX_HL, emuZ80AddCarry16(in_state, emuZ80GetPair(in_state, 2, INDEX_HL), emuZ80GetPair(in_state, p, INDEX_HL)));
+				return 15;
+
+			case 3:
+				// LD (nn),rp / LD rp,(nn)
+				if (q == 0)
+					emuZ80WriteWord(in_state, emuZ80FetchWord(in_state), emuZ80GetPair(in_state, p, INDEX_HL));
+				else
+					emuZ80SetPair(in_state, p, INDEX_HL, emuZ80ReadWord(in_state, emuZ80FetchWord(in_state)));
+				return 20;
+
+			case 4:
+				// NEG
+				value = in_state->A;
+				in_state->A = 0;
+				emuZ80ALU(in_state, 2, value);
+				return 8;
+
+			case 5:
+				// RETN / RETI
+				in_state->PC = emuZ80Pop(in_state);
+				in_state->IFF1 = in_state->IFF2;
+				return 14;
+
+			case 6:
+				// IM
+				in_state->InterruptMode = (y & 3) == 0 ? 0 : (uint8_t)((y & 3) - 1);
+				return 8;
+
+			default:
+				switch (y)
+				{
+					case 0: // LD I,A
+						in_state->I = in_state->A;
+						return 9;
+
+					case 1: // LD R,A
+						in_state->R = in_state->A;
+						return 9;
+
+					case 2: // LD A,I
+					case 3: // LD A,R
+						in_state->A = (y == 2) ? in_state->I : in_state->R;
+						in_state->F = (in_state->F & FLAG_C) | (emuZ80SZP(in_state->A) & ~FLAG_PV) | (in_state->IFF2 ? FLAG_PV : 0);
+						return 9;
+
+					case 4: // RRD
+					case 5: // RLD
+						hl = (uint16_t)((in_state->H << 8) | in_state->L);
+						value = in_state->Memory[hl];
+						if (y == 4)
+						{
+							in_state->Memory[hl] = (uint8_t)((in_state->A << 4) | (value >> 4));
+							in_state->A = (in_state->A & 0xf0) | (value & 0x0f);
+						}
+						else
+						{
+							in_state->Memory[hl] = (uint8_t)((value << 4) | (in_state->A & 0x0f));
+							in_state->A = (in_state->A & 0xf0) | (value >> 4);
+						}
+						in_state->F = (in_state->F & FLAG_C) | emuZ80SZP(in_state->A);
+						return 18;
+
+					default:
+						return 8;
+				}
+		}
+	}
+
+	if (x == 2 && y >= 4 && z <= 3)
+	{
+		// block instructions (y: 4 - increment, 5 - decrement, 6 - increment repeat, 7 - decrement repeat)
+		hl = (uint16_t)((in_state->H << 8) | in_state->L);
+		bc = (uint16_t)((in_state->B << 8) | in_state->C);
+		de = (uint16_t)((in_state->D << 8) | in_state->E);
+
+		switch (z)
+		{
+			case 0:
+				// LDI, LDD, LDIR, LDDR
+				value = in_state->Memory[hl];
+				in_state->Memory[de] = value;
+				hl += (y & 1) ? -1 : 1;
+				de += (y & 1) ? -1 : 1;
+				bc--;
+				value += in_state->A;
+				in_state->F = (in_state->F & (FLAG_S | FLAG_Z | FLAG_C)) | (value & FLAG_X) | ((value << 4) & FLAG_Y) | ((bc != 0) ? FLAG_PV : 0);
+				break;
+
+			case 1:
+				// CPI, CPD, CPIR, CPDR
+				value = in_state->Memory[hl];
+				result = in_state->A - value;
+				hl += (y & 1) ? -1 : 1;
+				bc--;
+				in_state->F = (in_state->F & FLAG_C) | FLAG_N | (result & FLAG_S) | ((result == 0) ? FLAG_Z : 0) | ((in_state->A ^ value ^ result) & FLAG_H) | ((bc != 0) ? FLAG_PV : 0);
+				value = result - ((in_state->F & FLAG_H) ? 1 : 0);
+				in_state->F |= (value & FLAG_X) | ((value << 4) & FLAG_Y);
+				break;
+
+			case 2:
+				// INI, IND, INIR, INDR
+				in_state->Memory[hl] = emuZ80PortIn(in_state, bc);
+				hl += (y & 1) ? -1 : 1;
+				bc -= 0x100;
+				in_state->F = FLAG_N | (((bc >> 8) == 0) ? FLAG_Z : 0);
+				break;
+
+			default:
+				// OUTI, OUTD, OTIR, OTDR
+				value = in_state->Memory[hl];
+				bc -= 0x100;
+				emuZ80PortOut(in_state, bc, value);
+				hl += (y & 1) ? -1 : 1;
+				in_state->F = FLAG_N | (((bc >> 8) == 0) ? FLAG_Z : 0);
+				break;
+		}
+
+		in_state->H = (uint8_t)(hl >> 8);
+		in_state->L = (uint8_t)hl;
+		in_state->B = (uint8_t)(bc >> 8);
+		in_state->C = (uint8_t)bc;
+		in_state->D = (uint8_t)(de >> 8);
+		in_state->E = (uint8_t)de;
+
+		// repeat
+		if (y >= 6)
+		{
+			if ((z <= 1 && bc != 0 && !(z == 1 && (in_state->F & FLAG_Z) != 0)) || (z >= 2 && (bc >> 8) != 0))
+			{
+				in_state->PC -= 2;
+				return 21;
+			}
+		}
+
+		return 16;
+	}
+
+	// invalid ED instruction (NOP)
+	return 8;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Fetches a byte from the program counter
+static uint8_t emuZ80FetchByte(emuZ80State* in_state)
+{
+	return in_state->Memory[in_state->PC++];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Fetches a word from the program counter
+static uint16_t emuZ80FetchWord(emuZ80State* in_state)
+{
+	uint16_t word = emuZ80ReadWord(in_state, in_state->PC);
+
+	in_state->PC += 2;
+
+	return word;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Reads a little endian word from the memory
+static uint16_t emuZ80ReadWord(emuZ80State* in_state, uint16_t in_address)
+{
+	return (uint16_t)(in_state->Memory[in_address] | (in_state->Memory[(uint16_t)(in_address + 1)] << 8));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes a little endian word into the memory
+static void emuZ80WriteWord(emuZ80State* in_state, uint16_t in_address, uint16_t in_data)
+{
+	in_state->Memory[in_address] = (uint8_t)in_data;
+	in_state->Memory[(uint16_t)(in_address + 1)] = (uint8_t)(in_data >> 8);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Pushes a word to the stack
+static void emuZ80Push(emuZ80State* in_state, uint16_t in_data)
+{
+	in_state->SP -= 2;
+	emuZ80WriteWord(in_state, in_state->SP, in_data);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Pops a word from the stack
+static uint16_t emuZ80Pop(emuZ80State* in_state)
+{
+	uint16_t data = emuZ80ReadWord(in_state, in_state->SP);
+
+	in_state->SP += 2;
+
+	return data;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes the output port
+static void emuZ80PortOut(emuZ80State* in_state, uint16_t in_port, uint8_t in_data)
+{
+	if (in_state->PortWrite != NULL)
+		in_state->PortWrite(in_state->PortContext, in_port, in_data);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Reads the input port
+static uint8_t emuZ80PortIn(emuZ80State* in_state, uint16_t in_port)
+{
+	if (in_state->PortRead != NULL)
+		return in_state->PortRead(in_state->PortContext, in_port);
+
+	return 0xff;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets register pair (0 - BC, 1 - DE, 2 - HL/IX/IY, 3 - SP)
+static uint16_t emuZ80GetPair(emuZ80State* in_state, int in_pair, int in_index)
+{
+	switch (in_pair)
+	{
+		case 0:
+			return (uint16_t)((in_state->B << 8) | in_state->C);
+
+		case 1:
+			return (uint16_t)((in_state->D << 8) | in_state->E);
+
+		case 2:
+			if (in_index == INDEX_IX)
+				return in_state->IX;
+			if (in_index == INDEX_IY)
+				return in_state->IY;
+			return (uint16_t)((in_state->H << 8) | in_state->L);
+
+		default:
+			return in_state->SP;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sets register pair (0 - BC, 1 - DE, 2 - HL/IX/IY, 3 - SP)
+static void emuZ80SetPair(emuZ80State* in_state, int in_pair, int in_index, uint16_t in_value)
+{
+	switch (in_pair)
+	{
+		case 0:
+			in_state->B = (uint8_t)(in_value >> 8);
+			in_state->C = (uint8_t)in_value;
+			break;
+
+		case 1:
+			in_state->D = (uint8_t)(in_value >> 8);
+			in_state->E = (uint8_t)in_value;
+			break;
+
+		case 2:
+			if (in_index == INDEX_IX)
+			{
+				in_state->IX = in_value;
+			}
+			else
+			{
+				if (in_index == INDEX_IY)
+				{
+					in_state->IY = in_value;
+				}
+				else
+				{
+					in_state->H = (uint8_t)(in_value >> 8);
+					in_state->L = (uint8_t)in_value;
+				}
+			}
+			break;
+
+		default:
+			in_state->SP = in_value;
+			break;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets register pair of PUSH/POP (0 - BC, 1 - DE, 2 - HL/IX/IY, 3 - AF)
+static uint16_t emuZ80GetPair2(emuZ80State* in_state, int in_pair, int in_index)
+{
+	if (in_pair == 3)
+		return (uint16_t)((in_state->A << 8) | in_state->F);
+
+	return emuZ80GetPair(in_state, in_pair, in_index);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sets register pair of PUSH/POP (0 - BC, 1 - DE, 2 - HL/IX/IY, 3 - AF)
+static void emuZ80SetPair2(emuZ80State* in_state, int in_pair, int in_index, uint16_t in_value)
+{
+	if (in_pair == 3)
+	{
+		in_state->A = (uint8_t)(in_value >> 8);
+		in_state->F = (uint8_t)in_value;
+	}
+	else
+	{
+		emuZ80SetPair(in_state, in_pair, in_index, in_value);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets address of the (HL) or (IX+d)/(IY+d) operand (fetches the displacement)
+static uint16_t emuZ80GetIndexAddress(emuZ80State* in_state, int in_index)
+{
+	switch (in_index)
+	{
+		case INDEX_IX:
+			return (uint16_t)(in_state->IX + (int8_t)emuZ80FetchByte(in_state));
+
+		case INDEX_IY:
+			return (uint16_t)(in_state->IY + (int8_t)emuZ80FetchByte(in_state));
+
+		default:
+			return (uint16_t)((in_state->H << 8) | in_state->L);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets 8 bit register (0 - B, 1 - C, 2 - D, 3 - E, 4 - H/IXH/IYH, 5 - L/IXL/IYL, 6 - memory, 7 - A)
+static uint8_t emuZ80GetRegister(emuZ80State* in_state, int in_register, int in_index, uint16_t in_address)
+{
+	switch (in_register)
+	{
+		case 0: return in_state->B;
+		case 1: return in_state->C;
+		case 2: return in_state->D;
+		case 3: return in_state->E;
+		case 4: return (in_index == INDEX_IX) ? (uint8_t)(in_state->IX >> 8) : (in_index == INDEX_IY) ? (uint8_t)(in_state->IY >> 8) : in_state->H;
+		case 5: return (in_index == INDEX_IX) ? (uint8_t)in_state->IX : (in_index == INDEX_IY) ? (uint8_t)in_state->IY : in_state->L;
+		case 6: return in_state->Memory[in_address];
+		default: return in_state->A;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sets 8 bit register (0 - B, 1 - C, 2 - D, 3 - E, 4 - H/IXH/IYH, 5 - L/IXL/IYL, 6 - memory, 7 - A)
+static void emuZ80SetRegister(emuZ80State* in_state, int in_register, int in_index, uint16_t in_address, uint8_t in_value)
+{
+	switch (in_register)
+	{
+		case 0: in_state->B = in_value; break;
+		case 1: in_state->C = in_value; break;
+		case 2: in_state->D = in_value; break;
+		case 3: in_state->E = in_value; break;
+
+		case 4:
+			if (in_index == INDEX_IX)
+				in_state->IX = (uint16_t)((in_state->IX & 0x00ff) | (in_value << 8));
+			else if (in_index == INDEX_IY)
+				in_state->IY = (uint16_t)((in_state->IY & 0x00ff) | (in_value << 8));
+			else
+				in_state->H = in_value;
+			break;
+
+		case 5:
+			if (in_index == INDEX_IX)
+				in_state->IX = (uint16_t)((in_state->IX & 0xff00) | in_value);
+			else if (in_index == INDEX_IY)
+				in_state->IY = (uint16_t)((in_state->IY & 0xff00) | in_value);
+			else
+				in_state->L = in_value;
+			break;
+
+		case 6: in_state->Memory[in_address] = in_value; break;
+		default: in_state->A = in_value; break;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Tests condition (0 - NZ, 1 - Z, 2 - NC, 3 - C, 4 - PO, 5 - PE, 6 - P, 7 - M)
+static bool emuZ80TestCondition(emuZ80State* in_state, int in_condition)
+{
+	static const uint8_t flags[4] = { FLAG_Z, FLAG_C, FLAG_PV, FLAG_S };
+	bool flag_set = (in_state->F & flags[in_condition >> 1]) != 0;
+
+	return (in_condition & 1) ? flag_set : !flag_set;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Executes an 8 bit arithmetic or logical operation (0 - ADD, 1 - ADC, 2 - SUB, 3 - SBC, 4 - AND, 5 - XOR, 6 - OR, 7 - CP)
+static void emuZ80ALU(emuZ80State* in_state, int in_operation, uint8_t in_value)
+{
+	int result;
+	int carry;
+	uint8_t a = in_state->A;
+
+	switch (in_operation)
+	{
+		case 0:
+		case 1:
+			carry = (in_operation == 1) ? (in_state->F & FLAG_C) : 0;
+			result = a + in_value + carry;
+			in_state->A = (uint8_t)result;
+			in_state->F = (in_state->A & (FLAG_S | FLAG_XY)) | ((in_state->A == 0) ? FLAG_Z : 0) | ((a ^ in_value ^ result) & FLAG_H) |
+				((((a ^ ~in_value) & (a ^ result)) & 0x80) ? FLAG_PV : 0) | ((result > 0xff) ? FLAG_C : 0);
+			break;
+
+		case 2:
+		case 3:
+		case 7:
+			carry = (in_operation == 3) ? (in_state->F & FLAG_C) : 0;
+			result = a - in_value - carry;
+			in_state->F = ((uint8_t)result & FLAG_S) | (((uint8_t)result == 0) ? FLAG_Z : 0) | ((a ^ in_value ^ result) & FLAG_H) |
+				((((a ^ in_value) & (a ^ result)) & 0x80) ? FLAG_PV : 0) | FLAG_N | ((result < 0) ? FLAG_C : 0);
+
+			// CP takes the undocumented flags from the operand
+			if (in_operation == 7)
+			{
+				in_state->F |= in_value & FLAG_XY;
+			}
+			else
+			{
+				in_state->A = (uint8_t)result;
+				in_state->F |= in_state->A & FLAG_XY;
+			}
+			break;
+
+		case 4:
+			in_state->A &= in_value;
+			in_state->F = emuZ80SZP(in_state->A) | FLAG_H;
+			break;
+
+		case 5:
+			in_state->A ^= in_value;
+			in_state->F = emuZ80SZP(in_state->A);
+			break;
+
+		default:
+			in_state->A |= in_value;
+			in_state->F = emuZ80SZP(in_state->A);
+			break;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Increments 8 bit value and sets the flags
+static uint8_t emuZ80Increment(emuZ80State* in_state, uint8_t in_value)
+{
+	uint8_t result = in_value + 1;
+
+	in_state->F = (in_state->F & FLAG_C) | (result & (FLAG_S | FLAG_XY)) | ((result == 0) ? FLAG_Z : 0) |
+		(((in_value & 0x0f) == 0x0f) ? FLAG_H : 0) | ((in_value == 0x7f) ? FLAG_PV : 0);
+
+	return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Decrements 8 bit value and sets the flags
+static uint8_t emuZ80Decrement(emuZ80State* in_state, uint8_t in_value)
+{
+	uint8_t result = in_value - 1;
+
+	in_state->F = (in_state->F & FLAG_C) | FLAG_N | (result & (FLAG_S | FLAG_XY)) | ((result == 0) ? FLAG_Z : 0) |
+		(((in_value & 0x0f) == 0x00) ? FLAG_H : 0) | ((in_value == 0x80) ? FLAG_PV : 0);
+
+	return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// 16 bit add (ADD HL,rp)
+static uint16_t emuZ80Add16(emuZ80State* in_state, uint16_t in_value1, uint16_t in_value2)
+{
+	uint32_t result = (uint32_t)in_value1 + in_value2;
+
+	in_state->F = (in_state->F & (FLAG_S | FLAG_Z | FLAG_PV)) | ((result >> 8) & FLAG_XY) |
+		(((in_value1 ^ in_value2 ^ result) >> 8) & FLAG_H) | ((result > 0xffff) ? FLAG_C : 0);
+
+	return (uint16_t)result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// 16 bit add with carry (ADC HL,rp)
+static uint16_t emuZ80AddCarry16(emuZ80State* in_state, uint16_t in_value1, uint16_t in_value2)
+{
+	uint32_t result = (uint32_t)in_value1 + in_value2 + (in_state->F & FLAG_C);
+
+	in_state->F = ((result >> 8) & (FLAG_S | FLAG_XY)) | (((uint16_t)result == 0) ? FLAG_Z : 0) |
+		(((in_value1 ^ in_value2 ^ result) >> 8) & FLAG_H) | ((((in_value1 ^ ~in_value2) & (in_value1 ^ result)) & 0x8000) ? FLAG_PV : 0) |
+		((result > 0xffff) ? FLAG_C : 0);
+
+	return (uint16_t)result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// 16 bit subtract with carry (SBC HL,rp)
+static uint16_t emuZ80SubtractCarry16(emuZ80State* in_state, uint16_t in_value1, uint16_t in_value2)
+{
+	int32_t result = (int32_t)in_value1 - in_value2 - (in_state->F & FLAG_C);
+
+	in_state->F = ((result >> 8) & (FLAG_S | FLAG_XY)) | (((uint16_t)result == 0) ? FLAG_Z : 0) |
+		(((in_value1 ^ in_value2 ^ result) >> 8) & FLAG_H) | ((((in_value1 ^ in_value2) & (in_value1 ^ result)) & 0x8000) ? FLAG_PV : 0) |
+		FLAG_N | ((result < 0) ? FLAG_C : 0);
+
+	return (uint16_t)result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Rotate and shift (0 - RLC, 1 - RRC, 2 - RL, 3 - RR, 4 - SLA, 5 - SRA, 6 - SLL, 7 - SRL)
+static uint8_t emuZ80Rotate(emuZ80State* in_state, int in_operation, uint8_t in_value)
+{
+	uint8_t result;
+	uint8_t carry;
+
+	switch (in_operation)
+	{
+		case 0:
+			carry = in_value >> 7;
+			result = (uint8_t)((in_value << 1) | carry);
+			break;
+
+		case 1:
+			carry = in_value & 1;
+			result = (uint8_t)((in_value >> 1) | (carry << 7));
+			break;
+
+		case 2:
+			carry = in_value >> 7;
+			result = (uint8_t)((in_value << 1) | (in_state->F & FLAG_C));
+			break;
+
+		case 3:
+			carry = in_value & 1;
+			result = (uint8_t)((in_value >> 1) | ((in_state->F & FLAG_C) << 7));
+			break;
+
+		case 4:
+			carry = in_value >> 7;
+			result = (uint8_t)(in_value << 1);
+			break;
+
+		case 5:
+			carry = in_value & 1;
+			result = (uint8_t)((in_value >> 1) | (in_value & 0x80));
+			break;
+
+		case 6:
+			carry = in_value >> 7;
+			result = (uint8_t)((in_value << 1) | 1);
+			break;
+
+		default:
+			carry = in_value & 1;
+			result = in_value >> 1;
+			break;
+	}
+
+	in_state->F = emuZ80SZP(result) | carry;
+
+	return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Decimal adjust accumulator (DAA)
+static void emuZ80DecimalAdjust(emuZ80State* in_state)
+{
+	uint8_t a = in_state->A;
+	uint8_t correction = 0;
+	uint8_t carry = in_state->F & FLAG_C;
+
+	if ((in_state->F & FLAG_H) != 0 || (a & 0x0f) > 9)
+		correction = 0x06;
+
+	if (carry != 0 || a > 0x99)
+	{
+		correction |= 0x60;
+		carry = FLAG_C;
+	}
+
+	if ((in_state->F & FLAG_N) != 0)
+		in_state->A = a - correction;
+	else
+		in_state->A = a + correction;
+
+	in_state->F = (in_state->F & FLAG_N) | emuZ80SZP(in_state->A) | ((a ^ in_state->A) & FLAG_H) | carry;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sign, zero, parity and undocumented flags of the value
+static uint8_t emuZ80SZP(uint8_t in_value)
+{
+	uint8_t parity = in_value;
+
+	parity ^= parity >> 4;
+	parity ^= parity >> 2;
+	parity ^= parity >> 1;
+
+	return (in_value & (FLAG_S | FLAG_XY)) | ((in_value == 0) ? FLAG_Z : 0) | (((parity & 1) == 0) ? FLAG_PV : 0);
+}
@@ -0,0 +1,394 @@
+/*****************************************************************************/
+/* PSGZ80 - TVC PSG player binary execution                                  */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <emuZ80.h>
+#include <tvcPlayer.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Player execution
+///////////////////////////////////////////////////////////////////////////////
+// The player binary (PSGTVC/main.a80 assembled by sjasmplus) is loaded into the
+// emulated memory and its routines are called through a small stub:
+//   call <routine>
+//   halt
+// The cycles of a call contain the 'call' instruction but not the 'halt', this
+// is the same as the cost of the PSGTVC/psgplayer.a80 'MusicPlayer_IT' routine
+// called from the interrupt handler. The sound card detection is not executed,
+// the card type and base address variables are set directly.
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+// Constants
+#define TVC_PLAYER_STUB_ADDRESS 0x0010
+#define TVC_PLAYER_STACK_ADDRESS 0x0100
+#define TVC_PLAYER_MAX_CYCLES 3125000			// one second, the player is considered as stuck above this
+#define TVC_PLAYER_SYMBOL_LENGTH 64
+#define TVC_PLAYER_LINE_LENGTH 256
+
+#define Z80_CALL 0xcd
+#define Z80_HALT 0x76
+
+// signature wildcard
+#define ANY -1
+
+///////////////////////////////////////////////////////////////////////////////
+// Local functions
+static int tvcPlayerFindSignature(const int* in_signature, int in_signature_length);
+static uint16_t tvcPlayerReadWord(uint16_t in_address);
+static bool tvcPlayerCall(uint16_t in_address, uint32_t* out_cycles);
+static void tvcPlayerPortWrite(void* in_context, uint16_t in_port, uint8_t in_data);
+
+///////////////////////////////////////////////////////////////////////////////
+// Module global variables
+static emuZ80State l_cpu;
+static emuSN76489State l_chip;
+static tvcPlayerSymbols l_symbols;
+static int l_binary_start = 0;
+static int l_binary_end = 0;
+static uint32_t l_write_count = 0;
+
+// code signatures of PSGTVC/psgplayer.a80 and PSGTVC/main.a80
+static const int l_music_player_it_signature[] = { 0x3a, ANY, ANY, 0xb7, 0xc8, 0x3a, ANY, ANY, 0xb7, 0xc2 };					// MusicPlayer_IT
+static const int l_start_music_signature[] = { 0x3a, ANY, ANY, 0xfe, 0x00, 0xc8, 0x2a, ANY, ANY, 0x22 };							// StartMusic
+static const int l_no_freq_change_signature[] = { 0x3a, ANY, ANY, 0x4f, 0xed, 0x41 };																	// NoFreqChange
+static const int l_fast_freq_signature[] = { 0x4d, 0x44, 0x29, 0x29, 0x29, 0xed, 0x42 };															// RecalculateAndUpdateFrequency (fast)
+
+///////////////////////////////////////////////////////////////////////////////
+// Loads player binary into the emulated memory
+bool tvcPlayerLoad(uint8_t* in_binary, int in_binary_length, uint16_t in_org)
+{
+	if (in_binary_length <= 0 || in_org < TVC_PLAYER_STACK_ADDRESS || in_org + in_binary_length > emuZ80_MEMORY_SIZE)
+	{
+		printf("ERROR: Player binary does not fit into the memory.\n");
+		return false;
+	}
+
+	memset(&l_cpu, 0, sizeof(l_cpu));
+	memset(&l_symbols, 0, sizeof(l_symbols));
+
+	memcpy(&l_cpu.Memory[in_org], in_binary, in_binary_length);
+
+	l_binary_start = in_org;
+	l_binary_end = in_org + in_binary_length;
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Loads symbol addresses from a sjasmplus symbol file (--sym option, 'Label: EQU 0x1234' lines)
+bool tvcPlayerLoadSymbols(char* in_file_name)
+{
+	FILE* symbol_file;
+	char line[TVC_PLAYER_LINE_LENGTH];
+	char name[TVC_PLAYER_SYMBOL_LENGTH];
+	char* value;
+	uint16_t address;
+
+	symbol_file = fopen(in_file_name, "rt");
+	if (symbol_file == NULL)
+	{
+		printf("ERROR: Can't open symbol file: %s\n", in_file_name);
+		return false;
+	}
+
+	while (fgets(line, sizeof(line), symbol_file) != NULL)
+	{
+		if (sscanf(line, "%63[^: \t]", name) != 1)
+			continue;
+
+		value = strchr(line, ':');
+		if (value == NULL)
+			continue;
+
+		// skip 'EQU'
+		value++;
+		while (*value == ' ' || *value == '\t')
+			value++;
+
+		if (_strnicmp(value, "EQU", 3) != 0)
+			continue;
+
+		value += 3;
+		while (*value == ' ' || *value == '\t')
+			value++;
+
+		if (*value == '$')
+			address = (uint16_t)strtoul(value + 1, NULL, 16);
+		else
+			address = (uint16_t)strtoul(value, NULL, 0);
+
+		if (strcmp(name, "MusicPlayer_IT") == 0)
+			l_symbols.MusicPlayerIT = address;
+		else if (strcmp(name, "StartMusic") == 0)
+			l_symbols.StartMusic = address;
+		else if (strcmp(name, "StartBankMusic") == 0)
+			l_symbols.StartBankMusic = address;
+		else if (strcmp(name, "PSGFile") == 0)
+			l_symbols.PSGFile = address;
+		else if (strcmp(name, "SndCardType") == 0)
+			l_symbols.SndCardType = address;
+		else if (strcmp(name, "SndCardBaseAddr") == 0)
+			l_symbols.SndCardBaseAddr = address;
+		else if (strcmp(name, "PSGFileData") == 0)
+			l_symbols.PSGFileData = address;
+	}
+
+	fclose(symbol_file);
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Finds the symbols not loaded from the symbol file by code signatures
+bool tvcPlayerFindSymbols(void)
+{
+	int address;
+	int i;
+
+	// MusicPlayer_IT
+	if (l_symbols.MusicPlayerIT == 0)
+	{
+		address = tvcPlayerFindSignature(l_music_player_it_signature, sizeof(l_music_player_it_signature) / sizeof(int));
+		if (address >= 0)
+			l_symbols.MusicPlayerIT = (uint16_t)address;
+	}
+
+	// StartMusic, SndCardType and PSGFile
+	address = tvcPlayerFindSignature(l_start_music_signature, sizeof(l_start_music_signature) / sizeof(int));
+	if (address >= 0)
+	{
+		if (l_symbols.StartMusic == 0)
+			l_symbols.StartMusic = (uint16_t)address;
+
+		if (l_symbols.SndCardType == 0)
+			l_symbols.SndCardType = tvcPlayerReadWord((uint16_t)(address + 1));
+
+		if (l_symbols.PSGFile == 0)
+			l_symbols.PSGFile = tvcPlayerReadWord((uint16_t)(address + 7));
+	}
+
+	// SndCardBaseAddr
+	if (l_symbols.SndCardBaseAddr == 0)
+	{
+		address = tvcPlayerFindSignature(l_no_freq_change_signature, sizeof(l_no_freq_change_signature) / sizeof(int));
+		if (address >= 0)
+			l_symbols.SndCardBaseAddr = tvcPlayerReadWord((uint16_t)(address + 1));
+	}
+
+	if (l_symbols.MusicPlayerIT == 0 || l_symbols.StartMusic == 0 || l_symbols.PSGFile == 0 || l_symbols.SndCardType == 0 || l_symbols.SndCardBaseAddr == 0)
+	{
+		printf("ERROR: Player routines are not found in the binary. Use the symbol file of the player.\n");
+		return false;
+	}
+
+	// PSGFileData ('ld hl, PSGFileData', 'ld (PSGFile), hl', 'call StartMusic' in main.a80)
+	if (l_symbols.PSGFileData == 0)
+	{
+		for (i = l_binary_start; i + 9 <= l_binary_end; i++)
+		{
+			if (l_cpu.Memory[i] == 0x21 && l_cpu.Memory[i + 3] == 0x22 && tvcPlayerReadWord((uint16_t)(i + 4)) == l_symbols.PSGFile &&
+				l_cpu.Memory[i + 6] == Z80_CALL && tvcPlayerReadWord((uint16_t)(i + 7)) == l_symbols.StartMusic)
+			{
+				l_symbols.PSGFileData = tvcPlayerReadWord((uint16_t)(i + 1));
+				break;
+			}
+		}
+	}
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets the player symbols
+tvcPlayerSymbols* tvcPlayerGetSymbols(void)
+{
+	return &l_symbols;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns true if the player was assembled with fast frequency calculation (PSGFastFreqCalculation=1)
+bool tvcPlayerIsFastFrequencyCalculation(void)
+{
+	return tvcPlayerFindSignature(l_fast_freq_signature, sizeof(l_fast_freq_signature) / sizeof(int)) >= 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets the first address after the loaded binary
+int tvcPlayerGetBinaryEnd(void)
+{
+	return l_binary_end;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets the emulated memory
+uint8_t* tvcPlayerGetMemory(void)
+{
+	return l_cpu.Memory;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sets sound card variables and starts the music at the given address
+// (in_song_index >= 0 - starts the song of the bank by 'StartBankMusic')
+bool tvcPlayerStart(tvcPlayerCardType in_card, uint16_t in_psg_address, int in_song_index)
+{
+	uint32_t cycles;
+
+	emuZ80Reset(&l_cpu);
+	l_cpu.PortWrite = tvcPlayerPortWrite;
+	l_cpu.PortRead = NULL;
+	l_cpu.PortContext = NULL;
+
+	emuSN76489Reset(&l_chip);
+
+	// variables normally set by 'DetectSndCard' and main.a80
+	l_cpu.Memory[l_symbols.SndCardType] = (uint8_t)in_card;
+	l_cpu.Memory[l_symbols.SndCardBaseAddr] = TVC_PLAYER_SOUND_PORT;
+	l_cpu.Memory[l_symbols.PSGFile] = (uint8_t)in_psg_address;
+	l_cpu.Memory[l_symbols.PSGFile + 1] = (uint8_t)(in_psg_address >> 8);
+
+	if (in_song_index >= 0)
+	{
+		if (l_symbols.StartBankMusic == 0)
+		{
+			printf("ERROR: 'StartBankMusic' is not found. Use the symbol file of the player.\n");
+			return false;
+		}
+
+		l_cpu.A = (uint8_t)in_song_index;
+		if (!tvcPlayerCall(l_symbols.StartBankMusic, &cycles))
+			return false;
+	}
+	else
+	{
+		if (!tvcPlayerCall(l_symbols.StartMusic, &cycles))
+			return false;
+	}
+
+	l_write_count = 0;
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Calls 'MusicPlayer_IT', returns the T-states and the number of sound chip writes
+bool tvcPlayerInterrupt(uint32_t* out_cycles, uint32_t* out_write_count)
+{
+	bool success;
+
+	l_write_count = 0;
+
+	success = tvcPlayerCall(l_symbols.MusicPlayerIT, out_cycles);
+
+	*out_write_count = l_write_count;
+
+	return success;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets the sound chip state written by the player
+emuSN76489State* tvcPlayerGetChip(void)
+{
+	return &l_chip;
+}
+
+/*****************************************************************************/
+/* Local functions                                                           */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Finds code signature in the loaded binary, returns the address or -1
+static int tvcPlayerFindSignature(const int* in_signature, int in_signature_length)
+{
+	int address;
+	int i;
+
+	for (address = l_binary_start; address + in_signature_length <= l_binary_end; address++)
+	{
+		for (i = 0; i < in_signature_length; i++)
+		{
+			if (in_signature[i] != ANY && in_signature[i] != l_cpu.Memory[address + i])
+				break;
+		}
+
+		if (i == in_signature_length)
+			return address;
+	}
+
+	return -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Reads a little endian word from the emulated memory
+static uint16_t tvcPlayerReadWord(uint16_t in_address)
+{
+	return (uint16_t)(l_cpu.Memory[in_address] | (l_cpu.Memory[(uint16_t)(in_address + 1)] << 8));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Executes the routine at the given address through the call stub
+static bool tvcPlayerCall(uint16_t in_address, uint32_t* out_cycles)
+{
+	uint32_t cycles = 0;
+	int instruction_cycles;
+
+	l_cpu.Memory[TVC_PLAYER_STUB_ADDRESS] = Z80_CALL;
+	l_cpu.Memory[TVC_PLAYER_STUB_ADDRESS + 1] = (uint8_t)in_address;
+	l_cpu.Memory[TVC_PLAYER_STUB_ADDRESS + 2] = (uint8_t)(in_address >> 8);
+	l_cpu.Memory[TVC_PLAYER_STUB_ADDRESS + 3] = Z80_HALT;
+
+	l_cpu.PC = TVC_PLAYER_STUB_ADDRESS;
+	l_cpu.SP = TVC_PLAYER_STACK_ADDRESS;
+	l_cpu.Halted = false;
+
+	while (true)
+	{
+		instruction_cycles = emuZ80Step(&l_cpu);
+
+		// the halt of the stub is not counted
+		if (l_cpu.Halted)
+			break;
+
+		cycles += instruction_cycles;
+
+		if (cycles > TVC_PLAYER_MAX_CYCLES)
+		{
+			printf("ERROR: Player routine at $%04X does not return (PC=$%04X).\n", in_address, l_cpu.PC);
+			return false;
+		}
+	}
+
+	if (l_cpu.PC != TVC_PLAYER_STUB_ADDRESS + 4)
+	{
+		printf("ERROR: Player routine at $%04X stopped at unexpected address (PC=$%04X).\n", in_address, l_cpu.PC);
+		return false;
+	}
+
+	*out_cycles = cycles;
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Output port handler, writes to the sound card base port go to the sound chip
+static void tvcPlayerPortWrite(void* in_context, uint16_t in_port, uint8_t in_data)
+{
+	(void)in_context;
+
+	if ((in_port & 0xff) == TVC_PLAYER_SOUND_PORT)
+	{
+		emuSN76496WriteRegister(&l_chip, in_data);
+		l_write_count++;
+	}
+}
@@ -19,5 +19,6 @@
 #define FILE_BUFFER_LENGTH (1024*1024)
 
 extern emuSN76489State g_SN76489_state;
+extern emuSN76489State g_SN76489_state_2nd;
 
 #endif
\ No newline at end of file
@@ -18,6 +18,11 @@
 ///////////////////////////////////////////////////////////////////////////////
 // Constants
 #define emuSN76489_REGISTER_COUNT 8
+#define emuSN76489_TONE_MAX 0x3ff
+#define emuSN76489_CHANNEL_COUNT 4
+#define emuSN76489_STEREO_DEFAULT 0xff		// Game Gear stereo register: every channel on both sides
+#define emuSN76489_STEREO_LEFT 0xf0
+#define emuSN76489_STEREO_RIGHT 0x0f
 
 ///////////////////////////////////////////////////////////////////////////////
 // Types
@@ -34,6 +39,8 @@ typedef struct
 
 	bool NoiseRegisterChanged;
 
+	uint8_t Stereo;			// Game Gear stereo register (bit 0..3 - channel on the right, bit 4..7 - channel on the left)
+
 } emuSN76489State;
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -41,8 +48,11 @@ typedef struct
 void emuSN76489Reset(emuSN76489State* in_state);
 void emuN76496WriteRegister(emuSN76489State* in_state, uint8_t in_data);
 void emuSN76489ClearRegisterChanged(emuSN76489State* in_state);
+void emuSN76489Merge(emuSN76489State* inout_state, emuSN76489State* in_first, emuSN76489State* in_second);
 
 void emuSN76489SetClockFrequency(int in_clock_frequency);
+int emuSN76489GetClockFrequency(void);
+uint32_t emuSN76489GetClampedToneCount(void);
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,42 @@
+/*****************************************************************************/
+/* VGM2PSG Conversion Result Cache                                           */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+#ifndef __fileCache_h
+#define __fileCache_h
+
+///////////////////////////////////////////////////////////////////////////////
+// Include files
+#include <Types.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Constants
+
+// version of the conversion, must be increased when the same input and options give a different PSG file
+#define CACHE_FORMAT_VERSION 2
+
+// maximum length of the extension of the stored entries
+#define CACHE_MAX_EXTENSION_LENGTH 3
+
+///////////////////////////////////////////////////////////////////////////////
+// Function prototypes
+bool fileCacheOpen(char* in_directory);
+void fileCacheKeyStart(void);
+void fileCacheKeyAdd(const void* in_data, int in_data_length);
+void fileCacheKeyAddString(const char* in_string);
+uint64_t fileCacheKeyGet(void);
+void fileCacheKeySet(uint64_t in_key);
+int fileCacheLoad(uint8_t* out_buffer, int in_buffer_length);
+bool fileCacheStore(uint8_t* in_buffer, int in_length);
+int fileCacheLoadEntry(uint64_t in_key, const char* in_extension, uint8_t* out_buffer, int in_buffer_length);
+bool fileCacheStoreEntry(uint64_t in_key, const char* in_extension, uint8_t* in_buffer, int in_length);
+bool fileCacheClose(void);
+void fileCachePrintStatistics(void);
+
+#endif
@@ -16,10 +16,27 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+///////////////////////////////////////////////////////////////////////////////
+// Types
+
+// Output file formats
+typedef enum
+{
+	OutputFormat_Binary,		// binary PSG file
+	OutputFormat_ASM,				// Z80 assembly source, '.db' lines
+	OutputFormat_ASMWords,	// Z80 assembly source, little endian '.dw' lines
+	OutputFormat_CHeader,		// C header with a byte array
+	OutputFormat_Incbin,		// binary PSG file and an '.inc' file with the symbols and the incbin directive (sjasmplus)
+
+	OutputFormat_Count
+} OutputFormatType;
+
 ///////////////////////////////////////////////////////////////////////////////
 // Function prototypes
-bool fileOutputCreate(char* in_filename, bool in_text_mode);
+bool fileOutputGetFormatByName(char* in_name, OutputFormatType* out_format);
+bool fileOutputIsValidFilename(char* in_filename, OutputFormatType in_format);
+bool fileOutputCreate(char* in_filename, OutputFormatType in_format);
 void fileOutputWriteBlock(uint8_t* in_data, int in_data_length);
-void fileOutputClose(void);
+bool fileOutputClose(void);
 
 #endif
\ No newline at end of file
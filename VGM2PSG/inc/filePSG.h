@@ -16,11 +16,50 @@
 #include <Types.h>
 #include <emuSN76489.h>
 
+///////////////////////////////////////////////////////////////////////////////
+// Constants
+
+// Clock frequencies of the clock tag
+#define PSG_CLOCK_3579KHZ 3579545
+#define PSG_CLOCK_3125KHZ 3125000
+
+// Clock tag values (clock frequency of the tone register values)
+#define PSG_CLOCK_TAG_NONE -1
+#define PSG_CLOCK_TAG_3579KHZ 0			// 3.579545MHz
+#define PSG_CLOCK_TAG_3125KHZ 1			// 3.125MHz (TVC Game Card)
+
+// Macro dictionary and macro start command
+#define PSG_MACRO 0x07
+#define PSG_MACRO_MAX_COUNT 32
+#define PSG_MACRO_MAX_LENGTH 127
+#define PSG_MACRO_TONE 0x80							// type bit of the macro length byte (0 - attenuation, 1 - tone)
+#define PSG_MACRO_LENGTH_MASK 0x7f
+
+// Long substring (extended format): followed by the length and the offset words of a block of the compressed data
+#define PSG_LONG_SUBSTRING 0x05
+#define PSG_LONG_SUBSTRING_LENGTH 5
+
+// Game Gear stereo (extended format): followed by the right (%0100 rrrr) and the left (%0100 llll) channel enable bits
+#define PSG_STEREO 0x02
+#define PSG_STEREO_LENGTH 3
+#define PSG_STEREO_PARAMETER(x) (0x40 + ((x) & 0x0f))
+
 ///////////////////////////////////////////////////////////////////////////////
 // Functions
 void filePSGStart(uint8_t* in_psg_buffer, int in_psg_buffer_length);
 void filePSGUpdate(emuSN76489State* in_SN76489_state, bool in_behind_loop_start);
-void filePSGFinish(void);
+void filePSGFinish(emuSN76489State* in_SN76489_state);
 int filePSGGetLength(void);
+int filePSGGetHeaderLength(uint8_t* in_buffer, int in_buffer_length);
+
+void filePSGSetClockTag(int in_clock_tag);
+
+void filePSGSetFrameSmoothing(int in_max_frame_bytes);
+void filePSGPrintFrameSmoothingResult(void);
+
+void filePSGSetWriteOptimization(bool in_enable);
+void filePSGPrintWriteOptimizationResult(void);
+
+void filePSGSetStereo(bool in_enable);
 
 #endif
\ No newline at end of file
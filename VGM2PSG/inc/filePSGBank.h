@@ -0,0 +1,32 @@
+/*****************************************************************************/
+/* VGM2PSG multi-song PSG bank                                               */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+#ifndef __filePSGBank_h
+#define __filePSGBank_h
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#include <Types.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Constants
+#define PSG_BANK_MAX_SONG_COUNT 255
+#define PSG_BANK_MAX_LENGTH 65536						// substring offsets and song table entries are 16-bit
+#define PSG_BANK_TABLE_LENGTH(count) (1 + (count) * 2)
+
+///////////////////////////////////////////////////////////////////////////////
+// Function prototypes
+void filePSGBankStart(int in_song_count, bool in_compression);
+bool filePSGBankAddSong(char* in_name, uint8_t* in_psg_buffer, int in_psg_length);
+uint8_t* filePSGBankGetBuffer(void);
+int filePSGBankGetLength(void);
+void filePSGBankPrintResult(void);
+
+#endif
\ No newline at end of file
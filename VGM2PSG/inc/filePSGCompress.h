@@ -15,6 +15,37 @@
 // Includes
 #include <Types.h>
 
+///////////////////////////////////////////////////////////////////////////////
+// Constants
+#define PSG_COMPRESSION_MIN_LEVEL 1
+#define PSG_COMPRESSION_MAX_LEVEL 9
+#define PSG_COMPRESSION_DEFAULT_LEVEL 6
+#define PSG_COMPRESSION_MIN_DISTANCE 4
+#define PSG_COMPRESSION_MAX_DISTANCE 65535
+#define PSG_COMPRESSION_MIN_PAGE_SIZE 256
+#define PSG_COMPRESSION_MAX_PAGE_SIZE 65536
+#define PSG_COMPRESSION_MAX_FORBIDDEN_RANGE_COUNT 16
+
+// Locked bytes (filePSGCompressWithLocks)
+#define PSG_LOCK_NONE				0
+#define PSG_LOCK_SOURCE			1				// can't be replaced, but can be used as a source
+#define PSG_LOCK_NO_SOURCE	2				// can't be replaced and can't be used as a source
+
+///////////////////////////////////////////////////////////////////////////////
+// Function prototypes
 int filePSGCompress(uint8_t* in_buffer, int in_buffer_length);
+int filePSGCompressWithDictionary(uint8_t* in_buffer, int in_buffer_length, int in_dictionary_length, const bool* in_dictionary_source, const uint8_t* in_locks);
+int filePSGCompressWithLocks(uint8_t* in_buffer, int in_buffer_length, const uint8_t* in_locks);
+int filePSGCompressPart(uint8_t* in_buffer, int in_buffer_length, int in_dictionary_length, const bool* in_dictionary_source);
+void filePSGCompressShowProgress(bool in_show_progress);
+void filePSGCompressSetLevel(int in_level);
+int filePSGCompressGetLevel(void);
+void filePSGCompressSetMaxDistance(int in_max_distance);
+int filePSGCompressGetMaxDistance(void);
+void filePSGCompressSetPageSize(int in_page_size);
+int filePSGCompressGetPageSize(void);
+bool filePSGCompressAddForbiddenRange(int in_first, int in_last);
+bool filePSGCompressGetForbiddenRange(int in_index, int* out_first, int* out_last);
+bool filePSGCompressHasConstraints(void);
 
 #endif
\ No newline at end of file
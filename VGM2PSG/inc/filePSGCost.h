@@ -0,0 +1,58 @@
+/*****************************************************************************/
+/* VGM2PSG Z80 player cycle cost model                                       */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+#ifndef __filePSGCost_h
+#define __filePSGCost_h
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#include <Types.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Constants
+#define PSG_COST_Z80_CLOCK 3125000		// TVC CPU clock frequency in Hz
+
+///////////////////////////////////////////////////////////////////////////////
+// Types
+
+// Modelled player configurations of PSGTVC/psgplayer.a80
+typedef enum
+{
+	PSG_COST_PLAYER_FAST,				// Game Card, fast (7/8) frequency recalculation (PSGFastFreqCalculation=1)
+	PSG_COST_PLAYER_ACCURATE,		// Game Card, table based frequency recalculation (PSGFastFreqCalculation=0)
+	PSG_COST_PLAYER_DIRECT,			// Sound Magic card, no frequency recalculation
+
+	PSG_COST_PLAYER_COUNT
+} PSGCostPlayer;
+
+// Cycle cost of one playthrough of the PSG file
+typedef struct
+{
+	uint32_t InterruptCount;			// number of 'MusicPlayer_IT' calls
+	uint32_t FrameCount;					// number of calls processing PSG data (not skipped frames)
+	uint32_t SubstringCount;			// number of played substring references
+	uint32_t WorstCycles;					// cycles of the most expensive call
+	uint32_t WorstInterrupt;			// index of the most expensive call
+	uint64_t TotalCycles;
+	uint32_t OverBudgetCount;			// number of calls above the maximum cycles (if set)
+} PSGCostResult;
+
+///////////////////////////////////////////////////////////////////////////////
+// Function prototypes
+void filePSGCostSetPlayer(PSGCostPlayer in_player);
+bool filePSGCostSetPlayerByName(char* in_name);
+PSGCostPlayer filePSGCostGetPlayer(void);
+void filePSGCostSetMaxCycles(int in_max_cycles);
+int filePSGCostGetMaxCycles(void);
+void filePSGCostAnalyze(uint8_t* in_buffer, int in_buffer_length, PSGCostResult* out_result);
+bool filePSGCostLockFrames(uint8_t* in_buffer, int in_buffer_length, uint8_t* inout_locked);
+void filePSGCostPrint(PSGCostResult* in_result, int in_framerate);
+
+#endif
@@ -0,0 +1,28 @@
+/*****************************************************************************/
+/* VGM2PSG Incremental PSG Compression                                       */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+#ifndef __filePSGIncremental_h
+#define __filePSGIncremental_h
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#include <Types.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Constants
+#define PSG_INCREMENTAL_DEFAULT_THRESHOLD 5		// allowed compression ratio degradation in percent
+
+///////////////////////////////////////////////////////////////////////////////
+// Function prototypes
+bool filePSGIncrementalStart(uint64_t in_key, int in_threshold);
+int filePSGIncrementalCompress(uint8_t* inout_buffer, int in_buffer_length);
+bool filePSGIncrementalFinish(uint8_t* in_uncompressed_buffer, int in_uncompressed_length, uint8_t* in_compressed_buffer, int in_compressed_length, bool in_full_compression);
+
+#endif
@@ -0,0 +1,23 @@
+/*****************************************************************************/
+/* VGM2PSG PSG macro (instrument envelope) encoder                           */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+#ifndef __filePSGMacro_h
+#define __filePSGMacro_h
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#include <Types.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Function prototypes
+int filePSGMacroEncode(uint8_t* inout_buffer, int in_buffer_length);
+void filePSGMacroPrintResult(void);
+
+#endif
\ No newline at end of file
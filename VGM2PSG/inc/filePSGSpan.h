@@ -0,0 +1,23 @@
+/*****************************************************************************/
+/* VGM2PSG Repeated Frame Span Encoder                                       */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+#ifndef __filePSGSpan_h
+#define __filePSGSpan_h
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#include <Types.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Function prototypes
+int filePSGSpanCompress(uint8_t* inout_buffer, int in_buffer_length);
+void filePSGSpanPrintResult(void);
+
+#endif
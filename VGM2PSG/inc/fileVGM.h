@@ -22,6 +22,7 @@
 #define GD3_BUFFER_LENGTH 1024
 #define VGM_DATA_BUFFER_LENGTH 512
 #define VGM_DUAL_CHIP_BIT 0x40000000ul
+#define VGM_T6W28_BIT     0x80000000ul		// with the dual chip bit: T6W28 (the first chip is the left, the second is the right channel)
 #define VGM_CLOCK_MASK    0x3ffffffful
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,86 @@
+/*****************************************************************************/
+/* VGM2PSG Conversion statistics                                             */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+#ifndef __sysStatistics_h
+#define __sysStatistics_h
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#include <Types.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Constants
+#define STAT_MAX_REGISTER_WRITES_PER_FRAME 16
+#define STAT_MAX_MATCH_LENGTH 256
+
+///////////////////////////////////////////////////////////////////////////////
+// Types
+
+// Conversion stages
+typedef enum
+{
+	STAT_STAGE_INFLATE,
+	STAT_STAGE_PARSE,
+	STAT_STAGE_ENCODE,
+	STAT_STAGE_COMPRESS,
+	STAT_STAGE_OUTPUT,
+
+	STAT_STAGE_COUNT
+} StatStage;
+
+// Timing and data size of one stage
+typedef struct
+{
+	double WallTime;
+	double CPUTime;
+	uint64_t BytesIn;
+	uint64_t BytesOut;
+	uint32_t CallCount;
+
+	double WallStart;
+	double CPUStart;
+} StatStageStatistics;
+
+// All conversion statistics
+typedef struct
+{
+	StatStageStatistics Stages[STAT_STAGE_COUNT];
+
+	// VGM parser
+	uint32_t VGMCommandCount[256];
+
+	// PSG encoder
+	uint32_t FrameCount;
+	uint32_t RegisterWriteCount;
+	uint32_t MaxRegisterWritesPerFrame;
+	uint32_t RegisterWriteHistogram[STAT_MAX_REGISTER_WRITES_PER_FRAME + 1];
+
+	// compressor
+	uint64_t CandidatePositions;
+	uint64_t MemcmpCalls;
+	uint32_t MatchCount[STAT_MAX_MATCH_LENGTH + 1];
+	uint32_t BytesSaved;
+} StatStatistics;
+
+///////////////////////////////////////////////////////////////////////////////
+// Global variables
+extern StatStatistics g_statistics;
+
+///////////////////////////////////////////////////////////////////////////////
+// Function prototypes
+void sysStatisticsReset(bool in_enable);
+void sysStatisticsStageBegin(StatStage in_stage);
+void sysStatisticsStageEnd(StatStage in_stage);
+void sysStatisticsAddBytes(StatStage in_stage, uint32_t in_bytes_in, uint32_t in_bytes_out);
+void sysStatisticsAddFrame(uint32_t in_register_write_count);
+void sysStatisticsPrint(void);
+bool sysStatisticsSaveJSON(char* in_filename);
+
+#endif
@@ -5,32 +5,84 @@
 #include <fileVGMDecompress.h>
 #include <filePSG.h>
 #include <filePSGCompress.h>
+#include <filePSGCost.h>
+#include <filePSGMacro.h>
+#include <filePSGBank.h>
 #include <fileOutput.h>
+#include <fileCache.h>
+#include <filePSGIncremental.h>
+#include <filePSGSpan.h>
+#include <sysStatistics.h>
 #include <Main.h>
 
 ///////////////////////////////////////////////////////////////////////////////
 // Defines
 
+// Converted chip of the VGM file
+#define CHIP_FIRST 0
+#define CHIP_SECOND 1
+#define CHIP_MERGED -1
+
+///////////////////////////////////////////////////////////////////////////////
+// Types
+
+// PSG data of the dual-chip VGM files
+typedef enum
+{
+	DualChip_Merge,			// the louder channel of the two chips in one PSG stream
+	DualChip_Split,			// two songs of the bank with the same frames, one for every chip
+	DualChip_First,			// only the first chip
+	DualChip_Second			// only the second chip
+} DualChipMode;
 
 ///////////////////////////////////////////////////////////////////////////////
 // Local functions
+static int LoadVGM(char* in_vgm_filename);
+static int ConvertVGM(int in_vgm_file_length, int in_chip);
+static void AddSettingsToCacheKey(void);
+static bool GetDualChipMode(char* in_name, DualChipMode* out_mode);
+static int GetConvertedChip(void);
+static bool BuildBank(char* in_vgm_filenames[], int in_song_count);
 static bool GetNumericParameter(int in_argc, char* in_argv[], int in_index, int in_min, int in_max, int* out_number);
+static bool GetRangeParameter(int in_argc, char* in_argv[], int in_index, int* out_first, int* out_last);
 static void PrintUsage(void);
 
 ///////////////////////////////////////////////////////////////////////////////
 // Global variables
 emuSN76489State g_SN76489_state;
+emuSN76489State g_SN76489_state_2nd;
 
 ///////////////////////////////////////////////////////////////////////////////
 // Module global variables
 static int l_psg_frame_step = 44100 / 50;  // default frame rate is 50Hz
+static int l_psg_framerate = 50;
 
 static uint8_t l_psg_buffer[FILE_BUFFER_LENGTH];
 static uint8_t l_psg_compressed_buffer[FILE_BUFFER_LENGTH];
+static uint8_t l_psg_uncompressed_buffer[FILE_BUFFER_LENGTH];
 static bool l_insert_length = false;
 static bool l_psg_compression = true;
 static uint8_t l_vgm_buffer[FILE_BUFFER_LENGTH];
-static bool l_asm_output = false;
+static OutputFormatType l_output_format = OutputFormat_Binary;
+static bool l_statistics = false;
+static char* l_statistics_json_filename = NULL;
+static bool l_cycle_report = false;
+static int l_smooth_max_frame_bytes = 0;		// 0 - no smoothing
+static bool l_write_optimization = false;
+static bool l_clock_tag = false;
+static bool l_macros = false;
+static bool l_bank = false;
+static int l_max_size = 0;
+static char* l_cache_directory = NULL;
+static bool l_cache_statistics = false;
+static int l_incremental_threshold = -1;		// -1 - no incremental compression
+static bool l_spans = false;
+static DualChipMode l_dual_chip_mode = DualChip_Merge;
+static bool l_stereo = false;
+static emuSN76489State l_merged_SN76489_state;
+
+// names of the dual-chip modes
+static const char* l_dual_chip_mode_names[] = { "merge", "split", "first", "second", NULL };
 
 ///////////////////////////////////////////////////////////////////////////////
 // Main function
@@ -38,9 +90,20 @@ int main(int argc, char* argv[])
 {
 	int i;
 	int value;
-	char* vgm_filename = NULL;
-	char* psg_filename = NULL;
+	int last_value;
+	int vgm_file_length = -1;
+	bool cache_hit = false;
+	bool incremental = false;
+	bool full_compression = true;
+	uint64_t options_key;
+	char* filenames[PSG_BANK_MAX_SONG_COUNT + 1];
+	int filename_count = 0;
+	char* psg_filename;
+	uint8_t* output_buffer;
 	int output_length;
+	int psg_length;
+	int level;
+	PSGCostResult cost;
 
 	for (i = 1; i < argc; i++)
 	{
@@ -53,6 +116,7 @@ int main(int argc, char* argv[])
 					return -1;
 
 				l_psg_frame_step = 44100 / value;
+				l_psg_framerate = value;
 				i++;
 			}
 			else
@@ -75,27 +139,251 @@ int main(int argc, char* argv[])
 					}
 					else
 					{
-						if (_strcmpi(argv[i], "-noncompressed") == 0)
+						// compression level
+						if (_strcmpi(argv[i], "-level") == 0)
 						{
-							l_psg_compression = false;
+							if (!GetNumericParameter(argc, argv, i, PSG_COMPRESSION_MIN_LEVEL, PSG_COMPRESSION_MAX_LEVEL, &value))
+								return -1;
+
+							filePSGCompressSetLevel(value);
+							i++;
 						}
 						else
 						{
-							if (_strcmpi(argv[i], "-asm") == 0)
+							if (_strcmpi(argv[i], "-noncompressed") == 0)
 							{
-								l_asm_output = true;
+								l_psg_compression = false;
 							}
 							else
 							{
-								if (_strcmpi(argv[i], "-?") == 0)
+								if (_strcmpi(argv[i], "-asm") == 0)
 								{
-									PrintUsage();
-									return 0;
+									l_output_format = OutputFormat_ASM;
 								}
 								else
 								{
-									printf("ERROR: Invalid command line parameter: %s\n", argv[i]);
-									return -1;
+									if (_strcmpi(argv[i], "-stats") == 0)
+									{
+										l_statistics = true;
+									}
+									else
+									{
+										if (_strcmpi(argv[i], "-statsjson") == 0)
+										{
+											if (i + 1 >= argc)
+											{
+												printf("Invalid parameter: %s\n", argv[i]);
+												return -1;
+											}
+
+											l_statistics = true;
+											l_statistics_json_filename = argv[++i];
+										}
+										else
+										{
+											if (_strcmpi(argv[i], "-cycles") == 0)
+											{
+												l_cycle_report = true;
+											}
+											else
+											{
+												if (_strcmpi(argv[i], "-maxcycles") == 0)
+												{
+													if (!GetNumericParameter(argc, argv, i, 1, PSG_COST_Z80_CLOCK, &value))
+														return -1;
+
+													filePSGCostSetMaxCycles(value);
+													l_cycle_report = true;
+													i++;
+												}
+												else
+												{
+													if (_strcmpi(argv[i], "-z80player") == 0)
+													{
+														if (i + 1 >= argc || !filePSGCostSetPlayerByName(argv[i + 1]))
+														{
+															printf("Invalid parameter: %s\n", argv[i]);
+															return -1;
+														}
+
+														l_cycle_report = true;
+														i++;
+													}
+													else
+													{
+														if (_strcmpi(argv[i], "-smooth") == 0)
+														{
+															if (!GetNumericParameter(argc, argv, i, 1, 16, &l_smooth_max_frame_bytes))
+																return -1;
+
+															filePSGSetFrameSmoothing(l_smooth_max_frame_bytes);
+															i++;
+														}
+														else
+														{
+															if (_strcmpi(argv[i], "-optimize") == 0)
+															{
+																filePSGSetWriteOptimization(true);
+																l_write_optimization = true;
+															}
+															else
+															{
+																if (_strcmpi(argv[i], "-clocktag") == 0)
+																{
+																	l_clock_tag = true;
+																}
+																else
+																{
+																	if (_strcmpi(argv[i], "-macros") == 0)
+																	{
+																		l_macros = true;
+																	}
+																	else
+																	{
+																		if (_strcmpi(argv[i], "-output") == 0)
+																		{
+																			if (i + 1 >= argc || !fileOutputGetFormatByName(argv[i + 1], &l_output_format))
+																			{
+																				printf("Invalid parameter: %s\n", argv[i]);
+																				return -1;
+																			}
+
+																			i++;
+																		}
+																		else
+																		{
+																			if (_strcmpi(argv[i], "-bank") == 0)
+																			{
+																				l_bank = true;
+																			}
+																			else
+																			{
+																				if (_strcmpi(argv[i], "-maxdistance") == 0)
+																				{
+																					if (!GetNumericParameter(argc, argv, i, PSG_COMPRESSION_MIN_DISTANCE, PSG_COMPRESSION_MAX_DISTANCE, &value))
+																						return -1;
+
+																					filePSGCompressSetMaxDistance(value);
+																					i++;
+																				}
+																				else
+																				{
+																					if (_strcmpi(argv[i], "-page") == 0)
+																					{
+																						if (!GetNumericParameter(argc, argv, i, PSG_COMPRESSION_MIN_PAGE_SIZE, PSG_COMPRESSION_MAX_PAGE_SIZE, &value))
+																							return -1;
+
+																						filePSGCompressSetPageSize(value);
+																						i++;
+																					}
+																					else
+																					{
+																						if (_strcmpi(argv[i], "-forbid") == 0)
+																						{
+																							if (!GetRangeParameter(argc, argv, i, &value, &last_value))
+																								return -1;
+
+																							if (!filePSGCompressAddForbiddenRange(value, last_value))
+																							{
+																								printf("ERROR: Too many forbidden ranges (maximum is %d).\n", PSG_COMPRESSION_MAX_FORBIDDEN_RANGE_COUNT);
+																								return -1;
+																							}
+																							i++;
+																						}
+																						else
+																						{
+																							if (_strcmpi(argv[i], "-maxsize") == 0)
+																							{
+																								if (!GetNumericParameter(argc, argv, i, 1, FILE_BUFFER_LENGTH, &l_max_size))
+																									return -1;
+
+																								i++;
+																							}
+																							else
+																							{
+																								if (_strcmpi(argv[i], "-cache") == 0)
+																								{
+																									if (i + 1 >= argc)
+																									{
+																										printf("Invalid parameter: %s\n", argv[i]);
+																										return -1;
+																									}
+
+																									l_cache_directory = argv[++i];
+																								}
+																								else
+																								{
+																									if (_strcmpi(argv[i], "-cachestats") == 0)
+																									{
+																										l_cache_statistics = true;
+																									}
+																									else
+																									{
+																										if (_strcmpi(argv[i], "-incremental") == 0)
+																										{
+																											if (!GetNumericParameter(argc, argv, i, 0, 100, &l_incremental_threshold))
+																												return -1;
+
+																											i++;
+																										}
+																										else
+																										{
+																											if (_strcmpi(argv[i], "-spans") == 0)
+																											{
+																												l_spans = true;
+																											}
+																											else
+																											{
+																												if (_strcmpi(argv[i], "-dual") == 0)
+																												{
+																													if (i + 1 >= argc || !GetDualChipMode(argv[i + 1], &l_dual_chip_mode))
+																													{
+																														printf("Invalid parameter: %s\n", argv[i]);
+																														return -1;
+																													}
+
+																													i++;
+																												}
+																												else
+																												{
+																													if (_strcmpi(argv[i], "-stereo") == 0)
+																													{
+																														filePSGSetStereo(true);
+																														l_stereo = true;
+																													}
+																													else
+																													{
+																														if (_strcmpi(argv[i], "-?") == 0)
+																														{
+																															PrintUsage();
+																															return 0;
+																														}
+																														else
+																														{
+																															printf("ERROR: Invalid command line parameter: %s\n", argv[i]);
+																															return -1;
+																														}
+																													}
+																												}
+																											}
+																										}
+																									}
+																								}
+																							}
+																						}
+																					}
+																				}
+																			}
+																		}
+																	}
+																}
+															}
+														}
+													}
+												}
+											}
+										}
+									}
 								}
 							}
 						}
@@ -105,43 +393,347 @@ int main(int argc, char* argv[])
 		}
 		else
 		{
-			if (vgm_filename == NULL)
+			if (filename_count < PSG_BANK_MAX_SONG_COUNT + 1)
 			{
-				vgm_filename = argv[i];
+				filenames[filename_count++] = argv[i];
 			}
 			else
 			{
-				if (psg_filename == NULL)
-				{
-					psg_filename = argv[i];
-				}
-				else
-				{
-					printf("ERROR: Invalid parameter: %s\n", argv[i]);
-					return -1;
-				}
+				printf("ERROR: Invalid parameter: %s\n", argv[i]);
+				return -1;
 			}
 		}
 	}
 
-	// check filenames
-	if (vgm_filename == NULL || psg_filename== NULL)
+	// print the cache statistics only
+	if (l_cache_statistics && filename_count == 0)
+	{
+		if (l_cache_directory == NULL)
+		{
+			printf("ERROR: The cache directory is not specified.\n");
+			return -1;
+		}
+
+		if (!fileCacheOpen(l_cache_directory))
+		{
+			printf("ERROR: Can't open cache directory: %s\n", l_cache_directory);
+			return -1;
+		}
+
+		fileCachePrintStatistics();
+		return 0;
+	}
+
+	// check filenames (the last one is the output file, only the bank can have more than one VGM file)
+	if (filename_count < 2)
 	{
 		PrintUsage();
 		return 0;
 	}
 
-	// load VGM file
-	printf("Opening: %s\n", vgm_filename);
+	if (!l_bank && filename_count > 2)
+	{
+		printf("ERROR: Invalid parameter: %s\n", filenames[2]);
+		return -1;
+	}
+
+	psg_filename = filenames[filename_count - 1];
+
+	// the cycle model of the Z80 player doesn't support macros and banks
+	if (l_macros && l_cycle_report)
+	{
+		printf("ERROR: Z80 player cycles can't be calculated for PSG files with macros.\n");
+		return -1;
+	}
+
+	if (l_bank && l_cycle_report)
+	{
+		printf("ERROR: Z80 player cycles can't be calculated for song banks.\n");
+		return -1;
+	}
+
+	// the stereo command is not supported by the Z80 player
+	if (l_stereo && l_cycle_report)
+	{
+		printf("ERROR: Z80 player cycles can't be calculated for PSG files with stereo.\n");
+		return -1;
+	}
+
+	// the songs of the chips are stored in a bank
+	if (l_dual_chip_mode == DualChip_Split && !l_bank)
+	{
+		printf("ERROR: The dual-chip split mode needs a song bank (-bank).\n");
+		return -1;
+	}
+
+	if (l_dual_chip_mode == DualChip_Split && (filename_count - 1) * 2 > PSG_BANK_MAX_SONG_COUNT)
+	{
+		printf("ERROR: The bank can contain songs of %d dual-chip VGM files.\n", PSG_BANK_MAX_SONG_COUNT / 2);
+		return -1;
+	}
+
+	// the long substrings are not supported by the Z80 player, and their sources are not checked by the memory constraints
+	if (l_spans && (l_cycle_report || l_bank || l_incremental_threshold >= 0 || filePSGCompressHasConstraints()))
+	{
+		printf("ERROR: Repeated frame spans can't be used with Z80 player cycles, song banks, incremental compression or memory constraints.\n");
+		return -1;
+	}
+
+	// the incremental compression needs the previous conversion from the cache and compresses a part of a single song
+	if (l_incremental_threshold >= 0)
+	{
+		if (l_cache_directory == NULL)
+		{
+			printf("ERROR: Incremental compression needs the cache directory (-cache).\n");
+			return -1;
+		}
+
+		if (l_bank || filePSGCostGetMaxCycles() > 0 || filePSGCompressHasConstraints())
+		{
+			printf("ERROR: Incremental compression can't be used for song banks, with cycle limit or with memory constraints.\n");
+			return -1;
+		}
+	}
+
+	// the '.inc' file of the incbin format would overwrite the binary file
+	if (!fileOutputIsValidFilename(psg_filename, l_output_format))
+	{
+		printf("ERROR: The binary file of the incbin output format can't have '.inc' extension: %s\n", psg_filename);
+		return -1;
+	}
+
+	sysStatisticsReset(l_statistics);
+
+	// look up the conversion result in the cache, the key contains the decompressed content of the VGM files
+	if (l_cache_directory != NULL)
+	{
+		if (!fileCacheOpen(l_cache_directory))
+		{
+			printf("ERROR: Can't open cache directory: %s\n", l_cache_directory);
+			return -1;
+		}
+
+		// the cache key contains the conversion settings, the previous conversion of the same file with the same settings is used by the incremental compression
+		fileCacheKeyStart();
+		AddSettingsToCacheKey();
+		options_key = fileCacheKeyGet();
+		fileCacheKeyAddString(filenames[0]);
+		incremental = (l_incremental_threshold >= 0 && l_psg_compression);
+		if (incremental)
+			incremental = filePSGIncrementalStart(fileCacheKeyGet(), l_incremental_threshold);
+		fileCacheKeySet(options_key);
+
+		for (i = 0; i < filename_count - 1; i++)
+		{
+			vgm_file_length = LoadVGM(filenames[i]);
+			if (vgm_file_length < 0)
+				return -1;
+
+			fileCacheKeyAdd(&vgm_file_length, sizeof(vgm_file_length));
+			fileCacheKeyAdd(l_vgm_buffer, vgm_file_length);
+		}
+
+		output_length = fileCacheLoad(l_psg_buffer, FILE_BUFFER_LENGTH);
+		output_buffer = l_psg_buffer;
+		cache_hit = (output_length >= 0);
+	}
+
+	if (cache_hit)
+	{
+		// nothing to convert
+	}
+	else if (l_bank)
+	{
+		// convert all songs and compress them into the bank, the bank is built again using the next compression level until it fits into the maximum size
+		if (!BuildBank(filenames, filename_count - 1))
+			return -1;
+
+		while (l_psg_compression && l_max_size > 0 && filePSGBankGetLength() > l_max_size && filePSGCompressGetLevel() < PSG_COMPRESSION_MAX_LEVEL)
+		{
+			level = filePSGCompressGetLevel() + 1;
+			printf("The bank is %d bytes, building it again using compression level %d\n", filePSGBankGetLength(), level);
+			filePSGCompressSetLevel(level);
+
+			if (!BuildBank(filenames, filename_count - 1))
+				return -1;
+		}
+
+		filePSGBankPrintResult();
+
+		output_buffer = filePSGBankGetBuffer();
+		output_length = filePSGBankGetLength();
+	}
+	else
+	{
+		// the VGM file is already loaded when the cache is used
+		if (vgm_file_length < 0)
+		{
+			vgm_file_length = LoadVGM(filenames[0]);
+			if (vgm_file_length < 0)
+				return -1;
+		}
+
+		psg_length = ConvertVGM(vgm_file_length, GetConvertedChip());
+		if (psg_length < 0)
+			return -1;
+
+		output_length = psg_length;
+
+		// compress PSG file (using the next compression level until it fits into the maximum size)
+		if (l_psg_compression)
+		{
+			printf("Compressing");
+			sysStatisticsStageBegin(STAT_STAGE_COMPRESS);
+			if (l_max_size > 0 || l_incremental_threshold >= 0)
+				memcpy(l_psg_uncompressed_buffer, l_psg_buffer, psg_length);
+
+			// compress only the changed part of the song when the previous conversion is in the cache
+			output_length = -1;
+			if (incremental)
+			{
+				output_length = filePSGIncrementalCompress(l_psg_buffer, psg_length);
+				if (output_length >= 0 && l_max_size > 0 && output_length > l_max_size)
+				{
+					printf("\nIncremental compression: %d bytes, it doesn't fit into %d bytes", output_length, l_max_size);
+					memcpy(l_psg_buffer, l_psg_uncompressed_buffer, psg_length);
+					output_length = -1;
+				}
+				full_compression = (output_length < 0);
+			}
+
+			if (full_compression)
+				output_length = (l_spans) ? filePSGSpanCompress(l_psg_buffer, psg_length) : filePSGCompress(l_psg_buffer, psg_length);
+
+			while (full_compression && output_length >= 0 && l_max_size > 0 && output_length > l_max_size && filePSGCompressGetLevel() < PSG_COMPRESSION_MAX_LEVEL)
+			{
+				level = filePSGCompressGetLevel() + 1;
+				printf("\n%d bytes, compressing again using level %d", output_length, level);
+				filePSGCompressSetLevel(level);
+
+				memcpy(l_psg_buffer, l_psg_uncompressed_buffer, psg_length);
+				output_length = (l_spans) ? filePSGSpanCompress(l_psg_buffer, psg_length) : filePSGCompress(l_psg_buffer, psg_length);
+			}
+			sysStatisticsStageEnd(STAT_STAGE_COMPRESS);
+
+			// the error is printed by the compression
+			if (output_length < 0)
+				return -1;
+
+			sysStatisticsAddBytes(STAT_STAGE_COMPRESS, psg_length, output_length);
+			printf("\n");
+
+			if (l_spans)
+				filePSGSpanPrintResult();
+
+			// keep this conversion for the next incremental compression
+			if (l_incremental_threshold >= 0 && !filePSGIncrementalFinish(l_psg_uncompressed_buffer, psg_length, l_psg_buffer, output_length, full_compression))
+				printf("Warning: Can't store the conversion for the incremental compression.\n");
+		}
+
+		output_buffer = l_psg_buffer;
+	}
+
+	// store the result in the cache
+	if (l_cache_directory != NULL && !cache_hit && !fileCacheStore(output_buffer, output_length))
+		printf("Warning: Can't store the result in the cache.\n");
+
+	if (l_max_size > 0 && output_length + (l_insert_length ? 2 : 0) > l_max_size)
+	{
+		printf("ERROR: The output is %d bytes, it doesn't fit into %d bytes.\n", output_length + (l_insert_length ? 2 : 0), l_max_size);
+		return -1;
+	}
+
+	printf("Creating: %s\n", psg_filename);
 
-	int vgm_file_length = fileVGMLoad(vgm_filename, l_vgm_buffer, FILE_BUFFER_LENGTH);
+	// write output file
+	sysStatisticsStageBegin(STAT_STAGE_OUTPUT);
+	if (!fileOutputCreate(psg_filename, l_output_format))
+	{
+		printf("Can't create output file: %s", psg_filename);
+		return -1;
+	}
+
+	if (l_insert_length)
+	{
+		fileOutputWriteBlock((uint8_t*)&output_length, 2);
+	}
+
+	fileOutputWriteBlock(output_buffer, output_length);
+	if (!fileOutputClose())
+	{
+		printf("Can't create the include file of: %s\n", psg_filename);
+		return -1;
+	}
+	sysStatisticsStageEnd(STAT_STAGE_OUTPUT);
+	sysStatisticsAddBytes(STAT_STAGE_OUTPUT, output_length, output_length + (l_insert_length ? 2 : 0));
+
+	printf("%d bytes written.\n", output_length);
+
+	// Z80 player cycle cost
+	if (l_cycle_report)
+	{
+		filePSGCostAnalyze(output_buffer, output_length, &cost);
+		filePSGCostPrint(&cost, l_psg_framerate);
+	}
+
+	// print statistics
+	if (l_statistics)
+	{
+		sysStatisticsPrint();
+
+		if (l_statistics_json_filename != NULL && !sysStatisticsSaveJSON(l_statistics_json_filename))
+		{
+			printf("Can't create statistics file: %s\n", l_statistics_json_filename);
+			return -1;
+		}
+	}
+
+	// update the cache counters
+	if (l_cache_directory != NULL)
+	{
+		if (!fileCacheClose())
+			printf("Warning: Can't update the statistics of the cache.\n");
+
+		if (l_cache_statistics)
+			fileCachePrintStatistics();
+	}
+
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Loads (and decompresses) the VGM file into the VGM buffer
+// Returns the length of the VGM data (-1 on error)
+static int LoadVGM(char* in_vgm_filename)
+{
+	int vgm_file_length;
+
+	printf("Opening: %s\n", in_vgm_filename);
+
+	sysStatisticsStageBegin(STAT_STAGE_INFLATE);
+	vgm_file_length = fileVGMLoad(in_vgm_filename, l_vgm_buffer, FILE_BUFFER_LENGTH);
+	sysStatisticsStageEnd(STAT_STAGE_INFLATE);
 	if (vgm_file_length == 0)
 	{
 		printf("ERROR: Can't load file.\n");
 		return -1;
 	}
+	sysStatisticsAddBytes(STAT_STAGE_INFLATE, 0, vgm_file_length);
 
-	if (!fileVGMOpen(l_vgm_buffer, vgm_file_length))
+	return vgm_file_length;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Converts the VGM file of the VGM buffer into non compressed PSG data in the PSG buffer
+// Returns the length of the PSG data (-1 on error)
+static int ConvertVGM(int in_vgm_file_length, int in_chip)
+{
+	int psg_length;
+	bool dual_chip;
+	emuSN76489State* converted_state;
+	uint64_t parsed_length = g_statistics.Stages[STAT_STAGE_PARSE].BytesOut;
+
+	if (!fileVGMOpen(l_vgm_buffer, in_vgm_file_length))
 	{
 		printf("ERROR: Invalid file.\n");
 		return -1;
@@ -151,60 +743,232 @@ int main(int argc, char* argv[])
 	if (g_vgm_file_header.SN76489Clock > 0)
 	{
 		g_SN76489_state.ClockFrequency = g_vgm_file_header.SN76489Clock & VGM_CLOCK_MASK;
+		g_SN76489_state_2nd.ClockFrequency = g_SN76489_state.ClockFrequency;
 	}
 	else
 	{
 		printf("The music is not composed for SN76489.\n");
 		return -1;
 	}
+
+	// the music of a single chip is converted from the first chip
+	dual_chip = (g_vgm_file_header.SN76489Clock & VGM_DUAL_CHIP_BIT) != 0;
+	if (dual_chip)
+	{
+		printf("Dual-chip music, converting %s\n", (in_chip == CHIP_MERGED) ? "the merged chips" : ((in_chip == CHIP_FIRST) ? "the first chip" : "the second chip"));
+	}
+	else
+	{
+		if (in_chip == CHIP_SECOND)
+		{
+			printf("ERROR: The music is not composed for two SN76489 chips.\n");
+			return -1;
+		}
+
+		in_chip = CHIP_FIRST;
+	}
+
+	if (in_chip == CHIP_MERGED)
+		converted_state = &l_merged_SN76489_state;
+	else
+		converted_state = (in_chip == CHIP_FIRST) ? &g_SN76489_state : &g_SN76489_state_2nd;
 	
+	// clock tag of the pre-scaled tone values
+	if (l_clock_tag)
+	{
+		switch (emuSN76489GetClockFrequency())
+		{
+			case PSG_CLOCK_3579KHZ:
+				filePSGSetClockTag(PSG_CLOCK_TAG_3579KHZ);
+				break;
+
+			case PSG_CLOCK_3125KHZ:
+				filePSGSetClockTag(PSG_CLOCK_TAG_3125KHZ);
+				break;
+
+			default:
+				printf("ERROR: Clock tag is supported only for %dHz and %dHz clock.\n", PSG_CLOCK_3579KHZ, PSG_CLOCK_3125KHZ);
+				return -1;
+		}
+	}
+
 	filePSGStart(l_psg_buffer, FILE_BUFFER_LENGTH);
 
 	// 'play' VGM file and log SN76489 register writes
 	emuSN76489Reset(&g_SN76489_state);
+	emuSN76489Reset(&g_SN76489_state_2nd);
+	emuSN76489Reset(&l_merged_SN76489_state);
+
+	// T6W28: the first chip is played on the left, the second chip on the right side
+	if (dual_chip && (g_vgm_file_header.SN76489Clock & VGM_T6W28_BIT) != 0)
+	{
+		g_SN76489_state.Stereo = emuSN76489_STEREO_LEFT;
+		g_SN76489_state_2nd.Stereo = emuSN76489_STEREO_RIGHT;
+	}
+
 	fileVGMPlayerStart();
 	while(fileVGMPlayerIsBusy())
 	{
+		sysStatisticsStageBegin(STAT_STAGE_PARSE);
 		fileVGMPlayerProcess(l_psg_frame_step);
+		sysStatisticsStageEnd(STAT_STAGE_PARSE);
 
-		filePSGUpdate(&g_SN76489_state, fileVGMIsBehindLoopStart());
+		sysStatisticsStageBegin(STAT_STAGE_ENCODE);
+		if (in_chip == CHIP_MERGED)
+			emuSN76489Merge(&l_merged_SN76489_state, &g_SN76489_state, &g_SN76489_state_2nd);
+
+		filePSGUpdate(converted_state, fileVGMIsBehindLoopStart());
+		sysStatisticsStageEnd(STAT_STAGE_ENCODE);
 	}
 
 	fileVGMClose();
-	filePSGFinish();
+	filePSGFinish(converted_state);
+
+	if (emuSN76489GetClampedToneCount() > 0)
+		printf("Warning: %u tone values clamped to the tone register range.\n", emuSN76489GetClampedToneCount());
 
-	output_length = filePSGGetLength();
+	if (l_write_optimization)
+		filePSGPrintWriteOptimizationResult();
 
-	// compress PSG file
-	if (l_psg_compression)
+	if (l_smooth_max_frame_bytes > 0)
+		filePSGPrintFrameSmoothingResult();
+
+	psg_length = filePSGGetLength();
+	sysStatisticsAddBytes(STAT_STAGE_ENCODE, (uint32_t)(g_statistics.Stages[STAT_STAGE_PARSE].BytesOut - parsed_length), psg_length);
+
+	// replace the repeating register patterns by macros
+	if (l_macros)
 	{
-		printf("Compressing");
-		output_length = filePSGCompress(l_psg_buffer, filePSGGetLength());
-		printf("\n");
+		psg_length = filePSGMacroEncode(l_psg_buffer, psg_length);
+		filePSGMacroPrintResult();
 	}
 
-	printf("Creating: %s\n", psg_filename);
+	return psg_length;
+}
 
-	// write output file
-	if (!fileOutputCreate(psg_filename, l_asm_output))
+///////////////////////////////////////////////////////////////////////////////
+// Converts the VGM files and compresses them into the song bank
+static bool BuildBank(char* in_vgm_filenames[], int in_song_count)
+{
+	int vgm_file_length = 0;
+	int psg_length;
+	int bank_length;
+	int chip_count = (l_dual_chip_mode == DualChip_Split) ? 2 : 1;
+	int chip;
+	int i;
+
+	filePSGBankStart(in_song_count * chip_count, l_psg_compression);
+
+	for (i = 0; i < in_song_count * chip_count; i++)
 	{
-		printf("Can't create output file: %s", argv[2]);
-		return -1;
+		// the split dual-chip files give a song for the first and for the second chip
+		if (i % chip_count == 0)
+		{
+			vgm_file_length = LoadVGM(in_vgm_filenames[i / chip_count]);
+			if (vgm_file_length < 0)
+				return false;
+		}
+
+		if (chip_count == 2)
+			chip = (i % chip_count == 0) ? CHIP_FIRST : CHIP_SECOND;
+		else
+			chip = GetConvertedChip();
+
+		psg_length = ConvertVGM(vgm_file_length, chip);
+		if (psg_length < 0)
+			return false;
+
+		if (l_psg_compression)
+			printf("Compressing");
+
+		bank_length = filePSGBankGetLength();
+		sysStatisticsStageBegin(STAT_STAGE_COMPRESS);
+		if (!filePSGBankAddSong(in_vgm_filenames[i / chip_count], l_psg_buffer, psg_length))
+			return false;
+		sysStatisticsStageEnd(STAT_STAGE_COMPRESS);
+		sysStatisticsAddBytes(STAT_STAGE_COMPRESS, psg_length, filePSGBankGetLength() - bank_length);
+
+		if (l_psg_compression)
+			printf("\n");
 	}
 
-	if (l_insert_length)
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Adds the settings which change the PSG data to the cache key in a fixed order
+// (the output format and the reports are not included, so the order of the options and the default values given explicitly don't change the key)
+static void AddSettingsToCacheKey(void)
+{
+	int settings[] =
 	{
-		fileOutputWriteBlock((uint8_t*)&output_length, 2);
+		l_psg_framerate,
+		emuSN76489GetClockFrequency(),
+		l_psg_compression,
+		filePSGCompressGetLevel(),
+		filePSGCompressGetMaxDistance(),
+		filePSGCompressGetPageSize(),
+		filePSGCostGetMaxCycles(),
+		(int)filePSGCostGetPlayer(),
+		l_smooth_max_frame_bytes,
+		l_write_optimization,
+		l_clock_tag,
+		l_macros,
+		l_bank,
+		l_max_size,
+		l_incremental_threshold,
+		l_spans,
+		(int)l_dual_chip_mode,
+		l_stereo
+	};
+	int first;
+	int last;
+	int i;
+
+	fileCacheKeyAdd(settings, sizeof(settings));
+
+	// the forbidden ranges are sorted
+	for (i = 0; filePSGCompressGetForbiddenRange(i, &first, &last); i++)
+	{
+		fileCacheKeyAdd(&first, sizeof(first));
+		fileCacheKeyAdd(&last, sizeof(last));
 	}
+}
 
-	fileOutputWriteBlock(l_psg_buffer, output_length);
-	fileOutputClose();
+///////////////////////////////////////////////////////////////////////////////
+// Gets the dual-chip mode by its name
+static bool GetDualChipMode(char* in_name, DualChipMode* out_mode)
+{
+	int i;
 
-	printf("%d bytes written.\n", output_length);
+	for (i = 0; l_dual_chip_mode_names[i] != NULL; i++)
+	{
+		if (_strcmpi(in_name, l_dual_chip_mode_names[i]) == 0)
+		{
+			*out_mode = (DualChipMode)i;
+			return true;
+		}
+	}
 
-	return 0;
+	return false;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Gets the converted chip of the dual-chip VGM files (except the split mode)
+static int GetConvertedChip(void)
+{
+	switch (l_dual_chip_mode)
+	{
+		case DualChip_First:
+			return CHIP_FIRST;
+
+		case DualChip_Second:
+			return CHIP_SECOND;
+
+		default:
+			return CHIP_MERGED;
+	}
+}
 
 ///////////////////////////////////////////////////////////////////////////////
 // Gets numeric parameter from the command line
@@ -235,17 +999,75 @@ static bool GetNumericParameter(int in_argc, char* in_argv[], int in_index, int
 	}
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Gets address range parameter (first-last, decimal or hexadecimal with 0x prefix) from the command line
+static bool GetRangeParameter(int in_argc, char* in_argv[], int in_index, int* out_first, int* out_last)
+{
+	char* end;
+	long first;
+	long last;
+
+	if (in_index + 1 < in_argc)
+	{
+		first = strtol(in_argv[in_index + 1], &end, 0);
+		if (*end == '-')
+		{
+			last = strtol(end + 1, &end, 0);
+			if (*end == '\0' && first >= 0 && first <= last && last <= 0xffff)
+			{
+				*out_first = (int)first;
+				*out_last = (int)last;
+
+				return true;
+			}
+		}
+
+		printf("Invalid range: %s\n", in_argv[in_index + 1]);
+		return false;
+	}
+	else
+	{
+		printf("Invalid parameter: %s\n", in_argv[in_index]);
+		return false;
+	}
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Prints help text
 static void PrintUsage(void)
 {
 	printf("Usage:\n");
 	printf("VGM2PSG musicfile.vgm musicfile.psg [options]\n");
+	printf("VGM2PSG -bank song1.vgm song2.vgm ... bankfile.psg [options]\n");
 	printf("Options:\n");
 	printf("  -asm           - sets output file format to Z80 ASM file. If not specified, binary output will be produced.\n");
+	printf("  -bank          - converts all VGM files into one song bank, the songs are compressed using the previous songs as a dictionary\n");
+	printf("  -cache d       - stores the conversion results in directory d and reuses them when the VGM files and the options are the same\n");
+	printf("  -cachestats    - prints the hit and miss counters of the cache (can be used without files)\n");
 	printf("  -clock n       - sets SN76489 clock frequency to n Hz. The default is 3579545Hz\n");
+	printf("  -clocktag      - writes the clock tag (3579545Hz or 3125000Hz clock) into the PSG file\n");
+	printf("  -cycles        - prints the worst case and average Z80 player cycles per frame\n");
+	printf("  -dual m        - sets the conversion of the dual-chip (and T6W28) music: merge (the louder channel of the chips, default),\n");
+	printf("                   split (two songs of the bank with the same frames, one for every chip), first or second (one chip only)\n");
+	printf("  -forbid a-b    - no substring source in the a..b range of offsets (decimal or 0x hex), can be given %d times\n", PSG_COMPRESSION_MAX_FORBIDDEN_RANGE_COUNT);
 	printf("  -framerate n   - sets the playback framerate to n Hz. The default is 50Hz\n");
+	printf("  -incremental n - compresses only the changed part of the song using its previous conversion in the cache (-cache), full compression\n");
+	printf("                   is used when the compression ratio is worse by more than n percent (%d is recommended)\n", PSG_INCREMENTAL_DEFAULT_THRESHOLD);
 	printf("  -insertlength  - inserts PSG file length into the begining of the output file\n");
+	printf("  -level n       - sets compression level (1 - fastest ... 9 - smallest). The default is 6\n");
+	printf("  -macros        - replaces the repeating attenuation envelopes and tone offset patterns by macros (extended format)\n");
+	printf("  -maxcycles n   - limits the Z80 player cycles per frame to n T-states by refusing substrings (implies -cycles)\n");
+	printf("  -maxdistance n - limits the distance between the substring reference and its source to n bytes\n");
+	printf("  -maxsize n     - compresses again using higher compression levels until the output fits into n bytes\n");
 	printf("  -noncompressed - creates PSG file without comressed elements\n");
+	printf("  -optimize      - drops the tone and noise register writes of the muted channels\n");
+	printf("  -output f      - sets output file format: bin, asm (same as -asm), dw (Z80 ASM words), c (C header) or incbin (binary and .inc file)\n");
+	printf("  -page n        - sets the memory page size (256..65536), the substring sources are in the page of the reference\n");
+	printf("  -smooth n      - defers low priority register writes of the frames above n bytes by one frame (1..16)\n");
+	printf("  -spans         - replaces the repeated frame sequences by long substrings (extended format)\n");
+	printf("  -stereo        - writes the changes of the Game Gear stereo register (extended format)\n");
+	printf("  -stats         - prints timing and counter statistics of the conversion stages\n");
+	printf("  -statsjson f   - saves the statistics into file f in JSON format (implies -stats)\n");
+	printf("  -z80player p   - sets the modelled Z80 player: fast, accurate (Game Card) or direct (Sound Magic). The default is fast\n");
 	printf("  -?             - prints this help text\n");
 }
@@ -26,6 +26,9 @@
 #define SN76489REG_NOISE_CTRL	6
 #define SN76489REG_NOISE_ATT	7
 
+#define SN76489_NOISE_CHANNEL 3
+#define SN76489_NOISE_TONE2_FREQUENCY 3		// noise shift rate uses the channel 2 tone frequency
+
 ///////////////////////////////////////////////////////////////////////////////
 // Local functions
 
@@ -33,6 +36,7 @@
 ///////////////////////////////////////////////////////////////////////////////
 // Local variables
 static int l_target_clock_frequency = 3579545;
+static uint32_t l_clamped_tone_count = 0;
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -53,6 +57,7 @@ void emuSN76489Reset(emuSN76489State* in_state)
 	}
 
 	in_state->NoiseRegisterChanged = false;
+	in_state->Stereo = emuSN76489_STEREO_DEFAULT;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -147,7 +152,14 @@ void emuN76496WriteRegister(emuSN76489State* in_state, uint8_t in_data)
 			in_state->ToneRegisters[register_index] = register_value;
 
 			// calculate new frequency value
-			register_value = (uint16_t)(((register_value * (int64_t)l_target_clock_frequency + (g_SN76489_state.ClockFrequency / 2)) / g_SN76489_state.ClockFrequency));
+			register_value = (uint16_t)(((register_value * (int64_t)l_target_clock_frequency + (in_state->ClockFrequency / 2)) / in_state->ClockFrequency));
+
+			// clamp to the 10 bit tone register range
+			if (register_value > emuSN76489_TONE_MAX)
+			{
+				register_value = emuSN76489_TONE_MAX;
+				l_clamped_tone_count++;
+			}
 
 			// store register value
 			in_state->Registers[register_index] = register_value;
@@ -175,9 +187,65 @@ void emuSN76489ClearRegisterChanged(emuSN76489State* in_state)
 	}
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Merges the state of two chips into one chip state (best effort for the dual-chip music): every channel
+// is taken from the chip where it is louder (from the first chip when they are equal), the channel 2 tone
+// is taken from the chip of the noise when the noise uses the channel 2 frequency
+void emuSN76489Merge(emuSN76489State* inout_state, emuSN76489State* in_first, emuSN76489State* in_second)
+{
+	emuSN76489State* source[emuSN76489_CHANNEL_COUNT];
+	int channel;
+	int tone_register;
+	int attenuation_register;
+	uint8_t channel_stereo;
+
+	for (channel = 0; channel < emuSN76489_CHANNEL_COUNT; channel++)
+	{
+		attenuation_register = channel * 2 + 1;
+		source[channel] = (in_second->Registers[attenuation_register] < in_first->Registers[attenuation_register]) ? in_second : in_first;
+	}
+
+	if ((source[SN76489_NOISE_CHANNEL]->Registers[SN76489REG_NOISE_CTRL] & 0x03) == SN76489_NOISE_TONE2_FREQUENCY)
+		source[2] = source[SN76489_NOISE_CHANNEL];
+
+	inout_state->Stereo = 0;
+	for (channel = 0; channel < emuSN76489_CHANNEL_COUNT; channel++)
+	{
+		tone_register = channel * 2;
+		attenuation_register = channel * 2 + 1;
+
+		inout_state->Registers[tone_register] = source[channel]->Registers[tone_register];
+		inout_state->ToneRegisters[tone_register] = source[channel]->ToneRegisters[tone_register];
+		inout_state->Registers[attenuation_register] = source[channel]->Registers[attenuation_register];
+
+		channel_stereo = (uint8_t)(0x11 << channel);
+		inout_state->Stereo |= source[channel]->Stereo & channel_stereo;
+	}
+
+	inout_state->NoiseRegisterChanged = source[SN76489_NOISE_CHANNEL]->NoiseRegisterChanged;
+
+	// the changes of the chips are processed
+	emuSN76489ClearRegisterChanged(in_first);
+	emuSN76489ClearRegisterChanged(in_second);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Sets chip target clock frequency
 void emuSN76489SetClockFrequency(int in_clock_frequency)
 {
 	l_target_clock_frequency = in_clock_frequency;
 }
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets chip target clock frequency
+int emuSN76489GetClockFrequency(void)
+{
+	return l_target_clock_frequency;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets the number of tone writes clamped to the tone register range by the clock conversion
+uint32_t emuSN76489GetClampedToneCount(void)
+{
+	return l_clamped_tone_count;
+}
@@ -0,0 +1,367 @@
+/*****************************************************************************/
+/* VGM2PSG Conversion Result Cache                                           */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#include <stdio.h>
+#include <string.h>
+#include <direct.h>
+#include <fileCache.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Cache structure
+///////////////////////////////////////////////////////////////////////////////
+// The cache is a directory, every conversion result is stored in a separate file.
+// The name of the file is the 64-bit key of the conversion: FNV-1a hash of the
+// conversion version, the conversion options and the decompressed VGM files. The
+// file starts with a header (magic, version, key, length of the PSG data) which
+// is checked when the file is loaded, so damaged or partially written entries
+// are handled as a miss. The 'cache.stats' text file of the directory contains
+// the total number of hits, misses and stored entries. Other data can be stored
+// with a different extension (previous conversion of the incremental compression).
+// The directory is refused when the name of its entry files would be longer than
+// the maximum path length.
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+#define MAX_PATH_LENGTH 260
+#define CACHE_KEY_DIGITS 16
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+#define CACHE_MAGIC "PSGC"
+#define CACHE_STATISTICS_FILENAME "cache.stats"
+#define CACHE_RESULT_EXTENSION "psg"
+
+///////////////////////////////////////////////////////////////////////////////
+// Types
+
+// Header of the cache entry files
+typedef struct
+{
+	char Magic[4];
+	uint32_t Version;
+	uint64_t Key;
+	uint32_t Length;
+} CacheEntryHeader;
+
+// Cache counters
+typedef struct
+{
+	uint32_t Hits;
+	uint32_t Misses;
+	uint32_t StoredEntries;
+	uint64_t StoredBytes;
+} CacheStatistics;
+
+///////////////////////////////////////////////////////////////////////////////
+// Local functions
+static bool fileCacheGetEntryFilename(char* out_filename, uint64_t in_key, const char* in_extension);
+static bool fileCacheGetStatisticsFilename(char* out_filename);
+static void fileCacheLoadStatistics(CacheStatistics* out_statistics);
+
+///////////////////////////////////////////////////////////////////////////////
+// Module global variables
+static char l_directory[MAX_PATH_LENGTH];
+static bool l_open = false;
+static uint64_t l_key = FNV_OFFSET_BASIS;
+static CacheStatistics l_statistics;		// counters of the current run
+
+///////////////////////////////////////////////////////////////////////////////
+// Opens the cache directory (it is created when it doesn't exist)
+bool fileCacheOpen(char* in_directory)
+{
+	FILE* file;
+	char filename[MAX_PATH_LENGTH];
+	int length;
+
+	// the longest file name of the directory ('\', key, '.', extension and terminator) must fit in the path
+	if (strlen(in_directory) + 1 + CACHE_KEY_DIGITS + 1 + CACHE_MAX_EXTENSION_LENGTH >= MAX_PATH_LENGTH)
+		return false;
+
+	length = snprintf(l_directory, MAX_PATH_LENGTH, "%s", in_directory);
+	if (length < 0 || length >= MAX_PATH_LENGTH)
+		return false;
+
+	memset(&l_statistics, 0, sizeof(l_statistics));
+
+	_mkdir(l_directory);
+
+	// check the directory by opening the statistics file
+	if (!fileCacheGetStatisticsFilename(filename))
+		return false;
+
+	file = fopen(filename, "a");
+	if (file == NULL)
+		return false;
+
+	fclose(file);
+	l_open = true;
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Starts a new conversion key
+void fileCacheKeyStart(void)
+{
+	uint32_t version = CACHE_FORMAT_VERSION;
+
+	l_key = FNV_OFFSET_BASIS;
+	fileCacheKeyAdd(&version, sizeof(version));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Adds data to the conversion key (FNV-1a hash)
+void fileCacheKeyAdd(const void* in_data, int in_data_length)
+{
+	const uint8_t* data = (const uint8_t*)in_data;
+	uint64_t key = l_key;
+	int i;
+
+	for (i = 0; i < in_data_length; i++)
+		key = (key ^ data[i]) * FNV_PRIME;
+
+	l_key = key;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets the current conversion key
+uint64_t fileCacheKeyGet(void)
+{
+	return l_key;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sets the conversion key (continues a key saved by fileCacheKeyGet)
+void fileCacheKeySet(uint64_t in_key)
+{
+	l_key = in_key;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Adds string (including the terminator, so the following data can't be part of the string) to the conversion key
+void fileCacheKeyAddString(const char* in_string)
+{
+	fileCacheKeyAdd(in_string, (int)strlen(in_string) + 1);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Loads the conversion result of the current key. Returns the length of the PSG data or -1 if it is not in the cache.
+int fileCacheLoad(uint8_t* out_buffer, int in_buffer_length)
+{
+	int length;
+
+	if (!l_open)
+		return -1;
+
+	length = fileCacheLoadEntry(l_key, CACHE_RESULT_EXTENSION, out_buffer, in_buffer_length);
+
+	if (length < 0)
+	{
+		printf("Cache miss: %016llx\n", (unsigned long long)l_key);
+		l_statistics.Misses++;
+	}
+	else
+	{
+		printf("Cache hit: %016llx (%d bytes)\n", (unsigned long long)l_key, length);
+		l_statistics.Hits++;
+	}
+
+	return length;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Stores the conversion result of the current key
+bool fileCacheStore(uint8_t* in_buffer, int in_length)
+{
+	if (!fileCacheStoreEntry(l_key, CACHE_RESULT_EXTENSION, in_buffer, in_length))
+		return false;
+
+	l_statistics.StoredEntries++;
+	l_statistics.StoredBytes += in_length;
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Loads the data stored with the key and extension. Returns the length of the data or -1 if it is not in the cache.
+int fileCacheLoadEntry(uint64_t in_key, const char* in_extension, uint8_t* out_buffer, int in_buffer_length)
+{
+	char filename[MAX_PATH_LENGTH];
+	FILE* file;
+	CacheEntryHeader header;
+	int length = -1;
+
+	if (!l_open)
+		return -1;
+
+	if (!fileCacheGetEntryFilename(filename, in_key, in_extension))
+		return -1;
+
+	file = fopen(filename, "rb");
+	if (file == NULL)
+		return -1;
+
+	if (fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.Magic, CACHE_MAGIC, sizeof(header.Magic)) == 0 &&
+		header.Version == CACHE_FORMAT_VERSION && header.Key == in_key && header.Length <= (uint32_t)in_buffer_length &&
+		fread(out_buffer, 1, header.Length, file) == header.Length && fgetc(file) == EOF)
+	{
+		length = (int)header.Length;
+	}
+
+	fclose(file);
+
+	return length;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Stores the data with the key and extension
+bool fileCacheStoreEntry(uint64_t in_key, const char* in_extension, uint8_t* in_buffer, int in_length)
+{
+	char filename[MAX_PATH_LENGTH];
+	FILE* file;
+	CacheEntryHeader header;
+	bool success;
+
+	if (!l_open)
+		return false;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.Magic, CACHE_MAGIC, sizeof(header.Magic));
+	header.Version = CACHE_FORMAT_VERSION;
+	header.Key = in_key;
+	header.Length = (uint32_t)in_length;
+
+	if (!fileCacheGetEntryFilename(filename, in_key, in_extension))
+		return false;
+
+	file = fopen(filename, "wb");
+	if (file == NULL)
+		return false;
+
+	success = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(in_buffer, 1, in_length, file) == (size_t)in_length;
+	success = (fclose(file) == 0) && success;
+
+	// a partially written entry is removed, it would be a miss anyway
+	if (!success)
+		remove(filename);
+
+	return success;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Adds the counters of the current run to the statistics file of the cache
+bool fileCacheClose(void)
+{
+	char filename[MAX_PATH_LENGTH];
+	FILE* file;
+	CacheStatistics statistics;
+
+	if (!l_open)
+		return true;
+
+	l_open = false;
+
+	// the file is read again just before writing, so parallel conversions lose counters only rarely
+	fileCacheLoadStatistics(&statistics);
+	statistics.Hits += l_statistics.Hits;
+	statistics.Misses += l_statistics.Misses;
+	statistics.StoredEntries += l_statistics.StoredEntries;
+	statistics.StoredBytes += l_statistics.StoredBytes;
+
+	if (!fileCacheGetStatisticsFilename(filename))
+		return false;
+
+	file = fopen(filename, "w");
+	if (file == NULL)
+		return false;
+
+	fprintf(file, "hits %u\nmisses %u\nentries %u\nbytes %llu\n", statistics.Hits, statistics.Misses, statistics.StoredEntries, (unsigned long long)statistics.StoredBytes);
+
+	return fclose(file) == 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Prints the total counters of the cache
+void fileCachePrintStatistics(void)
+{
+	CacheStatistics statistics;
+	uint32_t lookups;
+
+	fileCacheLoadStatistics(&statistics);
+	lookups = statistics.Hits + statistics.Misses;
+
+	printf("Cache: %s\n", l_directory);
+	printf("  Lookups:  %u (%u hits, %u misses, %.1f%% hit rate)\n", lookups, statistics.Hits, statistics.Misses, (lookups > 0) ? statistics.Hits * 100.0 / lookups : 0.0);
+	printf("  Stored:   %u entries, %llu bytes\n", statistics.StoredEntries, (unsigned long long)statistics.StoredBytes);
+}
+
+/*****************************************************************************/
+/* Local functions                                                           */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets the file name of the entry. Returns false if the extension or the file name is too long.
+static bool fileCacheGetEntryFilename(char* out_filename, uint64_t in_key, const char* in_extension)
+{
+	int length;
+
+	if (strlen(in_extension) > CACHE_MAX_EXTENSION_LENGTH)
+		return false;
+
+	length = snprintf(out_filename, MAX_PATH_LENGTH, "%s\\%016llx.%s", l_directory, (unsigned long long)in_key, in_extension);
+
+	return length >= 0 && length < MAX_PATH_LENGTH;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets the file name of the statistics file. Returns false if the file name is too long.
+static bool fileCacheGetStatisticsFilename(char* out_filename)
+{
+	int length;
+
+	length = snprintf(out_filename, MAX_PATH_LENGTH, "%s\\%s", l_directory, CACHE_STATISTICS_FILENAME);
+
+	return length >= 0 && length < MAX_PATH_LENGTH;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Loads the counters from the statistics file (missing values are zero)
+static void fileCacheLoadStatistics(CacheStatistics* out_statistics)
+{
+	char filename[MAX_PATH_LENGTH];
+	char name[16];
+	unsigned long long value;
+	FILE* file;
+
+	memset(out_statistics, 0, sizeof(CacheStatistics));
+
+	if (!fileCacheGetStatisticsFilename(filename))
+		return;
+
+	file = fopen(filename, "r");
+	if (file == NULL)
+		return;
+
+	while (fscanf(file, "%15s %llu", name, &value) == 2)
+	{
+		if (strcmp(name, "hits") == 0)
+			out_statistics->Hits = (uint32_t)value;
+		else if (strcmp(name, "misses") == 0)
+			out_statistics->Misses = (uint32_t)value;
+		else if (strcmp(name, "entries") == 0)
+			out_statistics->StoredEntries = (uint32_t)value;
+		else if (strcmp(name, "bytes") == 0)
+			out_statistics->StoredBytes = value;
+	}
+
+	fclose(file);
+}
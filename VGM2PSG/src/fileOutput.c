@@ -12,37 +12,124 @@
 // Includes
 #include <fileOutput.h>
 #include <stdio.h>
+#include <string.h>
+#include <ctype.h>
 
 ///////////////////////////////////////////////////////////////////////////////
 // Defines
 #define BYTE_COUNT_IN_LINE 16
+#define WORD_COUNT_IN_LINE 8
+#define OUTPUT_BUFFER_LENGTH 65536
+#define MAX_LINE_LENGTH 128				// longest line of the text formats
+#define MAX_PATH_LENGTH 260
+#define MAX_SYMBOL_LENGTH 64
+
+///////////////////////////////////////////////////////////////////////////////
+// Local functions
+static void fileOutputWriteText(const char* in_text);
+static void fileOutputWriteHex(uint8_t in_value);
+static void fileOutputFlush(bool in_all);
+static bool fileOutputWriteIncludeFile(void);
+static void fileOutputGetIncludeFilename(char* out_include_filename, const char* in_filename);
+static void fileOutputGetSymbolName(char* in_filename);
 
 ///////////////////////////////////////////////////////////////////////////////
 // Module global variables
 static FILE* l_output_file;
 static int l_file_length;
-bool l_asm_mode = false;
+static OutputFormatType l_format = OutputFormat_Binary;
+
+// text output buffer (the lines are formatted in the buffer and written in large blocks)
+static char l_buffer[OUTPUT_BUFFER_LENGTH];
+static int l_buffer_pos;
+static char l_hex_table[256][2];
+
+// pending low byte of the '.dw' format
+static uint8_t l_word_low_byte;
+
+// names of the output formats (command line)
+static const char* l_format_names[OutputFormat_Count] = { "bin", "asm", "dw", "c", "incbin" };
+
+// file and symbol names of the C header and the incbin formats
+static char l_filename[MAX_PATH_LENGTH];
+static char l_symbol_name[MAX_SYMBOL_LENGTH];
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets the output format by its name
+bool fileOutputGetFormatByName(char* in_name, OutputFormatType* out_format)
+{
+	int i;
+
+	for (i = 0; i < OutputFormat_Count; i++)
+	{
+		if (_strcmpi(in_name, l_format_names[i]) == 0)
+		{
+			*out_format = (OutputFormatType)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns false if the output file would be overwritten by the other file of the format (the '.inc' file of the incbin format)
+bool fileOutputIsValidFilename(char* in_filename, OutputFormatType in_format)
+{
+	char include_filename[MAX_PATH_LENGTH + 4];
+
+	if (in_format != OutputFormat_Incbin)
+		return true;
 
+	fileOutputGetIncludeFilename(include_filename, in_filename);
+
+	return _strcmpi(include_filename, in_filename) != 0;
+}
 
 //////////////////////////////////////////////////////////////////////////////
-// Creates output file in binary ot text mode
-bool fileOutputCreate(char* in_filename, bool in_text_mode)
+// Creates output file in the given format
+bool fileOutputCreate(char* in_filename, OutputFormatType in_format)
 {
+	int i;
+
 	// init
-	l_asm_mode = in_text_mode;
+	l_format = in_format;
 	l_file_length = 0;
+	l_buffer_pos = 0;
+
+	snprintf(l_filename, MAX_PATH_LENGTH, "%s", in_filename);
+	fileOutputGetSymbolName(in_filename);
+
+	// hex digits of all byte values
+	for (i = 0; i < 256; i++)
+	{
+		l_hex_table[i][0] = "0123456789ABCDEF"[i >> 4];
+		l_hex_table[i][1] = "0123456789ABCDEF"[i & 0x0f];
+	}
 
 	// create file
-	if (in_text_mode)
+	if (in_format == OutputFormat_Binary || in_format == OutputFormat_Incbin)
 	{
-		l_output_file = fopen(in_filename, "wt");
+		l_output_file = fopen(in_filename, "wb");
 	}
 	else
 	{
-		l_output_file = fopen(in_filename, "wb");
+		l_output_file = fopen(in_filename, "wt");
+	}
+
+	if (l_output_file == NULL)
+		return false;
+
+	// C header: beginning of the array
+	if (in_format == OutputFormat_CHeader)
+	{
+		fileOutputWriteText("// Generated by VGM2PSG\n\n#include <stdint.h>\n\nconst uint8_t ");
+		fileOutputWriteText(l_symbol_name);
+		fileOutputWriteText("[] =\n{");
 	}
 
-	return l_output_file != NULL;
+	return true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -51,43 +138,236 @@ void fileOutputWriteBlock(uint8_t* in_data, int in_data_length)
 {
 	int pos;
 
-	if (l_asm_mode)
+	switch (l_format)
 	{
-		for (pos = 0; pos < in_data_length; pos++)
-		{
-			// start a new line if required
-			if ((l_file_length % BYTE_COUNT_IN_LINE) == 0)
+		// binary formats
+		case OutputFormat_Binary:
+		case OutputFormat_Incbin:
+			fwrite(in_data, sizeof(uint8_t), in_data_length, l_output_file);
+			l_file_length += in_data_length;
+			break;
+
+		// '.db' lines
+		case OutputFormat_ASM:
+			for (pos = 0; pos < in_data_length; pos++)
 			{
-				if (l_file_length > 0)
+				// start a new line if required
+				if ((l_file_length % BYTE_COUNT_IN_LINE) == 0)
 				{
-					fprintf(l_output_file, "\n");
+					fileOutputFlush(false);
+					fileOutputWriteText((l_file_length > 0) ? "\n        .db 0" : "        .db 0");
 				}
-				fprintf(l_output_file, "        .db ");
+				else
+				{
+					fileOutputWriteText(", 0");
+				}
+
+				fileOutputWriteHex(in_data[pos]);
+				l_buffer[l_buffer_pos++] = 'h';
+				l_file_length++;
 			}
-			else
+			break;
+
+		// '.dw' lines, the words are written when the high byte arrives
+		case OutputFormat_ASMWords:
+			for (pos = 0; pos < in_data_length; pos++)
 			{
-				fprintf(l_output_file, ", ");
+				if ((l_file_length & 1) == 0)
+				{
+					l_word_low_byte = in_data[pos];
+				}
+				else
+				{
+					// start a new line if required
+					if ((l_file_length % (WORD_COUNT_IN_LINE * 2)) == 1)
+					{
+						fileOutputFlush(false);
+						fileOutputWriteText((l_file_length > 1) ? "\n        .dw 0" : "        .dw 0");
+					}
+					else
+					{
+						fileOutputWriteText(", 0");
+					}
+
+					fileOutputWriteHex(in_data[pos]);
+					fileOutputWriteHex(l_word_low_byte);
+					l_buffer[l_buffer_pos++] = 'h';
+				}
+				l_file_length++;
 			}
+			break;
 
-			fprintf(l_output_file, "0%02Xh", in_data[pos]);
-			l_file_length++;
-		}
+		// C array lines
+		case OutputFormat_CHeader:
+			for (pos = 0; pos < in_data_length; pos++)
+			{
+				// start a new line if required
+				if ((l_file_length % BYTE_COUNT_IN_LINE) == 0)
+				{
+					fileOutputFlush(false);
+					fileOutputWriteText((l_file_length > 0) ? ",\n\t0x" : "\n\t0x");
+				}
+				else
+				{
+					fileOutputWriteText(", 0x");
+				}
+
+				fileOutputWriteHex(in_data[pos]);
+				l_file_length++;
+			}
+			break;
+
+		default:
+			break;
 	}
-	else
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Closes output file
+// Returns false when the additional symbol file can't be created
+bool fileOutputClose(void)
+{
+	char text[MAX_LINE_LENGTH];
+	bool success = true;
+
+	if (l_output_file == NULL)
+		return false;
+
+	fileOutputFlush(false);
+
+	switch (l_format)
 	{
-		fwrite(in_data, sizeof(uint8_t), in_data_length, l_output_file);
-		l_file_length += in_data_length;
+		// odd length: the last byte is written by a '.db' line
+		case OutputFormat_ASMWords:
+			if ((l_file_length & 1) != 0)
+			{
+				fileOutputWriteText((l_file_length > 1) ? "\n        .db 0" : "        .db 0");
+				fileOutputWriteHex(l_word_low_byte);
+				l_buffer[l_buffer_pos++] = 'h';
+			}
+			break;
+
+		// end of the array and the length
+		case OutputFormat_CHeader:
+			snprintf(text, MAX_LINE_LENGTH, "\n};\n\nconst uint32_t %s_length = %d;\n", l_symbol_name, l_file_length);
+			fileOutputWriteText(text);
+			break;
+
+		case OutputFormat_Incbin:
+			success = fileOutputWriteIncludeFile();
+			break;
+
+		default:
+			break;
 	}
+
+	fileOutputFlush(true);
+
+	fclose(l_output_file);
+	l_output_file = NULL;
+
+	return success;
+}
+
+/*****************************************************************************/
+/* Local functions                                                           */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Copies text into the output buffer (the buffer is flushed before every line, it has room for one more line)
+static void fileOutputWriteText(const char* in_text)
+{
+	while (*in_text != '\0')
+		l_buffer[l_buffer_pos++] = *in_text++;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// Closes output file
-void fileOutputClose(void)
+// Writes the two hex digits of the byte into the output buffer
+static void fileOutputWriteHex(uint8_t in_value)
 {
-	if (l_output_file != NULL)
+	l_buffer[l_buffer_pos++] = l_hex_table[in_value][0];
+	l_buffer[l_buffer_pos++] = l_hex_table[in_value][1];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes the buffer into the file when the next line might not fit into it (or always when in_all is true)
+static void fileOutputFlush(bool in_all)
+{
+	if (l_buffer_pos > 0 && (in_all || l_buffer_pos > OUTPUT_BUFFER_LENGTH - MAX_LINE_LENGTH))
 	{
-		fclose(l_output_file);
-		l_output_file = NULL;
+		fwrite(l_buffer, 1, l_buffer_pos, l_output_file);
+		l_buffer_pos = 0;
 	}
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Creates the '.inc' file of the incbin format (length symbol, label and incbin directive of the binary file)
+static bool fileOutputWriteIncludeFile(void)
+{
+	char include_filename[MAX_PATH_LENGTH + 4];
+	const char* binary_filename;
+	FILE* include_file;
+
+	fileOutputGetIncludeFilename(include_filename, l_filename);
+
+	// the binary file is in the same folder as the include file
+	binary_filename = l_filename;
+	if (strrchr(binary_filename, '\\') != NULL)
+		binary_filename = strrchr(binary_filename, '\\') + 1;
+	if (strrchr(binary_filename, '/') != NULL)
+		binary_filename = strrchr(binary_filename, '/') + 1;
+
+	include_file = fopen(include_filename, "wt");
+	if (include_file == NULL)
+		return false;
+
+	fprintf(include_file, "; Generated by VGM2PSG\n");
+	fprintf(include_file, "%s_length equ %d\n\n", l_symbol_name, l_file_length);
+	fprintf(include_file, "%s:\n", l_symbol_name);
+	fprintf(include_file, "        incbin \"%s\"\n", binary_filename);
+
+	fclose(include_file);
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets the name of the '.inc' file of the incbin format (same name with '.inc' extension)
+static void fileOutputGetIncludeFilename(char* out_include_filename, const char* in_filename)
+{
+	char* extension;
+
+	snprintf(out_include_filename, MAX_PATH_LENGTH, "%s", in_filename);
+	extension = strrchr(out_include_filename, '.');
+	if (extension != NULL && strpbrk(extension, "\\/") == NULL)
+		*extension = '\0';
+	strcat(out_include_filename, ".inc");
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Creates the symbol name of the C header and the incbin formats from the file name (without folder and extension)
+static void fileOutputGetSymbolName(char* in_filename)
+{
+	const char* name = in_filename;
+	int length = 0;
+
+	if (strrchr(name, '\\') != NULL)
+		name = strrchr(name, '\\') + 1;
+	if (strrchr(name, '/') != NULL)
+		name = strrchr(name, '/') + 1;
+
+	// symbols can't start with a digit
+	if (isdigit((unsigned char)*name))
+		l_symbol_name[length++] = '_';
+
+	while (*name != '\0' && *name != '.' && length < MAX_SYMBOL_LENGTH - 1)
+	{
+		l_symbol_name[length++] = isalnum((unsigned char)*name) ? *name : '_';
+		name++;
+	}
+
+	if (length == 0)
+		l_symbol_name[length++] = '_';
+
+	l_symbol_name[length] = '\0';
+}
@@ -14,6 +14,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <filePSG.h>
+#include <sysStatistics.h>
 #include <Main.h>
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -33,7 +34,16 @@
 //% 0000 0001 - loop begin marker[value 0x01](optional, songs with no loop won't have this)
 //
 //	% 0000 0nnn - RESERVED for future expansions[values 0x02 - 0x07]
-//	* PLANNED: GameGear stereo - the following byte sets the stereo configuration
+//	* clock tag [value 0x06] (optional, only at the beginning of the file) - the following byte gives the clock
+//	frequency of the tone values (0 - 3.579545MHz, 1 - 3.125MHz TVC Game Card). Substring offsets include the tag.
+//	* macro [value 0x07] (optional, extended format) - at the beginning of the file (after the clock tag) it is the
+//	macro dictionary: followed by the number of macros and the macros (type/length byte %tlll llll: t=1 tone, t=0
+//	attenuation, l=1..127 frames, followed by l step bytes: attenuation values or signed tone offsets). In the music
+//	data it starts a macro: followed by %1cci iiii (channel c, macro index i), tone macros are followed by the base
+//	tone value (%0100 llll low bits, %01hh hhhh high bits). The macro writes one step into the register of the
+//	channel at the end of every frame (including the wait frames) from the frame of the command.
+//	* GameGear stereo [value 0x02] (optional, extended format) - followed by %0100 rrrr and %0100 llll, the channels
+//	(bit 0..3 - channel 0..3) which are enabled on the right and on the left side. It is at the beginning of the frame.
 //	* PLANNED : event callback - the following byte will be passed to the callback function
 //	* PLANNED : longer waits(8 - 255) - the following byte gives the additional frames
 //	* PLANNED : compression for longer substrings(52 - 255) - followed by a byte that gives the length
@@ -51,7 +61,11 @@
 ///////////////////////////////////////////////////////////////////////////////
 // Defines
 #define IS_ATTENUATION_REGISTER(x) (((x) & 1) != 0)
-#define IS_NOISE_CONTROL_REGISTER(x) ((x) == 6)
+#define IS_NOISE_CONTROL_REGISTER(x) ((x) == PSG_NOISE_CONTROL_REGISTER)
+#define PSG_TONE2_REGISTER 4
+#define PSG_NOISE_CONTROL_REGISTER 6
+#define PSG_NOISE_ATTENUATION_REGISTER 7
+#define PSG_NOISE_TONE2_FREQUENCY 3			// noise shift rate uses the channel 2 tone frequency
 
 #define PSG_WRITE_LATCH(r, d) (0x80 + ((r) << 4) + (d))
 #define PSG_WRITE_DATA(d) (0x40 + ((d) & 0x3f))
@@ -61,19 +75,17 @@
 #define PSG_READ_WAIT_COUNT(x) ((x)&0x07)
 #define PSG_MAX_WAIT_COUNT 7
 #define PSG_LOOP_START 0x01
+#define PSG_CLOCK_TAG 0x06
 
-#define PSG_SUBSTRING									0x08
-#define PSG_SUBSTRING_MIN_LEN         4
-#define PSG_SUBSTRING_MAX_LEN         51        // 47+4
-
-#define PSG_CBS_UNUSED			0
-#define PSG_CBS_REFERENCED	1
-#define PSG_CBS_SUBSTRING		2
-#define PSG_CBS_OFFSET			3
+#define PSG_SILENT_ATTENUATION 15
+#define PSG_QUIET_ATTENUATION 12				// attenuation values of 12..15 (-24..-30dB, off) are treated as silent by the frame smoothing
 
 ///////////////////////////////////////////////////////////////////////////////
 // Local functions
-
+static int filePSGGetWriteLength(emuSN76489State* in_SN76489_state, int in_register_index, uint16_t* in_written_registers);
+static bool filePSGIsLowPriorityWrite(emuSN76489State* in_SN76489_state, int in_register_index);
+static bool filePSGIsInaudibleWrite(emuSN76489State* in_SN76489_state, int in_register_index);
+static void filePSGWriteRegister(emuSN76489State* in_SN76489_state, int in_register_index);
 
 ///////////////////////////////////////////////////////////////////////////////
 // Module variables
@@ -83,8 +95,29 @@ static int l_psg_buffer_pos = 0;
 static int l_frame_count = 0;
 static bool l_prev_behind_loop_start = false;
 static int l_last_register_index = -1;
+static int l_clock_tag = PSG_CLOCK_TAG_NONE;
+
+// Game Gear stereo register
+static bool l_stereo = false;
+static uint8_t l_written_stereo;
+
+// register values written into the PSG file (differs from the chip state when a write is deferred)
+static uint16_t l_written_registers[emuSN76489_REGISTER_COUNT];
+
+// frame smoothing
+static int l_smooth_max_frame_bytes = 0;		// 0 - no smoothing
+static bool l_deferred_registers[emuSN76489_REGISTER_COUNT];
+static int l_original_peak_frame_bytes = 0;
+static int l_peak_frame_bytes = 0;
+static uint32_t l_deferred_write_count = 0;
+static uint32_t l_original_heavy_frame_count = 0;
+static uint32_t l_heavy_frame_count = 0;
+
+// inaudible write elimination
+static bool l_write_optimization = false;
+static uint32_t l_dropped_tone_write_count = 0;
+static uint32_t l_dropped_noise_write_count = 0;
 
-static uint8_t l_compression_buffer_state[FILE_BUFFER_LENGTH];
 ///////////////////////////////////////////////////////////////////////////////
 // Creates empty PSG file in memory buffer
 void filePSGStart(uint8_t* in_psg_buffer, int in_psg_buffer_length)
@@ -94,6 +127,68 @@ void filePSGStart(uint8_t* in_psg_buffer, int in_psg_buffer_length)
 	l_psg_buffer_pos = 0;
 	l_prev_behind_loop_start = false;
 	l_last_register_index = -1;
+
+	// clock tag of the tone values
+	if (l_clock_tag != PSG_CLOCK_TAG_NONE)
+	{
+		l_psg_buffer[l_psg_buffer_pos++] = PSG_CLOCK_TAG;
+		l_psg_buffer[l_psg_buffer_pos++] = (uint8_t)l_clock_tag;
+	}
+
+	memset(l_written_registers, 0, sizeof(l_written_registers));
+	l_written_stereo = emuSN76489_STEREO_DEFAULT;
+	memset(l_deferred_registers, 0, sizeof(l_deferred_registers));
+	l_original_peak_frame_bytes = 0;
+	l_peak_frame_bytes = 0;
+	l_deferred_write_count = 0;
+	l_original_heavy_frame_count = 0;
+	l_heavy_frame_count = 0;
+	l_dropped_tone_write_count = 0;
+	l_dropped_noise_write_count = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sets the clock tag written at the beginning of the PSG file (PSG_CLOCK_TAG_NONE - no tag)
+void filePSGSetClockTag(int in_clock_tag)
+{
+	l_clock_tag = in_clock_tag;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sets the maximum number of register write bytes per frame for the frame smoothing (0 - no smoothing)
+void filePSGSetFrameSmoothing(int in_max_frame_bytes)
+{
+	l_smooth_max_frame_bytes = in_max_frame_bytes;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Prints the peak register write bytes per frame and the number of frames above the limit without and with the smoothing
+void filePSGPrintFrameSmoothingResult(void)
+{
+	printf("Frame smoothing: %u register writes deferred\n", l_deferred_write_count);
+	printf("  Peak bytes per frame:         %d -> %d\n", l_original_peak_frame_bytes, l_peak_frame_bytes);
+	printf("  Frames above %2d bytes:        %u -> %u\n", l_smooth_max_frame_bytes, l_original_heavy_frame_count, l_heavy_frame_count);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Enables dropping the register writes which can not be heard (tone and noise changes of the muted channels)
+void filePSGSetWriteOptimization(bool in_enable)
+{
+	l_write_optimization = in_enable;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Prints the number of the dropped register writes
+void filePSGPrintWriteOptimizationResult(void)
+{
+	printf("Write optimization: %u tone and %u noise register writes dropped\n", l_dropped_tone_write_count, l_dropped_noise_write_count);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Enables writing the changes of the Game Gear stereo register
+void filePSGSetStereo(bool in_enable)
+{
+	l_stereo = in_enable;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -101,64 +196,89 @@ void filePSGStart(uint8_t* in_psg_buffer, int in_psg_buffer_length)
 void filePSGUpdate(emuSN76489State* in_SN76489_state, bool in_behind_loop_start)
 {
 	int register_index;
-	bool register_changed = false;
-
-	// write register values
+	int write_length[emuSN76489_REGISTER_COUNT];
+	int original_write_length;
+	int original_frame_bytes = 0;
+	int frame_bytes = 0;
+	int frame_start_pos = l_psg_buffer_pos;
+	bool loop_start = in_behind_loop_start && !l_prev_behind_loop_start;
+
+	// collect changed registers
 	for (register_index = 0; register_index < emuSN76489_REGISTER_COUNT; register_index++)
 	{
-		// if register is an attenuation register
-		if (IS_ATTENUATION_REGISTER(register_index))
+		write_length[register_index] = filePSGGetWriteLength(in_SN76489_state, register_index, l_written_registers);
+		original_write_length = filePSGGetWriteLength(in_SN76489_state, register_index, in_SN76489_state->PrevRegisters);
+
+		// drop inaudible writes, they are written later when the channel becomes audible
+		if (l_write_optimization && write_length[register_index] > 0 && filePSGIsInaudibleWrite(in_SN76489_state, register_index))
 		{
-			// and it has been changed
-			if (in_SN76489_state->Registers[register_index] != in_SN76489_state->PrevRegisters[register_index])
+			write_length[register_index] = 0;
+
+			if (original_write_length > 0)
 			{
-				// write attenuation register write command
-				l_psg_buffer[l_psg_buffer_pos++] = PSG_WRITE_LATCH(register_index, in_SN76489_state->Registers[register_index] & 0x0f);
-				
-				l_last_register_index = register_index;
-				register_changed = true;
+				if (IS_NOISE_CONTROL_REGISTER(register_index))
+					l_dropped_noise_write_count++;
+				else
+					l_dropped_tone_write_count++;
 			}
 		}
-		else
+
+		frame_bytes += write_length[register_index];
+		original_frame_bytes += original_write_length;
+	}
+
+	if (original_frame_bytes > l_original_peak_frame_bytes)
+		l_original_peak_frame_bytes = original_frame_bytes;
+
+	if (l_smooth_max_frame_bytes > 0 && original_frame_bytes > l_smooth_max_frame_bytes)
+		l_original_heavy_frame_count++;
+
+	// frame smoothing: defers the low priority writes of the heavy frames by one frame
+	// (a write is deferred only once and never behind the loop start)
+	for (register_index = emuSN76489_REGISTER_COUNT - 1; register_index >= 0; register_index--)
+	{
+		if (l_deferred_registers[register_index])
 		{
-			// if register is the noise control register
-			if (IS_NOISE_CONTROL_REGISTER(register_index))
-			{
-				if (in_SN76489_state->NoiseRegisterChanged)
-				{
-					// write noise control register write command
-					l_psg_buffer[l_psg_buffer_pos++] = PSG_WRITE_LATCH(register_index, in_SN76489_state->Registers[register_index] & 0x07);
-					l_last_register_index = register_index;
-					register_changed = true;
-				}
-			}
-			else
-			{
-				// tone registers
-				if (in_SN76489_state->Registers[register_index] != in_SN76489_state->PrevRegisters[register_index])
-				{
-					// tone register low bits
-					//if (((in_SN76489_state->Registers[register_index] & 0xf) != (in_SN76489_state->PrevRegisters[register_index] & 0xf)) || l_last_register_index != register_index)
-					{
-						// write tone register write command
-						l_psg_buffer[l_psg_buffer_pos++] = PSG_WRITE_LATCH(register_index, in_SN76489_state->Registers[register_index] & 0x0f);
-						l_last_register_index = register_index;
-						register_changed = true;
-					}
-
-					// tone registers high bits
-					if ((in_SN76489_state->Registers[register_index] & 0x3f0) != (in_SN76489_state->PrevRegisters[register_index] & 0x3f0))
-					{
-						l_psg_buffer[l_psg_buffer_pos++] = PSG_WRITE_DATA((in_SN76489_state->Registers[register_index] >> 4) & 0x3f);
-						register_changed = true;
-					}
-				}
-			}
+			l_deferred_registers[register_index] = false;
+			continue;
+		}
+
+		if (l_smooth_max_frame_bytes > 0 && frame_bytes > l_smooth_max_frame_bytes && !loop_start &&
+			write_length[register_index] > 0 && filePSGIsLowPriorityWrite(in_SN76489_state, register_index))
+		{
+			frame_bytes -= write_length[register_index];
+			write_length[register_index] = 0;
+			l_deferred_registers[register_index] = true;
+			l_deferred_write_count++;
 		}
 	}
 
+	if (frame_bytes > l_peak_frame_bytes)
+		l_peak_frame_bytes = frame_bytes;
+
+	if (l_smooth_max_frame_bytes > 0 && frame_bytes > l_smooth_max_frame_bytes)
+		l_heavy_frame_count++;
+
+	// stereo change at the beginning of the frame
+	if (l_stereo && in_SN76489_state->Stereo != l_written_stereo)
+	{
+		l_psg_buffer[l_psg_buffer_pos++] = PSG_STEREO;
+		l_psg_buffer[l_psg_buffer_pos++] = PSG_STEREO_PARAMETER(in_SN76489_state->Stereo);
+		l_psg_buffer[l_psg_buffer_pos++] = PSG_STEREO_PARAMETER(in_SN76489_state->Stereo >> 4);
+		l_written_stereo = in_SN76489_state->Stereo;
+	}
+
+	// write register values
+	for (register_index = 0; register_index < emuSN76489_REGISTER_COUNT; register_index++)
+	{
+		if (write_length[register_index] > 0)
+			filePSGWriteRegister(in_SN76489_state, register_index);
+	}
+
+	sysStatisticsAddFrame(l_psg_buffer_pos - frame_start_pos);
+
 	// close frame
-	if (register_changed)
+	if (l_psg_buffer_pos > frame_start_pos)
 	{
 		l_psg_buffer[l_psg_buffer_pos++] = PSG_WRITE_END_OF_FRAME(0);
 	}
@@ -167,7 +287,7 @@ void filePSGUpdate(emuSN76489State* in_SN76489_state, bool in_behind_loop_start)
 		int wait_count;
 
 		// empty frame, try to update the previous frame end with wait count
-		if (PSG_IS_END_OF_FRAME(l_psg_buffer[l_psg_buffer_pos - 1]))
+		if (l_psg_buffer_pos > 0 && PSG_IS_END_OF_FRAME(l_psg_buffer[l_psg_buffer_pos - 1]))
 		{
 			// increase wait count
 			wait_count = PSG_READ_WAIT_COUNT(l_psg_buffer[l_psg_buffer_pos - 1]);
@@ -188,7 +308,7 @@ void filePSGUpdate(emuSN76489State* in_SN76489_state, bool in_behind_loop_start)
 		}
 	}
 
-	if (in_behind_loop_start && !l_prev_behind_loop_start)
+	if (loop_start)
 	{
 		l_psg_buffer[l_psg_buffer_pos++] = PSG_LOOP_START;
 	}
@@ -200,8 +320,25 @@ void filePSGUpdate(emuSN76489State* in_SN76489_state, bool in_behind_loop_start)
 
 ///////////////////////////////////////////////////////////////////////////////
 // Closes PSG memory file
-void filePSGFinish(void)
+void filePSGFinish(emuSN76489State* in_SN76489_state)
 {
+	int register_index;
+	uint8_t end_of_frame;
+
+	// the writes deferred from the last frame are written back into the last frame
+	if (l_psg_buffer_pos > 0 && PSG_IS_END_OF_FRAME(l_psg_buffer[l_psg_buffer_pos - 1]))
+	{
+		end_of_frame = l_psg_buffer[--l_psg_buffer_pos];
+
+		for (register_index = 0; register_index < emuSN76489_REGISTER_COUNT; register_index++)
+		{
+			if (l_deferred_registers[register_index])
+				filePSGWriteRegister(in_SN76489_state, register_index);
+		}
+
+		l_psg_buffer[l_psg_buffer_pos++] = end_of_frame;
+	}
+
 	l_psg_buffer[l_psg_buffer_pos++] = PSG_END_OF_DATA;
 }
 
@@ -213,117 +350,133 @@ int filePSGGetLength(void)
 	return l_psg_buffer_pos;
 }
 
-
-#if 0
-int filePSGCompress1(uint8_t* in_buffer, int in_buffer_length)
+///////////////////////////////////////////////////////////////////////////////
+// Gets the length of the file header (clock tag and macro dictionary) which must be kept unchanged by the compression
+int filePSGGetHeaderLength(uint8_t* in_buffer, int in_buffer_length)
 {
-	int current_start_index;
-	int current_index;
-	int substring_index;
-	int substring_start_index;
-	int substring_length;
-	int copy_from;
-	int copy_to;
-	int copy_count;
-	int expected_substring_length;
-	int offset;
-
-	// no compression for short files
-	if (in_buffer_length < PSG_SUBSTRING_MIN_LEN)
-		return;
-
-	// mark status as unused
-	for (current_index = 0; current_index < in_buffer_length; current_index++)
-		l_compression_buffer_state[current_index] = PSG_CBS_UNUSED;
-
-	// start compression
-	for (expected_substring_length = PSG_SUBSTRING_MAX_LEN; expected_substring_length >= PSG_SUBSTRING_MIN_LEN; expected_substring_length--)
+	int pos = 0;
+	int macro_count;
+
+	if (pos + 1 < in_buffer_length && in_buffer[pos] == PSG_CLOCK_TAG)
+		pos += 2;
+
+	if (pos + 1 < in_buffer_length && in_buffer[pos] == PSG_MACRO)
 	{
-		printf(".");
+		macro_count = in_buffer[pos + 1];
+		pos += 2;
 
-		for (current_start_index = expected_substring_length; current_start_index < in_buffer_length - expected_substring_length; current_start_index++)
+		while (macro_count > 0 && pos < in_buffer_length)
 		{
-			if (l_compression_buffer_state[current_start_index] != PSG_CBS_UNUSED)
-				continue;
+			pos += 1 + (in_buffer[pos] & PSG_MACRO_LENGTH_MASK);
+			macro_count--;
+		}
+	}
 
-			// find substring
-			substring_start_index = 0;
-			while (substring_start_index < current_start_index)
-			{
-				if (l_compression_buffer_state[substring_start_index] > PSG_CBS_REFERENCED)
-				{
-					substring_start_index++;
-					continue;
-				}
-
-				substring_index = substring_start_index;
-				current_index = current_start_index;
-				while (in_buffer[substring_index] == in_buffer[current_index] &&
-					(current_index - current_start_index) < expected_substring_length &&
-					l_compression_buffer_state[substring_index] < PSG_CBS_SUBSTRING &&
-					l_compression_buffer_state[current_index] == PSG_CBS_UNUSED)
-				{
-					substring_index++;
-					current_index++;
-				}
-
-				substring_length = current_index - current_start_index;
-
-				if (substring_length == expected_substring_length)
-				{
-					// mark referenced bytes
-					for (current_index = substring_start_index; current_index < substring_start_index + substring_length; current_index++)
-						l_compression_buffer_state[current_index] = PSG_CBS_REFERENCED;
-
-					in_buffer[current_start_index] = (substring_length - PSG_SUBSTRING_MIN_LEN) + PSG_SUBSTRING;
-					in_buffer[current_start_index + 1] = (substring_start_index & 0xFF);
-					in_buffer[current_start_index + 2] = (substring_start_index >> 8);
-
-					l_compression_buffer_state[current_start_index] = PSG_CBS_SUBSTRING;
-					l_compression_buffer_state[current_start_index + 1] = PSG_CBS_OFFSET;
-					l_compression_buffer_state[current_start_index + 2] = PSG_CBS_OFFSET;
-
-					// compact remaining bytes
-					copy_from = current_start_index + substring_length;
-					copy_to = current_start_index + 3;
-					copy_count = in_buffer_length - copy_from;
-					while (copy_count > 0)
-					{
-						in_buffer[copy_to] = in_buffer[copy_from];
-						l_compression_buffer_state[copy_to] = l_compression_buffer_state[copy_from];
-						copy_from++;
-						copy_to++;
-						copy_count--;
-					}
-
-					// update offsets
-					for (current_index = current_start_index + 3; current_index < in_buffer_length; current_index++)
-					{
-						if (l_compression_buffer_state[current_index] == PSG_CBS_SUBSTRING)
-						{
-							offset = in_buffer[current_index + 1] + (in_buffer[current_index + 2] << 8);
-
-							if (offset > current_start_index)
-							{
-								offset -= substring_length - 3;
-								in_buffer[current_index + 1] = offset & 0xff;
-								in_buffer[current_index + 2] = offset >> 8;
-							}
-
-						}
-					}
-
-					in_buffer_length -= substring_length - 3;
-					current_start_index += 2;
-
-					break;
-				}
-
-				substring_start_index++;
-			}
+	return (pos < in_buffer_length) ? pos : in_buffer_length;
+}
+
+
+/*****************************************************************************/
+/* Local functions                                                           */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets the number of bytes needed to update the register from the reference register values
+static int filePSGGetWriteLength(emuSN76489State* in_SN76489_state, int in_register_index, uint16_t* in_written_registers)
+{
+	// noise control register is written on every change (it resets the noise generator) and when it differs from the written value
+	if (IS_NOISE_CONTROL_REGISTER(in_register_index))
+		return (in_SN76489_state->NoiseRegisterChanged || in_SN76489_state->Registers[in_register_index] != in_written_registers[in_register_index]) ? 1 : 0;
+
+	if (in_SN76489_state->Registers[in_register_index] == in_written_registers[in_register_index])
+		return 0;
+
+	// attenuation register
+	if (IS_ATTENUATION_REGISTER(in_register_index))
+		return 1;
+
+	// tone register latch and the high bits if they are changed
+	if ((in_SN76489_state->Registers[in_register_index] & 0x3f0) != (in_written_registers[in_register_index] & 0x3f0))
+		return 2;
+
+	return 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns true if the register write can be deferred by the frame smoothing:
+// tone changes of the muted channels, tone changes of the low bits only and
+// attenuation changes between silent levels
+static bool filePSGIsLowPriorityWrite(emuSN76489State* in_SN76489_state, int in_register_index)
+{
+	int attenuation_index;
+
+	if (IS_NOISE_CONTROL_REGISTER(in_register_index))
+		return false;
+
+	if (IS_ATTENUATION_REGISTER(in_register_index))
+		return in_SN76489_state->Registers[in_register_index] >= PSG_QUIET_ATTENUATION && l_written_registers[in_register_index] >= PSG_QUIET_ATTENUATION;
+
+	// the channel is muted at the end of the frame
+	attenuation_index = in_register_index + 1;
+	if (in_SN76489_state->Registers[attenuation_index] == PSG_SILENT_ATTENUATION)
+		return true;
+
+	return (in_SN76489_state->Registers[in_register_index] & 0x3f0) == (l_written_registers[in_register_index] & 0x3f0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns true if the register write can not be heard: tone or noise control change
+// of a muted channel (channel 2 tone is audible through the noise channel when the
+// noise uses its frequency)
+static bool filePSGIsInaudibleWrite(emuSN76489State* in_SN76489_state, int in_register_index)
+{
+	uint16_t* registers = in_SN76489_state->Registers;
+
+	if (IS_ATTENUATION_REGISTER(in_register_index))
+		return false;
+
+	if (IS_NOISE_CONTROL_REGISTER(in_register_index))
+		return registers[PSG_NOISE_ATTENUATION_REGISTER] == PSG_SILENT_ATTENUATION;
+
+	if (registers[in_register_index + 1] != PSG_SILENT_ATTENUATION)
+		return false;
+
+	if (in_register_index == PSG_TONE2_REGISTER && (registers[PSG_NOISE_CONTROL_REGISTER] & 0x03) == PSG_NOISE_TONE2_FREQUENCY &&
+		registers[PSG_NOISE_ATTENUATION_REGISTER] != PSG_SILENT_ATTENUATION)
+		return false;
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes register update command(s) into the PSG file
+static void filePSGWriteRegister(emuSN76489State* in_SN76489_state, int in_register_index)
+{
+	uint16_t value = in_SN76489_state->Registers[in_register_index];
+
+	if (IS_ATTENUATION_REGISTER(in_register_index))
+	{
+		// attenuation register write command
+		l_psg_buffer[l_psg_buffer_pos++] = PSG_WRITE_LATCH(in_register_index, value & 0x0f);
+	}
+	else
+	{
+		if (IS_NOISE_CONTROL_REGISTER(in_register_index))
+		{
+			// noise control register write command
+			l_psg_buffer[l_psg_buffer_pos++] = PSG_WRITE_LATCH(in_register_index, value & 0x07);
+		}
+		else
+		{
+			// tone register low bits
+			l_psg_buffer[l_psg_buffer_pos++] = PSG_WRITE_LATCH(in_register_index, value & 0x0f);
+
+			// tone registers high bits
+			if ((value & 0x3f0) != (l_written_registers[in_register_index] & 0x3f0))
+				l_psg_buffer[l_psg_buffer_pos++] = PSG_WRITE_DATA((value >> 4) & 0x3f);
 		}
 	}
 
-	return in_buffer_length;
+	l_written_registers[in_register_index] = value;
+	l_last_register_index = in_register_index;
 }
-#endif
\ No newline at end of file
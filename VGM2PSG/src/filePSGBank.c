@@ -0,0 +1,269 @@
+/*****************************************************************************/
+/* VGM2PSG multi-song PSG bank                                               */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Include files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <Main.h>
+#include <filePSG.h>
+#include <filePSGBank.h>
+#include <filePSGCompress.h>
+#include <sysStatistics.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Bank structure
+///////////////////////////////////////////////////////////////////////////////
+// The bank starts with the song table: the number of songs (one byte) and the
+// little-endian offsets of the songs from the beginning of the bank. The songs
+// follow the table in the order they were added, every song is a complete PSG
+// file (clock tag, macro dictionary, music data and end of data mark).
+//
+// The substring offsets are relative to the beginning of the bank, not to the
+// beginning of the song. Every song is compressed with the bank content before it
+// as a dictionary, so the patterns shared by the songs (instruments, drums) are
+// stored only once. The references of the earlier songs and the song table can't
+// be used as substring sources (the substrings can't be nested). When the song
+// is shorter compressed alone (the single pass matchers can lose sources of the
+// song by matching into the dictionary), the separately compressed song is stored.
+// It is compressed at its position in the bank (with a dictionary without usable
+// sources), so its offsets and the memory constraints are already correct.
+//
+// The loop marker of the song is locked: a reference could copy it from an other
+// song, and the player would restart the loop in the bytes of that song.
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+#define PSG_SUBSTRING_FIRST 0x08
+#define PSG_SUBSTRING_LAST 0x37
+#define PSG_REFERENCE_LENGTH 3
+#define PSG_LOOP 0x01
+
+///////////////////////////////////////////////////////////////////////////////
+// Types
+
+// Song of the bank
+typedef struct
+{
+	char* Name;
+	int Offset;								// offset of the song from the beginning of the bank
+	int UncompressedLength;
+	int StandaloneLength;			// compressed length without the other songs
+	int BankLength;						// compressed length in the bank
+} PSGBankSong;
+
+///////////////////////////////////////////////////////////////////////////////
+// Local functions
+static void filePSGBankMarkSources(int in_song_offset, int in_song_length);
+static void filePSGBankLockLoopMarker(uint8_t* out_locks, int in_song_offset, int in_song_length);
+
+///////////////////////////////////////////////////////////////////////////////
+// Module global variables
+static uint8_t l_bank_buffer[FILE_BUFFER_LENGTH];
+static bool l_bank_source[FILE_BUFFER_LENGTH];
+static uint8_t l_standalone_buffer[FILE_BUFFER_LENGTH];
+static bool l_no_source[FILE_BUFFER_LENGTH];
+static int l_bank_length = 0;
+static bool l_compression = true;
+
+static PSGBankSong l_songs[PSG_BANK_MAX_SONG_COUNT];
+static int l_song_count = 0;
+static int l_table_song_count = 0;
+
+///////////////////////////////////////////////////////////////////////////////
+// Starts a new bank, reserves the song table for the given number of songs
+void filePSGBankStart(int in_song_count, bool in_compression)
+{
+	l_table_song_count = in_song_count;
+	l_song_count = 0;
+	l_compression = in_compression;
+
+	l_bank_length = PSG_BANK_TABLE_LENGTH(in_song_count);
+	memset(l_bank_buffer, 0, l_bank_length);
+	memset(l_bank_source, false, l_bank_length);
+
+	l_bank_buffer[0] = (uint8_t)in_song_count;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Compresses the PSG file (non compressed, created by the encoder) and appends it to the bank
+// Returns false (the error is printed) if the song table is full, the song doesn't fit into the work buffer, the bank is larger than 64kbytes
+// or there is not enough memory for the compression
+bool filePSGBankAddSong(char* in_name, uint8_t* in_psg_buffer, int in_psg_length)
+{
+	PSGBankSong* song;
+	StatStatistics statistics;
+	StatStatistics standalone_statistics;
+	uint8_t* locks;
+	int length;
+
+	if (l_song_count >= l_table_song_count)
+	{
+		printf("\nERROR: The song table of the bank is full (%d songs).\n", l_table_song_count);
+		return false;
+	}
+
+	if (l_bank_length + in_psg_length > FILE_BUFFER_LENGTH)
+	{
+		printf("\nERROR: The bank with the non compressed song is larger than %d bytes.\n", FILE_BUFFER_LENGTH);
+		return false;
+	}
+
+	song = &l_songs[l_song_count];
+	song->Name = in_name;
+	song->Offset = l_bank_length;
+	song->UncompressedLength = in_psg_length;
+	song->StandaloneLength = in_psg_length;
+
+	memcpy(&l_bank_buffer[l_bank_length], in_psg_buffer, in_psg_length);
+	length = l_bank_length + in_psg_length;
+
+	if (l_compression)
+	{
+		locks = (uint8_t*)calloc(length, sizeof(uint8_t));
+		if (locks == NULL)
+		{
+			printf("\nERROR: Not enough memory for the compression of %d bytes.\n", length);
+			return false;
+		}
+
+		filePSGBankLockLoopMarker(locks, l_bank_length, in_psg_length);
+
+		// compress the song alone at its position in the bank, none of the bytes before the song is used as a source (the statistics contain only the stored result)
+		statistics = g_statistics;
+		memcpy(l_standalone_buffer, l_bank_buffer, length);
+		song->StandaloneLength = filePSGCompressWithDictionary(l_standalone_buffer, length, l_bank_length, l_no_source, locks) - l_bank_length;
+		standalone_statistics = g_statistics;
+		g_statistics = statistics;
+		if (song->StandaloneLength < 0)
+		{
+			free(locks);
+			return false;
+		}
+
+		// compress the song using the bank content as a dictionary
+		length = filePSGCompressWithDictionary(l_bank_buffer, length, l_bank_length, l_bank_source, locks);
+		free(locks);
+		if (length < 0)
+			return false;
+
+		// keep the shorter result
+		if (length - l_bank_length > song->StandaloneLength)
+		{
+			memcpy(&l_bank_buffer[l_bank_length], &l_standalone_buffer[l_bank_length], song->StandaloneLength);
+			length = l_bank_length + song->StandaloneLength;
+			g_statistics = standalone_statistics;
+		}
+	}
+
+	song->BankLength = length - l_bank_length;
+
+	if (length > PSG_BANK_MAX_LENGTH)
+	{
+		printf("\nERROR: The bank is larger than %d bytes.\n", PSG_BANK_MAX_LENGTH);
+		return false;
+	}
+
+	// song table entry
+	l_bank_buffer[PSG_BANK_TABLE_LENGTH(l_song_count)] = (uint8_t)(song->Offset & 0xff);
+	l_bank_buffer[PSG_BANK_TABLE_LENGTH(l_song_count) + 1] = (uint8_t)(song->Offset >> 8);
+
+	filePSGBankMarkSources(l_bank_length, song->BankLength);
+
+	l_bank_length = length;
+	l_song_count++;
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets the bank content
+uint8_t* filePSGBankGetBuffer(void)
+{
+	return l_bank_buffer;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets the length of the bank in bytes
+int filePSGBankGetLength(void)
+{
+	return l_bank_length;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Prints the size of the songs and the bytes saved by the shared dictionary
+void filePSGBankPrintResult(void)
+{
+	PSGBankSong* song;
+	int uncompressed_length = 0;
+	int standalone_length = 0;
+	int i;
+
+	printf("Song  Offset  Uncompressed  Standalone  In bank   Saved  File\n");
+	for (i = 0; i < l_song_count; i++)
+	{
+		song = &l_songs[i];
+
+		printf("%4d  %6d  %12d  %10d  %7d  %6d  %s\n", i, song->Offset, song->UncompressedLength, song->StandaloneLength, song->BankLength,
+			song->StandaloneLength - song->BankLength, song->Name);
+
+		uncompressed_length += song->UncompressedLength;
+		standalone_length += song->StandaloneLength;
+	}
+
+	printf("Bank: %d songs, %d bytes (song table: %d bytes, non compressed songs: %d bytes)\n", l_song_count, l_bank_length, PSG_BANK_TABLE_LENGTH(l_song_count), uncompressed_length);
+	printf("Saved by the shared dictionary: %d bytes (%.1f%% of the separately compressed songs: %d bytes)\n", standalone_length + PSG_BANK_TABLE_LENGTH(l_song_count) - l_bank_length,
+		(standalone_length > 0) ? (standalone_length + PSG_BANK_TABLE_LENGTH(l_song_count) - l_bank_length) * 100.0 / standalone_length : 0.0, standalone_length);
+}
+
+/*****************************************************************************/
+/* Local functions                                                           */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Marks the bytes of the compressed song which can be used as a substring source by the next songs
+// (the header and the literal bytes of the music data, but not the substring references)
+static void filePSGBankMarkSources(int in_song_offset, int in_song_length)
+{
+	int header_length = filePSGGetHeaderLength(&l_bank_buffer[in_song_offset], in_song_length);
+	int pos;
+
+	memset(&l_bank_source[in_song_offset], true, in_song_length);
+
+	pos = in_song_offset + header_length;
+	while (pos < in_song_offset + in_song_length)
+	{
+		if (l_bank_buffer[pos] >= PSG_SUBSTRING_FIRST && l_bank_buffer[pos] <= PSG_SUBSTRING_LAST)
+		{
+			memset(&l_bank_source[pos], false, PSG_REFERENCE_LENGTH);
+			pos += PSG_REFERENCE_LENGTH;
+		}
+		else
+		{
+			pos++;
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Locks the loop marker of the non compressed song (it is the only loop marker byte value of the music data)
+static void filePSGBankLockLoopMarker(uint8_t* out_locks, int in_song_offset, int in_song_length)
+{
+	int header_length = filePSGGetHeaderLength(&l_bank_buffer[in_song_offset], in_song_length);
+	int pos;
+
+	for (pos = in_song_offset + header_length; pos < in_song_offset + in_song_length; pos++)
+	{
+		if (l_bank_buffer[pos] == PSG_LOOP)
+			out_locks[pos] = PSG_LOCK_NO_SOURCE;
+	}
+}
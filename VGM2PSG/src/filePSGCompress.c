@@ -11,72 +11,613 @@
 ///////////////////////////////////////////////////////////////////////////////
 // Include files
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <Main.h>
 #include <filePSG.h>
 #include <filePSGCompress.h>
+#include <filePSGCost.h>
+#include <sysStatistics.h>
 
 ///////////////////////////////////////////////////////////////////////////////
-// Defines
-#define CHARACTER_COUNT 256
+// Compression levels
+///////////////////////////////////////////////////////////////////////////////
+// 1-2: single pass hash chain matcher. The data is processed from the begin to the end,
+//      every string is replaced by the longest earlier (non compressed) occurence found
+//      in the hash chain. Level 1 accepts the first match in a small window, level 2
+//      searches deeper in the whole addressable range and uses lazy matching.
+// 3-6: multi pass greedy matcher. Processes the substring lengths from the longest
+//      to the shortest, and replaces all occurence of the strings with the given length.
+//      Level 6 (default) processes all lengths, the lower levels process only every 8th,
+//      4th, 2nd length (the remaining strings are compressed by the shorter lengths).
+//      The sources are looked up in an index of the 4-byte prefixes of the earlier positions.
+// 7:   best result of the greedy matcher with all, every 2nd and every 4th length
+// 8:   best result of the greedy matcher with all length steps, using the leftmost or
+//      the nearest source of the strings, and of the exhaustive single pass matcher
+// 9:   like 8, plus the optimal parser (shortest path over all matches, followed by
+//      source validation because the substrings can't be nested)
+//
+// When the Z80 player cycle budget is set, the frames above the budget are locked
+// (their bytes can't be replaced by a reference, but can be used as a source) and
+// the data is compressed again until all frames fit into the budget or can't be
+// changed any more.
+//
+// The songs of a bank are compressed with the previous songs of the bank in front of
+// them as a dictionary. The dictionary is locked, its literal bytes can be used as
+// sources, but its references can't (the substrings can't be nested).
+//
+// The memory constraints limit the sources of the references for players which can
+// see only a part of the PSG data (paged memory): the maximum distance between the
+// reference and its source, the page size (the source must be in the same page as the
+// reference command) and the forbidden address ranges (can't contain a source). The
+// single pass and optimal matchers check the final output positions. The greedy matcher
+// moves the data while compressing, so only the distance is checked while the sources
+// are selected. The final references are validated at the end: the invalid ones get an
+// other usable source or they are replaced by the string. Levels 3-7 also try the level 2
+// single pass matcher when there are memory constraints and keep the shorter result.
+//
+// The work buffers and tables are allocated for every compression, sized to the
+// compressed buffer (only the tables of the matchers used by the level).
+///////////////////////////////////////////////////////////////////////////////
 
+///////////////////////////////////////////////////////////////////////////////
+// Defines
 #define PSG_SUBSTRING									0x08
 #define PSG_SUBSTRING_MIN_LEN         4
 #define PSG_SUBSTRING_MAX_LEN         51        // 47+4
+#define PSG_SUBSTRING_MAX_OFFSET      0xffff
+#define PSG_REFERENCE_LENGTH          3
 
 #define PSG_CBS_UNUSED			0
 #define PSG_CBS_REFERENCED	1
 #define PSG_CBS_SUBSTRING		2
 #define PSG_CBS_OFFSET			3
 
+// compression buffer state bit planes (bit 0 and bit 1 of the state of every byte, 64 bytes per word)
+#define PSG_STATE_WORD_BITS 64
+#define PSG_STATE_WORD_COUNT(length) ((length) / PSG_STATE_WORD_BITS + 2)
+#define PSG_STATE_WORD(pos) ((pos) >> 6)
+#define PSG_STATE_BIT(pos) ((pos) & (PSG_STATE_WORD_BITS - 1))
+#define PSG_STATE_MASK(count) (((count) >= PSG_STATE_WORD_BITS) ? ~(uint64_t)0 : (((uint64_t)1 << (count)) - 1))
+#define PSG_STATE_DE_BRUIJN 0x03f79d71b4cb0a89ull
+
+// state searches of filePSGStateFind
+#define PSG_STATE_FIND_USED					0		// not PSG_CBS_UNUSED
+#define PSG_STATE_FIND_COMPRESSED		1		// PSG_CBS_SUBSTRING or PSG_CBS_OFFSET
+#define PSG_STATE_FIND_SUBSTRING		2		// PSG_CBS_SUBSTRING
+
+#define PSG_HASH_BITS 16
+#define PSG_HASH_SIZE (1 << PSG_HASH_BITS)
+#define PSG_HASH(b) ((((uint32_t)(b)[0] << 24) | ((uint32_t)(b)[1] << 16) | ((uint32_t)(b)[2] << 8) | (b)[3]) * 2654435761u >> (32 - PSG_HASH_BITS))
+#define PSG_NO_POSITION -1
+
+#define PSG_OPTIMAL_CHAIN_DEPTH 1024
+
+///////////////////////////////////////////////////////////////////////////////
+// Types
+
+// Single pass matcher parameters
+typedef struct
+{
+	int Window;
+	int ChainDepth;
+	bool Lazy;
+} PSGMatcherParameters;
+
+// Greedy matcher parameters
+typedef struct
+{
+	int LengthStep;
+	bool NearestSource;
+} PSGGreedyParameters;
+
+// Address range (first and last offset of the range)
+typedef struct
+{
+	int First;
+	int Last;
+} PSGAddressRange;
+
 ///////////////////////////////////////////////////////////////////////////////
 // Local functions
-static void filePSGPrepareJumpTable(uint8_t* in_string, uint8_t in_length);
-static int filePSGSearchPattern(uint8_t* in_buffer, int in_start_index, int in_pattern_start_index, int in_pattern_length);
+static int filePSGCompressAfterDictionary(uint8_t* in_buffer, int in_buffer_length, int in_dictionary_length, const bool* in_dictionary_source, int in_header_length, const uint8_t* in_locks);
+static bool filePSGCompressAllocate(int in_buffer_length, bool in_cycle_budget);
+static void filePSGCompressFree(void);
+static int filePSGCompressBuffer(uint8_t* in_buffer, int in_buffer_length);
+static int filePSGCompressGreedy(uint8_t* in_buffer, int in_buffer_length, int in_length_step, bool in_nearest_source);
+static int filePSGGreedyNextLength(int in_length, int in_length_step);
+static int filePSGCompressSinglePass(uint8_t* in_source, uint8_t* out_buffer, int in_buffer_length, const PSGMatcherParameters* in_parameters);
+static int filePSGFindLongestMatch(uint8_t* in_source, int in_source_index, int in_source_length, uint8_t* in_buffer, int in_buffer_length, const PSGMatcherParameters* in_parameters, int* out_match_index);
+static int filePSGCompressOptimal(uint8_t* in_source, uint8_t* out_buffer, int in_buffer_length);
+static bool filePSGIsLiteralSource(int in_source_index, int in_length, int in_reference_position);
+static void filePSGKeepShorterResult(uint8_t* in_buffer, int* inout_result_length, int in_length);
+static int filePSGWriteReference(uint8_t* out_buffer, int in_pos, int in_length, int in_offset);
+static void filePSGCountMatches(uint8_t* in_buffer, int in_buffer_length);
+static bool filePSGIsValidReference(int in_reference_position, int in_source_position, int in_length);
+static int filePSGGetFirstSourcePosition(int in_reference_position);
+static int filePSGFixInvalidReferences(uint8_t* in_buffer, int in_buffer_length);
+static int filePSGFindValidSource(uint8_t* in_buffer, int in_reference_position, int in_source_position, int in_length);
+static void filePSGGreedyIndexReset(void);
+static void filePSGGreedyIndexInsert(uint8_t* in_buffer, int in_pos);
+static void filePSGGreedyIndexRemove(uint8_t* in_buffer, int in_pos);
+static int filePSGGreedyFindSource(uint8_t* in_buffer, int in_first_source, int in_string_index, int in_length, bool in_nearest_source);
+static void filePSGStateSet(int in_pos, int in_length, uint8_t in_state);
+static int filePSGStateFind(int in_pos, int in_end, int in_search);
+static void filePSGStateMove(int in_to, int in_from, int in_count);
+static uint64_t filePSGStateGetBits(const uint64_t* in_plane, int in_pos);
 
 ///////////////////////////////////////////////////////////////////////////////
 // Module global variables
-static uint8_t l_compression_buffer_state[FILE_BUFFER_LENGTH];
-static uint8_t l_jump_table[CHARACTER_COUNT];
+static uint64_t* l_compression_state_low = NULL;			// bit 0 of the compression buffer state (PSG_CBS_...)
+static uint64_t* l_compression_state_high = NULL;		// bit 1 of the compression buffer state
+static const uint8_t l_de_bruijn_bit_index[PSG_STATE_WORD_BITS] =
+{
+	0, 1, 48, 2, 57, 49, 28, 3, 61, 58, 50, 42, 38, 29, 17, 4,
+	62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12, 5,
+	63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+	46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19, 9, 13, 8, 7, 6
+};
+static bool l_show_progress = true;
+static int l_compression_level = PSG_COMPRESSION_DEFAULT_LEVEL;
+
+// memory constraints of the substring sources
+static int l_max_distance = 0;				// 0 - no limit
+static int l_page_size = 0;						// 0 - no paging
+static PSGAddressRange l_forbidden_ranges[PSG_COMPRESSION_MAX_FORBIDDEN_RANGE_COUNT];
+static int l_forbidden_range_count = 0;
+static bool l_constraints = false;
+static int l_song_start = 0;					// first byte of the music data after the dictionary and the header
+static int l_first_source = 0;				// first byte which can be used as a source
+
+// frame cycle budget handling (locked bytes can't be compressed)
+static uint8_t* l_locked = NULL;
+static uint8_t* l_uncompressed_buffer = NULL;
+
+// buffers for selecting the best result of the matchers
+static uint8_t* l_original_buffer = NULL;
+static uint8_t* l_result_buffer = NULL;
+
+// greedy matcher candidate index (positions of the 4-byte prefixes in ascending order)
+static int* l_greedy_head = NULL;
+static int* l_greedy_tail = NULL;
+static int* l_greedy_next = NULL;
+static int* l_greedy_prev = NULL;
+
+// hash chains and optimal parser tables
+static int* l_hash_head = NULL;
+static int* l_hash_prev = NULL;
+static int* l_output_position = NULL;
+static int* l_parse_cost = NULL;
+static int* l_match_source = NULL;
+static uint8_t* l_match_length = NULL;
+static uint8_t* l_parse_length = NULL;
+
+// single pass matcher parameters of level 1-2 and of the exhaustive matcher
+static const PSGMatcherParameters l_matcher_parameters[] =
+{
+	{ 4096, 1, false },
+	{ 65535, 64, true }
+};
+static const PSGMatcherParameters l_exhaustive_matcher_parameters = { 65535, 4096, true };
+
+// greedy matcher length steps of level 3-6
+static const int l_greedy_length_step[] = { 8, 4, 2, 1 };
+
+// greedy matcher variants of level 7-9 (level 7 uses the first three)
+static const PSGGreedyParameters l_greedy_variants[] =
+{
+	{ 1, false },
+	{ 2, false },
+	{ 4, false },
+	{ 8, false },
+	{ 1, true },
+	{ 2, true },
+	{ 4, true },
+	{ 8, true }
+};
+
+#define PSG_SINGLE_PASS_MAX_LEVEL 2
+#define PSG_LEVEL7_GREEDY_VARIANT_COUNT 3
+
+///////////////////////////////////////////////////////////////////////////////
+// Enables or disables printing of the progress dots
+void filePSGCompressShowProgress(bool in_show_progress)
+{
+	l_show_progress = in_show_progress;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sets compression level (1..9)
+void filePSGCompressSetLevel(int in_level)
+{
+	if (in_level < PSG_COMPRESSION_MIN_LEVEL)
+		in_level = PSG_COMPRESSION_MIN_LEVEL;
+
+	if (in_level > PSG_COMPRESSION_MAX_LEVEL)
+		in_level = PSG_COMPRESSION_MAX_LEVEL;
+
+	l_compression_level = in_level;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets compression level
+int filePSGCompressGetLevel(void)
+{
+	return l_compression_level;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sets the maximum distance between the reference and its source in bytes (0 - no limit)
+void filePSGCompressSetMaxDistance(int in_max_distance)
+{
+	l_max_distance = in_max_distance;
+	l_constraints = filePSGCompressHasConstraints();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets the maximum distance between the reference and its source (0 - no limit)
+int filePSGCompressGetMaxDistance(void)
+{
+	return l_max_distance;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sets the size of the memory pages (0 - no paging), the source must be in the page of the reference
+void filePSGCompressSetPageSize(int in_page_size)
+{
+	l_page_size = in_page_size;
+	l_constraints = filePSGCompressHasConstraints();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets the size of the memory pages (0 - no paging)
+int filePSGCompressGetPageSize(void)
+{
+	return l_page_size;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Adds an address range (offsets from the beginning of the file) which can't contain substring sources
+// The ranges are kept sorted, so the order of the additions doesn't matter.
+// Returns false if there are too many ranges
+bool filePSGCompressAddForbiddenRange(int in_first, int in_last)
+{
+	int i;
+
+	if (l_forbidden_range_count >= PSG_COMPRESSION_MAX_FORBIDDEN_RANGE_COUNT)
+		return false;
+
+	i = l_forbidden_range_count;
+	while (i > 0 && (l_forbidden_ranges[i - 1].First > in_first || (l_forbidden_ranges[i - 1].First == in_first && l_forbidden_ranges[i - 1].Last > in_last)))
+	{
+		l_forbidden_ranges[i] = l_forbidden_ranges[i - 1];
+		i--;
+	}
+
+	l_forbidden_ranges[i].First = in_first;
+	l_forbidden_ranges[i].Last = in_last;
+	l_forbidden_range_count++;
+	l_constraints = true;
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets the forbidden address range of the given index
+// Returns false if there is no range with this index
+bool filePSGCompressGetForbiddenRange(int in_index, int* out_first, int* out_last)
+{
+	if (in_index < 0 || in_index >= l_forbidden_range_count)
+		return false;
+
+	*out_first = l_forbidden_ranges[in_index].First;
+	*out_last = l_forbidden_ranges[in_index].Last;
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns true if the substring sources are limited by memory constraints
+bool filePSGCompressHasConstraints(void)
+{
+	return l_max_distance > 0 || l_page_size > 0 || l_forbidden_range_count > 0;
+}
 
 ///////////////////////////////////////////////////////////////////////////////
-// Compresses the buffer
+// Compresses the buffer using the selected compression level and the Z80 player cycle budget
+// Returns the compressed length (-1 if there is not enough memory, the buffer is not changed)
 int filePSGCompress(uint8_t* in_buffer, int in_buffer_length)
+{
+	return filePSGCompressWithDictionary(in_buffer, in_buffer_length, 0, NULL, NULL);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Compresses the PSG file stored after the dictionary (the first in_dictionary_length bytes of the buffer).
+// The dictionary is not changed, only its bytes marked in in_dictionary_source can be used as substring sources.
+// The bytes of the music data can be locked (in_locks, NULL - no locked bytes).
+// The Z80 player cycle budget is applied only when there is no dictionary, the memory constraints are always applied.
+int filePSGCompressWithDictionary(uint8_t* in_buffer, int in_buffer_length, int in_dictionary_length, const bool* in_dictionary_source, const uint8_t* in_locks)
+{
+	return filePSGCompressAfterDictionary(in_buffer, in_buffer_length, in_dictionary_length, in_dictionary_source,
+		filePSGGetHeaderLength(&in_buffer[in_dictionary_length], in_buffer_length - in_dictionary_length), in_locks);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Compresses the buffer, the bytes of the music data can be locked (PSG_LOCK_SOURCE or PSG_LOCK_NO_SOURCE in in_locks)
+int filePSGCompressWithLocks(uint8_t* in_buffer, int in_buffer_length, const uint8_t* in_locks)
+{
+	return filePSGCompressAfterDictionary(in_buffer, in_buffer_length, 0, NULL, filePSGGetHeaderLength(in_buffer, in_buffer_length), in_locks);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Compresses a part of the music data (without file header) stored after the dictionary (incremental compression)
+int filePSGCompressPart(uint8_t* in_buffer, int in_buffer_length, int in_dictionary_length, const bool* in_dictionary_source)
+{
+	return filePSGCompressAfterDictionary(in_buffer, in_buffer_length, in_dictionary_length, in_dictionary_source, 0, NULL);
+}
+
+/*****************************************************************************/
+/* Local functions                                                           */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Compresses the data stored after the dictionary, the header (in_header_length bytes after the dictionary) is not changed
+static int filePSGCompressAfterDictionary(uint8_t* in_buffer, int in_buffer_length, int in_dictionary_length, const bool* in_dictionary_source, int in_header_length, const uint8_t* in_locks)
+{
+	int result_length;
+	bool cycle_budget = (filePSGCostGetMaxCycles() > 0 && in_dictionary_length == 0);
+	int i;
+
+	// no compression for short files
+	if (in_buffer_length - in_dictionary_length < PSG_SUBSTRING_MIN_LEN)
+		return in_buffer_length;
+
+	if (!filePSGCompressAllocate(in_buffer_length, cycle_budget))
+	{
+		printf("\nERROR: Not enough memory for the compression of %d bytes.\n", in_buffer_length);
+		return -1;
+	}
+
+	// the bytes of the dictionary and of the file header are not replaced
+	memset(l_locked, PSG_LOCK_NONE, in_buffer_length);
+	for (i = 0; i < in_dictionary_length; i++)
+		l_locked[i] = (in_dictionary_source[i]) ? PSG_LOCK_SOURCE : PSG_LOCK_NO_SOURCE;
+	memset(&l_locked[in_dictionary_length], PSG_LOCK_SOURCE, in_header_length);
+	if (in_locks != NULL)
+	{
+		for (i = in_dictionary_length + in_header_length; i < in_buffer_length; i++)
+			l_locked[i] = in_locks[i];
+	}
+	if (cycle_budget)
+		memcpy(l_uncompressed_buffer, in_buffer, in_buffer_length);
+
+	l_song_start = in_dictionary_length + in_header_length;
+	l_first_source = 0;
+	while (l_first_source < in_dictionary_length && l_locked[l_first_source] == PSG_LOCK_NO_SOURCE)
+		l_first_source++;
+
+	result_length = filePSGCompressBuffer(in_buffer, in_buffer_length);
+
+	// lock the frames above the budget and compress again
+	while (cycle_budget && filePSGCostLockFrames(in_buffer, result_length, l_locked))
+	{
+		memcpy(in_buffer, l_uncompressed_buffer, in_buffer_length);
+		result_length = filePSGCompressBuffer(in_buffer, in_buffer_length);
+	}
+
+	filePSGCompressFree();
+
+	filePSGCountMatches(&in_buffer[in_dictionary_length], result_length - in_dictionary_length);
+	g_statistics.BytesSaved += in_buffer_length - result_length;
+
+	return result_length;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Allocates the work buffers and the tables used by the compression level for the buffer length
+// Returns false (nothing is allocated) if there is not enough memory
+static bool filePSGCompressAllocate(int in_buffer_length, bool in_cycle_budget)
+{
+	bool success;
+
+	l_compression_state_low = (uint64_t*)calloc(PSG_STATE_WORD_COUNT(in_buffer_length), sizeof(uint64_t));
+	l_compression_state_high = (uint64_t*)calloc(PSG_STATE_WORD_COUNT(in_buffer_length), sizeof(uint64_t));
+	l_locked = (uint8_t*)malloc(in_buffer_length);
+	l_original_buffer = (uint8_t*)malloc(in_buffer_length);
+	l_result_buffer = (uint8_t*)malloc(in_buffer_length);
+
+	success = (l_compression_state_low != NULL && l_compression_state_high != NULL && l_locked != NULL && l_original_buffer != NULL && l_result_buffer != NULL);
+
+	// copy of the data for compressing again with the new locked frames
+	if (in_cycle_budget)
+	{
+		l_uncompressed_buffer = (uint8_t*)malloc(in_buffer_length);
+		success = success && l_uncompressed_buffer != NULL;
+	}
+
+	// candidate index of the greedy matcher (level 3-9)
+	if (l_compression_level > PSG_SINGLE_PASS_MAX_LEVEL)
+	{
+		l_greedy_head = (int*)malloc(PSG_HASH_SIZE * sizeof(int));
+		l_greedy_tail = (int*)malloc(PSG_HASH_SIZE * sizeof(int));
+		l_greedy_next = (int*)malloc(in_buffer_length * sizeof(int));
+		l_greedy_prev = (int*)malloc(in_buffer_length * sizeof(int));
+		success = success && l_greedy_head != NULL && l_greedy_tail != NULL && l_greedy_next != NULL && l_greedy_prev != NULL;
+	}
+
+	// hash chains of the single pass matchers (level 1-2, 8-9 and levels 3-7 with memory constraints)
+	if (l_compression_level <= PSG_SINGLE_PASS_MAX_LEVEL || l_compression_level >= 8 || l_constraints)
+	{
+		l_hash_head = (int*)malloc(PSG_HASH_SIZE * sizeof(int));
+		l_hash_prev = (int*)malloc(in_buffer_length * sizeof(int));
+		success = success && l_hash_head != NULL && l_hash_prev != NULL;
+	}
+
+	// optimal parser tables (level 9)
+	if (l_compression_level >= 9)
+	{
+		l_output_position = (int*)malloc(in_buffer_length * sizeof(int));
+		l_parse_cost = (int*)malloc((in_buffer_length + 1) * sizeof(int));
+		l_match_source = (int*)malloc(in_buffer_length * sizeof(int));
+		l_match_length = (uint8_t*)malloc(in_buffer_length);
+		l_parse_length = (uint8_t*)malloc(in_buffer_length);
+		success = success && l_output_position != NULL && l_parse_cost != NULL && l_match_source != NULL && l_match_length != NULL && l_parse_length != NULL;
+	}
+
+	if (!success)
+		filePSGCompressFree();
+
+	return success;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Releases the work buffers and the tables of the compression
+static void filePSGCompressFree(void)
+{
+	free(l_compression_state_low);
+	free(l_compression_state_high);
+	free(l_locked);
+	free(l_uncompressed_buffer);
+	free(l_original_buffer);
+	free(l_result_buffer);
+	free(l_greedy_head);
+	free(l_greedy_tail);
+	free(l_greedy_next);
+	free(l_greedy_prev);
+	free(l_hash_head);
+	free(l_hash_prev);
+	free(l_output_position);
+	free(l_parse_cost);
+	free(l_match_source);
+	free(l_match_length);
+	free(l_parse_length);
+
+	l_compression_state_low = NULL;
+	l_compression_state_high = NULL;
+	l_locked = NULL;
+	l_uncompressed_buffer = NULL;
+	l_original_buffer = NULL;
+	l_result_buffer = NULL;
+	l_greedy_head = NULL;
+	l_greedy_tail = NULL;
+	l_greedy_next = NULL;
+	l_greedy_prev = NULL;
+	l_hash_head = NULL;
+	l_hash_prev = NULL;
+	l_output_position = NULL;
+	l_parse_cost = NULL;
+	l_match_source = NULL;
+	l_match_length = NULL;
+	l_parse_length = NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Compresses the buffer using the selected compression level
+static int filePSGCompressBuffer(uint8_t* in_buffer, int in_buffer_length)
+{
+	int length;
+	int result_length;
+	int variant_count;
+	int i;
+
+	if (l_compression_level <= PSG_SINGLE_PASS_MAX_LEVEL)
+	{
+		// single pass matcher
+		memcpy(l_original_buffer, in_buffer, in_buffer_length);
+		result_length = filePSGCompressSinglePass(l_original_buffer, in_buffer, in_buffer_length, &l_matcher_parameters[l_compression_level - PSG_COMPRESSION_MIN_LEVEL]);
+	}
+	else
+	{
+		if (l_compression_level > PSG_COMPRESSION_DEFAULT_LEVEL || l_constraints)
+			memcpy(l_original_buffer, in_buffer, in_buffer_length);
+
+		// greedy matcher
+		if (l_compression_level < PSG_COMPRESSION_DEFAULT_LEVEL)
+			result_length = filePSGCompressGreedy(in_buffer, in_buffer_length, l_greedy_length_step[l_compression_level - PSG_SINGLE_PASS_MAX_LEVEL - 1], false);
+		else
+			result_length = filePSGCompressGreedy(in_buffer, in_buffer_length, 1, false);
+
+		// greedy matcher variants
+		if (l_compression_level > PSG_COMPRESSION_DEFAULT_LEVEL)
+		{
+			variant_count = (l_compression_level == 7) ? PSG_LEVEL7_GREEDY_VARIANT_COUNT : sizeof(l_greedy_variants) / sizeof(l_greedy_variants[0]);
+			for (i = 1; i < variant_count; i++)
+			{
+				memcpy(l_result_buffer, l_original_buffer, in_buffer_length);
+				length = filePSGCompressGreedy(l_result_buffer, in_buffer_length, l_greedy_variants[i].LengthStep, l_greedy_variants[i].NearestSource);
+				filePSGKeepShorterResult(in_buffer, &result_length, length);
+			}
+		}
+
+		// exhaustive single pass matcher
+		if (l_compression_level >= 8)
+		{
+			length = filePSGCompressSinglePass(l_original_buffer, l_result_buffer, in_buffer_length, &l_exhaustive_matcher_parameters);
+			filePSGKeepShorterResult(in_buffer, &result_length, length);
+		}
+		else if (l_constraints)
+		{
+			// the greedy matcher loses many references when the sources are limited (small pages), the single pass matcher checks the final positions
+			length = filePSGCompressSinglePass(l_original_buffer, l_result_buffer, in_buffer_length, &l_matcher_parameters[PSG_SINGLE_PASS_MAX_LEVEL - PSG_COMPRESSION_MIN_LEVEL]);
+			filePSGKeepShorterResult(in_buffer, &result_length, length);
+		}
+
+		// optimal parser
+		if (l_compression_level >= 9)
+		{
+			length = filePSGCompressOptimal(l_original_buffer, l_result_buffer, in_buffer_length);
+			filePSGKeepShorterResult(in_buffer, &result_length, length);
+		}
+	}
+
+	return result_length;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Multi pass greedy compression. Replaces all occurences of the strings from the longest to the shortest length
+// (only every in_length_step-th length is processed). The leftmost (or the nearest if in_nearest_source is true)
+// usable occurence is used as the source of the string.
+static int filePSGCompressGreedy(uint8_t* in_buffer, int in_buffer_length, int in_length_step, bool in_nearest_source)
 {
 	int current_start_index;
 	int current_index;
-	int substring_start_index;
 	int substring_found;
+	int source_index;
 	int copy_from;
 	int copy_to;
 	int copy_count;
 	int expected_substring_length;
 	int offset;
 	int current_end;
-	int pos;
+	int indexed_pos;
 
-	// no compression for short files
-	if (in_buffer_length < PSG_SUBSTRING_MIN_LEN)
-		return in_buffer_length;
-
-	// mark all byte status as unused
+	// mark all byte status as unused (locked bytes can be used only as a source, the references of the dictionary can't be used at all)
+	filePSGStateSet(0, in_buffer_length, PSG_CBS_UNUSED);
 	for (current_index = 0; current_index < in_buffer_length; current_index++)
-		l_compression_buffer_state[current_index] = PSG_CBS_UNUSED;
+	{
+		if (l_locked[current_index] == PSG_LOCK_NO_SOURCE)
+			filePSGStateSet(current_index, 1, PSG_CBS_OFFSET);
+		else if (l_locked[current_index])
+			filePSGStateSet(current_index, 1, PSG_CBS_REFERENCED);
+	}
 
 	// start compression with all possible substring length
-	for (expected_substring_length = PSG_SUBSTRING_MAX_LEN; expected_substring_length >= PSG_SUBSTRING_MIN_LEN; expected_substring_length--)
+	for (expected_substring_length = PSG_SUBSTRING_MAX_LEN; expected_substring_length >= PSG_SUBSTRING_MIN_LEN; expected_substring_length = filePSGGreedyNextLength(expected_substring_length, in_length_step))
 	{
-		printf(".");
+		if (l_show_progress)
+			printf(".");
+
+		// the bytes before the selected string are not moved any more, their positions are added to the index when they can be a source
+		filePSGGreedyIndexReset();
+		indexed_pos = 0;
 
 		// select string for compression
 		current_start_index = expected_substring_length;
 		while (current_start_index < in_buffer_length - expected_substring_length)
 		{
 			// all bytes of the string must be unused
-			current_index = current_start_index;
 			current_end = current_start_index + expected_substring_length;
-			while (current_index < current_end && l_compression_buffer_state[current_index] == PSG_CBS_UNUSED)
-				current_index++;
+			current_index = filePSGStateFind(current_start_index, current_end, PSG_STATE_FIND_USED);
 
 			// not all bytes are unused -> move to the next byte after the used byte and try again 
 			if (current_index != current_end)
@@ -85,89 +626,55 @@ int filePSGCompress(uint8_t* in_buffer, int in_buffer_length)
 				continue;
 			}
 
-			// string is selected, build the jump table
-			filePSGPrepareJumpTable(&in_buffer[current_start_index], expected_substring_length);
+			// string is selected, update the index
+			g_statistics.CandidatePositions++;
+			while (indexed_pos <= current_start_index - expected_substring_length)
+				filePSGGreedyIndexInsert(in_buffer, indexed_pos++);
 
-			// try to find the repetition string before the selected string position
-			substring_start_index = 0; // start from the first character
-			substring_found = false;
-			while (!substring_found && substring_start_index <= current_start_index - expected_substring_length)
-			{
-				pos = filePSGSearchPattern(in_buffer, substring_start_index, current_start_index, expected_substring_length);
-
-				// if found a repetition substring
-				if (pos >= 0)
-				{
-					// none of the element of the substring can be 'substring' or 'offset' (no recursive compression is supported)
-					current_end = pos + expected_substring_length;
-					current_index = pos;
-					while (current_index < current_end && l_compression_buffer_state[current_index] < PSG_CBS_SUBSTRING)
-						current_index++;
-
-					if (current_index != current_end)
-					{
-						// skip unusable substring characters
-						substring_start_index = current_index + 1;
-					}
-					else
-					{
-						// substring found
-						substring_start_index = pos;
-						substring_found = true;
-					}
-				}
-				else
-				{
-					// substring not found -> exit loop
-					break;
-				}
-			}
+			// try to find the repetition string before the selected string position (from the first usable character)
+			source_index = filePSGGreedyFindSource(in_buffer, filePSGGetFirstSourcePosition(current_start_index), current_start_index, expected_substring_length, in_nearest_source);
+			substring_found = (source_index != PSG_NO_POSITION);
 
 			// if substring found -> replace oroginal string with a reference to the substring
 			if (substring_found)
 			{
 				// mark referenced bytes (substring)
-				for (current_index = substring_start_index; current_index < substring_start_index + expected_substring_length; current_index++)
-					l_compression_buffer_state[current_index] = PSG_CBS_REFERENCED;
+				filePSGStateSet(source_index, expected_substring_length, PSG_CBS_REFERENCED);
 
 				// create reference
 				in_buffer[current_start_index] = (expected_substring_length - PSG_SUBSTRING_MIN_LEN) + PSG_SUBSTRING;
-				in_buffer[current_start_index + 1] = (substring_start_index & 0xFF);
-				in_buffer[current_start_index + 2] = (substring_start_index >> 8);
+				in_buffer[current_start_index + 1] = (source_index & 0xFF);
+				in_buffer[current_start_index + 2] = (source_index >> 8);
 
 				// mark substring and offset
-				l_compression_buffer_state[current_start_index] = PSG_CBS_SUBSTRING;
-				l_compression_buffer_state[current_start_index + 1] = PSG_CBS_OFFSET;
-				l_compression_buffer_state[current_start_index + 2] = PSG_CBS_OFFSET;
+				filePSGStateSet(current_start_index, 1, PSG_CBS_SUBSTRING);
+				filePSGStateSet(current_start_index + 1, 2, PSG_CBS_OFFSET);
 
 				// compact remaining bytes
 				copy_from = current_start_index + expected_substring_length;
 				copy_to = current_start_index + 3;
 				copy_count = in_buffer_length - copy_from;
-				while (copy_count > 0)
+				if (copy_count > 0)
 				{
-					in_buffer[copy_to] = in_buffer[copy_from];
-					l_compression_buffer_state[copy_to] = l_compression_buffer_state[copy_from];
-					copy_from++;
-					copy_to++;
-					copy_count--;
+					memmove(&in_buffer[copy_to], &in_buffer[copy_from], copy_count);
+					filePSGStateMove(copy_to, copy_from, copy_count);
 				}
 
 				// update offsets to the moved area
-				for (current_index = current_start_index + 3; current_index < in_buffer_length; current_index++)
+				current_index = filePSGStateFind(current_start_index + 3, in_buffer_length, PSG_STATE_FIND_SUBSTRING);
+				while (current_index < in_buffer_length)
 				{
-					if (l_compression_buffer_state[current_index] == PSG_CBS_SUBSTRING)
-					{
-						offset = in_buffer[current_index + 1] + (in_buffer[current_index + 2] << 8);
+					offset = in_buffer[current_index + 1] + (in_buffer[current_index + 2] << 8);
 
-						// if offset is inside the moved area
-						if (offset > current_start_index)
-						{
-							offset -= expected_substring_length - 3;
-							in_buffer[current_index + 1] = offset & 0xff;
-							in_buffer[current_index + 2] = offset >> 8;
-						}
+					// if offset is inside the moved area
+					if (offset > current_start_index)
+					{
+						offset -= expected_substring_length - 3;
+						in_buffer[current_index + 1] = offset & 0xff;
+						in_buffer[current_index + 2] = offset >> 8;
 					}
+
+					current_index = filePSGStateFind(current_index + 1, in_buffer_length, PSG_STATE_FIND_SUBSTRING);
 				}
 
 				// move to the next string in the buffer
@@ -182,45 +689,710 @@ int filePSGCompress(uint8_t* in_buffer, int in_buffer_length)
 		}
 	}
 
+	// the data was moved after the sources were selected, the final positions must be checked
+	if (l_constraints)
+		in_buffer_length = filePSGFixInvalidReferences(in_buffer, in_buffer_length);
+
 	return in_buffer_length;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// Prepares jump table for string search
-static void filePSGPrepareJumpTable(uint8_t* in_string, uint8_t in_length)
+// Gets the next substring length of the greedy compression (the minimum length is always processed)
+static int filePSGGreedyNextLength(int in_length, int in_length_step)
 {
+	if (in_length > PSG_SUBSTRING_MIN_LEN && in_length - in_length_step < PSG_SUBSTRING_MIN_LEN)
+		return PSG_SUBSTRING_MIN_LEN;
+
+	return in_length - in_length_step;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Single pass hash chain compression. Every string is replaced by the longest earlier
+// occurence which is stored without compression in the output buffer.
+static int filePSGCompressSinglePass(uint8_t* in_source, uint8_t* out_buffer, int in_buffer_length, const PSGMatcherParameters* in_parameters)
+{
+	int source_index;
+	int output_length;
+	int literal_count;
+	int match_length;
+	int match_index;
+	int next_match_length;
+	int next_match_index;
 	int i;
 
-	for (i = 0; i < CHARACTER_COUNT; i++)
+	if (l_show_progress)
+		printf(".");
+
+	for (i = 0; i < PSG_HASH_SIZE; i++)
+		l_hash_head[i] = PSG_NO_POSITION;
+
+	source_index = 0;
+	output_length = 0;
+	literal_count = 0;
+	while (source_index < in_buffer_length)
 	{
-		l_jump_table[i] = in_length;
+		// find longest match (the last byte is the end of data mark, it is never compressed)
+		match_length = filePSGFindLongestMatch(in_source, source_index, in_buffer_length - 1, out_buffer, output_length, in_parameters, &match_index);
+
+		// lazy matching: store literal if the next position has a longer match
+		if (match_length >= PSG_SUBSTRING_MIN_LEN && in_parameters->Lazy && match_length < PSG_SUBSTRING_MAX_LEN)
+		{
+			next_match_length = filePSGFindLongestMatch(in_source, source_index + 1, in_buffer_length - 1, out_buffer, output_length, in_parameters, &next_match_index);
+			if (next_match_length > match_length)
+				match_length = 0;
+		}
+
+		if (match_length >= PSG_SUBSTRING_MIN_LEN)
+		{
+			// store reference
+			output_length = filePSGWriteReference(out_buffer, output_length, match_length, match_index);
+			source_index += match_length;
+			literal_count = 0;
+		}
+		else if (l_locked[source_index] == PSG_LOCK_NO_SOURCE)
+		{
+			// store the dictionary byte which can't be a source
+			out_buffer[output_length] = in_source[source_index++];
+			filePSGStateSet(output_length, 1, PSG_CBS_OFFSET);
+			output_length++;
+			literal_count = 0;
+		}
+		else
+		{
+			// store literal
+			out_buffer[output_length] = in_source[source_index++];
+			filePSGStateSet(output_length, 1, PSG_CBS_UNUSED);
+			output_length++;
+			literal_count++;
+
+			// the string ending at the literal can be used as a source
+			if (literal_count >= PSG_SUBSTRING_MIN_LEN && output_length - PSG_SUBSTRING_MIN_LEN <= PSG_SUBSTRING_MAX_OFFSET)
+			{
+				i = output_length - PSG_SUBSTRING_MIN_LEN;
+				l_hash_prev[i] = l_hash_head[PSG_HASH(&out_buffer[i])];
+				l_hash_head[PSG_HASH(&out_buffer[i])] = i;
+			}
+		}
 	}
 
-	for (i = 0; i < in_length - 1; i++)
+	return output_length;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Finds the longest non compressed occurence of the string in the output buffer using the hash chain
+static int filePSGFindLongestMatch(uint8_t* in_source, int in_source_index, int in_source_length, uint8_t* in_buffer, int in_buffer_length, const PSGMatcherParameters* in_parameters, int* out_match_index)
+{
+	int candidate;
+	int chain_depth;
+	int length;
+	int max_length;
+	int unused_end;
+	int best_length = 0;
+	int window = in_parameters->Window;
+
+	if (in_source_index + PSG_SUBSTRING_MIN_LEN > in_source_length)
+		return 0;
+
+	if (l_max_distance > 0 && l_max_distance < window)
+		window = l_max_distance;
+
+	g_statistics.CandidatePositions++;
+
+	max_length = in_source_length - in_source_index;
+	if (max_length > PSG_SUBSTRING_MAX_LEN)
+		max_length = PSG_SUBSTRING_MAX_LEN;
+
+	candidate = l_hash_head[PSG_HASH(&in_source[in_source_index])];
+	chain_depth = in_parameters->ChainDepth;
+	while (candidate != PSG_NO_POSITION && chain_depth > 0 && in_buffer_length - candidate <= window)
 	{
-		l_jump_table[in_string[i]] = in_length - 1 - i;
+		g_statistics.MemcmpCalls++;
+
+		// compare non compressed bytes of the output
+		unused_end = filePSGStateFind(candidate, (candidate + max_length < in_buffer_length) ? candidate + max_length : in_buffer_length, PSG_STATE_FIND_USED);
+		length = 0;
+		while (candidate + length < unused_end && !l_locked[in_source_index + length] && in_buffer[candidate + length] == in_source[in_source_index + length])
+		{
+			length++;
+		}
+
+		// shorten the match to the part in the usable memory
+		while (l_constraints && length >= PSG_SUBSTRING_MIN_LEN && !filePSGIsValidReference(in_buffer_length, candidate, length))
+			length--;
+
+		if (length > best_length)
+		{
+			best_length = length;
+			*out_match_index = candidate;
+
+			if (length == max_length)
+				break;
+		}
+
+		candidate = l_hash_prev[candidate];
+		chain_depth--;
 	}
+
+	return best_length;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Optimal parse compression. The shortest encoding is calculated over all matches of the
+// input (assuming non compressed sources), then the sources are validated while the output
+// is created, because the source of a substring can't contain compressed data.
+static int filePSGCompressOptimal(uint8_t* in_source, uint8_t* out_buffer, int in_buffer_length)
+{
+	int source_index;
+	int output_length;
+	int candidate;
+	int chain_depth;
+	int length;
+	int max_length;
+	int best_length;
+	int best_source;
+	uint32_t hash;
+	int i;
+
+	if (l_show_progress)
+		printf(".");
+
+	for (i = 0; i < PSG_HASH_SIZE; i++)
+		l_hash_head[i] = PSG_NO_POSITION;
+
+	// find longest match for all positions (the last byte is the end of data mark, it is never compressed)
+	for (source_index = 0; source_index < in_buffer_length; source_index++)
+	{
+		l_match_length[source_index] = 0;
+		l_hash_prev[source_index] = PSG_NO_POSITION;
+
+		if (source_index + PSG_SUBSTRING_MIN_LEN > in_buffer_length - 1)
+			continue;
+
+		g_statistics.CandidatePositions++;
+
+		max_length = in_buffer_length - 1 - source_index;
+		if (max_length > PSG_SUBSTRING_MAX_LEN)
+			max_length = PSG_SUBSTRING_MAX_LEN;
+
+		hash = PSG_HASH(&in_source[source_index]);
+		candidate = l_hash_head[hash];
+		chain_depth = PSG_OPTIMAL_CHAIN_DEPTH;
+		while (candidate != PSG_NO_POSITION && chain_depth > 0)
+		{
+			g_statistics.MemcmpCalls++;
+
+			// source and string can't overlap
+			length = 0;
+			while (length < max_length && candidate + length < source_index && !l_locked[source_index + length] && in_source[candidate + length] == in_source[source_index + length])
+				length++;
+
+			if (length > l_match_length[source_index])
+			{
+				l_match_length[source_index] = (uint8_t)length;
+				l_match_source[source_index] = candidate;
+				if (length == max_length)
+					break;
+			}
+
+			candidate = l_hash_prev[candidate];
+			chain_depth--;
+		}
+
+		if (source_index <= PSG_SUBSTRING_MAX_OFFSET)
+		{
+			l_hash_prev[source_index] = l_hash_head[hash];
+			l_hash_head[hash] = source_index;
+		}
+	}
+
+	// calculate the shortest encoding from the end
+	l_parse_cost[in_buffer_length] = 0;
+	for (source_index = in_buffer_length - 1; source_index >= 0; source_index--)
+	{
+		l_parse_cost[source_index] = l_parse_cost[source_index + 1] + 1;
+		l_parse_length[source_index] = 1;
+
+		for (length = PSG_SUBSTRING_MIN_LEN; length <= l_match_length[source_index]; length++)
+		{
+			if (l_parse_cost[source_index + length] + PSG_REFERENCE_LENGTH < l_parse_cost[source_index])
+			{
+				l_parse_cost[source_index] = l_parse_cost[source_index + length] + PSG_REFERENCE_LENGTH;
+				l_parse_length[source_index] = (uint8_t)length;
+			}
+		}
+	}
+
+	// create output, replace invalid sources
+	source_index = 0;
+	output_length = 0;
+	while (source_index < in_buffer_length)
+	{
+		length = l_parse_length[source_index];
+
+		if (length >= PSG_SUBSTRING_MIN_LEN && !filePSGIsLiteralSource(l_match_source[source_index], length, output_length))
+		{
+			// find the longest usable source in the hash chain
+			best_length = 0;
+			best_source = PSG_NO_POSITION;
+			candidate = l_hash_prev[source_index];
+			chain_depth = PSG_OPTIMAL_CHAIN_DEPTH;
+			while (candidate != PSG_NO_POSITION && chain_depth > 0 && best_length < length)
+			{
+				i = 0;
+				while (i < length && candidate + i < source_index && l_output_position[candidate + i] != PSG_NO_POSITION &&
+					in_source[candidate + i] == in_source[source_index + i])
+				{
+					i++;
+				}
+
+				if (i > best_length && filePSGIsLiteralSource(candidate, i, output_length))
+				{
+					best_length = i;
+					best_source = candidate;
+				}
+
+				candidate = l_hash_prev[candidate];
+				chain_depth--;
+			}
+
+			// use the shorter match only if it still worth
+			if (best_length >= PSG_SUBSTRING_MIN_LEN && l_parse_cost[source_index + best_length] + PSG_REFERENCE_LENGTH <= l_parse_cost[source_index + 1] + 1)
+			{
+				length = best_length;
+				l_match_source[source_index] = best_source;
+			}
+			else
+			{
+				length = 1;
+			}
+		}
+
+		if (length >= PSG_SUBSTRING_MIN_LEN)
+		{
+			// store reference
+			for (i = 0; i < length; i++)
+				l_output_position[source_index + i] = PSG_NO_POSITION;
+
+			output_length = filePSGWriteReference(out_buffer, output_length, length, l_output_position[l_match_source[source_index]]);
+			source_index += length;
+		}
+		else if (l_locked[source_index] == PSG_LOCK_NO_SOURCE)
+		{
+			// store the dictionary byte which can't be a source
+			l_output_position[source_index] = PSG_NO_POSITION;
+			filePSGStateSet(output_length, 1, PSG_CBS_OFFSET);
+			out_buffer[output_length++] = in_source[source_index++];
+		}
+		else
+		{
+			// store literal
+			l_output_position[source_index] = output_length;
+			filePSGStateSet(output_length, 1, PSG_CBS_UNUSED);
+			out_buffer[output_length++] = in_source[source_index++];
+		}
+	}
+
+	return output_length;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns true if all bytes of the source string was stored as literal and the source is usable from the reference position (optimal parser)
+static bool filePSGIsLiteralSource(int in_source_index, int in_length, int in_reference_position)
+{
+	int i;
+
+	for (i = 0; i < in_length; i++)
+	{
+		if (l_output_position[in_source_index + i] == PSG_NO_POSITION)
+			return false;
+	}
+
+	if (l_constraints && !filePSGIsValidReference(in_reference_position, l_output_position[in_source_index], in_length))
+		return false;
+
+	return l_output_position[in_source_index] <= PSG_SUBSTRING_MAX_OFFSET;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// Performs a Boyer-Moore-Horspool pattern matching
-static int filePSGSearchPattern(uint8_t* in_buffer, int in_start_index, int in_pattern_start_index, int in_pattern_length)
+// Copies the result buffer into the output if it is shorter than the current result
+static void filePSGKeepShorterResult(uint8_t* in_buffer, int* inout_result_length, int in_length)
 {
-	int skip;
+	if (in_length < *inout_result_length)
+	{
+		memcpy(in_buffer, l_result_buffer, in_length);
+		*inout_result_length = in_length;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes substring reference into the output buffer, returns the new output position
+static int filePSGWriteReference(uint8_t* out_buffer, int in_pos, int in_length, int in_offset)
+{
+	out_buffer[in_pos] = (uint8_t)((in_length - PSG_SUBSTRING_MIN_LEN) + PSG_SUBSTRING);
+	out_buffer[in_pos + 1] = (in_offset & 0xFF);
+	out_buffer[in_pos + 2] = (in_offset >> 8);
 
-	skip = in_start_index;
+	filePSGStateSet(in_pos, 1, PSG_CBS_SUBSTRING);
+	filePSGStateSet(in_pos + 1, 2, PSG_CBS_OFFSET);
+
+	return in_pos + PSG_REFERENCE_LENGTH;
+}
 
-	while (in_pattern_start_index - skip >= in_pattern_length)
+///////////////////////////////////////////////////////////////////////////////
+// Counts substring references of the compressed buffer by length (statistics)
+static void filePSGCountMatches(uint8_t* in_buffer, int in_buffer_length)
+{
+	int pos = 0;
+
+	while (pos < in_buffer_length)
 	{
-		if (memcmp(&in_buffer[skip], &in_buffer[in_pattern_start_index], in_pattern_length) == 0)
+		if (in_buffer[pos] >= PSG_SUBSTRING && in_buffer[pos] < PSG_SUBSTRING + PSG_SUBSTRING_MAX_LEN - PSG_SUBSTRING_MIN_LEN + 1)
 		{
-			return skip;
+			g_statistics.MatchCount[in_buffer[pos] - PSG_SUBSTRING + PSG_SUBSTRING_MIN_LEN]++;
+			pos += PSG_REFERENCE_LENGTH;
+		}
+		else if (in_buffer[pos] == PSG_LONG_SUBSTRING)
+		{
+			pos += PSG_LONG_SUBSTRING_LENGTH;
 		}
 		else
 		{
-			skip += l_jump_table[in_buffer[skip + in_pattern_length - 1]];
+			pos++;
 		}
 	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns true if the source string can be used by the reference at the given position (memory constraints)
+static bool filePSGIsValidReference(int in_reference_position, int in_source_position, int in_length)
+{
+	int source_last = in_source_position + in_length - 1;
+	int i;
+
+	if (l_max_distance > 0 && in_reference_position - in_source_position > l_max_distance)
+		return false;
+
+	if (l_page_size > 0 && (in_source_position / l_page_size != in_reference_position / l_page_size || source_last / l_page_size != in_reference_position / l_page_size))
+		return false;
+
+	for (i = 0; i < l_forbidden_range_count; i++)
+	{
+		if (in_source_position <= l_forbidden_ranges[i].Last && source_last >= l_forbidden_ranges[i].First)
+			return false;
+	}
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets the first position which can be a source of the reference at the given position (greedy matcher).
+// The distance can only decrease while the data is compressed, the pages and the forbidden ranges are checked at the end.
+static int filePSGGetFirstSourcePosition(int in_reference_position)
+{
+	if (l_max_distance > 0 && in_reference_position - l_max_distance > l_first_source)
+		return in_reference_position - l_max_distance;
+
+	return l_first_source;
+}
 
-	return -1;
-}
\ No newline at end of file
+///////////////////////////////////////////////////////////////////////////////
+// Fixes the references violating the memory constraints (greedy matcher). The reference gets an other usable
+// source if there is one, or it is replaced by the content of its source. Every byte before the checked
+// reference is at its final position, so one pass is enough. Returns the new length.
+static int filePSGFixInvalidReferences(uint8_t* in_buffer, int in_buffer_length)
+{
+	int pos;
+	int length;
+	int offset;
+	int i;
+
+	// the bytes before the music data can be used as source if they are not locked out (references of the dictionary)
+	for (pos = 0; pos < l_song_start; pos++)
+		filePSGStateSet(pos, 1, (l_locked[pos] == PSG_LOCK_NO_SOURCE) ? PSG_CBS_OFFSET : PSG_CBS_UNUSED);
+
+	while (pos < in_buffer_length)
+	{
+		if (in_buffer[pos] < PSG_SUBSTRING || in_buffer[pos] >= PSG_SUBSTRING + PSG_SUBSTRING_MAX_LEN - PSG_SUBSTRING_MIN_LEN + 1)
+		{
+			filePSGStateSet(pos++, 1, PSG_CBS_UNUSED);
+			continue;
+		}
+
+		length = in_buffer[pos] - PSG_SUBSTRING + PSG_SUBSTRING_MIN_LEN;
+		offset = in_buffer[pos + 1] + (in_buffer[pos + 2] << 8);
+
+		if (!filePSGIsValidReference(pos, offset, length))
+		{
+			offset = filePSGFindValidSource(in_buffer, pos, offset, length);
+			if (offset != PSG_NO_POSITION)
+			{
+				// use the other source
+				in_buffer[pos + 1] = (uint8_t)(offset & 0xff);
+				in_buffer[pos + 2] = (uint8_t)(offset >> 8);
+			}
+			else
+			{
+				// copy the source string (it is always before the reference) in place of the reference
+				offset = in_buffer[pos + 1] + (in_buffer[pos + 2] << 8);
+				memmove(&in_buffer[pos + length], &in_buffer[pos + PSG_REFERENCE_LENGTH], in_buffer_length - pos - PSG_REFERENCE_LENGTH);
+				memcpy(&in_buffer[pos], &in_buffer[offset], length);
+				in_buffer_length += length - PSG_REFERENCE_LENGTH;
+
+				// update the offsets of the sources behind the expanded reference
+				i = pos + length;
+				while (i < in_buffer_length)
+				{
+					if (in_buffer[i] >= PSG_SUBSTRING && in_buffer[i] < PSG_SUBSTRING + PSG_SUBSTRING_MAX_LEN - PSG_SUBSTRING_MIN_LEN + 1)
+					{
+						offset = in_buffer[i + 1] + (in_buffer[i + 2] << 8);
+						if (offset > pos)
+						{
+							offset += length - PSG_REFERENCE_LENGTH;
+							in_buffer[i + 1] = (uint8_t)(offset & 0xff);
+							in_buffer[i + 2] = (uint8_t)(offset >> 8);
+						}
+						i += PSG_REFERENCE_LENGTH;
+					}
+					else
+					{
+						i++;
+					}
+				}
+
+				continue;
+			}
+		}
+
+		filePSGStateSet(pos, 1, PSG_CBS_SUBSTRING);
+		filePSGStateSet(pos + 1, 2, PSG_CBS_OFFSET);
+		pos += PSG_REFERENCE_LENGTH;
+	}
+
+	return in_buffer_length;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Finds the nearest non compressed occurence of the source string which is usable from the reference position
+static int filePSGFindValidSource(uint8_t* in_buffer, int in_reference_position, int in_source_position, int in_length)
+{
+	int candidate;
+
+	for (candidate = in_reference_position - in_length; candidate >= filePSGGetFirstSourcePosition(in_reference_position); candidate--)
+	{
+		if (filePSGStateFind(candidate, candidate + in_length, PSG_STATE_FIND_USED) == candidate + in_length &&
+			memcmp(&in_buffer[candidate], &in_buffer[in_source_position], in_length) == 0 && filePSGIsValidReference(in_reference_position, candidate, in_length))
+			return candidate;
+	}
+
+	return PSG_NO_POSITION;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Clears the candidate index of the greedy matcher
+static void filePSGGreedyIndexReset(void)
+{
+	int i;
+
+	for (i = 0; i < PSG_HASH_SIZE; i++)
+	{
+		l_greedy_head[i] = PSG_NO_POSITION;
+		l_greedy_tail[i] = PSG_NO_POSITION;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Adds the position to the end of the list of its prefix (the positions are added in ascending order)
+static void filePSGGreedyIndexInsert(uint8_t* in_buffer, int in_pos)
+{
+	uint32_t hash = PSG_HASH(&in_buffer[in_pos]);
+
+	l_greedy_next[in_pos] = PSG_NO_POSITION;
+	l_greedy_prev[in_pos] = l_greedy_tail[hash];
+
+	if (l_greedy_tail[hash] == PSG_NO_POSITION)
+		l_greedy_head[hash] = in_pos;
+	else
+		l_greedy_next[l_greedy_tail[hash]] = in_pos;
+
+	l_greedy_tail[hash] = in_pos;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Removes the position from the list of its prefix
+static void filePSGGreedyIndexRemove(uint8_t* in_buffer, int in_pos)
+{
+	uint32_t hash = PSG_HASH(&in_buffer[in_pos]);
+
+	if (l_greedy_prev[in_pos] == PSG_NO_POSITION)
+		l_greedy_head[hash] = l_greedy_next[in_pos];
+	else
+		l_greedy_next[l_greedy_prev[in_pos]] = l_greedy_next[in_pos];
+
+	if (l_greedy_next[in_pos] == PSG_NO_POSITION)
+		l_greedy_tail[hash] = l_greedy_prev[in_pos];
+	else
+		l_greedy_prev[l_greedy_next[in_pos]] = l_greedy_prev[in_pos];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Finds the leftmost (or the nearest) usable source of the string in the candidate index. Within one pass of the
+// greedy matcher the indexed bytes are not moved and the first usable position only grows, so the candidates
+// before the first usable position or containing a reference (no recursive compression is supported) are
+// removed when they are found. Returns the source position or PSG_NO_POSITION.
+static int filePSGGreedyFindSource(uint8_t* in_buffer, int in_first_source, int in_string_index, int in_length, bool in_nearest_source)
+{
+	int candidate;
+	int next_candidate;
+
+	candidate = (in_nearest_source) ? l_greedy_tail[PSG_HASH(&in_buffer[in_string_index])] : l_greedy_head[PSG_HASH(&in_buffer[in_string_index])];
+
+	while (candidate != PSG_NO_POSITION)
+	{
+		next_candidate = (in_nearest_source) ? l_greedy_prev[candidate] : l_greedy_next[candidate];
+
+		if (candidate < in_first_source)
+		{
+			// the remaining candidates of the nearest source search are before the first position as well
+			if (in_nearest_source)
+				break;
+
+			filePSGGreedyIndexRemove(in_buffer, candidate);
+		}
+		else
+		{
+			if (filePSGStateFind(candidate, candidate + in_length, PSG_STATE_FIND_COMPRESSED) != candidate + in_length)
+			{
+				filePSGGreedyIndexRemove(in_buffer, candidate);
+			}
+			else
+			{
+				g_statistics.MemcmpCalls++;
+
+				if (memcmp(&in_buffer[candidate], &in_buffer[in_string_index], in_length) == 0)
+					return candidate;
+			}
+		}
+
+		candidate = next_candidate;
+	}
+
+	return PSG_NO_POSITION;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sets the compression buffer state of the bytes
+static void filePSGStateSet(int in_pos, int in_length, uint8_t in_state)
+{
+	int end = in_pos + in_length;
+	int word;
+	int count;
+	uint64_t mask;
+
+	while (in_pos < end)
+	{
+		word = PSG_STATE_WORD(in_pos);
+		count = PSG_STATE_WORD_BITS - PSG_STATE_BIT(in_pos);
+		if (count > end - in_pos)
+			count = end - in_pos;
+		mask = PSG_STATE_MASK(count) << PSG_STATE_BIT(in_pos);
+
+		if ((in_state & 0x01) != 0)
+			l_compression_state_low[word] |= mask;
+		else
+			l_compression_state_low[word] &= ~mask;
+
+		if ((in_state & 0x02) != 0)
+			l_compression_state_high[word] |= mask;
+		else
+			l_compression_state_high[word] &= ~mask;
+
+		in_pos += count;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Finds the first byte with the searched state (PSG_STATE_FIND_...) in the in_pos..in_end-1 range, 64 bytes at a time
+// Returns the position of the byte or in_end if there is no such byte
+static int filePSGStateFind(int in_pos, int in_end, int in_search)
+{
+	int word;
+	int pos;
+	uint64_t bits;
+
+	if (in_pos >= in_end)
+		return in_end;
+
+	word = PSG_STATE_WORD(in_pos);
+	bits = ~(uint64_t)0 << PSG_STATE_BIT(in_pos);
+
+	while (true)
+	{
+		switch (in_search)
+		{
+			case PSG_STATE_FIND_USED:
+				bits &= l_compression_state_low[word] | l_compression_state_high[word];
+				break;
+
+			case PSG_STATE_FIND_COMPRESSED:
+				bits &= l_compression_state_high[word];
+				break;
+
+			default:
+				bits &= l_compression_state_high[word] & ~l_compression_state_low[word];
+				break;
+		}
+
+		if (bits != 0)
+			break;
+
+		word++;
+		if (word * PSG_STATE_WORD_BITS >= in_end)
+			return in_end;
+
+		bits = ~(uint64_t)0;
+	}
+
+	// index of the lowest set bit
+	pos = word * PSG_STATE_WORD_BITS + l_de_bruijn_bit_index[((bits & (~bits + 1)) * PSG_STATE_DE_BRUIJN) >> 58];
+
+	return (pos < in_end) ? pos : in_end;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Moves the state of in_count bytes to a lower position (compaction of the greedy matcher)
+static void filePSGStateMove(int in_to, int in_from, int in_count)
+{
+	int word;
+	int count;
+	uint64_t mask;
+
+	// the source bits are always above the written bits
+	while (in_count > 0)
+	{
+		word = PSG_STATE_WORD(in_to);
+		count = PSG_STATE_WORD_BITS - PSG_STATE_BIT(in_to);
+		if (count > in_count)
+			count = in_count;
+		mask = PSG_STATE_MASK(count);
+
+		l_compression_state_low[word] = (l_compression_state_low[word] & ~(mask << PSG_STATE_BIT(in_to))) | ((filePSGStateGetBits(l_compression_state_low, in_from) & mask) << PSG_STATE_BIT(in_to));
+		l_compression_state_high[word] = (l_compression_state_high[word] & ~(mask << PSG_STATE_BIT(in_to))) | ((filePSGStateGetBits(l_compression_state_high, in_from) & mask) << PSG_STATE_BIT(in_to));
+
+		in_to += count;
+		in_from += count;
+		in_count -= count;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets 64 bits of the state bit plane starting at the position
+static uint64_t filePSGStateGetBits(const uint64_t* in_plane, int in_pos)
+{
+	int word = PSG_STATE_WORD(in_pos);
+	int shift = PSG_STATE_BIT(in_pos);
+
+	if (shift == 0)
+		return in_plane[word];
+
+	return (in_plane[word] >> shift) | (in_plane[word + 1] << (PSG_STATE_WORD_BITS - shift));
+}
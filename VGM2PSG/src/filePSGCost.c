@@ -0,0 +1,514 @@
+/*****************************************************************************/
+/* VGM2PSG Z80 player cycle cost model                                       */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Include files
+#include <stdio.h>
+#include <string.h>
+#include <Main.h>
+#include <filePSG.h>
+#include <filePSGCost.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Cycle costs
+///////////////////////////////////////////////////////////////////////////////
+// T-states of the code paths of 'MusicPlayer_IT' in PSGTVC/psgplayer.a80. The
+// cost of a call contains the 'call MusicPlayer_IT' instruction and the final
+// 'ret', but not the interrupt handler of the application.
+///////////////////////////////////////////////////////////////////////////////
+
+// call, music status check, skip frames check and 'LPSGSkipFrame'
+#define PSG_COST_SKIP_FRAME 93
+// call, music status check, skip frames check and frequency changed flag reset
+#define PSG_COST_FRAME_START 83
+
+// 'LPSGFrameLoop': byte fetch and substring length handling
+#define PSG_COST_FETCH 74
+#define PSG_COST_FETCH_SUBSTRING 98
+#define PSG_COST_FETCH_SUBSTRING_END 125
+
+// 'LPSGProcessCommand': byte type decoding
+#define PSG_COST_DECODE_LATCH 23
+#define PSG_COST_DECODE_DATA 35
+#define PSG_COST_DECODE_COMMAND 35
+
+// 'LPSGSendToChip': sound card check (direct write or frequency recalculation)
+#define PSG_COST_CARD_DIRECT 32
+#define PSG_COST_CARD_GAME 27
+
+// 'NoFreqChange': chip write
+#define PSG_COST_CHIP_WRITE 39
+
+// Game Card register type decoding ('FreqChangeProcessLatchCommand' and data path)
+#define PSG_COST_GAME_LATCH 23
+#define PSG_COST_GAME_DATA 18
+#define PSG_COST_GAME_NOISE 32
+#define PSG_COST_GAME_VOLUME 47
+#define PSG_COST_GAME_TONE 56
+
+// 'UpdateFrequencyRegisterLow' and 'UpdateFrequencyRegisterHigh'
+#define PSG_COST_TONE_LOW 80
+#define PSG_COST_TONE_HIGH 122
+
+// 'LPSGCommand'
+#define PSG_COST_WAIT 19
+#define PSG_COST_WAIT_FRAMES 41
+#define PSG_COST_OTHER_COMMAND 26
+#define PSG_COST_SUBSTRING 134
+#define PSG_COST_END 75
+#define PSG_COST_LOOP 89
+#define PSG_COST_RESERVED 52
+
+// 'LPSGFrameDone'
+#define PSG_COST_FRAME_DONE_DIRECT 31
+#define PSG_COST_FRAME_DONE_GAME 25
+#define PSG_COST_CHANNEL_UNCHANGED 32
+#define PSG_COST_CHANNEL_CHANGED 80
+#define PSG_COST_LAST_CHANNEL_UNCHANGED 31
+#define PSG_COST_LAST_CHANNEL_CHANGED 71
+
+// 'RecalculateAndUpdateFrequency'
+#define PSG_COST_RECALCULATE_FAST 199
+#define PSG_COST_RECALCULATE_ACCURATE 368
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+#define PSG_LATCH 0x80
+#define PSG_DATA 0x40
+#define PSG_NOISE_REGISTER 0xe0
+#define PSG_VOLUME_BIT 0x10
+#define PSG_CHANNEL_MASK 0x60
+#define PSG_WAIT 0x38
+#define PSG_SUBSTRING 0x08
+#define PSG_SUBSTRING_MIN_LEN 4
+#define PSG_LOOP 0x01
+#define PSG_END 0x00
+#define PSG_CLOCK_TAG 0x06
+#define PSG_CLOCK_TAG_LENGTH 2
+
+#define PSG_TONE_CHANNEL_COUNT 3
+
+///////////////////////////////////////////////////////////////////////////////
+// Types
+
+// State of the modelled player
+typedef struct
+{
+	int Pointer;
+	int SubstringLength;
+	int SubstringReturn;
+	int LoopPoint;
+	int SkipFrames;
+	uint8_t LastLatch;
+	uint8_t FrequencyChanged;
+	uint32_t SubstringCount;
+
+	// position of the processed byte in the uncompressed stream
+	int DecodedPosition;
+	int LoopDecodedPosition;
+} PSGCostState;
+
+///////////////////////////////////////////////////////////////////////////////
+// Local functions
+static bool filePSGCostSimulate(uint8_t* in_buffer, int in_buffer_length, uint8_t* inout_locked, PSGCostResult* out_result);
+static uint32_t filePSGCostInterrupt(PSGCostState* in_state, uint8_t* in_buffer, int in_buffer_length, uint8_t* inout_locked, bool* out_new_lock, bool* out_end_reached);
+static uint32_t filePSGCostRegisterWrite(PSGCostState* in_state, uint8_t in_data);
+static uint32_t filePSGCostFrameDone(PSGCostState* in_state);
+
+///////////////////////////////////////////////////////////////////////////////
+// Module global variables
+static PSGCostPlayer l_player = PSG_COST_PLAYER_FAST;
+static int l_max_cycles = 0;
+static bool l_direct_write = false;		// tone values are written without recalculation (Sound Magic or clock tagged PSG for the Game Card)
+
+static const char* l_player_names[PSG_COST_PLAYER_COUNT] =
+{
+	"fast",
+	"accurate",
+	"direct"
+};
+
+static const char* l_player_descriptions[PSG_COST_PLAYER_COUNT] =
+{
+	"Game Card, fast frequency recalculation",
+	"Game Card, table based frequency recalculation",
+	"Sound Magic, no frequency recalculation"
+};
+
+// channel selection cost of the tone registers
+static const uint32_t l_channel_select_cost[PSG_TONE_CHANNEL_COUNT] = { 24, 55, 60 };
+
+///////////////////////////////////////////////////////////////////////////////
+// Sets the modelled player configuration
+void filePSGCostSetPlayer(PSGCostPlayer in_player)
+{
+	l_player = in_player;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sets the modelled player configuration by name (fast, accurate, direct)
+bool filePSGCostSetPlayerByName(char* in_name)
+{
+	int i;
+
+	for (i = 0; i < PSG_COST_PLAYER_COUNT; i++)
+	{
+		if (_strcmpi(in_name, l_player_names[i]) == 0)
+		{
+			l_player = (PSGCostPlayer)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets the modelled player configuration
+PSGCostPlayer filePSGCostGetPlayer(void)
+{
+	return l_player;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sets the maximum cycles of one player call (0 - no limit)
+void filePSGCostSetMaxCycles(int in_max_cycles)
+{
+	l_max_cycles = in_max_cycles;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets the maximum cycles of one player call (0 - no limit)
+int filePSGCostGetMaxCycles(void)
+{
+	return l_max_cycles;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Calculates the player cycles of one playthrough of the PSG file
+void filePSGCostAnalyze(uint8_t* in_buffer, int in_buffer_length, PSGCostResult* out_result)
+{
+	filePSGCostSimulate(in_buffer, in_buffer_length, NULL, out_result);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Marks the uncompressed stream positions of the calls above the maximum cycles
+// as locked. Returns true if new positions were locked.
+bool filePSGCostLockFrames(uint8_t* in_buffer, int in_buffer_length, uint8_t* inout_locked)
+{
+	PSGCostResult result;
+
+	return filePSGCostSimulate(in_buffer, in_buffer_length, inout_locked, &result);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Prints the cycle cost report
+void filePSGCostPrint(PSGCostResult* in_result, int in_framerate)
+{
+	uint32_t frame_cycles = PSG_COST_Z80_CLOCK / in_framerate;
+
+	if (l_direct_write && l_player != PSG_COST_PLAYER_DIRECT)
+		printf("Z80 player cost (Game Card, clock tagged PSG, no frequency recalculation):\n");
+	else
+		printf("Z80 player cost (%s):\n", l_player_descriptions[l_player]);
+	printf("  Interrupts:         %u (%u with PSG data, %u substrings)\n", in_result->InterruptCount, in_result->FrameCount, in_result->SubstringCount);
+
+	if (in_result->InterruptCount == 0)
+		return;
+
+	printf("  Worst case:         %u T-states (%.2f%% of frame) at interrupt %u (%.2fs)\n", in_result->WorstCycles, in_result->WorstCycles * 100.0 / frame_cycles,
+		in_result->WorstInterrupt, (double)in_result->WorstInterrupt / in_framerate);
+	printf("  Average:            %.1f T-states (%.2f%% of frame)\n", (double)in_result->TotalCycles / in_result->InterruptCount,
+		(double)in_result->TotalCycles * 100.0 / in_result->InterruptCount / frame_cycles);
+
+	if (in_result->FrameCount > 0)
+		printf("  Average with data:  %.1f T-states\n", (double)in_result->TotalCycles / in_result->FrameCount);
+
+	if (l_max_cycles > 0)
+		printf("  Budget:             %d T-states, %u interrupts above the budget\n", l_max_cycles, in_result->OverBudgetCount);
+}
+
+/*****************************************************************************/
+/* Local functions                                                           */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Plays the PSG file until the end of data mark is reached and collects the cycle
+// costs. Locks the positions of the calls above the maximum cycles if the lock
+// buffer is given (the call is processed again from its start state to find its
+// positions). Returns true if new positions were locked.
+static bool filePSGCostSimulate(uint8_t* in_buffer, int in_buffer_length, uint8_t* inout_locked, PSGCostResult* out_result)
+{
+	PSGCostState state;
+	PSGCostState call_state;
+	uint32_t cycles;
+	bool end_reached = false;
+	bool call_end_reached;
+	bool new_lock = false;
+
+	memset(out_result, 0, sizeof(PSGCostResult));
+	memset(&state, 0, sizeof(state));
+
+	// the clock tag is processed by 'StartMusic', the Game Card player writes the tone values directly if they are for its clock
+	l_direct_write = (l_player == PSG_COST_PLAYER_DIRECT);
+	if (in_buffer_length >= PSG_CLOCK_TAG_LENGTH && in_buffer[0] == PSG_CLOCK_TAG)
+	{
+		if (in_buffer[1] == PSG_CLOCK_TAG_3125KHZ)
+			l_direct_write = true;
+
+		state.Pointer = PSG_CLOCK_TAG_LENGTH;
+		state.LoopPoint = PSG_CLOCK_TAG_LENGTH;
+		state.DecodedPosition = PSG_CLOCK_TAG_LENGTH;
+		state.LoopDecodedPosition = PSG_CLOCK_TAG_LENGTH;
+	}
+
+	// the pointer moves only forward outside of the substrings until the end of data mark is reached
+	while (!end_reached && state.Pointer < in_buffer_length)
+	{
+		call_state = state;
+
+		if (state.SkipFrames > 0)
+		{
+			state.SkipFrames--;
+			cycles = PSG_COST_SKIP_FRAME;
+		}
+		else
+		{
+			cycles = filePSGCostInterrupt(&state, in_buffer, in_buffer_length, NULL, NULL, &end_reached);
+			out_result->FrameCount++;
+		}
+
+		if (cycles > out_result->WorstCycles)
+		{
+			out_result->WorstCycles = cycles;
+			out_result->WorstInterrupt = out_result->InterruptCount;
+		}
+
+		if (l_max_cycles > 0 && cycles > (uint32_t)l_max_cycles)
+		{
+			out_result->OverBudgetCount++;
+
+			// the skipped frames don't process PSG data
+			if (inout_locked != NULL && call_state.SkipFrames == 0)
+				filePSGCostInterrupt(&call_state, in_buffer, in_buffer_length, inout_locked, &new_lock, &call_end_reached);
+		}
+
+		out_result->TotalCycles += cycles;
+		out_result->InterruptCount++;
+	}
+
+	out_result->SubstringCount = state.SubstringCount;
+
+	return new_lock;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Calculates the cycles of one call which processes PSG data. Marks the processed
+// uncompressed stream positions as locked if the lock buffer is given.
+static uint32_t filePSGCostInterrupt(PSGCostState* in_state, uint8_t* in_buffer, int in_buffer_length, uint8_t* inout_locked, bool* out_new_lock, bool* out_end_reached)
+{
+	uint32_t cycles = PSG_COST_FRAME_START;
+	uint8_t data;
+	int length;
+	int byte_count = 0;
+
+	in_state->FrequencyChanged = 0;
+
+	while (in_state->Pointer < in_buffer_length)
+	{
+		// fetch byte
+		data = in_buffer[in_state->Pointer++];
+
+		if (in_state->SubstringLength == 0)
+		{
+			cycles += PSG_COST_FETCH;
+		}
+		else
+		{
+			in_state->SubstringLength--;
+			if (in_state->SubstringLength > 0)
+			{
+				cycles += PSG_COST_FETCH_SUBSTRING;
+			}
+			else
+			{
+				cycles += PSG_COST_FETCH_SUBSTRING_END;
+				in_state->Pointer = in_state->SubstringReturn;
+			}
+		}
+
+		// substring reference is not a byte of the uncompressed stream, it is locked together with the first byte of the string
+		if (inout_locked != NULL && !inout_locked[in_state->DecodedPosition])
+		{
+			inout_locked[in_state->DecodedPosition] = true;
+			*out_new_lock = true;
+		}
+		byte_count++;
+
+		if (data >= PSG_LATCH)
+		{
+			// latch
+			cycles += PSG_COST_DECODE_LATCH + filePSGCostRegisterWrite(in_state, data);
+			in_state->DecodedPosition++;
+		}
+		else
+		{
+			if (data >= PSG_DATA)
+			{
+				// data
+				cycles += PSG_COST_DECODE_DATA + filePSGCostRegisterWrite(in_state, data);
+				in_state->DecodedPosition++;
+			}
+			else
+			{
+				cycles += PSG_COST_DECODE_COMMAND;
+
+				if (data >= PSG_WAIT)
+				{
+					// end of frame
+					in_state->DecodedPosition++;
+
+					if (data == PSG_WAIT)
+					{
+						cycles += PSG_COST_WAIT;
+					}
+					else
+					{
+						cycles += PSG_COST_WAIT_FRAMES;
+						in_state->SkipFrames = data & 0x07;
+					}
+
+					return cycles + filePSGCostFrameDone(in_state);
+				}
+
+				cycles += PSG_COST_OTHER_COMMAND;
+
+				if (data >= PSG_SUBSTRING)
+				{
+					// substring reference
+					cycles += PSG_COST_SUBSTRING;
+
+					if (in_state->Pointer + 2 > in_buffer_length)
+						break;
+
+					length = data - PSG_SUBSTRING + PSG_SUBSTRING_MIN_LEN;
+					in_state->SubstringReturn = in_state->Pointer + 2;
+					in_state->Pointer = in_buffer[in_state->Pointer] + (in_buffer[in_state->Pointer + 1] << 8);
+					in_state->SubstringLength = length;
+					in_state->SubstringCount++;
+				}
+				else
+				{
+					if (data == PSG_END)
+					{
+						// end of data, continue from the loop point
+						cycles += PSG_COST_END;
+						in_state->Pointer = in_state->LoopPoint;
+						in_state->DecodedPosition = in_state->LoopDecodedPosition;
+						*out_end_reached = true;
+					}
+					else
+					{
+						in_state->DecodedPosition++;
+
+						if (data == PSG_LOOP)
+						{
+							// loop start
+							cycles += PSG_COST_LOOP;
+							in_state->LoopPoint = in_state->Pointer;
+							in_state->LoopDecodedPosition = in_state->DecodedPosition;
+						}
+						else
+						{
+							// reserved command, the player returns
+							return cycles + PSG_COST_RESERVED;
+						}
+					}
+				}
+			}
+		}
+
+		// the data after the end mark would be processed in an endless loop if there is no end of frame
+		if (byte_count >= FILE_BUFFER_LENGTH)
+			break;
+	}
+
+	return cycles;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Calculates the cycles of a latch or data byte ('LPSGSendToChip')
+static uint32_t filePSGCostRegisterWrite(PSGCostState* in_state, uint8_t in_data)
+{
+	uint8_t latch;
+	int channel;
+
+	if (l_direct_write)
+		return PSG_COST_CARD_DIRECT + PSG_COST_CHIP_WRITE;
+
+	if (in_data >= PSG_LATCH)
+	{
+		in_state->LastLatch = in_data;
+		latch = in_data;
+	}
+	else
+	{
+		latch = in_state->LastLatch;
+	}
+
+	// noise and volume registers are sent directly to the chip
+	if (latch >= PSG_NOISE_REGISTER)
+		return PSG_COST_CARD_GAME + ((in_data >= PSG_LATCH) ? PSG_COST_GAME_LATCH : PSG_COST_GAME_DATA) + PSG_COST_GAME_NOISE + PSG_COST_CHIP_WRITE;
+
+	if ((latch & PSG_VOLUME_BIT) != 0)
+		return PSG_COST_CARD_GAME + ((in_data >= PSG_LATCH) ? PSG_COST_GAME_LATCH : PSG_COST_GAME_DATA) + PSG_COST_GAME_VOLUME + PSG_COST_CHIP_WRITE;
+
+	// tone registers are stored in the register mirror, only the latch sets the changed flag
+	channel = (latch & PSG_CHANNEL_MASK) >> 5;
+	if (in_data >= PSG_LATCH)
+	{
+		in_state->FrequencyChanged |= 1 << channel;
+		return PSG_COST_CARD_GAME + PSG_COST_GAME_LATCH + PSG_COST_GAME_TONE + l_channel_select_cost[channel] + PSG_COST_TONE_LOW;
+	}
+	else
+	{
+		return PSG_COST_CARD_GAME + PSG_COST_GAME_DATA + PSG_COST_GAME_TONE + l_channel_select_cost[channel] + PSG_COST_TONE_HIGH;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Calculates the cycles of the end of the frame ('LPSGFrameDone')
+static uint32_t filePSGCostFrameDone(PSGCostState* in_state)
+{
+	uint32_t cycles;
+	uint32_t recalculate;
+	int channel;
+
+	if (l_direct_write)
+		return PSG_COST_FRAME_DONE_DIRECT;
+
+	recalculate = (l_player == PSG_COST_PLAYER_FAST) ? PSG_COST_RECALCULATE_FAST : PSG_COST_RECALCULATE_ACCURATE;
+
+	cycles = PSG_COST_FRAME_DONE_GAME;
+	for (channel = 0; channel < PSG_TONE_CHANNEL_COUNT - 1; channel++)
+	{
+		if ((in_state->FrequencyChanged & (1 << channel)) != 0)
+			cycles += PSG_COST_CHANNEL_CHANGED + recalculate;
+		else
+			cycles += PSG_COST_CHANNEL_UNCHANGED;
+	}
+
+	if ((in_state->FrequencyChanged & (1 << channel)) != 0)
+		cycles += PSG_COST_LAST_CHANNEL_CHANGED + recalculate;
+	else
+		cycles += PSG_COST_LAST_CHANNEL_UNCHANGED;
+
+	return cycles;
+}
@@ -0,0 +1,409 @@
+/*****************************************************************************/
+/* VGM2PSG Incremental PSG Compression                                       */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Include files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <Main.h>
+#include <filePSG.h>
+#include <filePSGCompress.h>
+#include <filePSGIncremental.h>
+#include <fileCache.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Incremental compression
+///////////////////////////////////////////////////////////////////////////////
+// The non compressed and the compressed PSG data of the previous conversion of
+// the same VGM file (same file name and conversion options) is stored in the
+// cache. The new non compressed data is compared to the previous one, the common
+// prefix and suffix are the unchanged part of the song:
+//
+// - the compressed items (literal bytes and references) of the unchanged prefix
+//   are copied without change,
+// - the changed part is compressed using the copied prefix as a dictionary
+//   (its literal bytes can be used as sources),
+// - the compressed items of the unchanged suffix are copied after the changed
+//   part. The references keep their source when it is in the prefix or in the
+//   copied literal bytes of the suffix (the offset is moved), the other
+//   references are replaced by their string.
+//
+// The compression ratio of the last full compression is stored as well. When the
+// incrementally compressed data is worse than this ratio by more than the
+// threshold, the full compression must be used.
+//
+// The buffers are allocated only when the incremental compression is used. The
+// previous conversion is kept from the start until the new conversion is
+// stored, the work buffers are sized to the new and the previous data.
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+#define PSG_INCREMENTAL_EXTENSION "inc"
+#define PSG_SUBSTRING_FIRST 0x08
+#define PSG_SUBSTRING_LAST 0x37
+#define PSG_SUBSTRING_MIN_LEN 4
+#define PSG_SUBSTRING_MAX_OFFSET 0xffff
+#define PSG_REFERENCE_LENGTH 3
+#define PSG_NO_POSITION -1
+#define PSG_INCREMENTAL_MAX_ENTRY_LENGTH (sizeof(PSGIncrementalHeader) + 2 * FILE_BUFFER_LENGTH)
+
+///////////////////////////////////////////////////////////////////////////////
+// Types
+
+// Header of the stored conversion (followed by the non compressed and the compressed data)
+typedef struct
+{
+	uint32_t UncompressedLength;
+	uint32_t CompressedLength;
+	uint32_t FullUncompressedLength;		// lengths of the last full compression (reference compression ratio)
+	uint32_t FullCompressedLength;
+} PSGIncrementalHeader;
+
+///////////////////////////////////////////////////////////////////////////////
+// Local functions
+static int filePSGIncrementalGetItemLength(uint8_t* in_buffer, int in_pos, int* out_string_length);
+static bool filePSGIncrementalAllocate(int in_buffer_length, int in_old_compressed_length);
+static void filePSGIncrementalFree(void);
+static void filePSGIncrementalFreePrevious(void);
+
+///////////////////////////////////////////////////////////////////////////////
+// Module global variables
+static uint64_t l_key;
+static int l_threshold = PSG_INCREMENTAL_DEFAULT_THRESHOLD;
+static bool l_previous_valid = false;
+static PSGIncrementalHeader l_previous;
+static uint8_t* l_previous_buffer = NULL;
+static uint8_t* l_previous_uncompressed;
+static uint8_t* l_previous_compressed;
+
+static uint8_t* l_result_buffer = NULL;
+static bool* l_result_source = NULL;
+static int* l_position_map = NULL;		// new position of the copied literal bytes of the previous compressed data
+
+///////////////////////////////////////////////////////////////////////////////
+// Loads the previous conversion of the key from the cache. Returns false if there is no usable previous conversion.
+bool filePSGIncrementalStart(uint64_t in_key, int in_threshold)
+{
+	int length;
+
+	l_key = in_key;
+	l_threshold = in_threshold;
+	l_previous_valid = false;
+
+	filePSGIncrementalFreePrevious();
+	l_previous_buffer = (uint8_t*)malloc(PSG_INCREMENTAL_MAX_ENTRY_LENGTH);
+	if (l_previous_buffer == NULL)
+		return false;
+
+	length = fileCacheLoadEntry(l_key, PSG_INCREMENTAL_EXTENSION, l_previous_buffer, PSG_INCREMENTAL_MAX_ENTRY_LENGTH);
+	if (length < (int)sizeof(PSGIncrementalHeader))
+	{
+		filePSGIncrementalFreePrevious();
+		return false;
+	}
+
+	memcpy(&l_previous, l_previous_buffer, sizeof(l_previous));
+	if (l_previous.UncompressedLength > FILE_BUFFER_LENGTH || l_previous.CompressedLength > FILE_BUFFER_LENGTH ||
+		length != (int)(sizeof(PSGIncrementalHeader) + l_previous.UncompressedLength + l_previous.CompressedLength) ||
+		l_previous.FullUncompressedLength == 0 || l_previous.FullCompressedLength == 0)
+	{
+		filePSGIncrementalFreePrevious();
+		return false;
+	}
+
+	l_previous_uncompressed = &l_previous_buffer[sizeof(PSGIncrementalHeader)];
+	l_previous_compressed = &l_previous_uncompressed[l_previous.UncompressedLength];
+	l_previous_valid = true;
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Compresses the non compressed PSG data using the previous conversion. Only the changed part is compressed again.
+// Returns the compressed length or -1 if the full compression must be used.
+int filePSGIncrementalCompress(uint8_t* inout_buffer, int in_buffer_length)
+{
+	uint8_t* old_uncompressed = l_previous_uncompressed;
+	uint8_t* old_compressed = l_previous_compressed;
+	int old_uncompressed_length = (int)l_previous.UncompressedLength;
+	int old_compressed_length = (int)l_previous.CompressedLength;
+	int header_length;
+	int prefix_length;
+	int suffix_length;
+	int upos;
+	int cpos;
+	int item_length;
+	int string_length;
+	int prefix_compressed_length;
+	int suffix_uncompressed_start;
+	int suffix_compressed_start;
+	int changed_start;
+	int changed_end;
+	int length;
+	int source;
+	int new_source;
+	int reused_length;
+	int expanded_count = 0;
+
+	if (!l_previous_valid)
+		return -1;
+
+	// unchanged prefix and suffix of the non compressed data (the header must be unchanged)
+	header_length = filePSGGetHeaderLength(inout_buffer, in_buffer_length);
+
+	prefix_length = 0;
+	while (prefix_length < old_uncompressed_length && prefix_length < in_buffer_length && old_uncompressed[prefix_length] == inout_buffer[prefix_length])
+		prefix_length++;
+
+	suffix_length = 0;
+	while (suffix_length < old_uncompressed_length - prefix_length && suffix_length < in_buffer_length - prefix_length &&
+		old_uncompressed[old_uncompressed_length - 1 - suffix_length] == inout_buffer[in_buffer_length - 1 - suffix_length])
+		suffix_length++;
+
+	if (prefix_length < header_length)
+	{
+		printf("\nIncremental compression: the header is changed");
+		return -1;
+	}
+
+	if (!filePSGIncrementalAllocate(in_buffer_length, old_compressed_length))
+	{
+		printf("\nIncremental compression: not enough memory");
+		return -1;
+	}
+
+	// copy the header and the compressed items of the prefix, the header and the literal bytes can be used as sources
+	memcpy(l_result_buffer, inout_buffer, header_length);
+	memset(l_result_source, true, header_length);
+
+	upos = header_length;
+	cpos = header_length;
+	while (cpos < old_compressed_length)
+	{
+		item_length = filePSGIncrementalGetItemLength(old_compressed, cpos, &string_length);
+		if (upos + string_length > prefix_length)
+			break;
+
+		memcpy(&l_result_buffer[cpos], &old_compressed[cpos], item_length);
+		memset(&l_result_source[cpos], item_length == 1, item_length);
+
+		upos += string_length;
+		cpos += item_length;
+	}
+
+	prefix_compressed_length = cpos;
+	changed_start = upos;
+
+	// find the first compressed item of the suffix
+	while (cpos < old_compressed_length && upos < old_uncompressed_length - suffix_length)
+	{
+		item_length = filePSGIncrementalGetItemLength(old_compressed, cpos, &string_length);
+
+		upos += string_length;
+		cpos += item_length;
+	}
+
+	suffix_uncompressed_start = upos;
+	suffix_compressed_start = cpos;
+	changed_end = suffix_uncompressed_start - old_uncompressed_length + in_buffer_length;
+
+	// compress the changed part after the prefix
+	length = prefix_compressed_length + changed_end - changed_start;
+	memcpy(&l_result_buffer[prefix_compressed_length], &inout_buffer[changed_start], changed_end - changed_start);
+	length = filePSGCompressPart(l_result_buffer, length, prefix_compressed_length, l_result_source);
+	if (length < 0)
+	{
+		filePSGIncrementalFree();
+		return -1;
+	}
+
+	reused_length = prefix_compressed_length;
+
+	// copy the suffix
+	upos = changed_end;
+	cpos = suffix_compressed_start;
+	while (cpos < old_compressed_length)
+	{
+		item_length = filePSGIncrementalGetItemLength(old_compressed, cpos, &string_length);
+
+		if (length + string_length > in_buffer_length)
+		{
+			filePSGIncrementalFree();
+			return -1;
+		}
+
+		if (item_length == 1)
+		{
+			// literal byte
+			l_position_map[cpos] = length;
+			l_result_buffer[length++] = old_compressed[cpos];
+			reused_length++;
+		}
+		else
+		{
+			// reference, the source must be in the prefix or in the copied bytes of the suffix
+			l_position_map[cpos] = PSG_NO_POSITION;
+			source = old_compressed[cpos + 1] | (old_compressed[cpos + 2] << 8);
+			new_source = PSG_NO_POSITION;
+
+			if (source + string_length <= prefix_compressed_length)
+			{
+				new_source = source;
+			}
+			else
+			{
+				if (source >= suffix_compressed_start && source + string_length <= cpos && l_position_map[source] != PSG_NO_POSITION &&
+					l_position_map[source + string_length - 1] == l_position_map[source] + string_length - 1 && l_position_map[source] <= PSG_SUBSTRING_MAX_OFFSET)
+					new_source = l_position_map[source];
+			}
+
+			if (new_source != PSG_NO_POSITION)
+			{
+				l_result_buffer[length] = old_compressed[cpos];
+				l_result_buffer[length + 1] = (uint8_t)(new_source & 0xff);
+				l_result_buffer[length + 2] = (uint8_t)(new_source >> 8);
+				length += PSG_REFERENCE_LENGTH;
+				reused_length += PSG_REFERENCE_LENGTH;
+			}
+			else
+			{
+				// the string of the reference from the new data
+				memcpy(&l_result_buffer[length], &inout_buffer[upos], string_length);
+				length += string_length;
+				expanded_count++;
+			}
+		}
+
+		upos += string_length;
+		cpos += item_length;
+	}
+
+	printf("\nIncremental compression: %d changed bytes (%d-%d), %d compressed bytes reused, %d references expanded",
+		changed_end - changed_start, changed_start, changed_end, reused_length, expanded_count);
+
+	// the compression ratio can't be worse than the full compression ratio by more than the threshold
+	if ((uint64_t)length * l_previous.FullUncompressedLength * 100 > (uint64_t)l_previous.FullCompressedLength * in_buffer_length * (100 + l_threshold))
+	{
+		printf("\nIncremental compression: %d bytes, the compression ratio is worse than the full compression by more than %d%%", length, l_threshold);
+		filePSGIncrementalFree();
+		return -1;
+	}
+
+	memcpy(inout_buffer, l_result_buffer, length);
+	filePSGIncrementalFree();
+
+	return length;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Stores the current conversion in the cache for the next incremental compression
+bool filePSGIncrementalFinish(uint8_t* in_uncompressed_buffer, int in_uncompressed_length, uint8_t* in_compressed_buffer, int in_compressed_length, bool in_full_compression)
+{
+	PSGIncrementalHeader header;
+	uint8_t* entry_buffer;
+	int entry_length;
+	bool success;
+
+	header.UncompressedLength = (uint32_t)in_uncompressed_length;
+	header.CompressedLength = (uint32_t)in_compressed_length;
+
+	// the reference ratio is changed only by the full compression, so the incremental results can't degrade it step by step
+	if (in_full_compression || !l_previous_valid)
+	{
+		header.FullUncompressedLength = (uint32_t)in_uncompressed_length;
+		header.FullCompressedLength = (uint32_t)in_compressed_length;
+	}
+	else
+	{
+		header.FullUncompressedLength = l_previous.FullUncompressedLength;
+		header.FullCompressedLength = l_previous.FullCompressedLength;
+	}
+
+	l_previous_valid = false;
+	filePSGIncrementalFreePrevious();
+
+	entry_length = (int)sizeof(header) + in_uncompressed_length + in_compressed_length;
+	entry_buffer = (uint8_t*)malloc(entry_length);
+	if (entry_buffer == NULL)
+		return false;
+
+	memcpy(entry_buffer, &header, sizeof(header));
+	memcpy(&entry_buffer[sizeof(header)], in_uncompressed_buffer, in_uncompressed_length);
+	memcpy(&entry_buffer[sizeof(header) + in_uncompressed_length], in_compressed_buffer, in_compressed_length);
+
+	success = fileCacheStoreEntry(l_key, PSG_INCREMENTAL_EXTENSION, entry_buffer, entry_length);
+	free(entry_buffer);
+
+	return success;
+}
+
+/*****************************************************************************/
+/* Local functions                                                           */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets the length of the compressed item (literal byte or reference) and the length of its non compressed string
+static int filePSGIncrementalGetItemLength(uint8_t* in_buffer, int in_pos, int* out_string_length)
+{
+	if (in_buffer[in_pos] >= PSG_SUBSTRING_FIRST && in_buffer[in_pos] <= PSG_SUBSTRING_LAST)
+	{
+		*out_string_length = in_buffer[in_pos] - PSG_SUBSTRING_FIRST + PSG_SUBSTRING_MIN_LEN;
+		return PSG_REFERENCE_LENGTH;
+	}
+	else
+	{
+		*out_string_length = 1;
+		return 1;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Allocates the work buffers of the incremental compression. The result is never longer than the new data (an item
+// of the suffix is not longer than its string), the position map has an entry for each previous compressed byte.
+static bool filePSGIncrementalAllocate(int in_buffer_length, int in_old_compressed_length)
+{
+	l_result_buffer = (uint8_t*)malloc(in_buffer_length + 1);
+	l_result_source = (bool*)malloc((in_buffer_length + 1) * sizeof(bool));
+	l_position_map = (int*)malloc((in_old_compressed_length + 1) * sizeof(int));
+
+	if (l_result_buffer == NULL || l_result_source == NULL || l_position_map == NULL)
+	{
+		filePSGIncrementalFree();
+		return false;
+	}
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Releases the work buffers of the incremental compression
+static void filePSGIncrementalFree(void)
+{
+	free(l_result_buffer);
+	free(l_result_source);
+	free(l_position_map);
+
+	l_result_buffer = NULL;
+	l_result_source = NULL;
+	l_position_map = NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Releases the loaded previous conversion
+static void filePSGIncrementalFreePrevious(void)
+{
+	free(l_previous_buffer);
+
+	l_previous_buffer = NULL;
+	l_previous_uncompressed = NULL;
+	l_previous_compressed = NULL;
+}
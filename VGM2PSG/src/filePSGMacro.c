@@ -0,0 +1,798 @@
+/*****************************************************************************/
+/* VGM2PSG PSG macro (instrument envelope) encoder                           */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Include files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <Main.h>
+#include <filePSG.h>
+#include <filePSGMacro.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Macro encoding
+///////////////////////////////////////////////////////////////////////////////
+// The non compressed PSG data is decoded into the register values and the
+// number of written bytes of every register in every frame (the wait frames are
+// expanded). The same attenuation envelopes and tone offset patterns (vibrato,
+// arpeggio, pitch slides relative to the note) are searched in the register
+// values of all channels. The pattern which saves the most bytes is stored in
+// the macro dictionary and its occurences are replaced by macro start commands
+// (the writes of the register are removed from the covered frames). This is
+// repeated until the dictionary is full or no pattern saves bytes.
+//
+// Macros never cross the loop start or the end of the data, and the macros of a
+// register never overlap, so the register values at the end of every frame are
+// the same as without macros.
+//
+// The frame tables are allocated for every encoding, sized to the number of the
+// decoded frames. The pattern hash table is sized to the number of the searched
+// windows (up to PSG_MACRO_HASH_MAX_BITS).
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+#define PSG_LATCH 0x80
+#define PSG_DATA 0x40
+#define PSG_WAIT 0x38
+#define PSG_LOOP 0x01
+#define PSG_END 0x00
+#define PSG_IS_LATCH(x) (((x) & PSG_LATCH) != 0)
+#define PSG_IS_DATA(x) (((x) & 0xc0) == PSG_DATA)
+#define PSG_IS_END_OF_FRAME(x) (((x) & 0xf8) == PSG_WAIT)
+#define PSG_READ_WAIT_COUNT(x) ((x) & 0x07)
+#define PSG_WRITE_END_OF_FRAME(w) (PSG_WAIT + ((w) & 0x07))
+#define PSG_MAX_WAIT_COUNT 7
+#define PSG_LATCH_REGISTER(x) (((x) >> 4) & 0x07)
+
+#define PSG_MACRO_REGISTER_COUNT 8
+#define PSG_MACRO_NOISE_CONTROL_REGISTER 6
+#define PSG_MACRO_IS_TONE_REGISTER(x) (((x) & 1) == 0)
+#define PSG_MACRO_SILENT_ATTENUATION 0x0f			// reset value of the attenuation registers (same as the encoder and the chip)
+#define PSG_MACRO_PARAMETER(r, i) (PSG_LATCH + (((r) >> 1) << 5) + (i))
+#define PSG_MACRO_START_LENGTH 2						// command and parameter
+#define PSG_MACRO_TONE_START_LENGTH 4				// command, parameter and base tone value
+#define PSG_MACRO_MIN_TONE_OFFSET -128
+#define PSG_MACRO_MAX_TONE_OFFSET 127
+#define PSG_MACRO_DICTIONARY_MAX_LENGTH (2 + PSG_MACRO_MAX_COUNT * (1 + PSG_MACRO_MAX_LENGTH))
+
+#define PSG_MACRO_HASH_MIN_BITS 10
+#define PSG_MACRO_HASH_MAX_BITS 19
+#define PSG_MACRO_HASH_MULTIPLIER 0x100000001b3ull
+#define PSG_MACRO_HASH_TONE_SALT 0x9e3779b97f4a7c15ull
+
+///////////////////////////////////////////////////////////////////////////////
+// Types
+
+// Register value pattern (hash table entry)
+typedef struct
+{
+	uint64_t Key;
+	uint32_t Generation;			// the entry is empty when it differs from the current generation
+	int Register;							// first occurence of the pattern
+	int Frame;
+	int Gain;									// bytes saved by the occurences (without the dictionary entry)
+	int LastRegister;					// last counted occurence (the occurences can't overlap on the same register)
+	int LastEnd;
+} PSGMacroPattern;
+
+// Macro of the dictionary
+typedef struct
+{
+	int Length;
+	bool Tone;
+	uint8_t Steps[PSG_MACRO_MAX_LENGTH];
+} PSGMacro;
+
+///////////////////////////////////////////////////////////////////////////////
+// Local functions
+static int filePSGMacroCountFrames(uint8_t* in_buffer, int in_start, int in_buffer_length);
+static bool filePSGMacroAllocate(int in_frame_count);
+static void filePSGMacroFree(void);
+static bool filePSGMacroDecodeFrames(uint8_t* in_buffer, int in_start, int in_buffer_length);
+static bool filePSGMacroFindBestPattern(int* out_register, int* out_frame, int* out_length);
+static void filePSGMacroApplyPattern(int in_register, int in_frame, int in_length);
+static int filePSGMacroWrite(uint8_t* in_buffer, int in_header_length, uint8_t* out_buffer);
+static void filePSGMacroUpdateFreeLength(int in_register);
+static int filePSGMacroGetWindowGain(int in_register, int in_frame, int in_length);
+static bool filePSGMacroIsToneWindow(int in_register, int in_frame, int in_length);
+static bool filePSGMacroIsSamePattern(int in_register1, int in_frame1, int in_register2, int in_frame2, int in_length);
+static PSGMacroPattern* filePSGMacroFindPattern(uint64_t in_key, int in_register, int in_frame, int in_length);
+
+///////////////////////////////////////////////////////////////////////////////
+// Module global variables
+
+// decoded frames (the register tables are allocated in one block per table, the rows are the registers)
+static uint16_t* l_values[PSG_MACRO_REGISTER_COUNT];
+static uint8_t* l_write_bytes[PSG_MACRO_REGISTER_COUNT];
+static int* l_frame_pos = NULL;
+static int* l_frame_length = NULL;
+static int l_frame_capacity = 0;
+static int l_frame_count;
+static int l_loop_frame;						// first frame of the loop (-1 - no loop)
+
+// macro coverage
+static bool* l_covered[PSG_MACRO_REGISTER_COUNT];
+static uint8_t* l_macro_start[PSG_MACRO_REGISTER_COUNT];	// macro index + 1 (0 - no macro)
+static int* l_free_length = NULL;
+
+// pattern search
+static PSGMacroPattern* l_patterns = NULL;
+static int l_hash_bits;
+static int l_hash_max_pattern_count;
+static uint32_t l_generation = 0;
+static int l_pattern_count;
+
+// macro dictionary
+static PSGMacro l_macros[PSG_MACRO_MAX_COUNT];
+static int l_macro_count = 0;
+
+static uint8_t* l_output_buffer = NULL;
+
+// statistics
+static int l_original_length = 0;
+static int l_encoded_length = 0;
+static uint32_t l_macro_start_count = 0;
+
+// searched macro lengths (in frames)
+static const int l_macro_lengths[] = { 3, 4, 5, 6, 8, 10, 12, 16, 20, 24, 32 };
+
+///////////////////////////////////////////////////////////////////////////////
+// Replaces the repeating register patterns of the non compressed PSG data by macros
+// Returns the new length of the data
+int filePSGMacroEncode(uint8_t* inout_buffer, int in_buffer_length)
+{
+	int header_length;
+	int length;
+	int pattern_register = 0;
+	int pattern_frame = 0;
+	int pattern_length = 0;
+
+	l_original_length = in_buffer_length;
+	l_encoded_length = in_buffer_length;
+	l_macro_count = 0;
+	l_macro_start_count = 0;
+
+	header_length = filePSGGetHeaderLength(inout_buffer, in_buffer_length);
+	if (!filePSGMacroAllocate(filePSGMacroCountFrames(inout_buffer, header_length, in_buffer_length)))
+	{
+		printf("Warning: Macro encoding is skipped, there is not enough memory.\n");
+		return in_buffer_length;
+	}
+
+	if (!filePSGMacroDecodeFrames(inout_buffer, header_length, in_buffer_length))
+	{
+		printf("Warning: Macro encoding is skipped, the PSG data can't be decoded.\n");
+		filePSGMacroFree();
+		return in_buffer_length;
+	}
+
+	// collect macros
+	while (l_macro_count < PSG_MACRO_MAX_COUNT && filePSGMacroFindBestPattern(&pattern_register, &pattern_frame, &pattern_length))
+		filePSGMacroApplyPattern(pattern_register, pattern_frame, pattern_length);
+
+	length = in_buffer_length;
+	if (l_macro_count > 0)
+	{
+		l_output_buffer = (uint8_t*)malloc(in_buffer_length + PSG_MACRO_DICTIONARY_MAX_LENGTH);
+		if (l_output_buffer == NULL)
+		{
+			printf("Warning: Macro encoding is skipped, there is not enough memory.\n");
+			l_macro_count = 0;
+			l_macro_start_count = 0;
+		}
+		else
+		{
+			length = filePSGMacroWrite(inout_buffer, header_length, l_output_buffer);
+			memcpy(inout_buffer, l_output_buffer, length);
+			l_encoded_length = length;
+		}
+	}
+
+	filePSGMacroFree();
+
+	return length;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Prints the number of macros and the size reduction
+void filePSGMacroPrintResult(void)
+{
+	printf("Macros: %d macros, %u macro starts, %d -> %d bytes (%.1f%% smaller)\n", l_macro_count, l_macro_start_count, l_original_length, l_encoded_length,
+		(l_original_length > 0) ? (l_original_length - l_encoded_length) * 100.0 / l_original_length : 0.0);
+}
+
+/*****************************************************************************/
+/* Local functions                                                           */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Counts the frames of the music data (including the wait frames)
+static int filePSGMacroCountFrames(uint8_t* in_buffer, int in_start, int in_buffer_length)
+{
+	int frame_count = 0;
+	int pos;
+
+	// the end of frame commands are never parameters of the other commands
+	for (pos = in_start; pos < in_buffer_length; pos++)
+	{
+		if (PSG_IS_END_OF_FRAME(in_buffer[pos]))
+			frame_count += PSG_READ_WAIT_COUNT(in_buffer[pos]) + 1;
+	}
+
+	return frame_count;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Allocates the frame tables for the number of frames and the pattern hash table for the searched windows
+// Returns false (nothing is allocated) if there is not enough memory
+static bool filePSGMacroAllocate(int in_frame_count)
+{
+	bool success;
+	int i;
+
+	// the hash table is at most 3/4 full when all windows of the registers are different patterns
+	l_hash_bits = PSG_MACRO_HASH_MIN_BITS;
+	while (l_hash_bits < PSG_MACRO_HASH_MAX_BITS && (1 << l_hash_bits) / 4 * 3 < in_frame_count * (PSG_MACRO_REGISTER_COUNT - 1))
+		l_hash_bits++;
+	l_hash_max_pattern_count = (1 << l_hash_bits) / 4 * 3;
+
+	// one more entry for the end of the free length table (and no zero length allocation)
+	l_frame_capacity = in_frame_count + 1;
+	l_values[0] = (uint16_t*)malloc((size_t)l_frame_capacity * PSG_MACRO_REGISTER_COUNT * sizeof(uint16_t));
+	l_write_bytes[0] = (uint8_t*)calloc((size_t)l_frame_capacity * PSG_MACRO_REGISTER_COUNT, sizeof(uint8_t));
+	l_covered[0] = (bool*)calloc((size_t)l_frame_capacity * PSG_MACRO_REGISTER_COUNT, sizeof(bool));
+	l_macro_start[0] = (uint8_t*)calloc((size_t)l_frame_capacity * PSG_MACRO_REGISTER_COUNT, sizeof(uint8_t));
+	l_frame_pos = (int*)malloc(l_frame_capacity * sizeof(int));
+	l_frame_length = (int*)malloc(l_frame_capacity * sizeof(int));
+	l_free_length = (int*)malloc(l_frame_capacity * sizeof(int));
+	l_patterns = (PSGMacroPattern*)calloc((size_t)1 << l_hash_bits, sizeof(PSGMacroPattern));
+
+	success = (l_values[0] != NULL && l_write_bytes[0] != NULL && l_covered[0] != NULL && l_macro_start[0] != NULL &&
+		l_frame_pos != NULL && l_frame_length != NULL && l_free_length != NULL && l_patterns != NULL);
+
+	if (!success)
+	{
+		filePSGMacroFree();
+		return false;
+	}
+
+	for (i = 1; i < PSG_MACRO_REGISTER_COUNT; i++)
+	{
+		l_values[i] = &l_values[0][i * l_frame_capacity];
+		l_write_bytes[i] = &l_write_bytes[0][i * l_frame_capacity];
+		l_covered[i] = &l_covered[0][i * l_frame_capacity];
+		l_macro_start[i] = &l_macro_start[0][i * l_frame_capacity];
+	}
+
+	l_generation = 0;
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Releases the frame tables and the pattern hash table
+static void filePSGMacroFree(void)
+{
+	free(l_values[0]);
+	free(l_write_bytes[0]);
+	free(l_covered[0]);
+	free(l_macro_start[0]);
+	free(l_frame_pos);
+	free(l_frame_length);
+	free(l_free_length);
+	free(l_patterns);
+	free(l_output_buffer);
+
+	memset(l_values, 0, sizeof(l_values));
+	memset(l_write_bytes, 0, sizeof(l_write_bytes));
+	memset(l_covered, 0, sizeof(l_covered));
+	memset(l_macro_start, 0, sizeof(l_macro_start));
+	l_frame_pos = NULL;
+	l_frame_length = NULL;
+	l_free_length = NULL;
+	l_patterns = NULL;
+	l_output_buffer = NULL;
+	l_frame_capacity = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Decodes the register values and the written bytes of every frame
+// Returns false if the data contains a command which is not created by the PSG encoder
+static bool filePSGMacroDecodeFrames(uint8_t* in_buffer, int in_start, int in_buffer_length)
+{
+	uint16_t registers[PSG_MACRO_REGISTER_COUNT];
+	int latched_register = -1;
+	int pos = in_start;
+	int frame_start = in_start;
+	int register_index;
+	int wait;
+	int i;
+	uint8_t command;
+
+	// the channels are silent before the first write
+	for (i = 0; i < PSG_MACRO_REGISTER_COUNT; i++)
+		registers[i] = PSG_MACRO_IS_TONE_REGISTER(i) ? 0 : PSG_MACRO_SILENT_ATTENUATION;
+
+	l_frame_count = 0;
+	l_loop_frame = -1;
+
+	while (pos < in_buffer_length)
+	{
+		command = in_buffer[pos++];
+
+		if (PSG_IS_LATCH(command))
+		{
+			// register latch command
+			latched_register = PSG_LATCH_REGISTER(command);
+
+			if (PSG_MACRO_IS_TONE_REGISTER(latched_register) && latched_register != PSG_MACRO_NOISE_CONTROL_REGISTER)
+				registers[latched_register] = (registers[latched_register] & 0x3f0) | (command & 0x0f);
+			else
+				registers[latched_register] = command & 0x0f;
+
+			l_write_bytes[latched_register][l_frame_count]++;
+		}
+		else
+		{
+			if (PSG_IS_DATA(command))
+			{
+				// data byte (tone high bits)
+				if (latched_register < 0)
+					return false;
+
+				registers[latched_register] = (registers[latched_register] & 0x0f) | ((command & 0x3f) << 4);
+				l_write_bytes[latched_register][l_frame_count]++;
+			}
+			else
+			{
+				if (PSG_IS_END_OF_FRAME(command))
+				{
+					// end of frame and wait frames
+					wait = PSG_READ_WAIT_COUNT(command);
+					if (l_frame_count + wait >= l_frame_capacity)
+						return false;
+
+					for (i = 0; i <= wait; i++)
+					{
+						l_frame_pos[l_frame_count] = (i == 0) ? frame_start : pos;
+						l_frame_length[l_frame_count] = (i == 0) ? pos - 1 - frame_start : 0;
+
+						for (register_index = 0; register_index < PSG_MACRO_REGISTER_COUNT; register_index++)
+							l_values[register_index][l_frame_count] = registers[register_index];
+
+						l_frame_count++;
+					}
+
+					frame_start = pos;
+				}
+				else
+				{
+					if (command == PSG_LOOP)
+					{
+						l_loop_frame = l_frame_count;
+						frame_start = pos;
+					}
+					else if (command == PSG_STEREO)
+					{
+						// stereo change, it is kept in the frame
+						pos += PSG_STEREO_LENGTH - 1;
+					}
+					else
+					{
+						// end of data after the last frame, the other commands (substrings, tags, macros) are not expected
+						return command == PSG_END && pos - 1 == frame_start;
+					}
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Finds the register pattern which saves the most bytes as a new macro
+// Returns false if no pattern saves bytes
+static bool filePSGMacroFindBestPattern(int* out_register, int* out_frame, int* out_length)
+{
+	int best_gain = 0;
+	int length_index;
+	int length;
+	int register_index;
+	int frame;
+	int window_bytes;
+	int gain;
+	int dictionary_length;
+	uint64_t hash;
+	uint64_t power;
+	uint64_t power_sum;
+	uint64_t key;
+	PSGMacroPattern* pattern;
+	uint16_t* values;
+	uint8_t* write_bytes;
+	bool tone;
+	int i;
+
+	for (length_index = 0; length_index < (int)(sizeof(l_macro_lengths) / sizeof(l_macro_lengths[0])); length_index++)
+	{
+		length = l_macro_lengths[length_index];
+		if (length > l_frame_count)
+			break;
+
+		// dictionary entry (and the dictionary header for the first macro)
+		dictionary_length = 1 + length + ((l_macro_count == 0) ? 2 : 0);
+
+		// new generation of the hash table (all entries are empty)
+		l_generation++;
+		l_pattern_count = 0;
+
+		// multiplier powers of the rolling hash
+		power = 1;
+		power_sum = 1;
+		for (i = 1; i < length; i++)
+		{
+			power *= PSG_MACRO_HASH_MULTIPLIER;
+			power_sum += power;
+		}
+
+		for (register_index = 0; register_index < PSG_MACRO_REGISTER_COUNT; register_index++)
+		{
+			if (register_index == PSG_MACRO_NOISE_CONTROL_REGISTER)
+				continue;
+
+			tone = PSG_MACRO_IS_TONE_REGISTER(register_index);
+			values = l_values[register_index];
+			write_bytes = l_write_bytes[register_index];
+
+			filePSGMacroUpdateFreeLength(register_index);
+
+			// first window
+			hash = 0;
+			window_bytes = 0;
+			for (i = 0; i < length; i++)
+			{
+				hash = hash * PSG_MACRO_HASH_MULTIPLIER + values[i];
+				window_bytes += write_bytes[i];
+			}
+
+			for (frame = 0; frame + length <= l_frame_count; frame++)
+			{
+				// move the window
+				if (frame > 0)
+				{
+					hash = (hash - values[frame - 1] * power) * PSG_MACRO_HASH_MULTIPLIER + values[frame + length - 1];
+					window_bytes += write_bytes[frame + length - 1] - write_bytes[frame - 1];
+				}
+
+				if (l_free_length[frame] < length)
+					continue;
+
+				gain = window_bytes - ((tone) ? PSG_MACRO_TONE_START_LENGTH : PSG_MACRO_START_LENGTH);
+				if (l_frame_length[frame] == 0)
+					gain--;		// the macro start splits the waiting
+
+				if (gain <= 0)
+					continue;
+
+				// tone patterns are the offsets from the first value
+				if (tone)
+				{
+					if (!filePSGMacroIsToneWindow(register_index, frame, length))
+						continue;
+
+					key = (hash - values[frame] * power_sum) ^ PSG_MACRO_HASH_TONE_SALT;
+				}
+				else
+				{
+					key = hash;
+				}
+
+				pattern = filePSGMacroFindPattern(key, register_index, frame, length);
+				if (pattern == NULL)
+					continue;
+
+				// overlapping occurence
+				if (pattern->LastRegister == register_index && frame < pattern->LastEnd)
+					continue;
+
+				pattern->Gain += gain;
+				pattern->LastRegister = register_index;
+				pattern->LastEnd = frame + length;
+
+				if (pattern->Gain - dictionary_length > best_gain)
+				{
+					best_gain = pattern->Gain - dictionary_length;
+					*out_register = pattern->Register;
+					*out_frame = pattern->Frame;
+					*out_length = length;
+				}
+			}
+		}
+	}
+
+	return best_gain > 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Stores the pattern as a new macro and replaces its occurences by macro starts
+static void filePSGMacroApplyPattern(int in_register, int in_frame, int in_length)
+{
+	PSGMacro* macro = &l_macros[l_macro_count];
+	int register_index;
+	int frame;
+	int i;
+
+	macro->Length = in_length;
+	macro->Tone = PSG_MACRO_IS_TONE_REGISTER(in_register);
+
+	for (i = 0; i < in_length; i++)
+	{
+		if (macro->Tone)
+			macro->Steps[i] = (uint8_t)(l_values[in_register][in_frame + i] - l_values[in_register][in_frame]);
+		else
+			macro->Steps[i] = (uint8_t)l_values[in_register][in_frame + i];
+	}
+
+	// the occurences are selected the same way as they are counted by the pattern search
+	for (register_index = 0; register_index < PSG_MACRO_REGISTER_COUNT; register_index++)
+	{
+		if (register_index == PSG_MACRO_NOISE_CONTROL_REGISTER || PSG_MACRO_IS_TONE_REGISTER(register_index) != macro->Tone)
+			continue;
+
+		filePSGMacroUpdateFreeLength(register_index);
+
+		for (frame = 0; frame + in_length <= l_frame_count; frame++)
+		{
+			if (l_free_length[frame] < in_length || !filePSGMacroIsSamePattern(in_register, in_frame, register_index, frame, in_length) ||
+				filePSGMacroGetWindowGain(register_index, frame, in_length) <= 0)
+				continue;
+
+			for (i = 0; i < in_length; i++)
+				l_covered[register_index][frame + i] = true;
+
+			l_macro_start[register_index][frame] = (uint8_t)(l_macro_count + 1);
+			l_macro_start_count++;
+
+			frame += in_length - 1;
+		}
+	}
+
+	l_macro_count++;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes the macro dictionary and the frames without the register writes covered by the macros
+// Returns the length of the written data
+static int filePSGMacroWrite(uint8_t* in_buffer, int in_header_length, uint8_t* out_buffer)
+{
+	int pos;
+	int stream_start;
+	int frame_start;
+	int frame;
+	int register_index;
+	int latched_register = 0;
+	int i;
+	int wait_count;
+	uint8_t command;
+	uint16_t base;
+
+	// header and macro dictionary
+	memcpy(out_buffer, in_buffer, in_header_length);
+	pos = in_header_length;
+
+	out_buffer[pos++] = PSG_MACRO;
+	out_buffer[pos++] = (uint8_t)l_macro_count;
+
+	for (i = 0; i < l_macro_count; i++)
+	{
+		out_buffer[pos++] = (uint8_t)(((l_macros[i].Tone) ? PSG_MACRO_TONE : 0) | l_macros[i].Length);
+		memcpy(&out_buffer[pos], l_macros[i].Steps, l_macros[i].Length);
+		pos += l_macros[i].Length;
+	}
+
+	stream_start = pos;
+
+	if (l_loop_frame == 0)
+		out_buffer[pos++] = PSG_LOOP;
+
+	for (frame = 0; frame < l_frame_count; frame++)
+	{
+		frame_start = pos;
+
+		// register writes which are not covered by a macro
+		for (i = l_frame_pos[frame]; i < l_frame_pos[frame] + l_frame_length[frame]; i++)
+		{
+			command = in_buffer[i];
+
+			// stereo change (its parameters are not register writes)
+			if (command == PSG_STEREO)
+			{
+				memcpy(&out_buffer[pos], &in_buffer[i], PSG_STEREO_LENGTH);
+				pos += PSG_STEREO_LENGTH;
+				i += PSG_STEREO_LENGTH - 1;
+				continue;
+			}
+
+			if (PSG_IS_LATCH(command))
+				latched_register = PSG_LATCH_REGISTER(command);
+
+			if (!l_covered[latched_register][frame])
+				out_buffer[pos++] = command;
+		}
+
+		// macro starts
+		for (register_index = 0; register_index < PSG_MACRO_REGISTER_COUNT; register_index++)
+		{
+			if (l_macro_start[register_index][frame] == 0)
+				continue;
+
+			out_buffer[pos++] = PSG_MACRO;
+			out_buffer[pos++] = PSG_MACRO_PARAMETER(register_index, l_macro_start[register_index][frame] - 1);
+
+			// base tone value
+			if (PSG_MACRO_IS_TONE_REGISTER(register_index))
+			{
+				base = l_values[register_index][frame];
+				out_buffer[pos++] = PSG_DATA + (base & 0x0f);
+				out_buffer[pos++] = PSG_DATA + ((base >> 4) & 0x3f);
+			}
+		}
+
+		// close frame (the same way as the PSG encoder)
+		if (pos > frame_start)
+		{
+			out_buffer[pos++] = PSG_WRITE_END_OF_FRAME(0);
+		}
+		else
+		{
+			if (pos > stream_start && PSG_IS_END_OF_FRAME(out_buffer[pos - 1]) && PSG_READ_WAIT_COUNT(out_buffer[pos - 1]) < PSG_MAX_WAIT_COUNT)
+			{
+				wait_count = PSG_READ_WAIT_COUNT(out_buffer[pos - 1]) + 1;
+				out_buffer[pos - 1] = PSG_WRITE_END_OF_FRAME(wait_count);
+			}
+			else
+			{
+				out_buffer[pos++] = PSG_WRITE_END_OF_FRAME(0);
+			}
+		}
+
+		if (frame + 1 == l_loop_frame)
+			out_buffer[pos++] = PSG_LOOP;
+	}
+
+	out_buffer[pos++] = PSG_END;
+
+	return pos;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Updates the number of consecutive frames without macro from every frame of the register
+// (the free frames are counted only until the end of the loop segment)
+static void filePSGMacroUpdateFreeLength(int in_register)
+{
+	int frame;
+
+	l_free_length[l_frame_count] = 0;
+
+	for (frame = l_frame_count - 1; frame >= 0; frame--)
+	{
+		if (l_covered[in_register][frame])
+			l_free_length[frame] = 0;
+		else
+			l_free_length[frame] = (frame + 1 == l_loop_frame) ? 1 : l_free_length[frame + 1] + 1;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets the number of bytes saved by replacing the writes of the frames by a macro start
+static int filePSGMacroGetWindowGain(int in_register, int in_frame, int in_length)
+{
+	int gain = (PSG_MACRO_IS_TONE_REGISTER(in_register)) ? -PSG_MACRO_TONE_START_LENGTH : -PSG_MACRO_START_LENGTH;
+	int i;
+
+	if (l_frame_length[in_frame] == 0)
+		gain--;
+
+	for (i = 0; i < in_length; i++)
+		gain += l_write_bytes[in_register][in_frame + i];
+
+	return gain;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns true if the tone values of the frames can be given as offsets from the first value
+static bool filePSGMacroIsToneWindow(int in_register, int in_frame, int in_length)
+{
+	int base = l_values[in_register][in_frame];
+	int offset;
+	int i;
+
+	for (i = 1; i < in_length; i++)
+	{
+		offset = l_values[in_register][in_frame + i] - base;
+		if (offset < PSG_MACRO_MIN_TONE_OFFSET || offset > PSG_MACRO_MAX_TONE_OFFSET)
+			return false;
+	}
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns true if the two register windows have the same macro steps
+static bool filePSGMacroIsSamePattern(int in_register1, int in_frame1, int in_register2, int in_frame2, int in_length)
+{
+	uint16_t* values1 = &l_values[in_register1][in_frame1];
+	uint16_t* values2 = &l_values[in_register2][in_frame2];
+	int i;
+
+	if (PSG_MACRO_IS_TONE_REGISTER(in_register1) != PSG_MACRO_IS_TONE_REGISTER(in_register2))
+		return false;
+
+	if (PSG_MACRO_IS_TONE_REGISTER(in_register1))
+	{
+		if (!filePSGMacroIsToneWindow(in_register2, in_frame2, in_length))
+			return false;
+
+		for (i = 1; i < in_length; i++)
+		{
+			if (values1[i] - values1[0] != values2[i] - values2[0])
+				return false;
+		}
+	}
+	else
+	{
+		for (i = 0; i < in_length; i++)
+		{
+			if (values1[i] != values2[i])
+				return false;
+		}
+	}
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Finds the pattern in the hash table, or creates a new entry for it
+// Returns NULL if the hash table is full
+static PSGMacroPattern* filePSGMacroFindPattern(uint64_t in_key, int in_register, int in_frame, int in_length)
+{
+	uint32_t index = (uint32_t)(in_key >> (64 - l_hash_bits));
+	PSGMacroPattern* pattern;
+
+	while (true)
+	{
+		pattern = &l_patterns[index];
+
+		// empty entry -> new pattern
+		if (pattern->Generation != l_generation)
+		{
+			if (l_pattern_count >= l_hash_max_pattern_count)
+				return NULL;
+
+			pattern->Key = in_key;
+			pattern->Generation = l_generation;
+			pattern->Register = in_register;
+			pattern->Frame = in_frame;
+			pattern->Gain = 0;
+			pattern->LastRegister = -1;
+			pattern->LastEnd = 0;
+			l_pattern_count++;
+
+			return pattern;
+		}
+
+		if (pattern->Key == in_key && filePSGMacroIsSamePattern(pattern->Register, pattern->Frame, in_register, in_frame, in_length))
+			return pattern;
+
+		index = (index + 1) & ((1 << l_hash_bits) - 1);
+	}
+}
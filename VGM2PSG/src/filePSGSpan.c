@@ -0,0 +1,530 @@
+/*****************************************************************************/
+/* VGM2PSG Repeated Frame Span Encoder                                       */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Include files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <Main.h>
+#include <filePSG.h>
+#include <filePSGCompress.h>
+#include <filePSGSpan.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Frame span encoding
+///////////////////////////////////////////////////////////////////////////////
+// Songs often repeat whole patterns, which are hundreds of bytes of the same
+// frames. The substrings are at most 51 bytes long, so every repetition costs
+// many references. The non compressed PSG data is split into frames (ending with
+// the end of frame command) before the compression, and the repeated frame
+// sequences are searched by a rolling hash of the frame hashes over a window of
+// frames. The frames of the window are compared when the hash is found in the
+// hash table, then the match is extended frame by frame. Every frame is processed
+// once, so the search is linear.
+//
+// The repeated frames are replaced by a long substring command (extended format:
+// 0x05, length word, offset word), its source is the first occurence of the frames
+// in the compressed data. The source can contain substring references (the
+// decoder handles one level of nesting), but not long substrings. The compressor
+// can't replace the command (and can't use it as a source), and the bytes before
+// the first and the last byte of every source are locked, so no substring crosses
+// the boundaries of the source. After the compression the length and the offset of
+// the commands are set to the compressed position of their source.
+//
+// The frames containing the loop start or the end of data are never part of a span.
+//
+// The frame tables are allocated for every compression, sized to the number of
+// the frames, the encoded data and the span table are sized to the data length.
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+#define PSG_LOOP 0x01
+#define PSG_END 0x00
+#define PSG_IS_END_OF_FRAME(x) (((x) & 0xf8) == 0x38)
+#define PSG_SUBSTRING_FIRST 0x08
+#define PSG_SUBSTRING_LAST 0x37
+#define PSG_SUBSTRING_MIN_LEN 4
+#define PSG_REFERENCE_LENGTH 3
+
+#define PSG_SPAN_WINDOW_FRAMES 8						// number of frames of the rolling hash
+#define PSG_SPAN_MIN_LENGTH 48							// shorter spans are left to the substring compression
+#define PSG_SPAN_MAX_END 0x10000						// the offset and the length of the long substring are words
+#define PSG_SPAN_CHAIN_DEPTH 16
+#define PSG_SPAN_HASH_BITS 16
+#define PSG_SPAN_HASH_SIZE (1 << PSG_SPAN_HASH_BITS)
+#define PSG_SPAN_HASH_MULTIPLIER 0x01000193u
+#define PSG_SPAN_FNV_OFFSET_BASIS 0x811c9dc5u
+#define PSG_SPAN_NO_FRAME -1
+
+///////////////////////////////////////////////////////////////////////////////
+// Types
+
+// Repeated frame span
+typedef struct
+{
+	int Frame;									// first repeated frame
+	int SourceFrame;						// first frame of the source
+	int FrameCount;
+	int Position;								// position of the long substring command in the encoded data
+	int SourceStart;						// first and behind the last byte of the source in the encoded data
+	int SourceEnd;
+} PSGSpan;
+
+///////////////////////////////////////////////////////////////////////////////
+// Local functions
+static int filePSGSpanCountFrames(uint8_t* in_buffer, int in_start, int in_buffer_length);
+static bool filePSGSpanAllocate(int in_buffer_length, int in_frame_count);
+static void filePSGSpanFree(void);
+static int filePSGSpanFindFrames(uint8_t* in_buffer, int in_start, int in_buffer_length);
+static void filePSGSpanFindRepeats(uint8_t* in_buffer, int in_header_length);
+static void filePSGSpanInsertWindow(int in_frame);
+static bool filePSGSpanIsSameFrame(uint8_t* in_buffer, int in_frame1, int in_frame2);
+static int filePSGSpanEncode(uint8_t* in_buffer, int in_header_length, uint8_t* out_buffer);
+static void filePSGSpanResolve(uint8_t* inout_buffer, int in_header_length, int in_encoded_length, int in_compressed_length);
+
+///////////////////////////////////////////////////////////////////////////////
+// Module global variables
+static int* l_frame_start = NULL;
+static uint32_t* l_frame_hash = NULL;
+static uint32_t* l_window_hash = NULL;
+static int* l_unusable_count = NULL;		// number of the frames with loop start or end of data before the frame
+static bool* l_frame_replaced = NULL;
+static int* l_frame_new_start = NULL;			// position of the frame in the encoded data
+static int l_frame_count;
+
+static int* l_hash_head = NULL;
+static int* l_hash_prev = NULL;
+
+static PSGSpan* l_spans = NULL;
+static int l_span_capacity = 0;
+static int l_span_count = 0;
+
+static uint8_t* l_encoded_buffer = NULL;
+static uint8_t* l_locks = NULL;
+static int* l_position_map = NULL;		// compressed position of the encoded data
+
+static int l_original_length = 0;
+static int l_replaced_length = 0;
+static int l_compressed_length = 0;
+
+///////////////////////////////////////////////////////////////////////////////
+// Replaces the repeated frame spans of the non compressed PSG data by long substrings and compresses the data
+// Returns the compressed length (-1 if there is not enough memory)
+int filePSGSpanCompress(uint8_t* inout_buffer, int in_buffer_length)
+{
+	int header_length;
+	int length;
+
+	l_original_length = in_buffer_length;
+	l_replaced_length = 0;
+	l_span_count = 0;
+
+	header_length = filePSGGetHeaderLength(inout_buffer, in_buffer_length);
+	if (!filePSGSpanAllocate(in_buffer_length, filePSGSpanCountFrames(inout_buffer, header_length, in_buffer_length)))
+	{
+		printf("\nERROR: Not enough memory for the frame span encoding of %d bytes.\n", in_buffer_length);
+		return -1;
+	}
+
+	l_frame_count = filePSGSpanFindFrames(inout_buffer, header_length, in_buffer_length);
+	filePSGSpanFindRepeats(inout_buffer, header_length);
+
+	if (l_span_count == 0)
+	{
+		filePSGSpanFree();
+		l_compressed_length = filePSGCompress(inout_buffer, in_buffer_length);
+		return l_compressed_length;
+	}
+
+	length = filePSGSpanEncode(inout_buffer, header_length, l_encoded_buffer);
+	memcpy(inout_buffer, l_encoded_buffer, length);
+
+	l_compressed_length = filePSGCompressWithLocks(inout_buffer, length, l_locks);
+	if (l_compressed_length >= 0)
+		filePSGSpanResolve(inout_buffer, header_length, length, l_compressed_length);
+
+	filePSGSpanFree();
+
+	return l_compressed_length;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Prints the number of spans and the replaced bytes
+void filePSGSpanPrintResult(void)
+{
+	printf("Spans: %d repeated frame spans, %d of %d bytes replaced by long substrings\n", l_span_count, l_replaced_length, l_original_length);
+}
+
+/*****************************************************************************/
+/* Local functions                                                           */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Counts the frames of the music data (the last frame ends at the end of the data)
+static int filePSGSpanCountFrames(uint8_t* in_buffer, int in_start, int in_buffer_length)
+{
+	int frame_count = 0;
+	int pos;
+
+	for (pos = in_start; pos < in_buffer_length; pos++)
+	{
+		if (PSG_IS_END_OF_FRAME(in_buffer[pos]) || pos == in_buffer_length - 1)
+			frame_count++;
+	}
+
+	return frame_count;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Allocates the frame tables for the number of frames and the encoding buffers for the data length
+// Returns false (nothing is allocated) if there is not enough memory
+static bool filePSGSpanAllocate(int in_buffer_length, int in_frame_count)
+{
+	// every span replaces at least PSG_SPAN_MIN_LENGTH bytes
+	l_span_capacity = in_buffer_length / PSG_SPAN_MIN_LENGTH + 1;
+
+	l_frame_start = (int*)malloc((in_frame_count + 1) * sizeof(int));
+	l_frame_hash = (uint32_t*)malloc((in_frame_count + 1) * sizeof(uint32_t));
+	l_window_hash = (uint32_t*)malloc((in_frame_count + 1) * sizeof(uint32_t));
+	l_unusable_count = (int*)malloc((in_frame_count + 1) * sizeof(int));
+	l_frame_replaced = (bool*)malloc((in_frame_count + 1) * sizeof(bool));
+	l_frame_new_start = (int*)malloc((in_frame_count + 1) * sizeof(int));
+	l_hash_head = (int*)malloc(PSG_SPAN_HASH_SIZE * sizeof(int));
+	l_hash_prev = (int*)malloc((in_frame_count + 1) * sizeof(int));
+	l_spans = (PSGSpan*)malloc(l_span_capacity * sizeof(PSGSpan));
+	l_encoded_buffer = (uint8_t*)malloc(in_buffer_length + 1);
+	l_locks = (uint8_t*)malloc(in_buffer_length + 1);
+	l_position_map = (int*)malloc((in_buffer_length + 1) * sizeof(int));
+
+	if (l_frame_start == NULL || l_frame_hash == NULL || l_window_hash == NULL || l_unusable_count == NULL || l_frame_replaced == NULL || l_frame_new_start == NULL ||
+		l_hash_head == NULL || l_hash_prev == NULL || l_spans == NULL || l_encoded_buffer == NULL || l_locks == NULL || l_position_map == NULL)
+	{
+		filePSGSpanFree();
+		return false;
+	}
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Releases the frame tables and the encoding buffers
+static void filePSGSpanFree(void)
+{
+	free(l_frame_start);
+	free(l_frame_hash);
+	free(l_window_hash);
+	free(l_unusable_count);
+	free(l_frame_replaced);
+	free(l_frame_new_start);
+	free(l_hash_head);
+	free(l_hash_prev);
+	free(l_spans);
+	free(l_encoded_buffer);
+	free(l_locks);
+	free(l_position_map);
+
+	l_frame_start = NULL;
+	l_frame_hash = NULL;
+	l_window_hash = NULL;
+	l_unusable_count = NULL;
+	l_frame_replaced = NULL;
+	l_frame_new_start = NULL;
+	l_hash_head = NULL;
+	l_hash_prev = NULL;
+	l_spans = NULL;
+	l_encoded_buffer = NULL;
+	l_locks = NULL;
+	l_position_map = NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Splits the music data into frames, calculates the frame hashes and the rolling window hashes
+// Returns the number of frames
+static int filePSGSpanFindFrames(uint8_t* in_buffer, int in_start, int in_buffer_length)
+{
+	uint32_t hash = PSG_SPAN_FNV_OFFSET_BASIS;
+	uint32_t window_hash = 0;
+	uint32_t power = 1;
+	bool usable = true;
+	int frame_count = 0;
+	int pos;
+	int i;
+
+	l_frame_start[0] = in_start;
+	l_unusable_count[0] = 0;
+
+	for (pos = in_start; pos < in_buffer_length; pos++)
+	{
+		hash = (hash ^ in_buffer[pos]) * PSG_SPAN_HASH_MULTIPLIER;
+		if (in_buffer[pos] == PSG_LOOP || in_buffer[pos] == PSG_END)
+			usable = false;
+
+		// the last frame ends at the end of the data
+		if (PSG_IS_END_OF_FRAME(in_buffer[pos]) || pos == in_buffer_length - 1)
+		{
+			l_frame_hash[frame_count] = hash;
+			l_unusable_count[frame_count + 1] = l_unusable_count[frame_count] + ((usable) ? 0 : 1);
+			frame_count++;
+			l_frame_start[frame_count] = pos + 1;
+
+			hash = PSG_SPAN_FNV_OFFSET_BASIS;
+			usable = true;
+		}
+	}
+
+	// rolling hash of the frame hashes of the windows
+	for (i = 0; i < PSG_SPAN_WINDOW_FRAMES - 1; i++)
+		power *= PSG_SPAN_HASH_MULTIPLIER;
+
+	for (i = 0; i < frame_count; i++)
+	{
+		if (i >= PSG_SPAN_WINDOW_FRAMES)
+			window_hash -= l_frame_hash[i - PSG_SPAN_WINDOW_FRAMES] * power;
+
+		window_hash = window_hash * PSG_SPAN_HASH_MULTIPLIER + l_frame_hash[i];
+
+		if (i >= PSG_SPAN_WINDOW_FRAMES - 1)
+			l_window_hash[i - PSG_SPAN_WINDOW_FRAMES + 1] = window_hash;
+	}
+
+	return frame_count;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Finds the repeated frame spans from the beginning to the end of the data
+static void filePSGSpanFindRepeats(uint8_t* in_buffer, int in_header_length)
+{
+	int frame = 0;
+	int next_window = 0;
+	int new_position = in_header_length;
+	int candidate;
+	int chain_depth;
+	int count;
+	int best_count;
+	int best_source;
+	int i;
+
+	for (i = 0; i < PSG_SPAN_HASH_SIZE; i++)
+		l_hash_head[i] = PSG_SPAN_NO_FRAME;
+
+	memset(l_frame_replaced, false, l_frame_count * sizeof(bool));
+
+	while (frame < l_frame_count)
+	{
+		// the windows ending before the current frame can be sources
+		while (next_window + PSG_SPAN_WINDOW_FRAMES <= frame)
+			filePSGSpanInsertWindow(next_window++);
+
+		best_count = 0;
+		best_source = PSG_SPAN_NO_FRAME;
+
+		if (frame + PSG_SPAN_WINDOW_FRAMES <= l_frame_count && l_unusable_count[frame + PSG_SPAN_WINDOW_FRAMES] == l_unusable_count[frame] && l_span_count < l_span_capacity)
+		{
+			candidate = l_hash_head[l_window_hash[frame] & (PSG_SPAN_HASH_SIZE - 1)];
+			chain_depth = PSG_SPAN_CHAIN_DEPTH;
+			while (candidate != PSG_SPAN_NO_FRAME && chain_depth > 0)
+			{
+				// compare the window, then extend the match (the source ends before the repeated frames)
+				count = 0;
+				if (l_window_hash[candidate] == l_window_hash[frame])
+				{
+					while (count < PSG_SPAN_WINDOW_FRAMES && filePSGSpanIsSameFrame(in_buffer, candidate + count, frame + count))
+						count++;
+
+					if (count == PSG_SPAN_WINDOW_FRAMES)
+					{
+						while (frame + count < l_frame_count && candidate + count < frame && !l_frame_replaced[candidate + count] &&
+							l_unusable_count[frame + count + 1] == l_unusable_count[frame + count] && filePSGSpanIsSameFrame(in_buffer, candidate + count, frame + count))
+						{
+							count++;
+						}
+					}
+					else
+					{
+						count = 0;
+					}
+				}
+
+				// the source must be addressable by the long substring
+				while (count > 0 && l_frame_new_start[candidate] + l_frame_start[candidate + count] - l_frame_start[candidate] > PSG_SPAN_MAX_END)
+					count--;
+
+				if (count > best_count && l_frame_start[frame + count] - l_frame_start[frame] >= PSG_SPAN_MIN_LENGTH)
+				{
+					best_count = count;
+					best_source = candidate;
+				}
+
+				candidate = l_hash_prev[candidate];
+				chain_depth--;
+			}
+		}
+
+		l_frame_new_start[frame] = new_position;
+
+		if (best_count > 0)
+		{
+			// replace the repeated frames
+			l_spans[l_span_count].Frame = frame;
+			l_spans[l_span_count].SourceFrame = best_source;
+			l_spans[l_span_count].FrameCount = best_count;
+			l_span_count++;
+
+			l_replaced_length += l_frame_start[frame + best_count] - l_frame_start[frame];
+			memset(&l_frame_replaced[frame], true, best_count * sizeof(bool));
+
+			new_position += PSG_LONG_SUBSTRING_LENGTH;
+			frame += best_count;
+		}
+		else
+		{
+			new_position += l_frame_start[frame + 1] - l_frame_start[frame];
+			frame++;
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Adds the window to the hash table if all of its frames can be used as a source
+static void filePSGSpanInsertWindow(int in_frame)
+{
+	uint32_t hash_index;
+	int i;
+
+	if (l_unusable_count[in_frame + PSG_SPAN_WINDOW_FRAMES] != l_unusable_count[in_frame])
+		return;
+
+	for (i = 0; i < PSG_SPAN_WINDOW_FRAMES; i++)
+	{
+		if (l_frame_replaced[in_frame + i])
+			return;
+	}
+
+	hash_index = l_window_hash[in_frame] & (PSG_SPAN_HASH_SIZE - 1);
+	l_hash_prev[in_frame] = l_hash_head[hash_index];
+	l_hash_head[hash_index] = in_frame;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns true if the content of the frames is the same
+static bool filePSGSpanIsSameFrame(uint8_t* in_buffer, int in_frame1, int in_frame2)
+{
+	int length = l_frame_start[in_frame1 + 1] - l_frame_start[in_frame1];
+
+	if (l_frame_hash[in_frame1] != l_frame_hash[in_frame2] || l_frame_start[in_frame2 + 1] - l_frame_start[in_frame2] != length)
+		return false;
+
+	return memcmp(&in_buffer[l_frame_start[in_frame1]], &in_buffer[l_frame_start[in_frame2]], length) == 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes the data with the long substring commands (the offsets are set after the compression) and the locked bytes
+// Returns the length of the encoded data
+static int filePSGSpanEncode(uint8_t* in_buffer, int in_header_length, uint8_t* out_buffer)
+{
+	PSGSpan* span = l_spans;
+	int frame = 0;
+	int pos = in_header_length;
+	int length;
+	int i;
+
+	memcpy(out_buffer, in_buffer, in_header_length);
+
+	while (frame < l_frame_count)
+	{
+		if (span < &l_spans[l_span_count] && span->Frame == frame)
+		{
+			// long substring command (can't be compressed)
+			span->Position = pos;
+			span->SourceStart = l_frame_new_start[span->SourceFrame];
+			span->SourceEnd = span->SourceStart + l_frame_start[span->SourceFrame + span->FrameCount] - l_frame_start[span->SourceFrame];
+
+			memset(&out_buffer[pos], 0, PSG_LONG_SUBSTRING_LENGTH);
+			out_buffer[pos] = PSG_LONG_SUBSTRING;
+			memset(&l_locks[pos], PSG_LOCK_NO_SOURCE, PSG_LONG_SUBSTRING_LENGTH);
+			pos += PSG_LONG_SUBSTRING_LENGTH;
+
+			frame += span->FrameCount;
+			span++;
+		}
+		else
+		{
+			length = l_frame_start[frame + 1] - l_frame_start[frame];
+			memcpy(&out_buffer[pos], &in_buffer[l_frame_start[frame]], length);
+			memset(&l_locks[pos], PSG_LOCK_NONE, length);
+			pos += length;
+
+			frame++;
+		}
+	}
+
+	// no substring can cross the first and the last byte of the sources
+	for (i = 0; i < l_span_count; i++)
+	{
+		if (l_spans[i].SourceStart > in_header_length && l_locks[l_spans[i].SourceStart - 1] == PSG_LOCK_NONE)
+			l_locks[l_spans[i].SourceStart - 1] = PSG_LOCK_SOURCE;
+
+		if (l_locks[l_spans[i].SourceEnd - 1] == PSG_LOCK_NONE)
+			l_locks[l_spans[i].SourceEnd - 1] = PSG_LOCK_SOURCE;
+	}
+
+	return pos;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sets the length and the offset of the long substrings using the compressed position of the sources
+static void filePSGSpanResolve(uint8_t* inout_buffer, int in_header_length, int in_encoded_length, int in_compressed_length)
+{
+	PSGSpan* span = l_spans;
+	int encoded_pos = in_header_length;
+	int compressed_pos = in_header_length;
+	int length;
+	int offset;
+	int command;
+	int i;
+
+	// compressed position of the first byte of the literals, references and long substrings
+	while (encoded_pos < in_encoded_length && compressed_pos < in_compressed_length)
+	{
+		l_position_map[encoded_pos] = compressed_pos;
+
+		if (span < &l_spans[l_span_count] && span->Position == encoded_pos)
+		{
+			encoded_pos += PSG_LONG_SUBSTRING_LENGTH;
+			compressed_pos += PSG_LONG_SUBSTRING_LENGTH;
+			span++;
+		}
+		else if (inout_buffer[compressed_pos] >= PSG_SUBSTRING_FIRST && inout_buffer[compressed_pos] <= PSG_SUBSTRING_LAST)
+		{
+			encoded_pos += inout_buffer[compressed_pos] - PSG_SUBSTRING_FIRST + PSG_SUBSTRING_MIN_LEN;
+			compressed_pos += PSG_REFERENCE_LENGTH;
+		}
+		else
+		{
+			encoded_pos++;
+			compressed_pos++;
+		}
+	}
+	l_position_map[encoded_pos] = compressed_pos;
+
+	for (i = 0; i < l_span_count; i++)
+	{
+		offset = l_position_map[l_spans[i].SourceStart];
+		length = l_position_map[l_spans[i].SourceEnd] - offset;
+		command = l_position_map[l_spans[i].Position];
+
+		inout_buffer[command + 1] = (uint8_t)(length & 0xff);
+		inout_buffer[command + 2] = (uint8_t)(length >> 8);
+		inout_buffer[command + 3] = (uint8_t)(offset & 0xff);
+		inout_buffer[command + 4] = (uint8_t)(offset >> 8);
+	}
+}
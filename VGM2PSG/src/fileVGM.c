@@ -15,6 +15,7 @@
 #include <string.h>
 #include <stddef.h>
 #include <fileVGM.h>
+#include <sysStatistics.h>
 #include <Main.h>
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -25,6 +26,7 @@
 
 // VGM commands
 #define VGM_CMD_GG_STEREO               0x4F
+#define VGM_CMD_GG_STEREO_2nd           0x3F
 #define VGM_CMD_PSG                     0x50
 #define VGM_CMD_PSG_2nd									0x30
 #define VGM_CMD_YM2413                  0x51
@@ -193,11 +195,14 @@ static void fileVGMProcessCommand(void)
 	uint8_t command;
 	uint16_t word_buffer;
 	uint8_t byte_buffer;
+	uint32_t command_pos = l_vgm_file_pos;
 
 	l_player_state = VPS_CommandProcessing;
 
 	// process command
 	command = l_vgm_file_buffer[l_vgm_file_pos++];
+	g_statistics.VGMCommandCount[command]++;
+
 	switch(command)
 	{
 		case VGM_CMD_PSG:
@@ -207,6 +212,7 @@ static void fileVGMProcessCommand(void)
 
 		case VGM_CMD_PSG_2nd:
 			byte_buffer = l_vgm_file_buffer[l_vgm_file_pos++];
+			emuN76496WriteRegister(&g_SN76489_state_2nd, byte_buffer);
 			break;
 
 		case VGM_CMD_WAIT:
@@ -277,6 +283,12 @@ static void fileVGMProcessCommand(void)
 
 		case VGM_CMD_GG_STEREO:
 			byte_buffer = l_vgm_file_buffer[l_vgm_file_pos++];
+			g_SN76489_state.Stereo = byte_buffer;
+			break;
+
+		case VGM_CMD_GG_STEREO_2nd:
+			byte_buffer = l_vgm_file_buffer[l_vgm_file_pos++];
+			g_SN76489_state_2nd.Stereo = byte_buffer;
 			break;
 
 		// invalid or unknown command
@@ -284,6 +296,8 @@ static void fileVGMProcessCommand(void)
 			printf("Unknown VGM command: %2X ", command);
 			break;
 	}
+
+	sysStatisticsAddBytes(STAT_STAGE_PARSE, l_vgm_file_pos - command_pos, (command == VGM_CMD_PSG || command == VGM_CMD_PSG_2nd) ? 1 : 0);
 }
 
 
@@ -12,6 +12,7 @@
 #include <string.h>
 #include <Main.h>
 #include <fileVGMDecompress.h>
+#include <sysStatistics.h>
 
 ///////////////////////////////////////////////////////////////////////////////
 // Defines
@@ -74,6 +75,8 @@ int fileVGMLoad(char* in_filename, uint8_t* in_buffer, int in_buffer_length)
 
 	fclose(vgm_file);
 
+	sysStatisticsAddBytes(STAT_STAGE_INFLATE, vgm_file_length, 0);
+
 	// determine file type
 	magic = l_file_buffer[0] + 256 * l_file_buffer[1];
 
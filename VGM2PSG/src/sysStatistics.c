@@ -0,0 +1,242 @@
+/*****************************************************************************/
+/* VGM2PSG Conversion statistics                                             */
+/*                                                                           */
+/* Copyright (C) 2023 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the BSD license.  See the LICENSE file for details.                    */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sysStatistics.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Local functions
+static double sysStatisticsGetWallTime(void);
+static double sysStatisticsGetCPUTime(void);
+
+///////////////////////////////////////////////////////////////////////////////
+// Global variables
+StatStatistics g_statistics;
+
+///////////////////////////////////////////////////////////////////////////////
+// Module global variables
+static bool l_statistics_enabled = false;
+
+static const char* l_stage_names[STAT_STAGE_COUNT] =
+{
+	"inflate",
+	"parse",
+	"encode",
+	"compress",
+	"output"
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Clears all statistics. Stage timing is measured only when enabled.
+void sysStatisticsReset(bool in_enable)
+{
+	memset(&g_statistics, 0, sizeof(g_statistics));
+	l_statistics_enabled = in_enable;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Starts time measurement of a stage
+void sysStatisticsStageBegin(StatStage in_stage)
+{
+	if (!l_statistics_enabled)
+		return;
+
+	g_statistics.Stages[in_stage].WallStart = sysStatisticsGetWallTime();
+	g_statistics.Stages[in_stage].CPUStart = sysStatisticsGetCPUTime();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Finishes time measurement of a stage
+void sysStatisticsStageEnd(StatStage in_stage)
+{
+	StatStageStatistics* stage = &g_statistics.Stages[in_stage];
+
+	if (!l_statistics_enabled)
+		return;
+
+	stage->WallTime += sysStatisticsGetWallTime() - stage->WallStart;
+	stage->CPUTime += sysStatisticsGetCPUTime() - stage->CPUStart;
+	stage->CallCount++;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Adds processed data size to the stage
+void sysStatisticsAddBytes(StatStage in_stage, uint32_t in_bytes_in, uint32_t in_bytes_out)
+{
+	g_statistics.Stages[in_stage].BytesIn += in_bytes_in;
+	g_statistics.Stages[in_stage].BytesOut += in_bytes_out;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Adds one encoded frame
+void sysStatisticsAddFrame(uint32_t in_register_write_count)
+{
+	g_statistics.FrameCount++;
+	g_statistics.RegisterWriteCount += in_register_write_count;
+
+	if (in_register_write_count > g_statistics.MaxRegisterWritesPerFrame)
+		g_statistics.MaxRegisterWritesPerFrame = in_register_write_count;
+
+	if (in_register_write_count > STAT_MAX_REGISTER_WRITES_PER_FRAME)
+		in_register_write_count = STAT_MAX_REGISTER_WRITES_PER_FRAME;
+
+	g_statistics.RegisterWriteHistogram[in_register_write_count]++;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Prints human readable statistics
+void sysStatisticsPrint(void)
+{
+	int i;
+	double total_wall_time = 0;
+	double total_cpu_time = 0;
+
+	printf("\nStage       Wall[ms]    CPU[ms]   Bytes in  Bytes out\n");
+	for (i = 0; i < STAT_STAGE_COUNT; i++)
+	{
+		printf("%-9s %10.3f %10.3f %10llu %10llu\n", l_stage_names[i],
+			g_statistics.Stages[i].WallTime * 1000, g_statistics.Stages[i].CPUTime * 1000,
+			(unsigned long long)g_statistics.Stages[i].BytesIn, (unsigned long long)g_statistics.Stages[i].BytesOut);
+
+		total_wall_time += g_statistics.Stages[i].WallTime;
+		total_cpu_time += g_statistics.Stages[i].CPUTime;
+	}
+	printf("%-9s %10.3f %10.3f\n", "total", total_wall_time * 1000, total_cpu_time * 1000);
+
+	printf("\nVGM commands:");
+	for (i = 0; i < 256; i++)
+	{
+		if (g_statistics.VGMCommandCount[i] > 0)
+			printf(" %02Xh:%u", i, g_statistics.VGMCommandCount[i]);
+	}
+	printf("\n");
+
+	printf("\nFrames: %u, register writes: %u (%.2f/frame, max %u)\n", g_statistics.FrameCount, g_statistics.RegisterWriteCount,
+		(g_statistics.FrameCount > 0) ? (double)g_statistics.RegisterWriteCount / g_statistics.FrameCount : 0.0, g_statistics.MaxRegisterWritesPerFrame);
+	printf("Register writes per frame:");
+	for (i = 0; i <= STAT_MAX_REGISTER_WRITES_PER_FRAME; i++)
+	{
+		if (g_statistics.RegisterWriteHistogram[i] > 0)
+			printf(" %d%s:%u", i, (i == STAT_MAX_REGISTER_WRITES_PER_FRAME) ? "+" : "", g_statistics.RegisterWriteHistogram[i]);
+	}
+	printf("\n");
+
+	printf("\nCompressor: %llu candidate positions, %llu memcmp calls, %u bytes saved\n",
+		(unsigned long long)g_statistics.CandidatePositions, (unsigned long long)g_statistics.MemcmpCalls, g_statistics.BytesSaved);
+	printf("Matches per length:");
+	for (i = 0; i <= STAT_MAX_MATCH_LENGTH; i++)
+	{
+		if (g_statistics.MatchCount[i] > 0)
+			printf(" %d:%u", i, g_statistics.MatchCount[i]);
+	}
+	printf("\n");
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Saves statistics in JSON format
+bool sysStatisticsSaveJSON(char* in_filename)
+{
+	FILE* json_file;
+	int i;
+	bool first;
+
+	json_file = fopen(in_filename, "wt");
+	if (json_file == NULL)
+		return false;
+
+	fprintf(json_file, "{\n  \"stages\": {\n");
+	for (i = 0; i < STAT_STAGE_COUNT; i++)
+	{
+		fprintf(json_file, "    \"%s\": { \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"bytes_in\": %llu, \"bytes_out\": %llu }%s\n", l_stage_names[i],
+			g_statistics.Stages[i].WallTime * 1000, g_statistics.Stages[i].CPUTime * 1000,
+			(unsigned long long)g_statistics.Stages[i].BytesIn, (unsigned long long)g_statistics.Stages[i].BytesOut,
+			(i < STAT_STAGE_COUNT - 1) ? "," : "");
+	}
+	fprintf(json_file, "  },\n");
+
+	fprintf(json_file, "  \"vgm_commands\": {");
+	first = true;
+	for (i = 0; i < 256; i++)
+	{
+		if (g_statistics.VGMCommandCount[i] > 0)
+		{
+			fprintf(json_file, "%s \"0x%02X\": %u", first ? "" : ",", i, g_statistics.VGMCommandCount[i]);
+			first = false;
+		}
+	}
+	fprintf(json_file, " },\n");
+
+	fprintf(json_file, "  \"frames\": %u,\n  \"register_writes\": %u,\n  \"max_register_writes_per_frame\": %u,\n", g_statistics.FrameCount, g_statistics.RegisterWriteCount, g_statistics.MaxRegisterWritesPerFrame);
+	fprintf(json_file, "  \"register_writes_per_frame\": [");
+	for (i = 0; i <= STAT_MAX_REGISTER_WRITES_PER_FRAME; i++)
+		fprintf(json_file, "%s%u", (i > 0) ? ", " : "", g_statistics.RegisterWriteHistogram[i]);
+	fprintf(json_file, "],\n");
+
+	fprintf(json_file, "  \"compressor\": {\n    \"candidate_positions\": %llu,\n    \"memcmp_calls\": %llu,\n    \"bytes_saved\": %u,\n    \"matches_per_length\": {",
+		(unsigned long long)g_statistics.CandidatePositions, (unsigned long long)g_statistics.MemcmpCalls, g_statistics.BytesSaved);
+	first = true;
+	for (i = 0; i <= STAT_MAX_MATCH_LENGTH; i++)
+	{
+		if (g_statistics.MatchCount[i] > 0)
+		{
+			fprintf(json_file, "%s \"%d\": %u", first ? "" : ",", i, g_statistics.MatchCount[i]);
+			first = false;
+		}
+	}
+	fprintf(json_file, " }\n  }\n}\n");
+
+	fclose(json_file);
+
+	return true;
+}
+
+/*****************************************************************************/
+/* Local functions                                                           */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets wall clock time in seconds
+static double sysStatisticsGetWallTime(void)
+{
+	struct timespec time_spec;
+
+	timespec_get(&time_spec, TIME_UTC);
+
+	return time_spec.tv_sec + time_spec.tv_nsec / 1000000000.0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Gets process CPU time in seconds
+static double sysStatisticsGetCPUTime(void)
+{
+#ifdef _WIN32
+	FILETIME creation_time;
+	FILETIME exit_time;
+	FILETIME kernel_time;
+	FILETIME user_time;
+	ULARGE_INTEGER cpu_time;
+
+	GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time);
+
+	cpu_time.LowPart = user_time.dwLowDateTime;
+	cpu_time.HighPart = user_time.dwHighDateTime;
+
+	return cpu_time.QuadPart / 10000000.0;
+#else
+	return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}